@@ -4,13 +4,51 @@
 
 #include <brillo/dbus/data_serialization.h>
 
+#include <fcntl.h>
+#include <string.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <base/lazy_instance.h>
 #include <base/logging.h>
+#include <base/macros.h>
+#include <base/synchronization/lock.h>
 #include <brillo/any.h>
 #include <brillo/variant_dictionary.h>
 
 namespace brillo {
 namespace dbus_utils {
 
+namespace {
+
+// The descriptor sent in place of a default-constructed SharedBlob, which has
+// none: a sealed, empty memfd, so the peer receives an empty blob. Should the
+// memfd not be available, /dev/null is sent instead and the peer rejects it.
+class EmptySharedBlob {
+ public:
+  EmptySharedBlob() {
+    if (!SharedBlob::Create(nullptr, 0, &blob_)) {
+      LOG(ERROR) << "Failed to create an empty SharedBlob";
+      null_fd_.reset(open("/dev/null", O_RDONLY | O_CLOEXEC));
+    }
+  }
+
+  int fd() const { return blob_.fd() >= 0 ? blob_.fd() : null_fd_.get(); }
+
+ private:
+  SharedBlob blob_;
+  base::ScopedFD null_fd_;
+
+  DISALLOW_COPY_AND_ASSIGN(EmptySharedBlob);
+};
+
+base::LazyInstance<EmptySharedBlob>::Leaky g_empty_shared_blob =
+    LAZY_INSTANCE_INITIALIZER;
+
+}  // anonymous namespace
+
 void AppendValueToWriter(dbus::MessageWriter* writer, bool value) {
   writer->AppendBool(value);
 }
@@ -66,11 +104,24 @@ void AppendValueToWriter(dbus::MessageWriter* writer,
   writer->AppendFileDescriptor(value.get());
 }
 
+void AppendValueToWriter(dbus::MessageWriter* writer,
+                         const SharedBlob& value) {
+  int fd = value.fd();
+  if (fd < 0)
+    fd = g_empty_shared_blob.Get().fd();
+  writer->AppendFileDescriptor(fd);
+}
+
 void AppendValueToWriter(dbus::MessageWriter* writer,
                          const brillo::Any& value) {
   value.AppendToDBusMessageWriter(writer);
 }
 
+void AppendValueToWriter(dbus::MessageWriter* writer,
+                         const std::vector<uint8_t>& value) {
+  writer->AppendArrayOfBytes(value.data(), value.size());
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 bool PopValueFromReader(dbus::MessageReader* reader, bool* value) {
@@ -127,6 +178,35 @@ bool PopValueFromReader(dbus::MessageReader* reader, double* value) {
          reader->PopDouble(value);
 }
 
+bool PopValueFromReader(dbus::MessageReader* reader,
+                        std::vector<uint8_t>* value) {
+  dbus::MessageReader variant_reader(nullptr);
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+  if (!details::DescendIntoVariantIfPresent(&reader, &variant_reader) ||
+      !reader->PopArrayOfBytes(&data, &size))
+    return false;
+  value->assign(data, data + size);
+  return true;
+}
+
+bool PopArrayOfBytesIntoBuffer(dbus::MessageReader* reader,
+                               void* buffer,
+                               size_t buffer_size,
+                               size_t* size) {
+  dbus::MessageReader variant_reader(nullptr);
+  const uint8_t* data = nullptr;
+  size_t data_size = 0;
+  if (!details::DescendIntoVariantIfPresent(&reader, &variant_reader) ||
+      !reader->PopArrayOfBytes(&data, &data_size) ||
+      data_size > buffer_size)
+    return false;
+  if (data_size)
+    memcpy(buffer, data, data_size);
+  *size = data_size;
+  return true;
+}
+
 bool PopValueFromReader(dbus::MessageReader* reader, std::string* value) {
   dbus::MessageReader variant_reader(nullptr);
   return details::DescendIntoVariantIfPresent(&reader, &variant_reader) &&
@@ -147,6 +227,12 @@ bool PopValueFromReader(dbus::MessageReader* reader,
   return ok;
 }
 
+bool PopValueFromReader(dbus::MessageReader* reader, SharedBlob* value) {
+  base::ScopedFD fd;
+  return PopValueFromReader(reader, &fd) &&
+         SharedBlob::CreateFromFileDescriptor(std::move(fd), value);
+}
+
 namespace {
 
 // Helper methods for PopValueFromReader(dbus::MessageReader*, Any*)
@@ -162,107 +248,320 @@ bool PopTypedValueFromReader(dbus::MessageReader* reader,
   return true;
 }
 
-// std::vector<T> overload.
+// Variant de-serialization of ARRAY and STRUCT values is driven by a tree of
+// TypeNode built once per D-Bus signature. Each node carries the function
+// decoding a value of its type, so popping a value doesn't need to look at
+// the signature again.
+struct TypeNode;
+
+using Decoder = bool (*)(dbus::MessageReader* reader,
+                         const TypeNode& node,
+                         brillo::Any* value);
+
+struct TypeNode {
+  // The D-Bus type code of the node ('a', '(', '{', or a basic type code).
+  char type{0};
+  Decoder decoder{nullptr};
+  // The element type of an array, the key and value types of a dict entry
+  // or the member types of a struct.
+  std::vector<std::unique_ptr<TypeNode>> children;
+};
+
+// D-Bus allows 32 levels of array nesting plus 32 levels of structs.
+const int kMaxTypeDepth = 64;
+// The maximum number of signatures kept in the decoder cache.
+const size_t kMaxCachedSignatures = 256;
+
 template<typename T>
-bool PopTypedArrayFromReader(dbus::MessageReader* reader,
-                             brillo::Any* value) {
-  return PopTypedValueFromReader<std::vector<T>>(reader, value);
+bool DecodeTyped(dbus::MessageReader* reader,
+                 const TypeNode& /* node */,
+                 brillo::Any* value) {
+  return PopTypedValueFromReader<T>(reader, value);
+}
+
+// Arrays of types without a more specific C++ representation are decoded
+// into std::vector<Any>.
+bool DecodeArray(dbus::MessageReader* reader,
+                 const TypeNode& node,
+                 brillo::Any* value) {
+  dbus::MessageReader array_reader(nullptr);
+  if (!reader->PopArray(&array_reader))
+    return false;
+  const TypeNode& element = *node.children.front();
+  std::vector<brillo::Any> items;
+  while (array_reader.HasMoreData()) {
+    brillo::Any item;
+    if (!element.decoder(&array_reader, element, &item))
+      return false;
+    items.push_back(std::move(item));
+  }
+  *value = std::move(items);
+  return true;
 }
 
-// std::map<KEY, VALUE> overload.
-template<typename KEY, typename VALUE>
-bool PopTypedMapFromReader(dbus::MessageReader* reader, brillo::Any* value) {
-  return PopTypedValueFromReader<std::map<KEY, VALUE>>(reader, value);
+// Dictionaries are decoded into std::map<KEY, Any>, KEY being the C++ type
+// of the (basic) key type.
+template<typename KEY>
+bool DecodeDict(dbus::MessageReader* reader,
+                const TypeNode& node,
+                brillo::Any* value) {
+  dbus::MessageReader array_reader(nullptr);
+  if (!reader->PopArray(&array_reader))
+    return false;
+  const TypeNode& entry = *node.children.front();
+  const TypeNode& value_type = *entry.children.back();
+  std::map<KEY, brillo::Any> items;
+  while (array_reader.HasMoreData()) {
+    dbus::MessageReader entry_reader(nullptr);
+    KEY key{};
+    brillo::Any item;
+    if (!array_reader.PopDictEntry(&entry_reader) ||
+        !PopValueFromReader(&entry_reader, &key) ||
+        !value_type.decoder(&entry_reader, value_type, &item))
+      return false;
+    items.emplace(std::move(key), std::move(item));
+  }
+  *value = std::move(items);
+  return true;
 }
 
-// Helper methods for reading common ARRAY signatures into a Variant.
-// Note that only common types are supported. If an additional specific
-// type signature is required, feel free to add support for it.
-bool PopArrayValueFromReader(dbus::MessageReader* reader,
-                             brillo::Any* value) {
-  std::string signature = reader->GetDataSignature();
-  if (signature == "ab")
-    return PopTypedArrayFromReader<bool>(reader, value);
-  else if (signature == "ay")
-    return PopTypedArrayFromReader<uint8_t>(reader, value);
-  else if (signature == "an")
-    return PopTypedArrayFromReader<int16_t>(reader, value);
-  else if (signature == "aq")
-    return PopTypedArrayFromReader<uint16_t>(reader, value);
-  else if (signature == "ai")
-    return PopTypedArrayFromReader<int32_t>(reader, value);
-  else if (signature == "au")
-    return PopTypedArrayFromReader<uint32_t>(reader, value);
-  else if (signature == "ax")
-    return PopTypedArrayFromReader<int64_t>(reader, value);
-  else if (signature == "at")
-    return PopTypedArrayFromReader<uint64_t>(reader, value);
-  else if (signature == "ad")
-    return PopTypedArrayFromReader<double>(reader, value);
-  else if (signature == "as")
-    return PopTypedArrayFromReader<std::string>(reader, value);
-  else if (signature == "ao")
-    return PopTypedArrayFromReader<dbus::ObjectPath>(reader, value);
-  else if (signature == "av")
-    return PopTypedArrayFromReader<brillo::Any>(reader, value);
-  else if (signature == "a{ss}")
-    return PopTypedMapFromReader<std::string, std::string>(reader, value);
-  else if (signature == "a{sv}")
-    return PopTypedValueFromReader<brillo::VariantDictionary>(reader, value);
-  else if (signature == "aa{ss}")
-    return PopTypedArrayFromReader<
-        std::map<std::string, std::string>>(reader, value);
-  else if (signature == "aa{sv}")
-    return PopTypedArrayFromReader<brillo::VariantDictionary>(reader, value);
-  else if (signature == "a{sa{ss}}")
-    return PopTypedMapFromReader<
-        std::string, std::map<std::string, std::string>>(reader, value);
-  else if (signature == "a{sa{sv}}")
-    return PopTypedMapFromReader<
-        std::string, brillo::VariantDictionary>(reader, value);
-  else if (signature == "a{say}")
-    return PopTypedMapFromReader<
-        std::string, std::vector<uint8_t>>(reader, value);
-  else if (signature == "a{uv}")
-    return PopTypedMapFromReader<uint32_t, brillo::Any>(reader, value);
-  else if (signature == "a(su)")
-    return PopTypedArrayFromReader<
-        std::tuple<std::string, uint32_t>>(reader, value);
-  else if (signature == "a{uu}")
-    return PopTypedMapFromReader<uint32_t, uint32_t>(reader, value);
-  else if (signature == "a(uu)")
-    return PopTypedArrayFromReader<
-        std::tuple<uint32_t, uint32_t>>(reader, value);
-
-  // When a use case for particular array signature is found, feel free
-  // to add handing for it here.
-  LOG(ERROR) << "Variant de-serialization of array containing data of "
-             << "type '" << signature << "' is not yet supported";
-  return false;
-}
-
-// Helper methods for reading common STRUCT signatures into a Variant.
-// Note that only common types are supported. If an additional specific
-// type signature is required, feel free to add support for it.
-bool PopStructValueFromReader(dbus::MessageReader* reader,
-                              brillo::Any* value) {
+// Structs without a more specific C++ representation are decoded into a
+// std::vector<Any> holding the members.
+bool DecodeStruct(dbus::MessageReader* reader,
+                  const TypeNode& node,
+                  brillo::Any* value) {
+  dbus::MessageReader struct_reader(nullptr);
+  if (!reader->PopStruct(&struct_reader))
+    return false;
+  std::vector<brillo::Any> members;
+  members.reserve(node.children.size());
+  for (const auto& member : node.children) {
+    brillo::Any item;
+    if (!member->decoder(&struct_reader, *member, &item))
+      return false;
+    members.push_back(std::move(item));
+  }
+  *value = std::move(members);
+  return true;
+}
+
+struct TypedDecoder {
+  const char* signature;
+  Decoder decoder;
+};
+
+// The signatures decoded into specific C++ types rather than into the generic
+// std::vector<Any> and std::map<KEY, Any> containers. If an additional
+// specific type is required, feel free to add it here.
+const TypedDecoder kTypedDecoders[] = {
+    {"y", DecodeTyped<uint8_t>},
+    {"b", DecodeTyped<bool>},
+    {"n", DecodeTyped<int16_t>},
+    {"q", DecodeTyped<uint16_t>},
+    {"i", DecodeTyped<int32_t>},
+    {"u", DecodeTyped<uint32_t>},
+    {"x", DecodeTyped<int64_t>},
+    {"t", DecodeTyped<uint64_t>},
+    {"d", DecodeTyped<double>},
+    {"s", DecodeTyped<std::string>},
+    {"o", DecodeTyped<dbus::ObjectPath>},
+    {"v", DecodeTyped<brillo::Any>},
+    {"ab", DecodeTyped<std::vector<bool>>},
+    {"ay", DecodeTyped<std::vector<uint8_t>>},
+    {"an", DecodeTyped<std::vector<int16_t>>},
+    {"aq", DecodeTyped<std::vector<uint16_t>>},
+    {"ai", DecodeTyped<std::vector<int32_t>>},
+    {"au", DecodeTyped<std::vector<uint32_t>>},
+    {"ax", DecodeTyped<std::vector<int64_t>>},
+    {"at", DecodeTyped<std::vector<uint64_t>>},
+    {"ad", DecodeTyped<std::vector<double>>},
+    {"as", DecodeTyped<std::vector<std::string>>},
+    {"ao", DecodeTyped<std::vector<dbus::ObjectPath>>},
+    {"av", DecodeTyped<std::vector<brillo::Any>>},
+    {"a{ss}", DecodeTyped<std::map<std::string, std::string>>},
+    {"a{sv}", DecodeTyped<brillo::VariantDictionary>},
+    {"aa{ss}", DecodeTyped<std::vector<std::map<std::string, std::string>>>},
+    {"aa{sv}", DecodeTyped<std::vector<brillo::VariantDictionary>>},
+    {"a{sa{ss}}",
+     DecodeTyped<std::map<std::string, std::map<std::string, std::string>>>},
+    {"a{sa{sv}}",
+     DecodeTyped<std::map<std::string, brillo::VariantDictionary>>},
+    {"a{say}", DecodeTyped<std::map<std::string, std::vector<uint8_t>>>},
+    {"a{uv}", DecodeTyped<std::map<uint32_t, brillo::Any>>},
+    {"a(su)", DecodeTyped<std::vector<std::tuple<std::string, uint32_t>>>},
+    {"a{uu}", DecodeTyped<std::map<uint32_t, uint32_t>>},
+    {"a(uu)", DecodeTyped<std::vector<std::tuple<uint32_t, uint32_t>>>},
+    {"(ii)", DecodeTyped<std::tuple<int, int>>},
+    {"(ss)", DecodeTyped<std::tuple<std::string, std::string>>},
+    {"(ub)", DecodeTyped<std::tuple<uint32_t, bool>>},
+    {"(uu)", DecodeTyped<std::tuple<uint32_t, uint32_t>>},
+};
+
+Decoder FindTypedDecoder(const char* signature, size_t size) {
+  for (const TypedDecoder& entry : kTypedDecoders) {
+    if (strlen(entry.signature) == size &&
+        strncmp(entry.signature, signature, size) == 0) {
+      return entry.decoder;
+    }
+  }
+  return nullptr;
+}
+
+// Returns the decoder of dictionaries with keys of basic type |key_type|.
+Decoder GetDictDecoder(char key_type) {
+  switch (key_type) {
+    case DBUS_TYPE_BYTE:
+      return DecodeDict<uint8_t>;
+    case DBUS_TYPE_BOOLEAN:
+      return DecodeDict<bool>;
+    case DBUS_TYPE_INT16:
+      return DecodeDict<int16_t>;
+    case DBUS_TYPE_UINT16:
+      return DecodeDict<uint16_t>;
+    case DBUS_TYPE_INT32:
+      return DecodeDict<int32_t>;
+    case DBUS_TYPE_UINT32:
+      return DecodeDict<uint32_t>;
+    case DBUS_TYPE_INT64:
+      return DecodeDict<int64_t>;
+    case DBUS_TYPE_UINT64:
+      return DecodeDict<uint64_t>;
+    case DBUS_TYPE_DOUBLE:
+      return DecodeDict<double>;
+    case DBUS_TYPE_STRING:
+      return DecodeDict<std::string>;
+    case DBUS_TYPE_OBJECT_PATH:
+      return DecodeDict<dbus::ObjectPath>;
+  }
+  return nullptr;
+}
+
+// Parses the complete type starting at |signature|[*pos] and advances |pos|
+// past it. Returns nullptr if the signature is invalid or contains types that
+// can't be stored in an Any.
+std::unique_ptr<TypeNode> ParseType(const std::string& signature,
+                                    size_t* pos,
+                                    int depth) {
+  if (*pos >= signature.size() || depth > kMaxTypeDepth)
+    return nullptr;
+  size_t start = *pos;
+  std::unique_ptr<TypeNode> node{new TypeNode};
+  node->type = signature[(*pos)++];
+  switch (node->type) {
+    case DBUS_TYPE_BYTE:
+    case DBUS_TYPE_BOOLEAN:
+    case DBUS_TYPE_INT16:
+    case DBUS_TYPE_UINT16:
+    case DBUS_TYPE_INT32:
+    case DBUS_TYPE_UINT32:
+    case DBUS_TYPE_INT64:
+    case DBUS_TYPE_UINT64:
+    case DBUS_TYPE_DOUBLE:
+    case DBUS_TYPE_STRING:
+    case DBUS_TYPE_OBJECT_PATH:
+    case DBUS_TYPE_VARIANT:
+      break;
+    case DBUS_TYPE_SIGNATURE:
+    case DBUS_TYPE_UNIX_FD:
+      // Signatures can't be popped by dbus::MessageReader, and file
+      // descriptors can't be copied into an Any.
+      return nullptr;
+    case DBUS_TYPE_ARRAY:
+      if (*pos < signature.size() &&
+          signature[*pos] == DBUS_DICT_ENTRY_BEGIN_CHAR) {
+        std::unique_ptr<TypeNode> entry{new TypeNode};
+        entry->type = signature[(*pos)++];
+        auto key = ParseType(signature, pos, depth + 1);
+        if (!key || !key->children.empty())
+          return nullptr;
+        node->decoder = GetDictDecoder(key->type);
+        auto value = ParseType(signature, pos, depth + 1);
+        if (!node->decoder || !value || *pos >= signature.size() ||
+            signature[(*pos)++] != DBUS_DICT_ENTRY_END_CHAR) {
+          return nullptr;
+        }
+        entry->children.push_back(std::move(key));
+        entry->children.push_back(std::move(value));
+        node->children.push_back(std::move(entry));
+      } else {
+        auto element = ParseType(signature, pos, depth + 1);
+        if (!element)
+          return nullptr;
+        node->decoder = DecodeArray;
+        node->children.push_back(std::move(element));
+      }
+      break;
+    case DBUS_STRUCT_BEGIN_CHAR:
+      while (*pos < signature.size() &&
+             signature[*pos] != DBUS_STRUCT_END_CHAR) {
+        auto member = ParseType(signature, pos, depth + 1);
+        if (!member)
+          return nullptr;
+        node->children.push_back(std::move(member));
+      }
+      if (*pos >= signature.size() || node->children.empty())
+        return nullptr;
+      (*pos)++;
+      node->decoder = DecodeStruct;
+      break;
+    default:
+      return nullptr;
+  }
+  // Prefer the specific C++ type when there is one for the whole subtree.
+  Decoder typed = FindTypedDecoder(signature.data() + start, *pos - start);
+  if (typed)
+    node->decoder = typed;
+  return node;
+}
+
+std::unique_ptr<TypeNode> ParseSignature(const std::string& signature) {
+  size_t pos = 0;
+  auto node = ParseType(signature, &pos, 0);
+  if (pos != signature.size())
+    return nullptr;
+  return node;
+}
+
+// The type trees of the signatures seen so far. The number of distinct
+// signatures used by a program is small, but the cache is bounded anyway so
+// that a peer sending random signatures can't make it grow indefinitely.
+class DecoderCache {
+ public:
+  std::shared_ptr<const TypeNode> Get(const std::string& signature) {
+    {
+      base::AutoLock auto_lock(lock_);
+      auto p = nodes_.find(signature);
+      if (p != nodes_.end())
+        return p->second;
+    }
+    std::shared_ptr<const TypeNode> node = ParseSignature(signature);
+    if (!node)
+      return nullptr;
+    base::AutoLock auto_lock(lock_);
+    if (nodes_.size() < kMaxCachedSignatures)
+      nodes_.emplace(signature, node);
+    return node;
+  }
+
+ private:
+  base::Lock lock_;
+  std::map<std::string, std::shared_ptr<const TypeNode>> nodes_;
+};
+
+base::LazyInstance<DecoderCache>::Leaky g_decoder_cache =
+    LAZY_INSTANCE_INITIALIZER;
+
+// Pops an ARRAY or STRUCT value of any valid signature from |reader|.
+bool PopContainerValueFromReader(dbus::MessageReader* reader,
+                                 brillo::Any* value) {
   std::string signature = reader->GetDataSignature();
-  if (signature == "(ii)")
-    return PopTypedValueFromReader<std::tuple<int, int>>(reader, value);
-  else if (signature == "(ss)")
-    return PopTypedValueFromReader<std::tuple<std::string, std::string>>(reader,
-                                                                         value);
-  else if (signature == "(ub)")
-    return PopTypedValueFromReader<std::tuple<uint32_t, bool>>(reader, value);
-  else if (signature == "(uu)")
-    return PopTypedValueFromReader<std::tuple<uint32_t, uint32_t>>(reader,
-                                                                   value);
-
-  // When a use case for particular struct signature is found, feel free
-  // to add handing for it here.
-  LOG(ERROR) << "Variant de-serialization of structs of type '" << signature
-             << "' is not yet supported";
-  return false;
+  std::shared_ptr<const TypeNode> node = g_decoder_cache.Get().Get(signature);
+  if (!node) {
+    LOG(ERROR) << "Variant de-serialization of data of type '" << signature
+               << "' is not supported";
+    return false;
+  }
+  return node->decoder(reader, *node, value);
 }
 
 }  // anonymous namespace
@@ -296,9 +595,8 @@ bool PopValueFromReader(dbus::MessageReader* reader, brillo::Any* value) {
     case dbus::Message::OBJECT_PATH:
       return PopTypedValueFromReader<dbus::ObjectPath>(reader, value);
     case dbus::Message::ARRAY:
-      return PopArrayValueFromReader(reader, value);
     case dbus::Message::STRUCT:
-      return PopStructValueFromReader(reader, value);
+      return PopContainerValueFromReader(reader, value);
     case dbus::Message::DICT_ENTRY:
       LOG(ERROR) << "Variant of DICT_ENTRY is invalid";
       return false;
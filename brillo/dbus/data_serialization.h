@@ -9,6 +9,7 @@
 // native C++ data over D-Bus. This includes three major parts:
 // - Methods to get the D-Bus signature for a given C++ type:
 //     std::string GetDBusSignature<T>();
+//     (DBusType<T>::GetConstexprSignature() for the compile-time version)
 // - Methods to write arbitrary C++ data to D-Bus MessageWriter:
 //     void AppendValueToWriter(dbus::MessageWriter* writer, const T& value);
 //     void AppendValueToWriterAsVariant(dbus::MessageWriter*, const T&);
@@ -36,7 +37,7 @@
 //               |     (UVW...)    |  std::tuple<U,V,W,...>
 //   DICT        |       a{KV}     |  std::map<K,V>
 //   VARIANT     |        v        |  brillo::Any
-//   UNIX_FD     |        h        |  base::ScopedFD
+//   UNIX_FD     |        h        |  base::ScopedFD, brillo::SharedBlob
 //   SIGNATURE   |        g        |  (unsupported)
 //
 // Additional overloads/specialization can be provided for custom types.
@@ -49,6 +50,13 @@
 //  - static bool Read(dbus::MessageReader* reader, CustomType* value);
 // See an example in DBusUtils.CustomStruct unit test in
 // brillo/dbus/data_serialization_unittest.cc.
+//
+// The DBusType<> specializations of the types above also provide a constexpr
+// GetConstexprSignature() method returning the signature as a compile-time
+// details::ConstexprSignature<N>, so the signatures of the composite types
+// are literals rather than strings concatenated at run time. A custom type can
+// provide this method too; if it does not, the signatures of the containers
+// of the type are built with GetSignature() as before.
 
 #include <map>
 #include <memory>
@@ -60,6 +68,7 @@
 #include <base/logging.h>
 #include <base/files/scoped_file.h>
 #include <brillo/brillo_export.h>
+#include <brillo/shared_blob.h>
 #include <brillo/type_name_undecorate.h>
 #include <dbus/message.h>
 
@@ -138,10 +147,169 @@ void PopValueFromReader(dbus::MessageReader* reader, float* value) = delete;
 // Specializations of a generic GetDBusSignature<T>() provide signature strings
 // for native C++ types. This function is available only for type supported
 // by D-Bus.
+namespace details {
+
+// A signature string of N characters (and the terminating nul) computed at
+// compile time.
+template<size_t N>
+struct ConstexprSignature {
+  char data[N + 1];
+
+  constexpr const char* c_str() const { return data; }
+  static constexpr size_t size() { return N; }
+};
+
+// IndexSequence<0, 1, ..., N - 1>, used to expand the characters of the
+// signatures below one by one (std::index_sequence is C++14).
+template<size_t... I>
+struct IndexSequence {};
+
+template<size_t N, size_t... I>
+struct MakeIndexSequence : public MakeIndexSequence<N - 1, N - 1, I...> {};
+
+template<size_t... I>
+struct MakeIndexSequence<0, I...> {
+  using type = IndexSequence<I...>;
+};
+
+// The total length of signatures of the given lengths.
+template<size_t... Sizes>
+struct SignatureSize;
+
+template<>
+struct SignatureSize<> : public std::integral_constant<size_t, 0> {};
+
+template<size_t N, size_t... Rest>
+struct SignatureSize<N, Rest...>
+    : public std::integral_constant<size_t,
+                                    N + SignatureSize<Rest...>::value> {};
+
+template<size_t N, size_t... I>
+constexpr ConstexprSignature<N - 1> MakeConstexprSignatureImpl(
+    const char (&str)[N], IndexSequence<I...>) {
+  return ConstexprSignature<N - 1>{{str[I]...}};
+}
+
+// Makes a ConstexprSignature out of a string literal such as "a{sv}".
+template<size_t N>
+constexpr ConstexprSignature<N - 1> MakeConstexprSignature(
+    const char (&str)[N]) {
+  return MakeConstexprSignatureImpl(str,
+                                    typename MakeIndexSequence<N>::type{});
+}
+
+template<size_t A, size_t B, size_t... I>
+constexpr ConstexprSignature<A + B> ConcatSignaturesImpl(
+    const ConstexprSignature<A>& a,
+    const ConstexprSignature<B>& b,
+    IndexSequence<I...>) {
+  return ConstexprSignature<A + B>{{(I < A ? a.data[I] : b.data[I - A])...}};
+}
+
+// Concatenates two or more signatures.
+template<size_t A, size_t B>
+constexpr ConstexprSignature<A + B> ConcatSignatures(
+    const ConstexprSignature<A>& a,
+    const ConstexprSignature<B>& b) {
+  return ConcatSignaturesImpl(a, b,
+                              typename MakeIndexSequence<A + B + 1>::type{});
+}
+
+template<size_t A, size_t B, size_t C, size_t... Rest>
+constexpr ConstexprSignature<SignatureSize<A, B, C, Rest...>::value>
+ConcatSignatures(const ConstexprSignature<A>& a,
+                 const ConstexprSignature<B>& b,
+                 const ConstexprSignature<C>& c,
+                 const ConstexprSignature<Rest>&... rest) {
+  return ConcatSignatures(ConcatSignatures(a, b), c, rest...);
+}
+
+// Used to make the return type of the GetConstexprSignature() member templates
+// of the container types depend on their template parameter, so an element
+// type without a compile-time signature disables the method (SFINAE) instead
+// of failing to compile.
+template<typename T, typename>
+struct DependOn {
+  using type = T;
+};
+
+template<typename...>
+struct VoidType {
+  using type = void;
+};
+
+// HasConstexprSignature<T>::value is true if DBusType<T> provides a
+// GetConstexprSignature() method.
+template<typename T, typename = void>
+struct HasConstexprSignature : public std::false_type {};
+
+template<typename T>
+struct HasConstexprSignature<
+    T,
+    typename VoidType<decltype(DBusType<T>::GetConstexprSignature())>::type>
+    : public std::true_type {};
+
+// The type of the compile-time signature of type T. Used in the return types
+// below, where a type without one is a substitution failure.
+template<typename T>
+using ConstexprSignatureOf = decltype(DBusType<T>::GetConstexprSignature());
+
+// Returns "aT", where "T" is the compile-time signature of type T.
+template<typename T>
+constexpr ConstexprSignature<1 + ConstexprSignatureOf<T>::size()>
+GetConstexprArraySignature() {
+  return ConcatSignatures(MakeConstexprSignature(DBUS_TYPE_ARRAY_AS_STRING),
+                          DBusType<T>::GetConstexprSignature());
+}
+
+// Returns "(T...)", where "T..." are the compile-time signatures of Types...
+template<typename... Types>
+constexpr ConstexprSignature<
+    2 + SignatureSize<ConstexprSignatureOf<Types>::size()...>::value>
+GetConstexprStructSignature() {
+  return ConcatSignatures(
+      MakeConstexprSignature(DBUS_STRUCT_BEGIN_CHAR_AS_STRING),
+      DBusType<Types>::GetConstexprSignature()...,
+      MakeConstexprSignature(DBUS_STRUCT_END_CHAR_AS_STRING));
+}
+
+// Returns "{KV}", where "K" and "V" are the compile-time signatures of types
+// KEY/VALUE.
+template<typename KEY, typename VALUE>
+constexpr ConstexprSignature<2 + ConstexprSignatureOf<KEY>::size() +
+                             ConstexprSignatureOf<VALUE>::size()>
+GetConstexprDictEntrySignature() {
+  return ConcatSignatures(
+      MakeConstexprSignature(DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING),
+      DBusType<KEY>::GetConstexprSignature(),
+      DBusType<VALUE>::GetConstexprSignature(),
+      MakeConstexprSignature(DBUS_DICT_ENTRY_END_CHAR_AS_STRING));
+}
+
+// Returns the signature of type T. The compile-time signature is used when
+// available, so the string is copied from a literal instead of being built
+// from the signatures of the element types.
+template<typename T>
+inline typename std::enable_if<HasConstexprSignature<T>::value,
+                               std::string>::type
+GetDBusSignatureImpl() {
+  static constexpr auto kSignature = DBusType<T>::GetConstexprSignature();
+  return std::string{kSignature.c_str(), kSignature.size()};
+}
+
+template<typename T>
+inline typename std::enable_if<!HasConstexprSignature<T>::value,
+                               std::string>::type
+GetDBusSignatureImpl() {
+  return DBusType<T>::GetSignature();
+}
+
+}  // namespace details
+
 template<typename T>
 inline typename std::enable_if<IsTypeSupported<T>::value, std::string>::type
 GetDBusSignature() {
-  return DBusType<T>::GetSignature();
+  return details::GetDBusSignatureImpl<T>();
 }
 
 namespace details {
@@ -171,7 +339,20 @@ inline std::string GetArrayDBusSignature(const std::string& element_signature) {
 // KEY/VALUE. For example, GetDBusDictEntryType<std::string, int>() would return
 // "{si}".
 template<typename KEY, typename VALUE>
-inline std::string GetDBusDictEntryType() {
+inline typename std::enable_if<HasConstexprSignature<KEY>::value &&
+                                   HasConstexprSignature<VALUE>::value,
+                               std::string>::type
+GetDBusDictEntryType() {
+  static constexpr auto kSignature =
+      GetConstexprDictEntrySignature<KEY, VALUE>();
+  return std::string{kSignature.c_str(), kSignature.size()};
+}
+
+template<typename KEY, typename VALUE>
+inline typename std::enable_if<!HasConstexprSignature<KEY>::value ||
+                                   !HasConstexprSignature<VALUE>::value,
+                               std::string>::type
+GetDBusDictEntryType() {
   return DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING +
          GetDBusSignature<KEY>() + GetDBusSignature<VALUE>() +
          DBUS_DICT_ENTRY_END_CHAR_AS_STRING;
@@ -194,6 +375,9 @@ struct DBusType<bool> {
   inline static std::string GetSignature() {
     return DBUS_TYPE_BOOLEAN_AS_STRING;
   }
+  static constexpr details::ConstexprSignature<1> GetConstexprSignature() {
+    return details::MakeConstexprSignature(DBUS_TYPE_BOOLEAN_AS_STRING);
+  }
   inline static void Write(dbus::MessageWriter* writer, bool value) {
     AppendValueToWriter(writer, value);
   }
@@ -211,6 +395,9 @@ BRILLO_EXPORT bool PopValueFromReader(dbus::MessageReader* reader,
 template<>
 struct DBusType<uint8_t> {
   inline static std::string GetSignature() { return DBUS_TYPE_BYTE_AS_STRING; }
+  static constexpr details::ConstexprSignature<1> GetConstexprSignature() {
+    return details::MakeConstexprSignature(DBUS_TYPE_BYTE_AS_STRING);
+  }
   inline static void Write(dbus::MessageWriter* writer, uint8_t value) {
     AppendValueToWriter(writer, value);
   }
@@ -228,6 +415,9 @@ BRILLO_EXPORT bool PopValueFromReader(dbus::MessageReader* reader,
 template<>
 struct DBusType<int16_t> {
   inline static std::string GetSignature() { return DBUS_TYPE_INT16_AS_STRING; }
+  static constexpr details::ConstexprSignature<1> GetConstexprSignature() {
+    return details::MakeConstexprSignature(DBUS_TYPE_INT16_AS_STRING);
+  }
   inline static void Write(dbus::MessageWriter* writer, int16_t value) {
     AppendValueToWriter(writer, value);
   }
@@ -247,6 +437,9 @@ struct DBusType<uint16_t> {
   inline static std::string GetSignature() {
     return DBUS_TYPE_UINT16_AS_STRING;
   }
+  static constexpr details::ConstexprSignature<1> GetConstexprSignature() {
+    return details::MakeConstexprSignature(DBUS_TYPE_UINT16_AS_STRING);
+  }
   inline static void Write(dbus::MessageWriter* writer, uint16_t value) {
     AppendValueToWriter(writer, value);
   }
@@ -264,6 +457,9 @@ BRILLO_EXPORT bool PopValueFromReader(dbus::MessageReader* reader,
 template<>
 struct DBusType<int32_t> {
   inline static std::string GetSignature() { return DBUS_TYPE_INT32_AS_STRING; }
+  static constexpr details::ConstexprSignature<1> GetConstexprSignature() {
+    return details::MakeConstexprSignature(DBUS_TYPE_INT32_AS_STRING);
+  }
   inline static void Write(dbus::MessageWriter* writer, int32_t value) {
     AppendValueToWriter(writer, value);
   }
@@ -283,6 +479,9 @@ struct DBusType<uint32_t> {
   inline static std::string GetSignature() {
     return DBUS_TYPE_UINT32_AS_STRING;
   }
+  static constexpr details::ConstexprSignature<1> GetConstexprSignature() {
+    return details::MakeConstexprSignature(DBUS_TYPE_UINT32_AS_STRING);
+  }
   inline static void Write(dbus::MessageWriter* writer, uint32_t value) {
     AppendValueToWriter(writer, value);
   }
@@ -300,6 +499,9 @@ BRILLO_EXPORT bool PopValueFromReader(dbus::MessageReader* reader,
 template<>
 struct DBusType<int64_t> {
   inline static std::string GetSignature() { return DBUS_TYPE_INT64_AS_STRING; }
+  static constexpr details::ConstexprSignature<1> GetConstexprSignature() {
+    return details::MakeConstexprSignature(DBUS_TYPE_INT64_AS_STRING);
+  }
   inline static void Write(dbus::MessageWriter* writer, int64_t value) {
     AppendValueToWriter(writer, value);
   }
@@ -319,6 +521,9 @@ struct DBusType<uint64_t> {
   inline static std::string GetSignature() {
     return DBUS_TYPE_UINT64_AS_STRING;
   }
+  static constexpr details::ConstexprSignature<1> GetConstexprSignature() {
+    return details::MakeConstexprSignature(DBUS_TYPE_UINT64_AS_STRING);
+  }
   inline static void Write(dbus::MessageWriter* writer, uint64_t value) {
     AppendValueToWriter(writer, value);
   }
@@ -338,6 +543,9 @@ struct DBusType<double> {
   inline static std::string GetSignature() {
     return DBUS_TYPE_DOUBLE_AS_STRING;
   }
+  static constexpr details::ConstexprSignature<1> GetConstexprSignature() {
+    return details::MakeConstexprSignature(DBUS_TYPE_DOUBLE_AS_STRING);
+  }
   inline static void Write(dbus::MessageWriter* writer, double value) {
     AppendValueToWriter(writer, value);
   }
@@ -357,6 +565,9 @@ struct DBusType<std::string> {
   inline static std::string GetSignature() {
     return DBUS_TYPE_STRING_AS_STRING;
   }
+  static constexpr details::ConstexprSignature<1> GetConstexprSignature() {
+    return details::MakeConstexprSignature(DBUS_TYPE_STRING_AS_STRING);
+  }
   inline static void Write(dbus::MessageWriter* writer,
                            const std::string& value) {
     AppendValueToWriter(writer, value);
@@ -375,6 +586,9 @@ struct DBusType<const char*> {
   inline static std::string GetSignature() {
     return DBUS_TYPE_STRING_AS_STRING;
   }
+  static constexpr details::ConstexprSignature<1> GetConstexprSignature() {
+    return details::MakeConstexprSignature(DBUS_TYPE_STRING_AS_STRING);
+  }
   inline static void Write(dbus::MessageWriter* writer, const char* value) {
     AppendValueToWriter(writer, value);
   }
@@ -386,6 +600,9 @@ struct DBusType<const char[]> {
   inline static std::string GetSignature() {
     return DBUS_TYPE_STRING_AS_STRING;
   }
+  static constexpr details::ConstexprSignature<1> GetConstexprSignature() {
+    return details::MakeConstexprSignature(DBUS_TYPE_STRING_AS_STRING);
+  }
   inline static void Write(dbus::MessageWriter* writer, const char* value) {
     AppendValueToWriter(writer, value);
   }
@@ -402,6 +619,9 @@ struct DBusType<dbus::ObjectPath> {
   inline static std::string GetSignature() {
     return DBUS_TYPE_OBJECT_PATH_AS_STRING;
   }
+  static constexpr details::ConstexprSignature<1> GetConstexprSignature() {
+    return details::MakeConstexprSignature(DBUS_TYPE_OBJECT_PATH_AS_STRING);
+  }
   inline static void Write(dbus::MessageWriter* writer,
                            const dbus::ObjectPath& value) {
     AppendValueToWriter(writer, value);
@@ -423,6 +643,9 @@ struct DBusType<base::ScopedFD> {
   inline static std::string GetSignature() {
     return DBUS_TYPE_UNIX_FD_AS_STRING;
   }
+  static constexpr details::ConstexprSignature<1> GetConstexprSignature() {
+    return details::MakeConstexprSignature(DBUS_TYPE_UNIX_FD_AS_STRING);
+  }
   inline static void Write(dbus::MessageWriter* writer,
                            const base::ScopedFD& value) {
     AppendValueToWriter(writer, value);
@@ -433,9 +656,39 @@ struct DBusType<base::ScopedFD> {
   }
 };
 
+// brillo::SharedBlob -------------------------------------------------------
+// The blob is sent as its sealed memfd. A default-constructed blob has none and
+// is sent as a shared, sealed, empty memfd instead. Popping a descriptor which
+// is not a sealed memfd fails.
+BRILLO_EXPORT void AppendValueToWriter(dbus::MessageWriter* writer,
+                                         const SharedBlob& value);
+BRILLO_EXPORT bool PopValueFromReader(dbus::MessageReader* reader,
+                                        SharedBlob* value);
+
+template<>
+struct DBusType<SharedBlob> {
+  inline static std::string GetSignature() {
+    return DBUS_TYPE_UNIX_FD_AS_STRING;
+  }
+  static constexpr details::ConstexprSignature<1> GetConstexprSignature() {
+    return details::MakeConstexprSignature(DBUS_TYPE_UNIX_FD_AS_STRING);
+  }
+  inline static void Write(dbus::MessageWriter* writer,
+                           const SharedBlob& value) {
+    AppendValueToWriter(writer, value);
+  }
+  inline static bool Read(dbus::MessageReader* reader, SharedBlob* value) {
+    return PopValueFromReader(reader, value);
+  }
+};
+
 // brillo::Any --------------------------------------------------------------
 BRILLO_EXPORT void AppendValueToWriter(dbus::MessageWriter* writer,
                                          const brillo::Any& value);
+// Values of any signature (except those containing file descriptors) can be
+// popped into an Any. Common signatures are decoded into their usual C++
+// types (e.g. "a{sv}" into VariantDictionary), other arrays and structs into
+// std::vector<Any> and other dictionaries into std::map<KEY, Any>.
 BRILLO_EXPORT bool PopValueFromReader(dbus::MessageReader* reader,
                                         brillo::Any* value);
 
@@ -444,6 +697,9 @@ struct DBusType<brillo::Any> {
   inline static std::string GetSignature() {
     return DBUS_TYPE_VARIANT_AS_STRING;
   }
+  static constexpr details::ConstexprSignature<1> GetConstexprSignature() {
+    return details::MakeConstexprSignature(DBUS_TYPE_VARIANT_AS_STRING);
+  }
   inline static void Write(dbus::MessageWriter* writer,
                            const brillo::Any& value) {
     AppendValueToWriter(writer, value);
@@ -454,6 +710,22 @@ struct DBusType<brillo::Any> {
 };
 
 // std::vector = D-Bus ARRAY. -------------------------------------------------
+// Arrays of bytes are written and read in bulk with a single libdbus
+// fixed-array call rather than one call per element.
+BRILLO_EXPORT void AppendValueToWriter(dbus::MessageWriter* writer,
+                                       const std::vector<uint8_t>& value);
+BRILLO_EXPORT bool PopValueFromReader(dbus::MessageReader* reader,
+                                      std::vector<uint8_t>* value);
+
+// Reads an array of bytes directly into the caller's |buffer| of
+// |buffer_size| bytes, without an intermediate std::vector. The number of
+// bytes read is returned in |size|. Fails if the value is not an array of
+// bytes or does not fit in the buffer (the value is consumed in both cases).
+BRILLO_EXPORT bool PopArrayOfBytesIntoBuffer(dbus::MessageReader* reader,
+                                             void* buffer,
+                                             size_t buffer_size,
+                                             size_t* size);
+
 template<typename T, typename ALLOC>
 typename std::enable_if<IsTypeSupported<T>::value>::type AppendValueToWriter(
     dbus::MessageWriter* writer,
@@ -500,6 +772,11 @@ struct DBusArrayType {
   inline static std::string GetSignature() {
     return GetArrayDBusSignature(GetDBusSignature<T>());
   }
+  template<typename U = T>
+  static constexpr auto GetConstexprSignature()
+      -> decltype(GetConstexprArraySignature<U>()) {
+    return GetConstexprArraySignature<U>();
+  }
   inline static void Write(dbus::MessageWriter* writer,
                            const std::vector<T, ALLOC>& value) {
     AppendValueToWriter(writer, value);
@@ -592,6 +869,11 @@ struct DBusPairType {
   inline static std::string GetSignature() {
     return GetStructDBusSignature<U, V>();
   }
+  template<typename First = U, typename Second = V>
+  static constexpr auto GetConstexprSignature()
+      -> decltype(GetConstexprStructSignature<First, Second>()) {
+    return GetConstexprStructSignature<First, Second>();
+  }
   inline static void Write(dbus::MessageWriter* writer,
                            const std::pair<U, V>& value) {
     AppendValueToWriter(writer, value);
@@ -689,6 +971,12 @@ struct DBusTupleType {
   inline static std::string GetSignature() {
     return GetStructDBusSignature<T...>();
   }
+  template<typename Dummy = void>
+  static constexpr auto GetConstexprSignature()
+      -> decltype(GetConstexprStructSignature<
+          typename DependOn<T, Dummy>::type...>()) {
+    return GetConstexprStructSignature<T...>();
+  }
   inline static void Write(dbus::MessageWriter* writer,
                            const std::tuple<T...>& value) {
     AppendValueToWriter(writer, value);
@@ -772,6 +1060,14 @@ struct DBusMapType {
   inline static std::string GetSignature() {
     return GetArrayDBusSignature(GetDBusDictEntryType<KEY, VALUE>());
   }
+  template<typename K = KEY, typename V = VALUE>
+  static constexpr auto GetConstexprSignature()
+      -> decltype(ConcatSignatures(
+          MakeConstexprSignature(DBUS_TYPE_ARRAY_AS_STRING),
+          GetConstexprDictEntrySignature<K, V>())) {
+    return ConcatSignatures(MakeConstexprSignature(DBUS_TYPE_ARRAY_AS_STRING),
+                            GetConstexprDictEntrySignature<K, V>());
+  }
   inline static void Write(dbus::MessageWriter* writer,
                            const std::map<KEY, VALUE, PRED, ALLOC>& value) {
     AppendValueToWriter(writer, value);
@@ -825,6 +1121,9 @@ struct DBusType<T, typename std::enable_if<is_protobuf<T>::value>::type> {
   inline static std::string GetSignature() {
     return GetDBusSignature<std::vector<uint8_t>>();
   }
+  static constexpr details::ConstexprSignature<2> GetConstexprSignature() {
+    return details::GetConstexprArraySignature<uint8_t>();
+  }
   inline static void Write(dbus::MessageWriter* writer, const T& value) {
     AppendValueToWriter(writer, value);
   }
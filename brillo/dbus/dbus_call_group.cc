@@ -0,0 +1,156 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/dbus/dbus_call_group.h>
+
+#include <base/bind.h>
+#include <base/logging.h>
+#include <brillo/dbus/utils.h>
+
+namespace brillo {
+namespace dbus_utils {
+
+struct DBusCallGroup::Call {
+  dbus::ObjectProxy* proxy;
+  std::unique_ptr<dbus::MethodCall> method_call;
+  int timeout_ms;
+  bool finished;
+  std::unique_ptr<dbus::Response> response;
+  ErrorPtr error;
+};
+
+DBusCallGroup::DBusCallGroup(base::TimeDelta deadline) : deadline_(deadline) {}
+
+DBusCallGroup::~DBusCallGroup() {
+  if (deadline_task_id_ != MessageLoop::kTaskIdNull)
+    MessageLoop::current()->CancelTask(deadline_task_id_);
+}
+
+size_t DBusCallGroup::AddMethodCall(
+    int timeout_ms,
+    dbus::ObjectProxy* proxy,
+    std::unique_ptr<dbus::MethodCall> method_call) {
+  CHECK(!started_) << "Can't add calls to a running call group";
+  std::unique_ptr<Call> call{new Call};
+  call->proxy = proxy;
+  call->method_call = std::move(method_call);
+  call->timeout_ms = timeout_ms;
+  call->finished = false;
+  calls_.push_back(std::move(call));
+  return calls_.size() - 1;
+}
+
+void DBusCallGroup::Run(const CompletionCallback& callback) {
+  CHECK(!started_) << "The call group was already run";
+  started_ = true;
+  completion_callback_ = callback;
+  pending_calls_ = calls_.size();
+  if (calls_.empty()) {
+    if (!completion_callback_.is_null())
+      completion_callback_.Run(true);
+    return;
+  }
+  if (!deadline_.is_zero()) {
+    deadline_task_id_ = MessageLoop::current()->PostDelayedTask(
+        FROM_HERE,
+        base::Bind(&DBusCallGroup::OnDeadline, weak_ptr_factory_.GetWeakPtr()),
+        deadline_);
+  }
+
+  auto weak_this = weak_ptr_factory_.GetWeakPtr();
+  for (size_t index = 0; index < calls_.size(); index++) {
+    Call* call = calls_[index].get();
+    call->proxy->CallMethodWithErrorCallback(
+        call->method_call.get(),
+        call->timeout_ms,
+        base::Bind(&DBusCallGroup::OnSuccess, weak_this, index),
+        base::Bind(&TranslateErrorResponse,
+                   base::Bind(&DBusCallGroup::OnError, weak_this, index)));
+    // The completion callback may have destroyed the group if the calls
+    // failed right away.
+    if (!weak_this)
+      return;
+  }
+}
+
+bool DBusCallGroup::RunAndBlock() {
+  Run(CompletionCallback());
+  while (!IsComplete())
+    MessageLoop::current()->RunOnce(true);
+  return GetFailedCalls().empty();
+}
+
+const Error* DBusCallGroup::GetError(size_t index) const {
+  return calls_[index]->error.get();
+}
+
+std::vector<size_t> DBusCallGroup::GetFailedCalls() const {
+  std::vector<size_t> failed_calls;
+  for (size_t index = 0; index < calls_.size(); index++) {
+    if (calls_[index]->error)
+      failed_calls.push_back(index);
+  }
+  return failed_calls;
+}
+
+dbus::Response* DBusCallGroup::GetResponse(size_t index) const {
+  return calls_[index]->response.get();
+}
+
+void DBusCallGroup::OnSuccess(size_t index, dbus::Response* response) {
+  Call* call = calls_[index].get();
+  // Late replies to the calls which timed out are ignored.
+  if (call->finished)
+    return;
+  if (response) {
+    // Keep a reference to the message rather than copying it.
+    dbus_message_ref(response->raw_message());
+    call->response = dbus::Response::FromRawMessage(response->raw_message());
+  } else {
+    AddDBusError(&call->error, DBUS_ERROR_NO_REPLY,
+                 "No response to " + call->method_call->GetMember());
+  }
+  FinishCall(index);
+}
+
+void DBusCallGroup::OnError(size_t index, Error* error) {
+  Call* call = calls_[index].get();
+  if (call->finished)
+    return;
+  call->error = error->Clone();
+  FinishCall(index);
+}
+
+void DBusCallGroup::OnDeadline() {
+  deadline_task_id_ = MessageLoop::kTaskIdNull;
+  auto weak_this = weak_ptr_factory_.GetWeakPtr();
+  for (size_t index = 0; index < calls_.size(); index++) {
+    Call* call = calls_[index].get();
+    if (call->finished)
+      continue;
+    AddDBusError(&call->error, DBUS_ERROR_TIMEOUT,
+                 call->method_call->GetMember() +
+                     " did not complete before the deadline");
+    FinishCall(index);
+    if (!weak_this)
+      return;
+  }
+}
+
+void DBusCallGroup::FinishCall(size_t index) {
+  calls_[index]->finished = true;
+  if (--pending_calls_ > 0)
+    return;
+  if (deadline_task_id_ != MessageLoop::kTaskIdNull) {
+    MessageLoop::current()->CancelTask(deadline_task_id_);
+    deadline_task_id_ = MessageLoop::kTaskIdNull;
+  }
+  CompletionCallback callback = completion_callback_;
+  completion_callback_.Reset();
+  if (!callback.is_null())
+    callback.Run(GetFailedCalls().empty());
+}
+
+}  // namespace dbus_utils
+}  // namespace brillo
@@ -0,0 +1,152 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_DBUS_DBUS_CALL_GROUP_H_
+#define LIBBRILLO_BRILLO_DBUS_DBUS_CALL_GROUP_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/memory/weak_ptr.h>
+#include <base/time/time.h>
+#include <brillo/brillo_export.h>
+#include <brillo/dbus/dbus_method_invoker.h>
+#include <brillo/dbus/dbus_param_writer.h>
+#include <brillo/errors/error.h>
+#include <brillo/message_loops/message_loop.h>
+#include <dbus/message.h>
+#include <dbus/object_proxy.h>
+
+namespace brillo {
+namespace dbus_utils {
+
+// DBusCallGroup sends several D-Bus method calls at once, possibly to
+// different services, and gathers their results. Querying N services this
+// way takes as long as the slowest call instead of the sum of all of them,
+// as CallMethodAndBlock() in a loop would:
+//
+//   DBusCallGroup group{base::TimeDelta::FromSeconds(5)};
+//   size_t version_call =
+//       group.AddCall(proxy1, "org.chromium.Foo", "GetVersion");
+//   size_t status_call = group.AddCallWithTimeout(
+//       500, proxy2, "org.chromium.Bar", "GetStatus", std::string{"wlan0"});
+//   group.RunAndBlock();
+//
+//   std::string version;
+//   brillo::ErrorPtr error;
+//   if (group.GetResults(version_call, &error, &version)) {
+//     // Use |version|.
+//   }
+//
+// Each call can have its own timeout, and the whole group a deadline after
+// which the calls still pending fail with DBUS_ERROR_TIMEOUT. A call failing
+// does not affect the others: the results of each call are read separately
+// and GetFailedCalls() lists the calls which failed.
+//
+// The asynchronous Run() calls a callback when all the calls completed, while
+// RunAndBlock() runs the current brillo::MessageLoop until they do. A group
+// can only be run once.
+class BRILLO_EXPORT DBusCallGroup final {
+ public:
+  using CompletionCallback = base::Callback<void(bool all_succeeded)>;
+
+  // |deadline| is the time the calls have to complete, from the time the
+  // group is run. A zero |deadline| means no deadline other than the
+  // timeouts of the calls.
+  explicit DBusCallGroup(base::TimeDelta deadline = base::TimeDelta());
+  ~DBusCallGroup();
+
+  // Adds a call of |method_name| with the arguments |params| and the
+  // default D-Bus timeout. Returns the index of the call in the group.
+  template<typename... Args>
+  size_t AddCall(dbus::ObjectProxy* proxy,
+                 const std::string& interface_name,
+                 const std::string& method_name,
+                 const Args&... params) {
+    return AddCallWithTimeout(dbus::ObjectProxy::TIMEOUT_USE_DEFAULT, proxy,
+                              interface_name, method_name, params...);
+  }
+
+  // Same as AddCall() with a timeout of |timeout_ms| for this call.
+  template<typename... Args>
+  size_t AddCallWithTimeout(int timeout_ms,
+                            dbus::ObjectProxy* proxy,
+                            const std::string& interface_name,
+                            const std::string& method_name,
+                            const Args&... params) {
+    std::unique_ptr<dbus::MethodCall> method_call{
+        new dbus::MethodCall{interface_name, method_name}};
+    dbus::MessageWriter writer(method_call.get());
+    DBusParamWriter::Append(&writer, params...);
+    return AddMethodCall(timeout_ms, proxy, std::move(method_call));
+  }
+
+  // Sends all the calls at once. |callback| is called when they have all
+  // completed (or the deadline expired), which can be before Run() returns.
+  void Run(const CompletionCallback& callback);
+  // Sends all the calls and runs the current message loop until they have
+  // all completed. Returns true if all the calls succeeded.
+  bool RunAndBlock();
+
+  size_t GetCallCount() const { return calls_.size(); }
+  // Returns whether all the calls have completed.
+  bool IsComplete() const { return pending_calls_ == 0 && started_; }
+  // Returns the error of the call |index|, or nullptr if the call succeeded
+  // (or has not completed yet).
+  const Error* GetError(size_t index) const;
+  // Returns the indices of the calls which failed.
+  std::vector<size_t> GetFailedCalls() const;
+  // Returns the response of the call |index|, or nullptr if the call failed.
+  dbus::Response* GetResponse(size_t index) const;
+
+  // Reads the results of the call |index| into |results|. Returns false and
+  // sets |error| if the call failed or its results are not of the expected
+  // types.
+  template<typename... ResultTypes>
+  bool GetResults(size_t index,
+                  ErrorPtr* error,
+                  ResultTypes*... results) const {
+    const Error* call_error = GetError(index);
+    if (call_error) {
+      if (error)
+        *error = call_error->Clone();
+      return false;
+    }
+    dbus::Response* response = GetResponse(index);
+    CHECK(response) << "Call " << index << " has not completed";
+    return ExtractMethodCallResults(response, error, results...);
+  }
+
+ private:
+  struct Call;
+
+  size_t AddMethodCall(int timeout_ms,
+                       dbus::ObjectProxy* proxy,
+                       std::unique_ptr<dbus::MethodCall> method_call);
+
+  void OnSuccess(size_t index, dbus::Response* response);
+  void OnError(size_t index, Error* error);
+  void OnDeadline();
+  // Marks the call |index| as completed and calls the completion callback if
+  // it was the last call pending.
+  void FinishCall(size_t index);
+
+  base::TimeDelta deadline_;
+  std::vector<std::unique_ptr<Call>> calls_;
+  size_t pending_calls_{0};
+  bool started_{false};
+  CompletionCallback completion_callback_;
+  MessageLoop::TaskId deadline_task_id_{MessageLoop::kTaskIdNull};
+
+  base::WeakPtrFactory<DBusCallGroup> weak_ptr_factory_{this};
+  DISALLOW_COPY_AND_ASSIGN(DBusCallGroup);
+};
+
+}  // namespace dbus_utils
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_DBUS_DBUS_CALL_GROUP_H_
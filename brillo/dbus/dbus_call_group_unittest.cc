@@ -0,0 +1,215 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/dbus/dbus_call_group.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/test/simple_test_clock.h>
+#include <brillo/bind_lambda.h>
+#include <brillo/message_loops/fake_message_loop.h>
+#include <dbus/mock_bus.h>
+#include <dbus/mock_object_proxy.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using testing::Invoke;
+using testing::_;
+
+namespace brillo {
+namespace dbus_utils {
+
+namespace {
+
+const char kTestServiceName[] = "org.test.Service";
+const char kTestInterface[] = "org.test.Service.TestInterface";
+const char kAddMethod[] = "Add";
+const char kFailMethod[] = "Fail";
+const char kHangMethod[] = "Hang";
+const char kSleepMethod[] = "Sleep";
+
+}  // anonymous namespace
+
+// Each proxy replies to its calls after |reply_delay_|: "Add" returns the
+// sum of its two arguments, "Fail" an error and "Hang" never replies. "Sleep"
+// replies after the number of milliseconds passed as its argument instead.
+class DBusCallGroupTest : public testing::Test {
+ public:
+  void SetUp() override {
+    loop_.SetAsCurrent();
+    dbus::Bus::Options options;
+    options.bus_type = dbus::Bus::SYSTEM;
+    bus_ = new dbus::MockBus(options);
+    for (const char* path : {"/test/path1", "/test/path2"}) {
+      proxies_.push_back(new dbus::MockObjectProxy(
+          bus_.get(), kTestServiceName, dbus::ObjectPath{path}));
+      EXPECT_CALL(*proxies_.back(), CallMethodWithErrorCallback(_, _, _, _))
+          .WillRepeatedly(Invoke(this, &DBusCallGroupTest::CallMethod));
+    }
+  }
+
+  void TearDown() override {
+    proxies_.clear();
+    bus_ = nullptr;
+  }
+
+  void CallMethod(dbus::MethodCall* method_call,
+                  int /* timeout_ms */,
+                  dbus::ObjectProxy::ResponseCallback callback,
+                  dbus::ObjectProxy::ErrorCallback error_callback) {
+    sent_calls_++;
+    if (method_call->GetMember() == kHangMethod)
+      return;
+    method_call->SetSerial(123);
+    std::shared_ptr<dbus::Response> response;
+    base::TimeDelta delay = reply_delay_;
+    dbus::MessageReader reader(method_call);
+    if (method_call->GetMember() == kAddMethod) {
+      int x = 0;
+      int y = 0;
+      EXPECT_TRUE(reader.PopInt32(&x) && reader.PopInt32(&y));
+      response = dbus::Response::CreateEmpty();
+      dbus::MessageWriter writer(response.get());
+      writer.AppendInt32(x + y);
+    } else if (method_call->GetMember() == kSleepMethod) {
+      int delay_ms = 0;
+      EXPECT_TRUE(reader.PopInt32(&delay_ms));
+      delay = base::TimeDelta::FromMilliseconds(delay_ms);
+      response = dbus::Response::CreateEmpty();
+    } else {
+      response = dbus::ErrorResponse::FromMethodCall(
+          method_call, "org.test.Error", "Failed on purpose");
+    }
+    auto reply = [callback, error_callback, response]() {
+      if (response->GetMessageType() == dbus::Message::MESSAGE_ERROR) {
+        error_callback.Run(static_cast<dbus::ErrorResponse*>(response.get()));
+      } else {
+        callback.Run(response.get());
+      }
+    };
+    MessageLoop::current()->PostDelayedTask(FROM_HERE, base::Bind(reply),
+                                            delay);
+  }
+
+ protected:
+  base::SimpleTestClock clock_;
+  FakeMessageLoop loop_{&clock_};
+  scoped_refptr<dbus::MockBus> bus_;
+  std::vector<scoped_refptr<dbus::MockObjectProxy>> proxies_;
+  base::TimeDelta reply_delay_{base::TimeDelta::FromMilliseconds(100)};
+  int sent_calls_{0};
+};
+
+TEST_F(DBusCallGroupTest, Concurrent) {
+  DBusCallGroup group;
+  size_t call1 = group.AddCall(proxies_[0].get(), kTestInterface, kAddMethod,
+                               1, 2);
+  size_t call2 = group.AddCall(proxies_[1].get(), kTestInterface, kAddMethod,
+                               3, 4);
+  EXPECT_EQ(2u, group.GetCallCount());
+
+  int completion_calls = 0;
+  bool success = false;
+  group.Run(base::Bind([&completion_calls, &success](bool all_succeeded) {
+    completion_calls++;
+    success = all_succeeded;
+  }));
+  // Both calls are sent right away.
+  EXPECT_EQ(2, sent_calls_);
+  EXPECT_FALSE(group.IsComplete());
+
+  base::Time start = clock_.Now();
+  loop_.Run();
+  EXPECT_TRUE(group.IsComplete());
+  EXPECT_EQ(1, completion_calls);
+  EXPECT_TRUE(success);
+  // The calls took as long as one call.
+  EXPECT_EQ(reply_delay_, clock_.Now() - start);
+
+  int sum = 0;
+  EXPECT_TRUE(group.GetResults(call1, nullptr, &sum));
+  EXPECT_EQ(3, sum);
+  EXPECT_TRUE(group.GetResults(call2, nullptr, &sum));
+  EXPECT_EQ(7, sum);
+  EXPECT_TRUE(group.GetFailedCalls().empty());
+}
+
+TEST_F(DBusCallGroupTest, PartialFailure) {
+  DBusCallGroup group;
+  size_t call1 = group.AddCall(proxies_[0].get(), kTestInterface, kAddMethod,
+                               1, 2);
+  size_t call2 = group.AddCall(proxies_[1].get(), kTestInterface, kFailMethod);
+  EXPECT_FALSE(group.RunAndBlock());
+
+  EXPECT_EQ(std::vector<size_t>{call2}, group.GetFailedCalls());
+  int sum = 0;
+  EXPECT_TRUE(group.GetResults(call1, nullptr, &sum));
+  EXPECT_EQ(3, sum);
+  ErrorPtr error;
+  EXPECT_FALSE(group.GetResults(call2, &error));
+  ASSERT_NE(nullptr, error.get());
+  EXPECT_EQ("org.test.Error", error->GetCode());
+  EXPECT_EQ("org.test.Error", group.GetError(call2)->GetCode());
+  EXPECT_EQ(nullptr, group.GetError(call1));
+
+  // Results of the wrong types.
+  std::string str;
+  EXPECT_FALSE(group.GetResults(call1, &error, &str));
+}
+
+TEST_F(DBusCallGroupTest, Deadline) {
+  DBusCallGroup group{base::TimeDelta::FromSeconds(1)};
+  size_t call1 = group.AddCall(proxies_[0].get(), kTestInterface, kAddMethod,
+                               1, 2);
+  size_t call2 = group.AddCall(proxies_[1].get(), kTestInterface, kHangMethod);
+  base::Time start = clock_.Now();
+  EXPECT_FALSE(group.RunAndBlock());
+  EXPECT_EQ(base::TimeDelta::FromSeconds(1), clock_.Now() - start);
+
+  EXPECT_EQ(std::vector<size_t>{call2}, group.GetFailedCalls());
+  EXPECT_EQ(DBUS_ERROR_TIMEOUT, group.GetError(call2)->GetCode());
+  int sum = 0;
+  EXPECT_TRUE(group.GetResults(call1, nullptr, &sum));
+  EXPECT_EQ(3, sum);
+}
+
+TEST_F(DBusCallGroupTest, DeadlineNotReached) {
+  DBusCallGroup group{base::TimeDelta::FromSeconds(1)};
+  group.AddCall(proxies_[0].get(), kTestInterface, kAddMethod, 1, 2);
+  EXPECT_TRUE(group.RunAndBlock());
+  // The deadline task is cancelled.
+  EXPECT_FALSE(loop_.RunOnce(false));
+}
+
+// Querying many services takes as long as the slowest call, instead of the
+// sum of the calls when they are made one after another.
+TEST_F(DBusCallGroupTest, SlowestCallLatency) {
+  DBusCallGroup group;
+  base::TimeDelta slowest;
+  base::TimeDelta sum;
+  for (int i = 1; i <= 20; i++) {
+    base::TimeDelta delay = base::TimeDelta::FromMilliseconds(i * 10);
+    group.AddCall(proxies_[i % proxies_.size()].get(), kTestInterface,
+                  kSleepMethod, static_cast<int>(delay.InMilliseconds()));
+    slowest = std::max(slowest, delay);
+    sum += delay;
+  }
+  base::Time start = clock_.Now();
+  EXPECT_TRUE(group.RunAndBlock());
+  EXPECT_EQ(20, sent_calls_);
+  EXPECT_EQ(slowest, clock_.Now() - start);
+  EXPECT_LT(clock_.Now() - start, sum);
+}
+
+TEST_F(DBusCallGroupTest, Empty) {
+  DBusCallGroup group;
+  EXPECT_TRUE(group.RunAndBlock());
+  EXPECT_TRUE(group.IsComplete());
+}
+
+}  // namespace dbus_utils
+}  // namespace brillo
@@ -4,6 +4,7 @@
 
 #include <brillo/dbus/dbus_object.h>
 
+#include <set>
 #include <vector>
 
 #include <base/bind.h>
@@ -16,6 +17,17 @@
 namespace brillo {
 namespace dbus_utils {
 
+namespace {
+
+void CommitTransaction(
+    const base::WeakPtr<ExportedObjectManager>& object_manager,
+    bool /* all_succeeded */) {
+  if (object_manager)
+    object_manager->CommitTransaction();
+}
+
+}  // anonymous namespace
+
 //////////////////////////////////////////////////////////////////////////////
 
 DBusInterface::DBusInterface(DBusObject* dbus_object,
@@ -39,15 +51,14 @@ void DBusInterface::ExportAsync(
           << object_path.value() << "'";
   scoped_refptr<AsyncEventSequencer> sequencer(new AsyncEventSequencer());
   for (const auto& pair : handlers_) {
-    std::string method_name = pair.first;
+    const std::string& method_name = pair.first;
     VLOG(1) << "Exporting method: " << interface_name_ << "." << method_name;
     std::string export_error = "Failed exporting " + method_name + " method";
     auto export_handler = sequencer->GetExportHandler(
         interface_name_, method_name, export_error, true);
-    auto method_handler =
-        base::Bind(&DBusInterface::HandleMethodCall, base::Unretained(this));
-    exported_object->ExportMethod(
-        interface_name_, method_name, method_handler, export_handler);
+    exported_object->ExportMethod(interface_name_, method_name,
+                                  GetExportedMethodHandler(pair.second.get()),
+                                  export_handler);
   }
 
   std::vector<AsyncEventSequencer::CompletionAction> actions;
@@ -73,12 +84,11 @@ void DBusInterface::ExportAndBlock(
   VLOG(1) << "Registering D-Bus interface '" << interface_name_ << "' for '"
           << object_path.value() << "'";
   for (const auto& pair : handlers_) {
-    std::string method_name = pair.first;
+    const std::string& method_name = pair.first;
     VLOG(1) << "Exporting method: " << interface_name_ << "." << method_name;
-    auto method_handler =
-        base::Bind(&DBusInterface::HandleMethodCall, base::Unretained(this));
     if (!exported_object->ExportMethodAndBlock(
-            interface_name_, method_name, method_handler)) {
+            interface_name_, method_name,
+            GetExportedMethodHandler(pair.second.get()))) {
         LOG(FATAL) << "Failed exporting " << method_name << " method";
     }
   }
@@ -108,13 +118,19 @@ void DBusInterface::ClaimInterface(
                  object_manager, object_path, interface_name_));
 }
 
+dbus::ExportedObject::MethodCallCallback
+DBusInterface::GetExportedMethodHandler(
+    DBusInterfaceMethodHandlerInterface* handler) {
+  // dbus::ExportedObject already looks the method up by name, so the calls
+  // go straight to the handler instead of through HandleMethodCall().
+  return base::Bind(&DBusInterfaceMethodHandlerInterface::HandleMethod,
+                    base::Unretained(handler));
+}
+
 void DBusInterface::HandleMethodCall(dbus::MethodCall* method_call,
                                      ResponseSender sender) {
   std::string method_name = method_call->GetMember();
-  // Make a local copy of |interface_name_| because calling HandleMethod()
-  // can potentially kill this interface object...
-  std::string interface_name = interface_name_;
-  VLOG(1) << "Received method call request: " << interface_name << "."
+  VLOG(1) << "Received method call request: " << interface_name_ << "."
           << method_name << "(" << method_call->GetSignature() << ")";
   auto pair = handlers_.find(method_name);
   if (pair == handlers_.end()) {
@@ -153,8 +169,11 @@ DBusObject::DBusObject(ExportedObjectManager* object_manager,
                        const scoped_refptr<dbus::Bus>& bus,
                        const dbus::ObjectPath& object_path)
     : property_set_(bus.get()), bus_(bus), object_path_(object_path) {
-  if (object_manager)
+  if (object_manager) {
     object_manager_ = object_manager->AsWeakPtr();
+    property_set_.SetPropertyChangedCallback(base::Bind(
+        &ExportedObjectManager::OnPropertyChanged, object_manager_));
+  }
 }
 
 DBusObject::~DBusObject() {
@@ -192,10 +211,10 @@ void DBusObject::RegisterAsync(
 
   // Add the org.freedesktop.DBus.Properties interface to the object.
   DBusInterface* prop_interface = AddOrGetInterface(dbus::kPropertiesInterface);
-  prop_interface->AddSimpleMethodHandler(
+  prop_interface->AddRawMethodHandler(
       dbus::kPropertiesGetAll,
       base::Unretained(&property_set_),
-      &ExportedPropertySet::HandleGetAll);
+      &ExportedPropertySet::HandleGetAllRequest);
   prop_interface->AddSimpleMethodHandlerWithError(
       dbus::kPropertiesGet,
       base::Unretained(&property_set_),
@@ -206,6 +225,15 @@ void DBusObject::RegisterAsync(
       &ExportedPropertySet::HandleSet);
   property_set_.OnPropertiesInterfaceExported(prop_interface);
 
+  // Batch the InterfacesAdded signals of the interfaces until they are all
+  // exported.
+  std::vector<AsyncEventSequencer::CompletionAction> actions;
+  if (object_manager_) {
+    object_manager_->BeginTransaction();
+    actions.push_back(base::Bind(&CommitTransaction, object_manager_));
+  }
+  actions.push_back(completion_callback);
+
   // Export interface methods
   for (const auto& pair : interfaces_) {
     pair.second->ExportAsync(
@@ -217,7 +245,7 @@ void DBusObject::RegisterAsync(
                               false));
   }
 
-  sequencer->OnAllTasksCompletedCall({completion_callback});
+  sequencer->OnAllTasksCompletedCall(actions);
 }
 
 void DBusObject::RegisterAndBlock() {
@@ -227,10 +255,10 @@ void DBusObject::RegisterAndBlock() {
 
   // Add the org.freedesktop.DBus.Properties interface to the object.
   DBusInterface* prop_interface = AddOrGetInterface(dbus::kPropertiesInterface);
-  prop_interface->AddSimpleMethodHandler(
+  prop_interface->AddRawMethodHandler(
       dbus::kPropertiesGetAll,
       base::Unretained(&property_set_),
-      &ExportedPropertySet::HandleGetAll);
+      &ExportedPropertySet::HandleGetAllRequest);
   prop_interface->AddSimpleMethodHandlerWithError(
       dbus::kPropertiesGet,
       base::Unretained(&property_set_),
@@ -242,6 +270,8 @@ void DBusObject::RegisterAndBlock() {
   property_set_.OnPropertiesInterfaceExported(prop_interface);
 
   // Export interface methods
+  if (object_manager_)
+    object_manager_->BeginTransaction();
   for (const auto& pair : interfaces_) {
     pair.second->ExportAndBlock(
         object_manager_.get(),
@@ -249,6 +279,32 @@ void DBusObject::RegisterAndBlock() {
         exported_object_,
         object_path_);
   }
+  if (object_manager_)
+    object_manager_->CommitTransaction();
+}
+
+void DBusObject::RegisterObjectsAsync(
+    const std::vector<DBusObject*>& objects,
+    const AsyncEventSequencer::CompletionAction& completion_callback) {
+  VLOG(1) << "Registering " << objects.size() << " D-Bus objects.";
+  scoped_refptr<AsyncEventSequencer> sequencer(new AsyncEventSequencer());
+  std::vector<AsyncEventSequencer::CompletionAction> actions;
+  std::set<ExportedObjectManager*> object_managers;
+  for (DBusObject* object : objects) {
+    ExportedObjectManager* object_manager = object->object_manager_.get();
+    if (object_manager && object_managers.insert(object_manager).second) {
+      object_manager->BeginTransaction();
+      actions.push_back(
+          base::Bind(&CommitTransaction, object->object_manager_));
+    }
+  }
+  actions.push_back(completion_callback);
+
+  for (DBusObject* object : objects) {
+    object->RegisterAsync(sequencer->GetHandler(
+        "Failed to register object " + object->object_path_.value(), false));
+  }
+  sequencer->OnAllTasksCompletedCall(actions);
 }
 
 void DBusObject::UnregisterAsync() {
@@ -63,6 +63,7 @@ class MyDbusObject {
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include <base/bind.h>
 #include <base/callback_helpers.h>
@@ -442,6 +443,10 @@ class BRILLO_EXPORT DBusInterface final {
   // name from |method_call|, looks up a registered handler from |handlers_|
   // map and dispatched the call to that handler.
   void HandleMethodCall(dbus::MethodCall* method_call, ResponseSender sender);
+  // Returns the callback exported to dbus::ExportedObject for a method,
+  // dispatching the method calls directly to its |handler|.
+  BRILLO_PRIVATE static dbus::ExportedObject::MethodCallCallback
+  GetExportedMethodHandler(DBusInterfaceMethodHandlerInterface* handler);
   // Helper to add a handler for method |method_name| to the |handlers_| map.
   // Not marked BRILLO_PRIVATE because it needs to be called by the inline
   // template functions AddMethodHandler(...)
@@ -526,10 +531,21 @@ class BRILLO_EXPORT DBusObject {
 
   // Registers the object instance with D-Bus. This is an asynchronous call
   // that will call |completion_callback| when the object and all of its
-  // interfaces are registered.
+  // interfaces are registered. The interfaces are claimed with the object
+  // manager in a single transaction, so that one InterfacesAdded signal is
+  // sent for the object.
   virtual void RegisterAsync(
       const AsyncEventSequencer::CompletionAction& completion_callback);
 
+  // Registers several objects at once, e.g. the objects a daemon exports at
+  // startup. The interfaces of all the objects are claimed in one transaction
+  // of their object managers when the last object is exported, still sending
+  // one InterfacesAdded signal per object. |completion_callback| is called
+  // when all the objects are registered.
+  static void RegisterObjectsAsync(
+      const std::vector<DBusObject*>& objects,
+      const AsyncEventSequencer::CompletionAction& completion_callback);
+
   // Registers the object instance with D-Bus. This is call is synchronous and
   // will block until the object and all of its interfaces are registered.
   virtual void RegisterAndBlock();
@@ -554,6 +570,10 @@ class BRILLO_EXPORT DBusObject {
   // Returns the reference to dbus::Bus this object is associated with.
   scoped_refptr<dbus::Bus> GetBus() { return bus_; }
 
+  // Returns the set of the properties registered with the interfaces of this
+  // object, e.g. to enable the coalescing of PropertiesChanged signals.
+  ExportedPropertySet* GetPropertySet() { return &property_set_; }
+
  private:
   // A map of all the interfaces added to this object.
   std::map<std::string, std::unique_ptr<DBusInterface>> interfaces_;
@@ -4,9 +4,15 @@
 
 #include <brillo/dbus/dbus_object.h>
 
+#include <map>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <base/bind.h>
+#include <base/logging.h>
+#include <base/time/time.h>
+#include <brillo/bind_lambda.h>
 #include <brillo/dbus/dbus_object_test_helpers.h>
 #include <brillo/dbus/mock_exported_object_manager.h>
 #include <dbus/message.h>
@@ -89,6 +95,15 @@ void TestWithMessageAsync(
   response->Return(message->GetSender());
 }
 
+// Completes the export of a method right away.
+void ExportMethodNow(
+    const std::string& interface_name,
+    const std::string& method_name,
+    dbus::ExportedObject::MethodCallCallback /* method_call_callback */,
+    dbus::ExportedObject::OnExportedCallback on_exported_callback) {
+  on_exported_callback.Run(interface_name, method_name, true);
+}
+
 }  // namespace
 
 class DBusObjectTest : public ::testing::Test {
@@ -388,5 +403,146 @@ TEST_F(DBusObjectTest, ShouldReleaseOnlyClaimedInterfaces) {
   dbus_object_.reset();
 }
 
+TEST_F(DBusObjectTest, RegisterObjectsAsync) {
+  const dbus::ObjectPath kObjectManagerPath{std::string{"/"}};
+  const dbus::ObjectPath kPath1{std::string{"/object1"}};
+  const dbus::ObjectPath kPath2{std::string{"/object2"}};
+  MockExportedObjectManager mock_object_manager{bus_, kObjectManagerPath};
+  std::vector<std::unique_ptr<DBusObject>> objects;
+  std::vector<scoped_refptr<dbus::MockExportedObject>> exported_objects;
+  for (const auto& path : {kPath1, kPath2}) {
+    exported_objects.push_back(new dbus::MockExportedObject(bus_.get(), path));
+    EXPECT_CALL(*bus_, GetExportedObject(path))
+        .WillOnce(Return(exported_objects.back().get()));
+    EXPECT_CALL(*exported_objects.back(), ExportMethod(_, _, _, _))
+        .WillRepeatedly(Invoke(&ExportMethodNow));
+    EXPECT_CALL(*exported_objects.back(), Unregister()).Times(1);
+    objects.emplace_back(new DBusObject(&mock_object_manager, bus_, path));
+    DBusInterface* itf = objects.back()->AddOrGetInterface(kTestInterface3);
+    itf->AddSimpleMethodHandler(kTestMethod_NoOp, base::Bind(NoOp));
+  }
+  // The test interface and the properties interface of each object.
+  EXPECT_CALL(mock_object_manager, ClaimInterface(kPath1, _, _)).Times(2);
+  EXPECT_CALL(mock_object_manager, ClaimInterface(kPath2, _, _)).Times(2);
+  EXPECT_CALL(mock_object_manager, ReleaseInterface(_, _)).Times(4);
+
+  int completion_calls = 0;
+  DBusObject::RegisterObjectsAsync(
+      {objects[0].get(), objects[1].get()},
+      base::Bind([](int* calls, bool success) {
+        EXPECT_TRUE(success);
+        (*calls)++;
+      }, &completion_calls));
+  EXPECT_EQ(1, completion_calls);
+  objects.clear();
+}
+
+TEST_F(DBusObjectTest, ExportedMethodCallbacks) {
+  const dbus::ObjectPath kPath{std::string{"/direct"}};
+  scoped_refptr<dbus::MockExportedObject> exported_object =
+      new dbus::MockExportedObject(bus_.get(), kPath);
+  EXPECT_CALL(*bus_, GetExportedObject(kPath))
+      .WillOnce(Return(exported_object.get()));
+  std::map<std::string, dbus::ExportedObject::MethodCallCallback> methods;
+  auto export_method = [&methods](
+      const std::string& interface_name,
+      const std::string& method_name,
+      dbus::ExportedObject::MethodCallCallback method_call_callback,
+      dbus::ExportedObject::OnExportedCallback /* on_exported_callback */) {
+    methods[interface_name + "." + method_name] = method_call_callback;
+  };
+  EXPECT_CALL(*exported_object, ExportMethod(_, _, _, _))
+      .WillRepeatedly(Invoke(export_method));
+  EXPECT_CALL(*exported_object, Unregister()).Times(1);
+
+  DBusObject dbus_object{nullptr, bus_, kPath};
+  DBusInterface* itf = dbus_object.AddOrGetInterface(kTestInterface1);
+  itf->AddSimpleMethodHandler(
+      kTestMethod_Add, base::Unretained(&calc_), &Calc::Add);
+  itf->AddSimpleMethodHandler(
+      kTestMethod_Negate, base::Unretained(&calc_), &Calc::Negate);
+  dbus_object.RegisterAsync(AsyncEventSequencer::GetDefaultCompletionAction());
+  // The two methods and Properties.Get, GetAll and Set.
+  EXPECT_EQ(5u, methods.size());
+
+  // The exported callbacks call the method handlers directly.
+  dbus::MethodCall method_call(kTestInterface1, kTestMethod_Negate);
+  method_call.SetSerial(123);
+  dbus::MessageWriter writer(&method_call);
+  writer.AppendInt32(17);
+  testing::ResponseHolder response_holder;
+  methods[std::string{kTestInterface1} + "." + kTestMethod_Negate].Run(
+      &method_call, base::Bind(&testing::ResponseHolder::ReceiveResponse,
+                               response_holder.AsWeakPtr()));
+  ASSERT_NE(nullptr, response_holder.response_.get());
+  dbus::MessageReader reader(response_holder.response_.get());
+  int result;
+  ASSERT_TRUE(reader.PopInt32(&result));
+  ASSERT_FALSE(reader.HasMoreData());
+  EXPECT_EQ(-17, result);
+}
+
+// Times dispatching method calls through the callbacks exported for each
+// method against the generic DBusInterface::HandleMethodCall() lookup they
+// replace. Run with --gtest_also_run_disabled_tests.
+TEST_F(DBusObjectTest, DISABLED_DispatchBenchmark) {
+  const int kIterations = 1000000;
+  const dbus::ObjectPath kPath{std::string{"/direct"}};
+  scoped_refptr<dbus::MockExportedObject> exported_object =
+      new dbus::MockExportedObject(bus_.get(), kPath);
+  EXPECT_CALL(*bus_, GetExportedObject(kPath))
+      .WillOnce(Return(exported_object.get()));
+  dbus::ExportedObject::MethodCallCallback negate_callback;
+  auto export_method = [&negate_callback](
+      const std::string& /* interface_name */,
+      const std::string& method_name,
+      dbus::ExportedObject::MethodCallCallback method_call_callback,
+      dbus::ExportedObject::OnExportedCallback /* on_exported_callback */) {
+    if (method_name == kTestMethod_Negate)
+      negate_callback = method_call_callback;
+  };
+  EXPECT_CALL(*exported_object, ExportMethod(_, _, _, _))
+      .WillRepeatedly(Invoke(export_method));
+  EXPECT_CALL(*exported_object, Unregister()).Times(1);
+
+  DBusObject dbus_object{nullptr, bus_, kPath};
+  DBusInterface* itf = dbus_object.AddOrGetInterface(kTestInterface1);
+  itf->AddSimpleMethodHandler(
+      kTestMethod_Add, base::Unretained(&calc_), &Calc::Add);
+  itf->AddSimpleMethodHandler(
+      kTestMethod_Negate, base::Unretained(&calc_), &Calc::Negate);
+  dbus_object.RegisterAsync(AsyncEventSequencer::GetDefaultCompletionAction());
+  ASSERT_FALSE(negate_callback.is_null());
+
+  dbus::MethodCall method_call(kTestInterface1, kTestMethod_Negate);
+  method_call.SetSerial(123);
+  dbus::MessageWriter writer(&method_call);
+  writer.AppendInt32(17);
+  testing::ResponseHolder response_holder;
+  auto response_sender = base::Bind(&testing::ResponseHolder::ReceiveResponse,
+                                    response_holder.AsWeakPtr());
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (int i = 0; i < kIterations; i++) {
+    response_holder.response_.reset();
+    negate_callback.Run(&method_call, response_sender);
+    ASSERT_NE(nullptr, response_holder.response_.get());
+  }
+  base::TimeDelta direct_time = base::TimeTicks::Now() - start;
+
+  start = base::TimeTicks::Now();
+  for (int i = 0; i < kIterations; i++) {
+    response_holder.response_.reset();
+    testing::DBusInterfaceTestHelper::HandleMethodCall(itf, &method_call,
+                                                       response_sender);
+    ASSERT_NE(nullptr, response_holder.response_.get());
+  }
+  base::TimeDelta lookup_time = base::TimeTicks::Now() - start;
+
+  LOG(INFO) << kIterations << " method calls: direct "
+            << direct_time.InMilliseconds() << " ms, through "
+            << "HandleMethodCall() " << lookup_time.InMilliseconds() << " ms";
+}
+
 }  // namespace dbus_utils
 }  // namespace brillo
@@ -7,6 +7,8 @@
 #include <vector>
 
 #include <brillo/dbus/async_event_sequencer.h>
+#include <brillo/dbus/dbus_method_invoker.h>
+#include <brillo/dbus/utils.h>
 #include <dbus/object_manager.h>
 
 using brillo::dbus_utils::AsyncEventSequencer;
@@ -26,9 +28,10 @@ void ExportedObjectManager::RegisterAsync(
   bus_->AssertOnOriginThread();
   DBusInterface* itf =
       dbus_object_.AddOrGetInterface(dbus::kObjectManagerInterface);
-  itf->AddSimpleMethodHandler(dbus::kObjectManagerGetManagedObjects,
-                              base::Unretained(this),
-                              &ExportedObjectManager::HandleGetManagedObjects);
+  itf->AddRawMethodHandler(
+      dbus::kObjectManagerGetManagedObjects,
+      base::Unretained(this),
+      &ExportedObjectManager::HandleGetManagedObjectsRequest);
 
   signal_itf_added_ = itf->RegisterSignalOfType<SignalInterfacesAdded>(
       dbus::kObjectManagerInterfacesAdded);
@@ -46,13 +49,18 @@ void ExportedObjectManager::ClaimInterface(
   //   org.freedesktop.DBus.ObjectManager.InterfacesAdded (
   //       OBJPATH object_path,
   //       DICT<STRING,DICT<STRING,VARIANT>> interfaces_and_properties);
+  registered_objects_[path][interface_name] = property_writer;
+  managed_objects_reply_.reset();
+  if (transaction_depth_ > 0) {
+    pending_added_[path].insert(interface_name);
+    return;
+  }
   VariantDictionary property_dict;
   property_writer.Run(&property_dict);
   std::map<std::string, VariantDictionary> interfaces_and_properties{
       {interface_name, property_dict}
   };
   signal_itf_added_.lock()->Send(path, interfaces_and_properties);
-  registered_objects_[path][interface_name] = property_writer;
 }
 
 void ExportedObjectManager::ReleaseInterface(
@@ -71,6 +79,20 @@ void ExportedObjectManager::ReleaseInterface(
   interfaces_for_path.erase(interface_name);
   if (interfaces_for_path.empty())
     registered_objects_.erase(path);
+  managed_objects_reply_.reset();
+  if (transaction_depth_ > 0) {
+    // No need to signal the removal of an interface which was not announced
+    // yet.
+    auto pending_itr = pending_added_.find(path);
+    if (pending_itr != pending_added_.end() &&
+        pending_itr->second.erase(interface_name) > 0) {
+      if (pending_itr->second.empty())
+        pending_added_.erase(pending_itr);
+      return;
+    }
+    pending_removed_[path].push_back(interface_name);
+    return;
+  }
 
   // We're sending signals that look like:
   //   org.freedesktop.DBus.ObjectManager.InterfacesRemoved (
@@ -79,6 +101,43 @@ void ExportedObjectManager::ReleaseInterface(
                                    std::vector<std::string>{interface_name});
 }
 
+void ExportedObjectManager::BeginTransaction() {
+  bus_->AssertOnOriginThread();
+  transaction_depth_++;
+}
+
+void ExportedObjectManager::CommitTransaction() {
+  bus_->AssertOnOriginThread();
+  CHECK_GT(transaction_depth_, 0) << "No transaction to commit";
+  if (--transaction_depth_ > 0)
+    return;
+
+  // Send the removals first, an interface released and claimed again during
+  // the transaction must end up being present.
+  std::map<dbus::ObjectPath, std::vector<std::string>> removed;
+  removed.swap(pending_removed_);
+  if (!removed.empty()) {
+    auto signal = signal_itf_removed_.lock();
+    for (const auto& pair : removed)
+      signal->Send(pair.first, pair.second);
+  }
+
+  std::map<dbus::ObjectPath, std::set<std::string>> added;
+  added.swap(pending_added_);
+  if (!added.empty()) {
+    auto signal = signal_itf_added_.lock();
+    for (const auto& pair : added) {
+      const InterfaceProperties& interfaces = registered_objects_[pair.first];
+      std::map<std::string, VariantDictionary> interfaces_and_properties;
+      for (const std::string& interface_name : pair.second) {
+        interfaces.find(interface_name)->second.Run(
+            &interfaces_and_properties[interface_name]);
+      }
+      signal->Send(pair.first, interfaces_and_properties);
+    }
+  }
+}
+
 ExportedObjectManager::ObjectMap
 ExportedObjectManager::HandleGetManagedObjects() {
   // Implements the GetManagedObjects method:
@@ -89,17 +148,39 @@ ExportedObjectManager::HandleGetManagedObjects() {
   //                   DICT<STRING,VARIANT>>> )
   bus_->AssertOnOriginThread();
   ExportedObjectManager::ObjectMap objects;
-  for (const auto path_pair : registered_objects_) {
+  for (const auto& path_pair : registered_objects_) {
     std::map<std::string, VariantDictionary>& interfaces =
         objects[path_pair.first];
     const InterfaceProperties& interface2properties = path_pair.second;
-    for (const auto interface : interface2properties) {
+    for (const auto& interface : interface2properties) {
       interface.second.Run(&interfaces[interface.first]);
     }
   }
   return objects;
 }
 
+void ExportedObjectManager::HandleGetManagedObjectsRequest(
+    dbus::MethodCall* method_call,
+    dbus::ExportedObject::ResponseSender sender) {
+  bus_->AssertOnOriginThread();
+  dbus::MessageReader reader(method_call);
+  ErrorPtr error;
+  if (!ExtractMessageParameters(&reader, &error)) {
+    sender.Run(GetDBusError(method_call, error.get()));
+    return;
+  }
+  if (!managed_objects_reply_) {
+    managed_objects_reply_ = dbus::Response::CreateEmpty();
+    dbus::MessageWriter writer(managed_objects_reply_.get());
+    AppendValueToWriter(&writer, HandleGetManagedObjects());
+  }
+  sender.Run(CopyCachedResponse(managed_objects_reply_.get(), method_call));
+}
+
+void ExportedObjectManager::OnPropertyChanged() {
+  managed_objects_reply_.reset();
+}
+
 }  // namespace dbus_utils
 
 }  // namespace brillo
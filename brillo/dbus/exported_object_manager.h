@@ -6,6 +6,8 @@
 #define LIBBRILLO_BRILLO_DBUS_EXPORTED_OBJECT_MANAGER_H_
 
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -106,15 +108,42 @@ class BRILLO_EXPORT ExportedObjectManager
   virtual void ReleaseInterface(const dbus::ObjectPath& path,
                                 const std::string& interface_name);
 
+  // Starts a transaction batching the InterfacesAdded and InterfacesRemoved
+  // signals. The interfaces claimed and released until the matching
+  // CommitTransaction() call are reported by GetManagedObjects() right away,
+  // but the signals are only sent on commit: one InterfacesRemoved and one
+  // InterfacesAdded signal per object path, with the properties as of the
+  // commit. An interface claimed and released within the transaction is not
+  // signaled at all. Transactions can be nested, the signals are sent when
+  // the outermost one is committed.
+  void BeginTransaction();
+  void CommitTransaction();
+
+  // Drops the cached GetManagedObjects() reply. Called by the DBusObject
+  // instances using this object manager when one of their properties changes.
+  void OnPropertyChanged();
+
   const scoped_refptr<dbus::Bus>& GetBus() const { return bus_; }
 
  private:
   BRILLO_PRIVATE ObjectMap HandleGetManagedObjects();
+  // GetManagedObjects handler. The reply is cached and only marshalled again
+  // after an interface is claimed or released, or a property changes.
+  BRILLO_PRIVATE void HandleGetManagedObjectsRequest(
+      dbus::MethodCall* method_call,
+      dbus::ExportedObject::ResponseSender sender);
 
   scoped_refptr<dbus::Bus> bus_;
   brillo::dbus_utils::DBusObject dbus_object_;
   // Tracks all objects currently known to the ExportedObjectManager.
   std::map<dbus::ObjectPath, InterfaceProperties> registered_objects_;
+  std::unique_ptr<dbus::Response> managed_objects_reply_;
+  // The nesting level of the transactions started by BeginTransaction().
+  int transaction_depth_{0};
+  // The interfaces claimed and released during the current transaction, to
+  // be signaled on commit.
+  std::map<dbus::ObjectPath, std::set<std::string>> pending_added_;
+  std::map<dbus::ObjectPath, std::vector<std::string>> pending_removed_;
 
   using SignalInterfacesAdded =
       DBusSignal<dbus::ObjectPath, std::map<std::string, VariantDictionary>>;
@@ -4,7 +4,16 @@
 
 #include <brillo/dbus/exported_object_manager.h>
 
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
 #include <base/bind.h>
+#include <base/logging.h>
+#include <base/strings/stringprintf.h>
+#include <base/time/time.h>
+#include <brillo/bind_lambda.h>
 #include <brillo/dbus/dbus_object_test_helpers.h>
 #include <brillo/dbus/utils.h>
 #include <dbus/mock_bus.h>
@@ -189,6 +198,149 @@ TEST_F(ExportedObjectManagerTest, GetManagedObjectsResponseCorrectness) {
   EXPECT_EQ(interface_name, kClaimedInterface);
 }
 
+TEST_F(ExportedObjectManagerTest, GetManagedObjectsCachedReply) {
+  int writer_calls = 0;
+  std::string value = "a";
+  auto writer = [&writer_calls, &value](VariantDictionary* dict) {
+    writer_calls++;
+    (*dict)[kTestPropertyName] = value;
+  };
+  auto get_value = [this]() {
+    auto response = CallHandleGetManagedObjects();
+    EXPECT_EQ(1234u, response->GetReplySerial());
+    ExportedObjectManager::ObjectMap objects;
+    dbus::MessageReader reader(response.get());
+    EXPECT_TRUE(PopValueFromReader(&reader, &objects));
+    return objects[kClaimedTestPath][kClaimedInterface][kTestPropertyName]
+        .Get<std::string>();
+  };
+  EXPECT_CALL(*mock_exported_object_, SendSignal(_)).Times(AnyNumber());
+  om_->ClaimInterface(kClaimedTestPath, kClaimedInterface,
+                      base::Bind(writer));
+  EXPECT_EQ(1, writer_calls);
+
+  EXPECT_EQ("a", get_value());
+  EXPECT_EQ("a", get_value());
+  // The reply is built only once.
+  EXPECT_EQ(2, writer_calls);
+
+  value = "b";
+  om_->OnPropertyChanged();
+  EXPECT_EQ("b", get_value());
+  EXPECT_EQ(3, writer_calls);
+
+  // Releasing an interface invalidates the cached reply too.
+  om_->ReleaseInterface(kClaimedTestPath, kClaimedInterface);
+  auto response = CallHandleGetManagedObjects();
+  ExportedObjectManager::ObjectMap objects;
+  dbus::MessageReader reader(response.get());
+  EXPECT_TRUE(PopValueFromReader(&reader, &objects));
+  EXPECT_TRUE(objects.empty());
+}
+
+TEST_F(ExportedObjectManagerTest, TransactionBatchesSignals) {
+  const dbus::ObjectPath kOtherPath(std::string("/test/other_path"));
+  const std::string kOtherInterface("other.interface");
+  std::vector<std::string> members;
+  std::map<dbus::ObjectPath, std::set<std::string>> added;
+  auto on_signal = [&members, &added](dbus::Signal* signal) {
+    members.push_back(signal->GetMember());
+    if (signal->GetMember() != dbus::kObjectManagerInterfacesAdded)
+      return;
+    dbus::MessageReader reader(signal);
+    dbus::ObjectPath path;
+    std::map<std::string, VariantDictionary> interfaces;
+    EXPECT_TRUE(PopValueFromReader(&reader, &path));
+    EXPECT_TRUE(PopValueFromReader(&reader, &interfaces));
+    for (const auto& pair : interfaces)
+      added[path].insert(pair.first);
+  };
+  EXPECT_CALL(*mock_exported_object_, SendSignal(_))
+      .WillRepeatedly(Invoke(on_signal));
+
+  om_->ClaimInterface(kOtherPath, kOtherInterface, property_writer_);
+  members.clear();
+  added.clear();
+
+  om_->BeginTransaction();
+  om_->BeginTransaction();
+  om_->ClaimInterface(kClaimedTestPath, kClaimedInterface, property_writer_);
+  om_->ClaimInterface(kClaimedTestPath, kOtherInterface, property_writer_);
+  om_->ClaimInterface(kOtherPath, kClaimedInterface, property_writer_);
+  om_->ReleaseInterface(kOtherPath, kClaimedInterface);
+  om_->ReleaseInterface(kOtherPath, kOtherInterface);
+  om_->CommitTransaction();
+  EXPECT_TRUE(members.empty());
+  // The claimed interfaces are reported before the signals are sent.
+  auto response = CallHandleGetManagedObjects();
+  ExportedObjectManager::ObjectMap objects;
+  dbus::MessageReader reader(response.get());
+  EXPECT_TRUE(PopValueFromReader(&reader, &objects));
+  EXPECT_EQ(2u, objects[kClaimedTestPath].size());
+  om_->CommitTransaction();
+
+  // The interface claimed and released within the transaction is not
+  // signaled.
+  std::vector<std::string> expected_members{
+      dbus::kObjectManagerInterfacesRemoved,
+      dbus::kObjectManagerInterfacesAdded};
+  EXPECT_EQ(expected_members, members);
+  std::map<dbus::ObjectPath, std::set<std::string>> expected_added{
+      {kClaimedTestPath, {kClaimedInterface, kOtherInterface}}};
+  EXPECT_EQ(expected_added, added);
+}
+
+// Times claiming 4 interfaces on each of 500 objects, as a daemon does at
+// startup, one by one and within a transaction, and counts the signals sent.
+// Run with --gtest_also_run_disabled_tests.
+TEST_F(ExportedObjectManagerTest, DISABLED_ClaimInterfacesBenchmark) {
+  const int kObjectCount = 500;
+  const int kInterfaceCount = 4;
+  int signal_count = 0;
+  auto on_signal = [&signal_count](dbus::Signal* /* signal */) {
+    signal_count++;
+  };
+  EXPECT_CALL(*mock_exported_object_, SendSignal(_))
+      .WillRepeatedly(Invoke(on_signal));
+  auto claim_all = [this]() {
+    for (int i = 0; i < kObjectCount; i++) {
+      dbus::ObjectPath path{base::StringPrintf("/test/object%d", i)};
+      for (int j = 0; j < kInterfaceCount; j++) {
+        om_->ClaimInterface(path, base::StringPrintf("test.Interface%d", j),
+                            property_writer_);
+      }
+    }
+  };
+  auto release_all = [this]() {
+    for (int i = 0; i < kObjectCount; i++) {
+      dbus::ObjectPath path{base::StringPrintf("/test/object%d", i)};
+      for (int j = 0; j < kInterfaceCount; j++)
+        om_->ReleaseInterface(path, base::StringPrintf("test.Interface%d", j));
+    }
+  };
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  claim_all();
+  base::TimeDelta separate_time = base::TimeTicks::Now() - start;
+  int separate_signals = signal_count;
+  EXPECT_EQ(kObjectCount * kInterfaceCount, separate_signals);
+  release_all();
+
+  signal_count = 0;
+  start = base::TimeTicks::Now();
+  om_->BeginTransaction();
+  claim_all();
+  om_->CommitTransaction();
+  base::TimeDelta transaction_time = base::TimeTicks::Now() - start;
+  EXPECT_EQ(kObjectCount, signal_count);
+
+  LOG(INFO) << kObjectCount << " objects with " << kInterfaceCount
+            << " interfaces: one by one " << separate_time.InMilliseconds()
+            << " ms (" << separate_signals << " signals), in a transaction "
+            << transaction_time.InMilliseconds() << " ms (" << signal_count
+            << " signals)";
+}
+
 }  // namespace dbus_utils
 
 }  // namespace brillo
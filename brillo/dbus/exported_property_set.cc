@@ -9,7 +9,9 @@
 #include <dbus/property.h>  // For kPropertyInterface
 
 #include <brillo/dbus/async_event_sequencer.h>
+#include <brillo/dbus/dbus_method_invoker.h>
 #include <brillo/dbus/dbus_object.h>
+#include <brillo/dbus/utils.h>
 #include <brillo/errors/error_codes.h>
 
 using brillo::dbus_utils::AsyncEventSequencer;
@@ -44,6 +46,7 @@ void ExportedPropertySet::RegisterProperty(
   auto& prop_map = properties_[interface_name];
   auto res = prop_map.insert(std::make_pair(property_name, exported_property));
   CHECK(res.second) << "Property '" << property_name << "' already exists";
+  InvalidateCachedReplies(interface_name);
   // Technically, the property set exists longer than the properties themselves,
   // so we could use Unretained here rather than a weak pointer.
   ExportedPropertyBase::OnUpdateCallback cb =
@@ -60,6 +63,35 @@ VariantDictionary ExportedPropertySet::HandleGetAll(
   return GetInterfaceProperties(interface_name);
 }
 
+void ExportedPropertySet::HandleGetAllRequest(
+    dbus::MethodCall* method_call,
+    dbus::ExportedObject::ResponseSender sender) {
+  bus_->AssertOnOriginThread();
+  dbus::MessageReader reader(method_call);
+  std::string interface_name;
+  ErrorPtr error;
+  if (!ExtractMessageParameters(&reader, &error, &interface_name)) {
+    sender.Run(GetDBusError(method_call, error.get()));
+    return;
+  }
+  // Don't cache the (empty) replies for unknown interfaces, the callers
+  // control their names.
+  if (properties_.find(interface_name) == properties_.end()) {
+    auto response = dbus::Response::FromMethodCall(method_call);
+    dbus::MessageWriter writer(response.get());
+    AppendValueToWriter(&writer, VariantDictionary{});
+    sender.Run(std::move(response));
+    return;
+  }
+  std::unique_ptr<dbus::Response>& reply = get_all_replies_[interface_name];
+  if (!reply) {
+    reply = dbus::Response::CreateEmpty();
+    dbus::MessageWriter writer(reply.get());
+    AppendValueToWriter(&writer, GetInterfaceProperties(interface_name));
+  }
+  sender.Run(CopyCachedResponse(reply.get(), method_call));
+}
+
 VariantDictionary ExportedPropertySet::GetInterfaceProperties(
     const std::string& interface_name) const {
   VariantDictionary properties;
@@ -122,7 +154,22 @@ bool ExportedPropertySet::HandleSet(brillo::ErrorPtr* error,
     return false;
   }
 
-  return property_itr->second->SetValue(error, value);
+  if (!property_itr->second->SetValue(error, value))
+    return false;
+  InvalidateCachedReplies(interface_name);
+  return true;
+}
+
+void ExportedPropertySet::SetPropertyChangedCallback(
+    const base::Closure& callback) {
+  property_changed_callback_ = callback;
+}
+
+void ExportedPropertySet::InvalidateCachedReplies(
+    const std::string& interface_name) {
+  get_all_replies_.erase(interface_name);
+  if (!property_changed_callback_.is_null())
+    property_changed_callback_.Run();
 }
 
 void ExportedPropertySet::HandlePropertyUpdated(
@@ -130,12 +177,35 @@ void ExportedPropertySet::HandlePropertyUpdated(
     const std::string& property_name,
     const ExportedPropertyBase* exported_property) {
   bus_->AssertOnOriginThread();
+  InvalidateCachedReplies(interface_name);
   // Send signal only if the object has been exported successfully.
   // This could happen when a property value is changed (which triggers
   // the notification) before D-Bus interface is completely exported/claimed.
   auto signal = signal_properties_changed_.lock();
   if (!signal)
     return;
+  if (coalesce_signals_) {
+    PendingChange* change = nullptr;
+    for (PendingChange& pending : pending_changes_) {
+      if (pending.interface_name == interface_name) {
+        change = &pending;
+        break;
+      }
+    }
+    if (!change) {
+      pending_changes_.push_back(PendingChange{interface_name, {}});
+      change = &pending_changes_.back();
+    }
+    change->property_names.insert(property_name);
+    if (flush_task_id_ == MessageLoop::kTaskIdNull) {
+      flush_task_id_ = MessageLoop::current()->PostDelayedTask(
+          FROM_HERE,
+          base::Bind(&ExportedPropertySet::FlushPropertiesChanged,
+                     weak_ptr_factory_.GetWeakPtr()),
+          coalesce_delay_);
+    }
+    return;
+  }
   VariantDictionary changed_properties{
       {property_name, exported_property->GetValue()}};
   // The interface specification tells us to include this list of properties
@@ -145,6 +215,37 @@ void ExportedPropertySet::HandlePropertyUpdated(
   signal->Send(interface_name, changed_properties, invalidated_properties);
 }
 
+void ExportedPropertySet::SetSignalCoalescing(bool enabled,
+                                              base::TimeDelta delay) {
+  coalesce_signals_ = enabled;
+  coalesce_delay_ = delay;
+  if (!enabled)
+    FlushPropertiesChanged();
+}
+
+void ExportedPropertySet::FlushPropertiesChanged() {
+  bus_->AssertOnOriginThread();
+  if (flush_task_id_ != MessageLoop::kTaskIdNull) {
+    // This is a no-op when called from the flush task itself.
+    MessageLoop::current()->CancelTask(flush_task_id_);
+    flush_task_id_ = MessageLoop::kTaskIdNull;
+  }
+  std::vector<PendingChange> pending_changes;
+  pending_changes.swap(pending_changes_);
+  auto signal = signal_properties_changed_.lock();
+  if (!signal)
+    return;
+  for (const PendingChange& change : pending_changes) {
+    const auto& property_map = properties_[change.interface_name];
+    VariantDictionary changed_properties;
+    for (const std::string& property_name : change.property_names) {
+      changed_properties.emplace(property_name,
+                                 property_map.at(property_name)->GetValue());
+    }
+    signal->Send(change.interface_name, changed_properties, {});
+  }
+}
+
 void ExportedPropertyBase::NotifyPropertyChanged() {
   // These is a brief period after the construction of an ExportedProperty
   // when this callback is not initialized because the property has not
@@ -8,15 +8,20 @@
 #include <stdint.h>
 
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
+#include <base/callback.h>
 #include <base/memory/weak_ptr.h>
+#include <base/time/time.h>
 #include <brillo/any.h>
 #include <brillo/brillo_export.h>
 #include <brillo/dbus/dbus_signal.h>
 #include <brillo/errors/error.h>
 #include <brillo/errors/error_codes.h>
+#include <brillo/message_loops/message_loop.h>
 #include <brillo/variant_dictionary.h>
 #include <dbus/exported_object.h>
 #include <dbus/message.h>
@@ -130,12 +135,41 @@ class BRILLO_EXPORT ExportedPropertySet {
   VariantDictionary GetInterfaceProperties(
       const std::string& interface_name) const;
 
+  // By default, a PropertiesChanged signal is sent for every property change.
+  // With coalescing enabled, the changes are accumulated and sent |delay|
+  // after the first one (at the next message loop iteration for a zero
+  // delay), in one signal per interface carrying the latest values. The
+  // signals of different interfaces are sent in the order of their first
+  // change. Disabling the coalescing sends the pending signals.
+  void SetSignalCoalescing(bool enabled,
+                           base::TimeDelta delay = base::TimeDelta());
+  // Sends the pending coalesced PropertiesChanged signals right away.
+  void FlushPropertiesChanged();
+
+  // Sets a callback run when the value of a property may have changed. Used
+  // by ExportedObjectManager to drop its cached GetManagedObjects() reply.
+  void SetPropertyChangedCallback(const base::Closure& callback);
+
  private:
+  // The properties of an interface changed since the last coalesced signal.
+  struct PendingChange {
+    std::string interface_name;
+    std::set<std::string> property_names;
+  };
+
   // Used to write the dictionary of string->variant to a message.
   // This dictionary represents the property name/value pairs for the
   // given interface.
   BRILLO_PRIVATE void WritePropertiesToDict(const std::string& interface_name,
                                             VariantDictionary* dict);
+  // Properties.GetAll handler. The reply for each interface is cached and
+  // only marshalled again after a property of the interface changes.
+  BRILLO_PRIVATE void HandleGetAllRequest(
+      dbus::MethodCall* method_call,
+      dbus::ExportedObject::ResponseSender sender);
+  // Drops the cached replies after a property of |interface_name| changed.
+  BRILLO_PRIVATE void InvalidateCachedReplies(
+      const std::string& interface_name);
   BRILLO_PRIVATE void HandlePropertyUpdated(
       const std::string& interface_name,
       const std::string& property_name,
@@ -145,6 +179,9 @@ class BRILLO_EXPORT ExportedPropertySet {
   // This is a map from interface name -> property name -> pointer to property.
   std::map<std::string, std::map<std::string, ExportedPropertyBase*>>
       properties_;
+  // The cached replies to Properties.GetAll, by interface name.
+  std::map<std::string, std::unique_ptr<dbus::Response>> get_all_replies_;
+  base::Closure property_changed_callback_;
 
   // D-Bus callbacks may last longer the property set exporting those methods.
   base::WeakPtrFactory<ExportedPropertySet> weak_ptr_factory_;
@@ -154,6 +191,11 @@ class BRILLO_EXPORT ExportedPropertySet {
 
   std::weak_ptr<SignalPropertiesChanged> signal_properties_changed_;
 
+  bool coalesce_signals_{false};
+  base::TimeDelta coalesce_delay_;
+  std::vector<PendingChange> pending_changes_;
+  MessageLoop::TaskId flush_task_id_{MessageLoop::kTaskIdNull};
+
   friend class DBusObject;
   friend class ExportedPropertySetTest;
   DISALLOW_COPY_AND_ASSIGN(ExportedPropertySet);
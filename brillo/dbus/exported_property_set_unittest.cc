@@ -8,10 +8,14 @@
 #include <vector>
 
 #include <base/bind.h>
+#include <base/logging.h>
 #include <base/macros.h>
+#include <base/test/simple_test_clock.h>
+#include <base/time/time.h>
 #include <brillo/dbus/dbus_object.h>
 #include <brillo/dbus/dbus_object_test_helpers.h>
 #include <brillo/errors/error_codes.h>
+#include <brillo/message_loops/fake_message_loop.h>
 #include <dbus/message.h>
 #include <dbus/property.h>
 #include <dbus/object_path.h>
@@ -148,6 +152,25 @@ class ExportedPropertySetTest : public ::testing::Test {
     return testing::CallMethod(p_->dbus_object_, &method_call);
   }
 
+  // Calls Properties.GetAll and returns the properties of |interface_name|.
+  VariantDictionary GetAllOnInterface(const std::string& interface_name,
+                                      uint32_t serial) {
+    dbus::MethodCall method_call(dbus::kPropertiesInterface,
+                                 dbus::kPropertiesGetAll);
+    method_call.SetSerial(serial);
+    dbus::MessageWriter writer(&method_call);
+    writer.AppendString(interface_name);
+    auto response = testing::CallMethod(p_->dbus_object_, &method_call);
+    EXPECT_EQ(dbus::Message::MESSAGE_METHOD_RETURN,
+              response->GetMessageType());
+    EXPECT_EQ(serial, response->GetReplySerial());
+    VariantDictionary properties;
+    dbus::MessageReader reader(response.get());
+    EXPECT_TRUE(PopValueFromReader(&reader, &properties));
+    EXPECT_FALSE(reader.HasMoreData());
+    return properties;
+  }
+
   std::unique_ptr<dbus::Response> SetPropertyOnInterface(
       const std::string& interface_name,
       const std::string& property_name,
@@ -285,6 +308,31 @@ TEST_F(ExportedPropertySetTest, GetAllCorrectness) {
   ASSERT_FALSE(response_reader.HasMoreData());
 }
 
+TEST_F(ExportedPropertySetTest, GetAllCachedReply) {
+  VariantDictionary properties = GetAllOnInterface(kTestInterface1, 1);
+  EXPECT_EQ(3u, properties.size());
+  EXPECT_FALSE(properties[kBoolPropName].Get<bool>());
+  // The cached reply is addressed to each call.
+  properties = GetAllOnInterface(kTestInterface1, 2);
+  EXPECT_EQ(3u, properties.size());
+
+  // Local updates invalidate the cached reply of the interface.
+  EXPECT_CALL(*mock_exported_object_, SendSignal(_)).Times(2);
+  p_->bool_prop_.SetValue(true);
+  properties = GetAllOnInterface(kTestInterface1, 3);
+  EXPECT_TRUE(properties[kBoolPropName].Get<bool>());
+
+  // So do remote ones.
+  p_->uint16_prop_.SetAccessMode(ExportedPropertyBase::Access::kReadWrite);
+  EXPECT_EQ(0, GetAllOnInterface(kTestInterface2, 4)[kUint16PropName]
+                   .Get<uint16_t>());
+  auto response = SetPropertyOnInterface(kTestInterface2, kUint16PropName,
+                                         brillo::Any(uint16_t{42}));
+  ASSERT_NE(dbus::Message::MESSAGE_ERROR, response->GetMessageType());
+  EXPECT_EQ(42, GetAllOnInterface(kTestInterface2, 5)[kUint16PropName]
+                    .Get<uint16_t>());
+}
+
 TEST_F(ExportedPropertySetTest, GetNoArgs) {
   dbus::MethodCall method_call(dbus::kPropertiesInterface,
                                dbus::kPropertiesGet);
@@ -587,6 +635,155 @@ TEST_F(ExportedPropertySetTest, SignalsAreParsable) {
   p_->uint8_prop_.SetValue(57);
 }
 
+class ExportedPropertySetCoalescingTest : public ExportedPropertySetTest {
+ public:
+  void SetUp() override {
+    ExportedPropertySetTest::SetUp();
+    clock_.SetNow(base::Time::Now());
+    loop_.SetAsCurrent();
+    EXPECT_CALL(*mock_exported_object_, SendSignal(_))
+        .WillRepeatedly(
+            Invoke(this, &ExportedPropertySetCoalescingTest::OnSignal));
+  }
+
+  ExportedPropertySet* property_set() {
+    return p_->dbus_object_.GetPropertySet();
+  }
+
+  void OnSignal(dbus::Signal* signal) {
+    dbus::MessageReader reader(signal);
+    std::string interface_name;
+    VariantDictionary changed_properties;
+    std::vector<std::string> invalidated_properties;
+    ASSERT_TRUE(PopValueFromReader(&reader, &interface_name));
+    ASSERT_TRUE(PopValueFromReader(&reader, &changed_properties));
+    ASSERT_TRUE(PopValueFromReader(&reader, &invalidated_properties));
+    signal_interfaces_.push_back(interface_name);
+    signal_properties_.push_back(changed_properties);
+    signal_times_.push_back(clock_.Now());
+  }
+
+ protected:
+  base::SimpleTestClock clock_;
+  FakeMessageLoop loop_{&clock_};
+  std::vector<std::string> signal_interfaces_;
+  std::vector<VariantDictionary> signal_properties_;
+  std::vector<base::Time> signal_times_;
+};
+
+TEST_F(ExportedPropertySetCoalescingTest, Disabled) {
+  p_->bool_prop_.SetValue(true);
+  p_->uint8_prop_.SetValue(1);
+  EXPECT_EQ(2u, signal_interfaces_.size());
+}
+
+TEST_F(ExportedPropertySetCoalescingTest, OneSignalPerInterface) {
+  property_set()->SetSignalCoalescing(true);
+  p_->string_prop_.SetValue(kTestString);
+  p_->bool_prop_.SetValue(true);
+  p_->uint8_prop_.SetValue(1);
+  p_->uint8_prop_.SetValue(57);
+  p_->int32_prop_.SetValue(1);
+  p_->double_prop_.SetValue(1.0);
+  EXPECT_TRUE(signal_interfaces_.empty());
+
+  loop_.Run();
+  // The interfaces are in the order of their first change.
+  EXPECT_EQ((std::vector<std::string>{kTestInterface3, kTestInterface1,
+                                      kTestInterface2}),
+            signal_interfaces_);
+  ASSERT_EQ(3u, signal_properties_.size());
+  EXPECT_EQ(2u, signal_properties_[0].size());
+  EXPECT_EQ(kTestString,
+            signal_properties_[0][kStringPropName].Get<std::string>());
+  EXPECT_EQ(1.0, signal_properties_[0][kDoublePropName].Get<double>());
+  // Only the latest value is sent.
+  EXPECT_EQ(2u, signal_properties_[1].size());
+  EXPECT_EQ(57, signal_properties_[1][kUint8PropName].Get<uint8_t>());
+  EXPECT_EQ(1u, signal_properties_[2].size());
+
+  // The next changes start a new batch.
+  p_->bool_prop_.SetValue(false);
+  loop_.Run();
+  EXPECT_EQ(4u, signal_interfaces_.size());
+}
+
+TEST_F(ExportedPropertySetCoalescingTest, Delay) {
+  property_set()->SetSignalCoalescing(true,
+                                      base::TimeDelta::FromMilliseconds(100));
+  base::Time start = clock_.Now();
+  p_->bool_prop_.SetValue(true);
+  clock_.Advance(base::TimeDelta::FromMilliseconds(60));
+  // Changes within the window don't postpone the signal.
+  p_->uint8_prop_.SetValue(1);
+  loop_.Run();
+  ASSERT_EQ(1u, signal_times_.size());
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(100), signal_times_[0] - start);
+  EXPECT_EQ(2u, signal_properties_[0].size());
+}
+
+TEST_F(ExportedPropertySetCoalescingTest, Flush) {
+  property_set()->SetSignalCoalescing(true, base::TimeDelta::FromSeconds(1));
+  base::Time start = clock_.Now();
+  p_->bool_prop_.SetValue(true);
+  property_set()->FlushPropertiesChanged();
+  ASSERT_EQ(1u, signal_times_.size());
+  EXPECT_EQ(start, signal_times_[0]);
+  // Nothing left to send.
+  loop_.Run();
+  EXPECT_EQ(1u, signal_times_.size());
+  property_set()->FlushPropertiesChanged();
+  EXPECT_EQ(1u, signal_times_.size());
+
+  // Disabling the coalescing flushes the pending changes too.
+  p_->uint8_prop_.SetValue(1);
+  EXPECT_EQ(1u, signal_times_.size());
+  property_set()->SetSignalCoalescing(false);
+  EXPECT_EQ(2u, signal_times_.size());
+  p_->uint8_prop_.SetValue(2);
+  EXPECT_EQ(3u, signal_times_.size());
+}
+
+// Times Properties.GetAll served from the cached reply against GetAll right
+// after a property of the interface changed, which marshals the reply again.
+// Run with --gtest_also_run_disabled_tests.
+TEST_F(ExportedPropertySetTest, DISABLED_GetAllBenchmark) {
+  const int kIterations = 100000;
+  std::vector<std::string> strings;
+  for (int i = 0; i < 100; i++)
+    strings.push_back("string " + std::to_string(i));
+  p_->stringlist_prop_.SetValue(strings);
+  p_->uint8list_prop_.SetValue(std::vector<uint8_t>(4096, 0x55));
+  EXPECT_CALL(*mock_exported_object_, SendSignal(_)).Times(AnyNumber());
+
+  dbus::MethodCall method_call(dbus::kPropertiesInterface,
+                               dbus::kPropertiesGetAll);
+  method_call.SetSerial(123);
+  dbus::MessageWriter writer(&method_call);
+  writer.AppendString(kTestInterface3);
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (int i = 0; i < kIterations; i++) {
+    auto response = testing::CallMethod(p_->dbus_object_, &method_call);
+    ASSERT_EQ(dbus::Message::MESSAGE_METHOD_RETURN,
+              response->GetMessageType());
+  }
+  base::TimeDelta cached_time = base::TimeTicks::Now() - start;
+
+  start = base::TimeTicks::Now();
+  for (int i = 0; i < kIterations; i++) {
+    p_->int64_prop_.SetValue(i + 1);
+    auto response = testing::CallMethod(p_->dbus_object_, &method_call);
+    ASSERT_EQ(dbus::Message::MESSAGE_METHOD_RETURN,
+              response->GetMessageType());
+  }
+  base::TimeDelta rebuilt_time = base::TimeTicks::Now() - start;
+
+  LOG(INFO) << kIterations << " GetAll calls for 9 properties: cached "
+            << cached_time.InMilliseconds() << " ms, after a change "
+            << rebuilt_time.InMilliseconds() << " ms";
+}
+
 }  // namespace dbus_utils
 
 }  // namespace brillo
@@ -0,0 +1,323 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/dbus/property_cache.h>
+
+#include <base/bind.h>
+#include <base/bind_helpers.h>
+#include <base/logging.h>
+#include <brillo/dbus/dbus_method_invoker.h>
+#include <brillo/dbus/dbus_signal_handler.h>
+#include <dbus/object_manager.h>
+#include <dbus/property.h>
+
+namespace brillo {
+namespace dbus_utils {
+
+PropertyCache::PropertyCache(const scoped_refptr<dbus::Bus>& bus,
+                             const std::string& service_name)
+    : bus_(bus), service_name_(service_name) {}
+
+PropertyCache::~PropertyCache() = default;
+
+void PropertyCache::SetPropertyChangedCallback(
+    const PropertyChangedCallback& callback) {
+  property_changed_callback_ = callback;
+}
+
+void PropertyCache::WatchInterface(const dbus::ObjectPath& object_path,
+                                   const std::string& interface_name) {
+  bus_->AssertOnOriginThread();
+  bool added = watched_interfaces_[object_path].insert(interface_name).second;
+  auto connected = connected_objects_.find(object_path);
+  if (connected == connected_objects_.end()) {
+    // The interfaces are fetched once the signal is connected. This also
+    // retries a connection which failed, even if the interface is already
+    // watched.
+    ConnectPropertiesChanged(object_path);
+  } else if (added && connected->second) {
+    FetchAll(object_path, interface_name);
+  }
+}
+
+void PropertyCache::WatchObjectManager(
+    const dbus::ObjectPath& object_manager_path) {
+  bus_->AssertOnOriginThread();
+  dbus::ObjectProxy* proxy =
+      bus_->GetObjectProxy(service_name_, object_manager_path);
+  auto weak_this = weak_ptr_factory_.GetWeakPtr();
+  ConnectToSignal(proxy,
+                  dbus::kObjectManagerInterface,
+                  dbus::kObjectManagerInterfacesAdded,
+                  base::Bind(&PropertyCache::OnInterfacesAdded, weak_this),
+                  base::Bind(&PropertyCache::OnSignalConnected, weak_this));
+  ConnectToSignal(proxy,
+                  dbus::kObjectManagerInterface,
+                  dbus::kObjectManagerInterfacesRemoved,
+                  base::Bind(&PropertyCache::OnInterfacesRemoved, weak_this),
+                  base::Bind(&PropertyCache::OnSignalConnected, weak_this));
+  // The signals are subscribed to before the call is sent, as both go
+  // through the D-Bus task runner in order, so no change can be missed.
+  CallMethod(proxy,
+             dbus::kObjectManagerInterface,
+             dbus::kObjectManagerGetManagedObjects,
+             base::Bind(&PropertyCache::OnGetManagedObjects, weak_this),
+             base::Bind(&PropertyCache::OnError, weak_this,
+                        std::string{dbus::kObjectManagerGetManagedObjects}));
+}
+
+bool PropertyCache::HasInterface(const dbus::ObjectPath& object_path,
+                                 const std::string& interface_name) const {
+  return GetProperties(object_path, interface_name) != nullptr;
+}
+
+std::vector<dbus::ObjectPath> PropertyCache::GetObjectPaths() const {
+  std::vector<dbus::ObjectPath> object_paths;
+  object_paths.reserve(objects_.size());
+  for (const auto& pair : objects_)
+    object_paths.push_back(pair.first);
+  return object_paths;
+}
+
+const VariantDictionary* PropertyCache::GetProperties(
+    const dbus::ObjectPath& object_path,
+    const std::string& interface_name) const {
+  auto object = objects_.find(object_path);
+  if (object == objects_.end())
+    return nullptr;
+  auto interface = object->second.find(interface_name);
+  if (interface == object->second.end())
+    return nullptr;
+  return &interface->second;
+}
+
+const Any* PropertyCache::GetProperty(const dbus::ObjectPath& object_path,
+                                      const std::string& interface_name,
+                                      const std::string& property_name) const {
+  const VariantDictionary* properties =
+      GetProperties(object_path, interface_name);
+  if (!properties)
+    return nullptr;
+  auto property = properties->find(property_name);
+  return property == properties->end() ? nullptr : &property->second;
+}
+
+void PropertyCache::ConnectPropertiesChanged(
+    const dbus::ObjectPath& object_path) {
+  if (!connected_objects_.insert(std::make_pair(object_path, false)).second)
+    return;
+  auto weak_this = weak_ptr_factory_.GetWeakPtr();
+  ConnectToSignal(
+      bus_->GetObjectProxy(service_name_, object_path),
+      dbus::kPropertiesInterface,
+      dbus::kPropertiesChanged,
+      base::Bind(&PropertyCache::OnPropertiesChanged, weak_this, object_path),
+      base::Bind(&PropertyCache::OnPropertiesChangedConnected, weak_this,
+                 object_path));
+}
+
+void PropertyCache::OnPropertiesChangedConnected(
+    const dbus::ObjectPath& object_path,
+    const std::string& interface_name,
+    const std::string& signal_name,
+    bool success) {
+  OnSignalConnected(interface_name, signal_name, success);
+  auto connected = connected_objects_.find(object_path);
+  // The object may have been released in the meantime.
+  if (connected == connected_objects_.end())
+    return;
+  if (!success) {
+    // The connection is attempted again the next time the object is watched
+    // or added.
+    connected_objects_.erase(connected);
+    return;
+  }
+  connected->second = true;
+  // Fetch the properties of the object now that no change can be missed.
+  // The interfaces already cached were reported by the object manager before
+  // the signal was connected, and may have changed since.
+  std::set<std::string> interfaces;
+  auto watched = watched_interfaces_.find(object_path);
+  if (watched != watched_interfaces_.end())
+    interfaces = watched->second;
+  auto object = objects_.find(object_path);
+  if (object != objects_.end()) {
+    for (const auto& pair : object->second)
+      interfaces.insert(pair.first);
+  }
+  for (const std::string& interface : interfaces)
+    FetchAll(object_path, interface);
+}
+
+void PropertyCache::ReleaseObject(const dbus::ObjectPath& object_path) {
+  // The explicitly watched objects are kept, they might come back.
+  if (watched_interfaces_.count(object_path) ||
+      connected_objects_.erase(object_path) == 0) {
+    return;
+  }
+  bus_->RemoveObjectProxy(service_name_, object_path,
+                          base::Bind(&base::DoNothing));
+}
+
+void PropertyCache::FetchAll(const dbus::ObjectPath& object_path,
+                             const std::string& interface_name) {
+  auto weak_this = weak_ptr_factory_.GetWeakPtr();
+  CallMethod(bus_->GetObjectProxy(service_name_, object_path),
+             dbus::kPropertiesInterface,
+             dbus::kPropertiesGetAll,
+             base::Bind(&PropertyCache::OnGetAll, weak_this, object_path,
+                        interface_name),
+             base::Bind(&PropertyCache::OnError, weak_this,
+                        std::string{dbus::kPropertiesGetAll}),
+             interface_name);
+}
+
+void PropertyCache::OnPropertiesChanged(
+    const dbus::ObjectPath& object_path,
+    const std::string& interface_name,
+    const VariantDictionary& changed_properties,
+    const std::vector<std::string>& invalidated) {
+  // The signals received before an interface is primed are ignored, the
+  // pending GetAll reply was sent after them.
+  auto object = objects_.find(object_path);
+  if (object == objects_.end())
+    return;
+  auto interface = object->second.find(interface_name);
+  if (interface == object->second.end())
+    return;
+  VariantDictionary& properties = interface->second;
+  for (const auto& pair : changed_properties)
+    properties[pair.first] = pair.second;
+  for (const std::string& property_name : invalidated)
+    properties.erase(property_name);
+
+  for (const auto& pair : changed_properties)
+    NotifyPropertyChanged(object_path, interface_name, pair.first);
+  auto weak_this = weak_ptr_factory_.GetWeakPtr();
+  for (const std::string& property_name : invalidated) {
+    NotifyPropertyChanged(object_path, interface_name, property_name);
+    CallMethod(bus_->GetObjectProxy(service_name_, object_path),
+               dbus::kPropertiesInterface,
+               dbus::kPropertiesGet,
+               base::Bind(&PropertyCache::OnGet, weak_this, object_path,
+                          interface_name, property_name),
+               base::Bind(&PropertyCache::OnError, weak_this,
+                          std::string{dbus::kPropertiesGet}),
+               interface_name, property_name);
+  }
+}
+
+void PropertyCache::OnInterfacesAdded(const dbus::ObjectPath& object_path,
+                                      const InterfaceMap& interfaces) {
+  for (const auto& pair : interfaces)
+    UpdateInterface(object_path, pair.first, pair.second);
+  ConnectPropertiesChanged(object_path);
+}
+
+void PropertyCache::OnInterfacesRemoved(
+    const dbus::ObjectPath& object_path,
+    const std::vector<std::string>& interfaces) {
+  auto object = objects_.find(object_path);
+  if (object == objects_.end())
+    return;
+  std::map<std::string, std::vector<std::string>> removed_properties;
+  for (const std::string& interface_name : interfaces) {
+    auto interface = object->second.find(interface_name);
+    if (interface == object->second.end())
+      continue;
+    std::vector<std::string>& names = removed_properties[interface_name];
+    for (const auto& pair : interface->second)
+      names.push_back(pair.first);
+    object->second.erase(interface);
+  }
+  if (object->second.empty()) {
+    objects_.erase(object);
+    ReleaseObject(object_path);
+  }
+
+  for (const auto& pair : removed_properties) {
+    for (const std::string& property_name : pair.second)
+      NotifyPropertyChanged(object_path, pair.first, property_name);
+  }
+}
+
+void PropertyCache::OnGetManagedObjects(
+    const std::map<dbus::ObjectPath, InterfaceMap>& objects) {
+  for (const auto& pair : objects)
+    OnInterfacesAdded(pair.first, pair.second);
+}
+
+void PropertyCache::OnGetAll(const dbus::ObjectPath& object_path,
+                             const std::string& interface_name,
+                             const VariantDictionary& properties) {
+  // Don't bring back an interface removed while the call was pending.
+  auto watched = watched_interfaces_.find(object_path);
+  if ((watched == watched_interfaces_.end() ||
+       watched->second.count(interface_name) == 0) &&
+      !HasInterface(object_path, interface_name)) {
+    return;
+  }
+  UpdateInterface(object_path, interface_name, properties);
+}
+
+void PropertyCache::OnGet(const dbus::ObjectPath& object_path,
+                          const std::string& interface_name,
+                          const std::string& property_name,
+                          const Any& value) {
+  auto object = objects_.find(object_path);
+  if (object == objects_.end())
+    return;
+  auto interface = object->second.find(interface_name);
+  if (interface == object->second.end())
+    return;
+  interface->second[property_name] = value;
+  NotifyPropertyChanged(object_path, interface_name, property_name);
+}
+
+void PropertyCache::OnSignalConnected(const std::string& interface_name,
+                                      const std::string& signal_name,
+                                      bool success) {
+  LOG_IF(ERROR, !success) << "Failed to connect to the signal "
+                          << interface_name << "." << signal_name << " of "
+                          << service_name_;
+}
+
+void PropertyCache::OnError(const std::string& method_name, Error* error) {
+  LOG(ERROR) << "Failed to call " << method_name << " on " << service_name_
+             << ": " << error->GetMessage();
+}
+
+void PropertyCache::UpdateInterface(const dbus::ObjectPath& object_path,
+                                    const std::string& interface_name,
+                                    const VariantDictionary& properties) {
+  VariantDictionary old_properties;
+  VariantDictionary& cached_properties = objects_[object_path][interface_name];
+  old_properties.swap(cached_properties);
+  cached_properties = properties;
+
+  std::vector<std::string> changed;
+  for (const auto& pair : properties) {
+    auto old_property = old_properties.find(pair.first);
+    if (old_property == old_properties.end() ||
+        old_property->second != pair.second) {
+      changed.push_back(pair.first);
+    }
+  }
+  for (const auto& pair : old_properties) {
+    if (properties.count(pair.first) == 0)
+      changed.push_back(pair.first);
+  }
+  for (const std::string& property_name : changed)
+    NotifyPropertyChanged(object_path, interface_name, property_name);
+}
+
+void PropertyCache::NotifyPropertyChanged(const dbus::ObjectPath& object_path,
+                                          const std::string& interface_name,
+                                          const std::string& property_name) {
+  if (!property_changed_callback_.is_null())
+    property_changed_callback_.Run(object_path, interface_name, property_name);
+}
+
+}  // namespace dbus_utils
+}  // namespace brillo
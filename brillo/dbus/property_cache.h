@@ -0,0 +1,170 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_DBUS_PROPERTY_CACHE_H_
+#define LIBBRILLO_BRILLO_DBUS_PROPERTY_CACHE_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/memory/ref_counted.h>
+#include <base/memory/weak_ptr.h>
+#include <brillo/any.h>
+#include <brillo/brillo_export.h>
+#include <brillo/errors/error.h>
+#include <brillo/variant_dictionary.h>
+#include <dbus/bus.h>
+#include <dbus/object_path.h>
+#include <dbus/object_proxy.h>
+
+namespace brillo {
+namespace dbus_utils {
+
+// PropertyCache keeps a local copy of the D-Bus properties of the objects of
+// a remote service, so that reading a property does not take a round trip to
+// the service like calling org.freedesktop.DBus.Properties.Get does:
+//
+//   PropertyCache cache{bus, "org.chromium.Service"};
+//   cache.SetPropertyChangedCallback(base::Bind(&OnPropertyChanged));
+//   cache.WatchObjectManager(dbus::ObjectPath{"/org/chromium/Service"});
+//   ...
+//   std::string state;
+//   if (cache.GetProperty(path, "org.chromium.Device", "State", &state))
+//     ...
+//
+// WatchInterface() caches the properties of one interface of an object, it
+// subscribes to the PropertiesChanged signal of the object and primes the
+// cache with Properties.GetAll. WatchObjectManager() caches all the objects
+// of an ObjectManager, it subscribes to the InterfacesAdded and
+// InterfacesRemoved signals, primes the cache with GetManagedObjects and
+// subscribes to the PropertiesChanged signal of each object.
+//
+// The cache is updated from the values carried by the PropertiesChanged
+// signals, which is how ExportedPropertySet reports its changes. The
+// properties listed as invalidated by a signal are dropped from the cache and
+// fetched again with Properties.Get. The reads fail until the value of a
+// property is known.
+//
+// PropertyCache must be used on the origin thread of the bus.
+class BRILLO_EXPORT PropertyCache final {
+ public:
+  // Called when the cached value of a property changes, including when the
+  // property is invalidated or its interface is removed from the object.
+  using PropertyChangedCallback =
+      base::Callback<void(const dbus::ObjectPath& object_path,
+                          const std::string& interface_name,
+                          const std::string& property_name)>;
+
+  PropertyCache(const scoped_refptr<dbus::Bus>& bus,
+                const std::string& service_name);
+  ~PropertyCache();
+
+  void SetPropertyChangedCallback(const PropertyChangedCallback& callback);
+
+  // Starts caching the properties of |interface_name| on |object_path|.
+  void WatchInterface(const dbus::ObjectPath& object_path,
+                      const std::string& interface_name);
+  // Starts caching the properties of all the objects, and all their
+  // interfaces, managed by the ObjectManager at |object_manager_path|.
+  void WatchObjectManager(const dbus::ObjectPath& object_manager_path);
+
+  // Returns true if the properties of the interface are cached.
+  bool HasInterface(const dbus::ObjectPath& object_path,
+                    const std::string& interface_name) const;
+  // Returns the paths of the objects with cached interfaces.
+  std::vector<dbus::ObjectPath> GetObjectPaths() const;
+  // Returns the cached properties of the interface, or nullptr.
+  const VariantDictionary* GetProperties(
+      const dbus::ObjectPath& object_path,
+      const std::string& interface_name) const;
+  // Returns the cached value of the property, or nullptr if it is unknown.
+  const Any* GetProperty(const dbus::ObjectPath& object_path,
+                         const std::string& interface_name,
+                         const std::string& property_name) const;
+
+  // Reads the cached value of the property into |value|. Returns false if the
+  // value is unknown or is not of type T.
+  template<typename T>
+  bool GetProperty(const dbus::ObjectPath& object_path,
+                   const std::string& interface_name,
+                   const std::string& property_name,
+                   T* value) const {
+    const Any* property =
+        GetProperty(object_path, interface_name, property_name);
+    if (!property || !property->IsTypeCompatible<T>())
+      return false;
+    *value = property->Get<T>();
+    return true;
+  }
+
+ private:
+  using InterfaceMap = std::map<std::string, VariantDictionary>;
+
+  // Subscribes to the PropertiesChanged signal of |object_path|, unless
+  // already done.
+  void ConnectPropertiesChanged(const dbus::ObjectPath& object_path);
+  void OnPropertiesChangedConnected(const dbus::ObjectPath& object_path,
+                                    const std::string& interface_name,
+                                    const std::string& signal_name,
+                                    bool success);
+  // Unsubscribes from the signals of an object which is gone and releases its
+  // proxy, unless the object is watched with WatchInterface().
+  void ReleaseObject(const dbus::ObjectPath& object_path);
+  void FetchAll(const dbus::ObjectPath& object_path,
+                const std::string& interface_name);
+
+  void OnPropertiesChanged(const dbus::ObjectPath& object_path,
+                           const std::string& interface_name,
+                           const VariantDictionary& changed_properties,
+                           const std::vector<std::string>& invalidated);
+  void OnInterfacesAdded(const dbus::ObjectPath& object_path,
+                         const InterfaceMap& interfaces);
+  void OnInterfacesRemoved(const dbus::ObjectPath& object_path,
+                           const std::vector<std::string>& interfaces);
+  void OnGetManagedObjects(
+      const std::map<dbus::ObjectPath, InterfaceMap>& objects);
+  void OnGetAll(const dbus::ObjectPath& object_path,
+                const std::string& interface_name,
+                const VariantDictionary& properties);
+  void OnGet(const dbus::ObjectPath& object_path,
+             const std::string& interface_name,
+             const std::string& property_name,
+             const Any& value);
+  void OnSignalConnected(const std::string& interface_name,
+                         const std::string& signal_name,
+                         bool success);
+  void OnError(const std::string& method_name, Error* error);
+
+  // Replaces the cached properties of the interface with |properties|.
+  void UpdateInterface(const dbus::ObjectPath& object_path,
+                       const std::string& interface_name,
+                       const VariantDictionary& properties);
+  void NotifyPropertyChanged(const dbus::ObjectPath& object_path,
+                             const std::string& interface_name,
+                             const std::string& property_name);
+
+  scoped_refptr<dbus::Bus> bus_;
+  std::string service_name_;
+  PropertyChangedCallback property_changed_callback_;
+
+  // The cached properties of each object.
+  std::map<dbus::ObjectPath, InterfaceMap> objects_;
+  // The interfaces passed to WatchInterface().
+  std::map<dbus::ObjectPath, std::set<std::string>> watched_interfaces_;
+  // The objects whose PropertiesChanged signal is subscribed to, mapped to
+  // whether the subscription completed.
+  std::map<dbus::ObjectPath, bool> connected_objects_;
+
+  base::WeakPtrFactory<PropertyCache> weak_ptr_factory_{this};
+  DISALLOW_COPY_AND_ASSIGN(PropertyCache);
+};
+
+}  // namespace dbus_utils
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_DBUS_PROPERTY_CACHE_H_
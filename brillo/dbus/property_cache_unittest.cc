@@ -0,0 +1,349 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/dbus/property_cache.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/bind.h>
+#include <brillo/dbus/data_serialization.h>
+#include <brillo/dbus/dbus_param_writer.h>
+#include <dbus/mock_bus.h>
+#include <dbus/mock_object_proxy.h>
+#include <dbus/object_manager.h>
+#include <dbus/property.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using testing::AnyNumber;
+using testing::Invoke;
+using testing::Return;
+using testing::_;
+
+namespace brillo {
+namespace dbus_utils {
+
+namespace {
+
+const char kServiceName[] = "org.test.Service";
+const char kInterface[] = "org.test.Interface";
+const char kOtherInterface[] = "org.test.OtherInterface";
+const char kNameProperty[] = "Name";
+const char kCountProperty[] = "Count";
+
+const dbus::ObjectPath kManagerPath{std::string{"/org/test"}};
+const dbus::ObjectPath kObjectPath1{std::string{"/org/test/object1"}};
+const dbus::ObjectPath kObjectPath2{std::string{"/org/test/object2"}};
+
+using InterfaceMap = std::map<std::string, VariantDictionary>;
+
+}  // anonymous namespace
+
+// Runs a fake service with the objects in |service_objects_|.
+class PropertyCacheTest : public testing::Test {
+ public:
+  void SetUp() override {
+    dbus::Bus::Options options;
+    options.bus_type = dbus::Bus::SYSTEM;
+    bus_ = new dbus::MockBus(options);
+    // By default, don't worry about threading assertions.
+    EXPECT_CALL(*bus_, AssertOnOriginThread()).Times(AnyNumber());
+    EXPECT_CALL(*bus_, AssertOnDBusThread()).Times(AnyNumber());
+    EXPECT_CALL(*bus_, GetObjectProxy(kServiceName, _))
+        .WillRepeatedly(Invoke(this, &PropertyCacheTest::GetObjectProxy));
+
+    service_objects_[kObjectPath1][kInterface] = {
+        {kNameProperty, std::string{"object1"}}, {kCountProperty, 1}};
+    service_objects_[kObjectPath2][kInterface] = {
+        {kNameProperty, std::string{"object2"}}, {kCountProperty, 2}};
+    service_objects_[kObjectPath2][kOtherInterface] = {};
+
+    cache_.reset(new PropertyCache{bus_, kServiceName});
+    cache_->SetPropertyChangedCallback(
+        base::Bind(&PropertyCacheTest::OnPropertyChanged,
+                   base::Unretained(this)));
+  }
+
+  void TearDown() override {
+    cache_.reset();
+    proxies_.clear();
+    bus_ = nullptr;
+  }
+
+  dbus::ObjectProxy* GetObjectProxy(const std::string& /* service_name */,
+                                    const dbus::ObjectPath& object_path) {
+    auto& proxy = proxies_[object_path];
+    if (!proxy) {
+      proxy = new dbus::MockObjectProxy(bus_.get(), kServiceName, object_path);
+      EXPECT_CALL(*proxy, ConnectToSignal(_, _, _, _))
+          .WillRepeatedly(Invoke(
+              [this, object_path](
+                  const std::string& interface_name,
+                  const std::string& signal_name,
+                  dbus::ObjectProxy::SignalCallback signal_callback,
+                  dbus::ObjectProxy::OnConnectedCallback on_connected) {
+                signal_callbacks_[object_path][signal_name] = signal_callback;
+                on_connected.Run(interface_name, signal_name,
+                                 connect_signals_);
+              }));
+      EXPECT_CALL(*proxy, CallMethodWithErrorCallback(_, _, _, _))
+          .WillRepeatedly(Invoke(
+              [this, object_path](
+                  dbus::MethodCall* method_call,
+                  int /* timeout_ms */,
+                  dbus::ObjectProxy::ResponseCallback callback,
+                  dbus::ObjectProxy::ErrorCallback /* error_callback */) {
+                auto response = HandleMethodCall(object_path, method_call);
+                callback.Run(response.get());
+              }));
+    }
+    return proxy.get();
+  }
+
+  std::unique_ptr<dbus::Response> HandleMethodCall(
+      const dbus::ObjectPath& object_path,
+      dbus::MethodCall* method_call) {
+    method_calls_.push_back(method_call->GetMember());
+    dbus::MessageReader reader(method_call);
+    auto response = dbus::Response::CreateEmpty();
+    dbus::MessageWriter writer(response.get());
+    std::string interface_name;
+    std::string property_name;
+    if (method_call->GetMember() == dbus::kObjectManagerGetManagedObjects) {
+      AppendValueToWriter(&writer, service_objects_);
+    } else if (method_call->GetMember() == dbus::kPropertiesGetAll) {
+      EXPECT_TRUE(PopValueFromReader(&reader, &interface_name));
+      AppendValueToWriter(&writer,
+                          service_objects_[object_path][interface_name]);
+    } else if (method_call->GetMember() == dbus::kPropertiesGet) {
+      EXPECT_TRUE(PopValueFromReader(&reader, &interface_name));
+      EXPECT_TRUE(PopValueFromReader(&reader, &property_name));
+      AppendValueToWriter(
+          &writer,
+          service_objects_[object_path][interface_name][property_name]);
+    } else {
+      ADD_FAILURE() << "Unexpected method call: " << method_call->ToString();
+    }
+    return response;
+  }
+
+  template<typename... Args>
+  void SendSignal(const dbus::ObjectPath& object_path,
+                  const std::string& interface_name,
+                  const std::string& signal_name,
+                  const Args&... args) {
+    dbus::Signal signal(interface_name, signal_name);
+    dbus::MessageWriter writer(&signal);
+    DBusParamWriter::Append(&writer, args...);
+    const auto& callback = signal_callbacks_[object_path][signal_name];
+    ASSERT_FALSE(callback.is_null());
+    callback.Run(&signal);
+  }
+
+  void OnPropertyChanged(const dbus::ObjectPath& object_path,
+                         const std::string& interface_name,
+                         const std::string& property_name) {
+    changes_.push_back(object_path.value() + " " + interface_name + "." +
+                       property_name);
+  }
+
+  scoped_refptr<dbus::MockBus> bus_;
+  std::map<dbus::ObjectPath, scoped_refptr<dbus::MockObjectProxy>> proxies_;
+  std::map<dbus::ObjectPath,
+           std::map<std::string, dbus::ObjectProxy::SignalCallback>>
+      signal_callbacks_;
+  std::map<dbus::ObjectPath, InterfaceMap> service_objects_;
+  std::vector<std::string> method_calls_;
+  std::vector<std::string> changes_;
+  std::unique_ptr<PropertyCache> cache_;
+  // Whether the signal connections succeed.
+  bool connect_signals_{true};
+};
+
+TEST_F(PropertyCacheTest, WatchInterface) {
+  EXPECT_FALSE(cache_->HasInterface(kObjectPath1, kInterface));
+  cache_->WatchInterface(kObjectPath1, kInterface);
+  EXPECT_TRUE(cache_->HasInterface(kObjectPath1, kInterface));
+  EXPECT_EQ(std::vector<std::string>{dbus::kPropertiesGetAll}, method_calls_);
+  EXPECT_EQ(2u, changes_.size());
+
+  std::string name;
+  int count = 0;
+  EXPECT_TRUE(
+      cache_->GetProperty(kObjectPath1, kInterface, kNameProperty, &name));
+  EXPECT_EQ("object1", name);
+  EXPECT_TRUE(
+      cache_->GetProperty(kObjectPath1, kInterface, kCountProperty, &count));
+  EXPECT_EQ(1, count);
+  // Wrong type.
+  EXPECT_FALSE(
+      cache_->GetProperty(kObjectPath1, kInterface, kCountProperty, &name));
+  EXPECT_EQ(nullptr, cache_->GetProperty(kObjectPath1, kInterface, "Unknown"));
+  EXPECT_FALSE(cache_->HasInterface(kObjectPath2, kInterface));
+
+  // The reads are served from the cache.
+  method_calls_.clear();
+  changes_.clear();
+  for (int i = 0; i < 10; i++) {
+    EXPECT_TRUE(
+        cache_->GetProperty(kObjectPath1, kInterface, kNameProperty, &name));
+  }
+  EXPECT_TRUE(method_calls_.empty());
+  EXPECT_TRUE(changes_.empty());
+}
+
+TEST_F(PropertyCacheTest, PropertiesChanged) {
+  cache_->WatchInterface(kObjectPath1, kInterface);
+  method_calls_.clear();
+  changes_.clear();
+
+  SendSignal(kObjectPath1, dbus::kPropertiesInterface, dbus::kPropertiesChanged,
+             std::string{kInterface}, VariantDictionary{{kCountProperty, 5}},
+             std::vector<std::string>{});
+  EXPECT_TRUE(method_calls_.empty());
+  EXPECT_EQ(std::vector<std::string>{"/org/test/object1 "
+                                     "org.test.Interface.Count"},
+            changes_);
+  int count = 0;
+  EXPECT_TRUE(
+      cache_->GetProperty(kObjectPath1, kInterface, kCountProperty, &count));
+  EXPECT_EQ(5, count);
+
+  // The signals of the interfaces which are not cached are ignored.
+  SendSignal(kObjectPath1, dbus::kPropertiesInterface, dbus::kPropertiesChanged,
+             std::string{kOtherInterface},
+             VariantDictionary{{kCountProperty, 5}},
+             std::vector<std::string>{});
+  EXPECT_FALSE(cache_->HasInterface(kObjectPath1, kOtherInterface));
+}
+
+TEST_F(PropertyCacheTest, InvalidatedProperty) {
+  cache_->WatchInterface(kObjectPath1, kInterface);
+  method_calls_.clear();
+  changes_.clear();
+
+  // The invalidated properties are fetched again.
+  service_objects_[kObjectPath1][kInterface][kNameProperty] =
+      std::string{"renamed"};
+  SendSignal(kObjectPath1, dbus::kPropertiesInterface, dbus::kPropertiesChanged,
+             std::string{kInterface}, VariantDictionary{},
+             std::vector<std::string>{kNameProperty});
+  EXPECT_EQ(std::vector<std::string>{dbus::kPropertiesGet}, method_calls_);
+  // Once when invalidated and once when fetched.
+  EXPECT_EQ(2u, changes_.size());
+  std::string name;
+  EXPECT_TRUE(
+      cache_->GetProperty(kObjectPath1, kInterface, kNameProperty, &name));
+  EXPECT_EQ("renamed", name);
+}
+
+TEST_F(PropertyCacheTest, WatchObjectManager) {
+  cache_->WatchObjectManager(kManagerPath);
+  std::vector<dbus::ObjectPath> expected_paths{kObjectPath1, kObjectPath2};
+  EXPECT_EQ(expected_paths, cache_->GetObjectPaths());
+  EXPECT_TRUE(cache_->HasInterface(kObjectPath2, kOtherInterface));
+  std::string name;
+  EXPECT_TRUE(
+      cache_->GetProperty(kObjectPath2, kInterface, kNameProperty, &name));
+  EXPECT_EQ("object2", name);
+
+  // The properties of each object are watched.
+  changes_.clear();
+  SendSignal(kObjectPath2, dbus::kPropertiesInterface, dbus::kPropertiesChanged,
+             std::string{kInterface},
+             VariantDictionary{{kNameProperty, std::string{"renamed"}}},
+             std::vector<std::string>{});
+  EXPECT_TRUE(
+      cache_->GetProperty(kObjectPath2, kInterface, kNameProperty, &name));
+  EXPECT_EQ("renamed", name);
+  EXPECT_EQ(1u, changes_.size());
+}
+
+TEST_F(PropertyCacheTest, InterfacesAddedAndRemoved) {
+  cache_->WatchObjectManager(kManagerPath);
+  const dbus::ObjectPath kObjectPath3{std::string{"/org/test/object3"}};
+  service_objects_[kObjectPath3][kInterface] = {{kCountProperty, 3}};
+
+  changes_.clear();
+  SendSignal(kManagerPath, dbus::kObjectManagerInterface,
+             dbus::kObjectManagerInterfacesAdded, kObjectPath3,
+             service_objects_[kObjectPath3]);
+  int count = 0;
+  EXPECT_TRUE(
+      cache_->GetProperty(kObjectPath3, kInterface, kCountProperty, &count));
+  EXPECT_EQ(3, count);
+  EXPECT_EQ(1u, changes_.size());
+
+  changes_.clear();
+  SendSignal(kManagerPath, dbus::kObjectManagerInterface,
+             dbus::kObjectManagerInterfacesRemoved, kObjectPath2,
+             std::vector<std::string>{kInterface});
+  EXPECT_FALSE(cache_->HasInterface(kObjectPath2, kInterface));
+  EXPECT_TRUE(cache_->HasInterface(kObjectPath2, kOtherInterface));
+  // Both properties of the interface are gone.
+  EXPECT_EQ(2u, changes_.size());
+
+  // The proxy of an object is released when its last interface is removed.
+  EXPECT_CALL(*bus_, RemoveObjectProxy(kServiceName, kObjectPath2, _))
+      .WillOnce(Return(true));
+  SendSignal(kManagerPath, dbus::kObjectManagerInterface,
+             dbus::kObjectManagerInterfacesRemoved, kObjectPath2,
+             std::vector<std::string>{kOtherInterface});
+  std::vector<dbus::ObjectPath> expected_paths{kObjectPath1, kObjectPath3};
+  EXPECT_EQ(expected_paths, cache_->GetObjectPaths());
+
+  // A watched object is kept, even when all its interfaces are gone.
+  cache_->WatchInterface(kObjectPath1, kInterface);
+  SendSignal(kManagerPath, dbus::kObjectManagerInterface,
+             dbus::kObjectManagerInterfacesRemoved, kObjectPath1,
+             std::vector<std::string>{kInterface});
+  EXPECT_FALSE(cache_->HasInterface(kObjectPath1, kInterface));
+
+  // A released object is watched again when it comes back.
+  signal_callbacks_.erase(kObjectPath2);
+  SendSignal(kManagerPath, dbus::kObjectManagerInterface,
+             dbus::kObjectManagerInterfacesAdded, kObjectPath2,
+             service_objects_[kObjectPath2]);
+  EXPECT_TRUE(cache_->HasInterface(kObjectPath2, kInterface));
+  EXPECT_FALSE(signal_callbacks_[kObjectPath2][dbus::kPropertiesChanged]
+                   .is_null());
+}
+
+TEST_F(PropertyCacheTest, SignalConnectionFailure) {
+  connect_signals_ = false;
+  cache_->WatchInterface(kObjectPath1, kInterface);
+  // Without the signal, the properties could go stale.
+  EXPECT_TRUE(method_calls_.empty());
+  EXPECT_FALSE(cache_->HasInterface(kObjectPath1, kInterface));
+
+  // The connection is retried when the object is watched again.
+  connect_signals_ = true;
+  cache_->WatchInterface(kObjectPath1, kOtherInterface);
+  EXPECT_EQ((std::vector<std::string>{dbus::kPropertiesGetAll,
+                                      dbus::kPropertiesGetAll}),
+            method_calls_);
+  EXPECT_TRUE(cache_->HasInterface(kObjectPath1, kInterface));
+  EXPECT_TRUE(cache_->HasInterface(kObjectPath1, kOtherInterface));
+}
+
+TEST_F(PropertyCacheTest, SignalConnectionRetriedForSameInterface) {
+  connect_signals_ = false;
+  cache_->WatchInterface(kObjectPath1, kInterface);
+  EXPECT_FALSE(cache_->HasInterface(kObjectPath1, kInterface));
+
+  connect_signals_ = true;
+  cache_->WatchInterface(kObjectPath1, kInterface);
+  EXPECT_EQ(std::vector<std::string>{dbus::kPropertiesGetAll}, method_calls_);
+  EXPECT_TRUE(cache_->HasInterface(kObjectPath1, kInterface));
+
+  // Once connected, watching the interface again is a no-op.
+  cache_->WatchInterface(kObjectPath1, kInterface);
+  EXPECT_EQ(1u, method_calls_.size());
+}
+
+}  // namespace dbus_utils
+}  // namespace brillo
@@ -89,5 +89,17 @@ void AddDBusError(brillo::ErrorPtr* error,
   }
 }
 
+std::unique_ptr<dbus::Response> CopyCachedResponse(
+    dbus::Response* cached_response,
+    dbus::MethodCall* method_call) {
+  DBusMessage* raw_message = dbus_message_copy(cached_response->raw_message());
+  CHECK(raw_message) << "Failed to copy the D-Bus message";
+  CHECK(dbus_message_set_reply_serial(raw_message, method_call->GetSerial()));
+  std::string sender = method_call->GetSender();
+  if (!sender.empty())
+    CHECK(dbus_message_set_destination(raw_message, sender.c_str()));
+  return dbus::Response::FromRawMessage(raw_message);
+}
+
 }  // namespace dbus_utils
 }  // namespace brillo
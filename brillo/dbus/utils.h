@@ -38,6 +38,13 @@ BRILLO_EXPORT void AddDBusError(brillo::ErrorPtr* error,
                                 const std::string& dbus_error_name,
                                 const std::string& dbus_error_message);
 
+// Creates the reply to |method_call| from |cached_response|, a response
+// created with dbus::Response::CreateEmpty() and filled once. The message is
+// copied as is, without marshalling its arguments again.
+BRILLO_EXPORT std::unique_ptr<dbus::Response> CopyCachedResponse(
+    dbus::Response* cached_response,
+    dbus::MethodCall* method_call);
+
 }  // namespace dbus_utils
 }  // namespace brillo
 
@@ -17,6 +17,7 @@ namespace json {
 const char kDomain[] = "json_parser";
 const char kParseError[] = "json_parse_error";
 const char kObjectExpected[] = "json_object_expected";
+const char kTypeMismatch[] = "json_type_mismatch";
 }  // namespace json
 
 namespace http {
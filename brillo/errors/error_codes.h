@@ -21,6 +21,7 @@ namespace json {
 BRILLO_EXPORT extern const char kDomain[];
 BRILLO_EXPORT extern const char kParseError[];
 BRILLO_EXPORT extern const char kObjectExpected[];
+BRILLO_EXPORT extern const char kTypeMismatch[];
 }  // namespace json
 
 namespace http {
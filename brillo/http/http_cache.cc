@@ -0,0 +1,323 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/http/http_cache.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <base/files/file_enumerator.h>
+#include <base/files/file_util.h>
+#include <base/files/important_file_writer.h>
+#include <base/logging.h>
+#include <base/sha1.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/string_util.h>
+
+namespace brillo {
+namespace http {
+
+namespace {
+
+const char kMetadataExtension[] = ".meta";
+const char kBodyExtension[] = ".body";
+
+// The metadata file is a sequence of fields, each stored as its length in
+// decimal, a colon, the field itself and a newline. The fields are the format
+// version, URL, status code, status text, protocol version, response time,
+// the count of the response headers followed by their names and values, and
+// the same for the Vary'd request headers. The header names and values are
+// stored verbatim, whatever characters they contain.
+const char kMetadataVersion[] = "1";
+
+void AppendField(const std::string& field, std::string* data) {
+  data->append(std::to_string(field.size()));
+  data->push_back(':');
+  data->append(field);
+  data->push_back('\n');
+}
+
+bool ReadField(const std::string& data, size_t* pos, std::string* field) {
+  size_t colon = data.find(':', *pos);
+  size_t size = 0;
+  if (colon == std::string::npos ||
+      !base::StringToSizeT(data.substr(*pos, colon - *pos), &size) ||
+      size >= data.size() - colon - 1 || data[colon + 1 + size] != '\n') {
+    return false;
+  }
+  field->assign(data, colon + 1, size);
+  *pos = colon + size + 2;
+  return true;
+}
+
+bool ReadIntField(const std::string& data, size_t* pos, int* value) {
+  std::string field;
+  return ReadField(data, pos, &field) && base::StringToInt(field, value);
+}
+
+void AppendHeaders(const HeaderList& headers, std::string* data) {
+  AppendField(std::to_string(headers.size()), data);
+  for (const auto& pair : headers) {
+    AppendField(pair.first, data);
+    AppendField(pair.second, data);
+  }
+}
+
+bool ReadHeaders(const std::string& data, size_t* pos, HeaderList* headers) {
+  int count = 0;
+  if (!ReadIntField(data, pos, &count) || count < 0)
+    return false;
+  headers->clear();
+  for (int i = 0; i < count; i++) {
+    std::string name;
+    std::string value;
+    if (!ReadField(data, pos, &name) || !ReadField(data, pos, &value))
+      return false;
+    headers->emplace_back(name, value);
+  }
+  return true;
+}
+
+std::string SerializeMetadata(const CachedResponse& response) {
+  std::string data;
+  AppendField(kMetadataVersion, &data);
+  AppendField(response.url, &data);
+  AppendField(std::to_string(response.status_code), &data);
+  AppendField(response.status_text, &data);
+  AppendField(response.protocol_version, &data);
+  AppendField(std::to_string(response.response_time.ToInternalValue()),
+              &data);
+  AppendHeaders(response.headers, &data);
+  AppendHeaders(response.vary_headers, &data);
+  return data;
+}
+
+bool ParseMetadata(const std::string& data, CachedResponse* response) {
+  size_t pos = 0;
+  std::string version;
+  std::string response_time;
+  int64_t response_time_value = 0;
+  if (!ReadField(data, &pos, &version) || version != kMetadataVersion ||
+      !ReadField(data, &pos, &response->url) ||
+      !ReadIntField(data, &pos, &response->status_code) ||
+      !ReadField(data, &pos, &response->status_text) ||
+      !ReadField(data, &pos, &response->protocol_version) ||
+      !ReadField(data, &pos, &response_time) ||
+      !base::StringToInt64(response_time, &response_time_value) ||
+      !ReadHeaders(data, &pos, &response->headers) ||
+      !ReadHeaders(data, &pos, &response->vary_headers)) {
+    return false;
+  }
+  response->response_time = base::Time::FromInternalValue(response_time_value);
+  return pos == data.size();
+}
+
+}  // anonymous namespace
+
+std::string CachedResponse::GetHeader(const std::string& name) const {
+  for (const auto& pair : headers) {
+    if (base::EqualsCaseInsensitiveASCII(pair.first, name))
+      return pair.second;
+  }
+  return std::string();
+}
+
+void CachedResponse::SetHeader(const std::string& name,
+                               const std::string& value) {
+  for (auto& pair : headers) {
+    if (base::EqualsCaseInsensitiveASCII(pair.first, name)) {
+      pair.second = value;
+      return;
+    }
+  }
+  headers.emplace_back(name, value);
+}
+
+void CachedResponse::RemoveHeader(const std::string& name) {
+  for (auto p = headers.begin(); p != headers.end(); ++p) {
+    if (base::EqualsCaseInsensitiveASCII(p->first, name)) {
+      headers.erase(p);
+      return;
+    }
+  }
+}
+
+DiskCache::DiskCache(const base::FilePath& cache_dir, uint64_t max_size)
+    : cache_dir_{cache_dir}, max_size_{max_size} {
+  if (!base::CreateDirectory(cache_dir_)) {
+    PLOG(ERROR) << "Failed to create HTTP cache directory "
+                << cache_dir_.value();
+  }
+  LoadIndex();
+}
+
+DiskCache::~DiskCache() = default;
+
+bool DiskCache::Lookup(const std::string& url, CachedResponse* response) {
+  std::string key = GetKey(url);
+  if (index_.find(key) == index_.end())
+    return false;
+
+  std::string data;
+  if (!base::ReadFileToString(GetMetadataPath(key), &data) ||
+      !ParseMetadata(data, response) || response->url != url) {
+    LOG(WARNING) << "Dropping corrupted HTTP cache entry for " << url;
+    RemoveEntry(key);
+    return false;
+  }
+  Touch(key);
+  return true;
+}
+
+bool DiskCache::ReadBody(const std::string& url,
+                         std::vector<uint8_t>* body) const {
+  std::string key = GetKey(url);
+  if (index_.find(key) == index_.end())
+    return false;
+  std::string data;
+  if (!base::ReadFileToString(GetBodyPath(key), &data))
+    return false;
+  body->assign(data.begin(), data.end());
+  return true;
+}
+
+bool DiskCache::Store(const CachedResponse& response,
+                      const std::vector<uint8_t>& body) {
+  std::string key = GetKey(response.url);
+  RemoveEntry(key);
+  if (body.size() > max_size_)
+    return false;
+
+  const char* data = reinterpret_cast<const char*>(body.data());
+  uint64_t metadata_size = 0;
+  if (!base::ImportantFileWriter::WriteFileAtomically(
+          GetBodyPath(key), std::string{data, body.size()}) ||
+      !WriteMetadata(key, response, &metadata_size)) {
+    base::DeleteFile(GetBodyPath(key), false);
+    return false;
+  }
+
+  lru_.push_front(IndexEntry{key, body.size() + metadata_size});
+  index_.emplace(key, lru_.begin());
+  total_size_ += lru_.front().size;
+  EvictIfNeeded();
+  return true;
+}
+
+bool DiskCache::UpdateMetadata(const CachedResponse& response) {
+  std::string key = GetKey(response.url);
+  auto p = index_.find(key);
+  if (p == index_.end())
+    return false;
+
+  uint64_t metadata_size = 0;
+  int64_t old_metadata_size = 0;
+  base::GetFileSize(GetMetadataPath(key), &old_metadata_size);
+  if (!WriteMetadata(key, response, &metadata_size)) {
+    RemoveEntry(key);
+    return false;
+  }
+  IndexEntry& entry = *p->second;
+  total_size_ -= entry.size;
+  entry.size = entry.size - old_metadata_size + metadata_size;
+  total_size_ += entry.size;
+  Touch(key);
+  EvictIfNeeded();
+  return true;
+}
+
+void DiskCache::Remove(const std::string& url) {
+  RemoveEntry(GetKey(url));
+}
+
+std::string DiskCache::GetKey(const std::string& url) {
+  return base::ToLowerASCII(base::HexEncode(base::SHA1HashString(url).data(),
+                                            base::kSHA1Length));
+}
+
+base::FilePath DiskCache::GetMetadataPath(const std::string& key) const {
+  return cache_dir_.Append(key + kMetadataExtension);
+}
+
+base::FilePath DiskCache::GetBodyPath(const std::string& key) const {
+  return cache_dir_.Append(key + kBodyExtension);
+}
+
+void DiskCache::LoadIndex() {
+  struct FoundEntry {
+    std::string key;
+    uint64_t size;
+    base::Time last_used;
+  };
+  std::vector<FoundEntry> entries;
+  base::FileEnumerator enumerator{cache_dir_, false,
+                                  base::FileEnumerator::FILES,
+                                  std::string{"*"} + kMetadataExtension};
+  for (base::FilePath path = enumerator.Next(); !path.empty();
+       path = enumerator.Next()) {
+    std::string key = path.BaseName().RemoveExtension().value();
+    int64_t body_size = 0;
+    if (!base::GetFileSize(GetBodyPath(key), &body_size)) {
+      // Metadata without the body. Probably a leftover from a crash.
+      base::DeleteFile(path, false);
+      continue;
+    }
+    auto info = enumerator.GetInfo();
+    uint64_t size = static_cast<uint64_t>(body_size + info.GetSize());
+    entries.push_back(FoundEntry{key, size, info.GetLastModifiedTime()});
+  }
+
+  std::sort(entries.begin(), entries.end(),
+            [](const FoundEntry& a, const FoundEntry& b) {
+              return a.last_used > b.last_used;
+            });
+  for (const FoundEntry& entry : entries) {
+    lru_.push_back(IndexEntry{entry.key, entry.size});
+    index_.emplace(entry.key, std::prev(lru_.end()));
+    total_size_ += entry.size;
+  }
+  EvictIfNeeded();
+}
+
+bool DiskCache::WriteMetadata(const std::string& key,
+                              const CachedResponse& response,
+                              uint64_t* size) {
+  std::string data = SerializeMetadata(response);
+  if (!base::ImportantFileWriter::WriteFileAtomically(GetMetadataPath(key),
+                                                      data)) {
+    return false;
+  }
+  *size = data.size();
+  return true;
+}
+
+void DiskCache::Touch(const std::string& key) {
+  auto p = index_.find(key);
+  if (p == index_.end())
+    return;
+  lru_.splice(lru_.begin(), lru_, p->second);
+  base::Time now = base::Time::Now();
+  base::TouchFile(GetMetadataPath(key), now, now);
+}
+
+void DiskCache::RemoveEntry(const std::string& key) {
+  base::DeleteFile(GetMetadataPath(key), false);
+  base::DeleteFile(GetBodyPath(key), false);
+  auto p = index_.find(key);
+  if (p == index_.end())
+    return;
+  total_size_ -= p->second->size;
+  lru_.erase(p->second);
+  index_.erase(p);
+}
+
+void DiskCache::EvictIfNeeded() {
+  while (total_size_ > max_size_ && !lru_.empty()) {
+    VLOG(1) << "Evicting HTTP cache entry " << lru_.back().key;
+    RemoveEntry(lru_.back().key);
+  }
+}
+
+}  // namespace http
+}  // namespace brillo
@@ -0,0 +1,128 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_HTTP_HTTP_CACHE_H_
+#define LIBBRILLO_BRILLO_HTTP_HTTP_CACHE_H_
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/time/time.h>
+#include <brillo/brillo_export.h>
+#include <brillo/http/http_transport.h>
+
+namespace brillo {
+namespace http {
+
+// The status line and headers of an HTTP response stored in DiskCache.
+struct BRILLO_EXPORT CachedResponse {
+  std::string url;
+  int status_code{0};
+  std::string status_text;
+  std::string protocol_version;
+  HeaderList headers;
+  // The time the response was received from the server or last successfully
+  // revalidated with it.
+  base::Time response_time;
+  // The request headers named by the "Vary" response header, with the values
+  // they had in the request this response was received for. The response is
+  // only used for requests with the same values.
+  HeaderList vary_headers;
+
+  // Returns the value of the header |name| (case-insensitive) or an empty
+  // string if the header is not present.
+  std::string GetHeader(const std::string& name) const;
+  // Replaces the value of the header |name| or adds it if not present.
+  void SetHeader(const std::string& name, const std::string& value);
+  // Removes the header |name|, if present.
+  void RemoveHeader(const std::string& name);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// DiskCache is a simple persistent store of HTTP responses keyed by URL.
+// Each entry consists of a metadata file (the status line, headers and the
+// time the response was received) and a body file in the cache directory.
+// The total size of the entries is kept under the given budget by evicting
+// the least recently used ones. The recency of the entries is tracked using
+// the modification time of their metadata files so it survives restarts.
+//
+// DiskCache only deals with storage. The HTTP caching policy (freshness,
+// revalidation, etc) is implemented by http::CachingTransport.
+//
+// All the methods perform blocking file I/O on the calling thread.
+///////////////////////////////////////////////////////////////////////////////
+class BRILLO_EXPORT DiskCache final {
+ public:
+  // Creates a cache in |cache_dir| (created if it doesn't exist) holding up
+  // to |max_size| bytes of data. Existing entries are picked up from disk.
+  DiskCache(const base::FilePath& cache_dir, uint64_t max_size);
+  ~DiskCache();
+
+  // Looks up the entry for |url| and returns its metadata in |response|.
+  // Marks the entry as most recently used.
+  bool Lookup(const std::string& url, CachedResponse* response);
+
+  // Reads the body of the cached response for |url|.
+  bool ReadBody(const std::string& url, std::vector<uint8_t>* body) const;
+
+  // Stores a response and its body, replacing any previous entry for the same
+  // URL and evicting older entries if needed to stay within the size budget.
+  bool Store(const CachedResponse& response, const std::vector<uint8_t>& body);
+
+  // Updates the metadata of an existing entry (e.g. after a successful
+  // revalidation of the response with the server).
+  bool UpdateMetadata(const CachedResponse& response);
+
+  // Removes the entry for |url|, if any.
+  void Remove(const std::string& url);
+
+  // Returns the total size of the entries and their count.
+  uint64_t GetTotalSize() const { return total_size_; }
+  size_t GetEntryCount() const { return index_.size(); }
+
+ private:
+  struct IndexEntry {
+    std::string key;
+    uint64_t size;
+  };
+  using LruList = std::list<IndexEntry>;
+
+  // Returns the key of an entry in the cache directory for the given |url|.
+  static std::string GetKey(const std::string& url);
+  base::FilePath GetMetadataPath(const std::string& key) const;
+  base::FilePath GetBodyPath(const std::string& key) const;
+
+  // Builds the in-memory LRU index from the entries in the cache directory.
+  void LoadIndex();
+  // Writes the metadata file of |response| and returns its size.
+  bool WriteMetadata(const std::string& key,
+                     const CachedResponse& response,
+                     uint64_t* size);
+  // Marks the entry |key| as the most recently used.
+  void Touch(const std::string& key);
+  // Removes entry files and its index record.
+  void RemoveEntry(const std::string& key);
+  // Removes the least recently used entries until the cache fits into
+  // |max_size_|.
+  void EvictIfNeeded();
+
+  base::FilePath cache_dir_;
+  uint64_t max_size_;
+  uint64_t total_size_{0};
+
+  // Entries ordered from the most recently used to the least recently used.
+  LruList lru_;
+  std::map<std::string, LruList::iterator> index_;
+
+  DISALLOW_COPY_AND_ASSIGN(DiskCache);
+};
+
+}  // namespace http
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_HTTP_HTTP_CACHE_H_
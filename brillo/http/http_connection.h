@@ -91,6 +91,15 @@ class BRILLO_EXPORT Connection
   // Returns empty stream on failure and fills in the error information in
   // |error| object.
   virtual StreamPtr ExtractDataStream(brillo::ErrorPtr* error) = 0;
+  // Returns the timing breakdown of the completed request. Returns false if
+  // the information is not available (e.g. not supported by the transport).
+  virtual bool GetTimings(RequestTimings* /* timings */) const {
+    return false;
+  }
+
+  // The priority used by the transport to schedule an asynchronous request.
+  void SetPriority(RequestPriority priority) { priority_ = priority; }
+  RequestPriority GetPriority() const { return priority_; }
 
  protected:
   // |transport_| is mainly used to keep the object alive as long as the
@@ -99,6 +108,8 @@ class BRILLO_EXPORT Connection
   std::shared_ptr<Transport> transport_;
 
  private:
+  RequestPriority priority_{RequestPriority::MEDIUM};
+
   DISALLOW_COPY_AND_ASSIGN(Connection);
 };
 
@@ -4,12 +4,14 @@
 
 #include <brillo/http/http_connection_curl.h>
 
+#include <algorithm>
+
 #include <base/logging.h>
+#include <base/strings/string_util.h>
 #include <brillo/http/http_request.h>
 #include <brillo/http/http_transport_curl.h>
 #include <brillo/streams/memory_stream.h>
 #include <brillo/streams/stream_utils.h>
-#include <brillo/strings/string_utils.h>
 
 namespace brillo {
 namespace http {
@@ -73,7 +75,7 @@ Connection::~Connection() {
 
 bool Connection::SendHeaders(const HeaderList& headers,
                              brillo::ErrorPtr* /* error */) {
-  headers_.insert(headers.begin(), headers.end());
+  headers_.AddHeaders(headers);
   return true;
 }
 
@@ -111,7 +113,7 @@ void Connection::PrepareRequest() {
       }
     } else {
       // Data size is unknown, so use chunked upload.
-      headers_.emplace(http::request_header::kTransferEncoding, "chunked");
+      headers_.Add(http::request_header::kTransferEncoding, "chunked");
     }
 
     if (request_data_stream_) {
@@ -123,9 +125,14 @@ void Connection::PrepareRequest() {
 
   if (!headers_.empty()) {
     CHECK(header_list_ == nullptr);
-    for (auto pair : headers_) {
-      std::string header =
-          brillo::string_utils::Join(": ", pair.first, pair.second);
+    // curl_slist_append() makes its own copy of the string, so the same
+    // buffer can be reused for all the header lines.
+    std::string header;
+    for (size_t i = 0; i < headers_.size(); i++) {
+      header.clear();
+      headers_.GetName(i).AppendToString(&header);
+      header.append(": ");
+      headers_.GetValue(i).AppendToString(&header);
       VLOG(2) << "Request header: " << header;
       header_list_ = curl_slist_append(header_list_, header.c_str());
     }
@@ -133,7 +140,9 @@ void Connection::PrepareRequest() {
         curl_handle_, CURLOPT_HTTPHEADER, header_list_);
   }
 
-  headers_.clear();
+  // Reuse the map (and the memory it already allocated) for the response
+  // headers.
+  headers_.Clear();
 
   // Set up HTTP response data.
   if (!response_data_stream_)
@@ -156,6 +165,7 @@ bool Connection::FinishRequest(brillo::ErrorPtr* error) {
   if (ret != CURLE_OK) {
     Transport::AddEasyCurlError(error, FROM_HERE, ret, curl_interface_.get());
   } else {
+    CollectTimings();
     // Rewind our data stream to the beginning so that it can be read back.
     if (response_data_stream_->CanSeek() &&
         !response_data_stream_->SetPosition(0, error))
@@ -190,8 +200,7 @@ std::string Connection::GetProtocolVersion() const {
 
 std::string Connection::GetResponseHeader(
     const std::string& header_name) const {
-  auto p = headers_.find(header_name);
-  return p != headers_.end() ? p->second : std::string();
+  return headers_.Get(header_name).as_string();
 }
 
 StreamPtr Connection::ExtractDataStream(brillo::ErrorPtr* error) {
@@ -201,6 +210,54 @@ StreamPtr Connection::ExtractDataStream(brillo::ErrorPtr* error) {
   return std::move(response_data_stream_);
 }
 
+bool Connection::GetTimings(RequestTimings* timings) const {
+  if (!timings_collected_)
+    return false;
+  *timings = timings_;
+  return true;
+}
+
+void Connection::CollectTimings() {
+  auto get_time = [this](CURLINFO info) {
+    double seconds = 0.0;
+    curl_interface_->EasyGetInfoDbl(curl_handle_, info, &seconds);
+    return base::TimeDelta::FromMicroseconds(
+        static_cast<int64_t>(seconds * base::Time::kMicrosecondsPerSecond));
+  };
+  auto get_size = [this](CURLINFO info) {
+    double size = 0.0;
+    curl_interface_->EasyGetInfoDbl(curl_handle_, info, &size);
+    return static_cast<uint64_t>(size);
+  };
+
+  timings_.name_lookup = get_time(CURLINFO_NAMELOOKUP_TIME);
+  timings_.connect = get_time(CURLINFO_CONNECT_TIME);
+  timings_.app_connect = get_time(CURLINFO_APPCONNECT_TIME);
+  timings_.start_transfer = get_time(CURLINFO_STARTTRANSFER_TIME);
+  timings_.total = get_time(CURLINFO_TOTAL_TIME);
+  timings_.bytes_sent = get_size(CURLINFO_SIZE_UPLOAD);
+  int header_size = 0;
+  curl_interface_->EasyGetInfoInt(curl_handle_, CURLINFO_HEADER_SIZE,
+                                  &header_size);
+  timings_.bytes_received =
+      get_size(CURLINFO_SIZE_DOWNLOAD) + std::max(header_size, 0);
+  // CURL reports the number of new connections it had to create for the
+  // transfer.
+  int new_connections = 0;
+  curl_interface_->EasyGetInfoInt(curl_handle_, CURLINFO_NUM_CONNECTS,
+                                  &new_connections);
+  timings_.connection_reused = (new_connections == 0);
+  timings_collected_ = true;
+
+  VLOG(1) << "Request to " << host_ << " took "
+          << timings_.total.InMilliseconds() << " ms (name lookup "
+          << timings_.name_lookup.InMilliseconds() << " ms, connect "
+          << timings_.connect.InMilliseconds() << " ms, first byte "
+          << timings_.start_transfer.InMilliseconds() << " ms)";
+  if (timing_stats_)
+    timing_stats_->AddRequest(host_, timings_);
+}
+
 size_t Connection::write_callback(char* ptr,
                                   size_t size,
                                   size_t num,
@@ -237,13 +294,13 @@ size_t Connection::header_callback(char* ptr,
                                    size_t size,
                                    size_t num,
                                    void* data) {
-  using brillo::string_utils::SplitAtFirst;
   Connection* me = reinterpret_cast<Connection*>(data);
   size_t hdr_len = size * num;
-  std::string header(ptr, hdr_len);
+  base::StringPiece header{ptr, hdr_len};
   // Remove newlines at the end of header line.
-  while (!header.empty() && (header.back() == '\r' || header.back() == '\n')) {
-    header.pop_back();
+  while (!header.empty() && (header[header.size() - 1] == '\r' ||
+                             header[header.size() - 1] == '\n')) {
+    header.remove_suffix(1);
   }
 
   VLOG(2) << "Response header: " << header;
@@ -251,14 +308,23 @@ size_t Connection::header_callback(char* ptr,
   if (!me->status_text_set_) {
     // First header - response code as "HTTP/1.1 200 OK".
     // Need to extract the OK part
-    auto pair = SplitAtFirst(header, " ");
-    me->protocol_version_ = pair.first;
-    me->status_text_ = SplitAtFirst(pair.second, " ").second;
+    base::StringPiece version = header;
+    base::StringPiece status_text;
+    size_t pos = header.find(' ');
+    if (pos != base::StringPiece::npos) {
+      version = header.substr(0, pos);
+      base::StringPiece rest = header.substr(pos + 1);
+      pos = rest.find(' ');
+      if (pos != base::StringPiece::npos)
+        status_text = rest.substr(pos + 1);
+    }
+    me->protocol_version_ =
+        base::TrimWhitespaceASCII(version, base::TRIM_ALL).as_string();
+    me->status_text_ =
+        base::TrimWhitespaceASCII(status_text, base::TRIM_ALL).as_string();
     me->status_text_set_ = true;
   } else {
-    auto pair = SplitAtFirst(header, ":");
-    if (!pair.second.empty())
-      me->headers_.insert(pair);
+    me->headers_.AddHeaderLine(header);
   }
   return hdr_len;
 }
@@ -5,13 +5,14 @@
 #ifndef LIBBRILLO_BRILLO_HTTP_HTTP_CONNECTION_CURL_H_
 #define LIBBRILLO_BRILLO_HTTP_HTTP_CONNECTION_CURL_H_
 
-#include <map>
 #include <string>
 #include <vector>
 
 #include <base/macros.h>
 #include <brillo/brillo_export.h>
 #include <brillo/http/http_connection.h>
+#include <brillo/http/http_header_map.h>
+#include <brillo/http/http_timing_stats.h>
 #include <brillo/http/http_transport_curl.h>
 #include <curl/curl.h>
 
@@ -43,6 +44,7 @@ class BRILLO_EXPORT Connection : public http::Connection {
   std::string GetProtocolVersion() const override;
   std::string GetResponseHeader(const std::string& header_name) const override;
   StreamPtr ExtractDataStream(brillo::ErrorPtr* error) override;
+  bool GetTimings(RequestTimings* timings) const override;
 
  protected:
   // Write data callback. Used by CURL when receiving response data.
@@ -65,9 +67,23 @@ class BRILLO_EXPORT Connection : public http::Connection {
   // pertaining to the current connection.
   BRILLO_PRIVATE void PrepareRequest();
 
+  // Reads the timing information of the completed transfer from CURL and
+  // reports it to |timing_stats_|.
+  BRILLO_PRIVATE void CollectTimings();
+
   // HTTP request verb, such as "GET", "POST", "PUT", ...
   std::string method_;
 
+  // The host (and port) part of the request URL. Used by the transport to
+  // limit the number of concurrent requests to the same server.
+  std::string host_;
+
+  // The timing breakdown of the completed request, and the transport-wide
+  // statistics to add it to.
+  RequestTimings timings_;
+  bool timings_collected_{false};
+  std::shared_ptr<TimingStats> timing_stats_;
+
   // Binary data for request body.
   StreamPtr request_data_stream_;
 
@@ -76,7 +92,7 @@ class BRILLO_EXPORT Connection : public http::Connection {
 
   // List of optional request headers provided by the caller.
   // After request has been sent, contains the received response headers.
-  std::multimap<std::string, std::string> headers_;
+  HeaderMap headers_;
 
   // HTTP protocol version, such as HTTP/1.1
   std::string protocol_version_;
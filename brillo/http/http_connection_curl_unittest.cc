@@ -288,6 +288,20 @@ TEST_F(HttpCurlConnectionTest, FinishRequest) {
   EXPECT_CALL(*curl_api_, EasyGetInfoInt(handle_, CURLINFO_RESPONSE_CODE, _))
       .WillOnce(DoAll(SetArgPointee<2>(status_code::Ok), Return(CURLE_OK)));
 
+  // Timing information collected after the transfer.
+  EXPECT_CALL(*curl_api_, EasyGetInfoDbl(handle_, _, _))
+      .WillRepeatedly(Return(CURLE_OK));
+  EXPECT_CALL(*curl_api_, EasyGetInfoDbl(handle_, CURLINFO_CONNECT_TIME, _))
+      .WillOnce(DoAll(SetArgPointee<2>(0.1), Return(CURLE_OK)));
+  EXPECT_CALL(*curl_api_, EasyGetInfoDbl(handle_, CURLINFO_TOTAL_TIME, _))
+      .WillOnce(DoAll(SetArgPointee<2>(0.25), Return(CURLE_OK)));
+  EXPECT_CALL(*curl_api_, EasyGetInfoDbl(handle_, CURLINFO_SIZE_DOWNLOAD, _))
+      .WillOnce(DoAll(SetArgPointee<2>(28.0), Return(CURLE_OK)));
+  EXPECT_CALL(*curl_api_, EasyGetInfoInt(handle_, CURLINFO_HEADER_SIZE, _))
+      .WillOnce(DoAll(SetArgPointee<2>(100), Return(CURLE_OK)));
+  EXPECT_CALL(*curl_api_, EasyGetInfoInt(handle_, CURLINFO_NUM_CONNECTS, _))
+      .WillOnce(DoAll(SetArgPointee<2>(1), Return(CURLE_OK)));
+
   // Set up the CurlPerformer with the response data expected to be received.
   HeaderList response_headers{
       {response_header::kContentLength, std::to_string(response_data.size())},
@@ -315,8 +329,16 @@ TEST_F(HttpCurlConnectionTest, FinishRequest) {
   EXPECT_EQ(mime::text::kHtml,
             connection_->GetResponseHeader(response_header::kContentType));
   EXPECT_EQ("baz", connection_->GetResponseHeader("X-Foo"));
+  EXPECT_EQ("baz", connection_->GetResponseHeader("x-foo"));
   auto data_stream = connection_->ExtractDataStream(nullptr);
   ASSERT_NE(nullptr, data_stream.get());
+
+  RequestTimings timings;
+  EXPECT_TRUE(connection_->GetTimings(&timings));
+  EXPECT_EQ(100, timings.connect.InMilliseconds());
+  EXPECT_EQ(250, timings.total.InMilliseconds());
+  EXPECT_EQ(128u, timings.bytes_received);
+  EXPECT_FALSE(timings.connection_reused);
 }
 
 }  // namespace curl
@@ -4,18 +4,24 @@
 
 #include <brillo/http/http_form_data.h>
 
+#include <string.h>
+
+#include <algorithm>
 #include <limits>
 
+#include <base/bind.h>
 #include <base/format_macros.h>
 #include <base/rand_util.h>
 #include <base/strings/stringprintf.h>
 
 #include <brillo/errors/error_codes.h>
 #include <brillo/http/http_transport.h>
+#include <brillo/message_loops/message_loop.h>
 #include <brillo/mime_utils.h>
 #include <brillo/streams/file_stream.h>
-#include <brillo/streams/input_stream_set.h>
 #include <brillo/streams/memory_stream.h>
+#include <brillo/streams/stream_errors.h>
+#include <brillo/streams/stream_utils.h>
 
 namespace brillo {
 namespace http {
@@ -29,6 +35,199 @@ const char kContentType[] = "Content-Type";
 const char content_disposition::kFile[] = "file";
 const char content_disposition::kFormData[] = "form-data";
 
+void FormDataStream::AppendText(const std::string& text) {
+  if (text.empty())
+    return;
+  size_ += text.size();
+  if (!chunks_.empty() && !chunks_.back().stream) {
+    chunks_.back().text += text;
+    return;
+  }
+  chunks_.push_back(Chunk{text, nullptr, true, 0, 0});
+}
+
+void FormDataStream::AppendStream(StreamPtr stream) {
+  if (stream->CanGetSize()) {
+    uint64_t size = stream->GetRemainingSize();
+    AppendStream(std::move(stream), size);
+    return;
+  }
+  chunks_.push_back(Chunk{{}, std::move(stream), false, 0, 0});
+  size_known_ = false;
+}
+
+void FormDataStream::AppendStream(StreamPtr stream, uint64_t size) {
+  size_ += size;
+  chunks_.push_back(Chunk{{}, std::move(stream), true, size, 0});
+}
+
+bool FormDataStream::SetSizeBlocking(uint64_t /* size */, ErrorPtr* error) {
+  return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+uint64_t FormDataStream::GetRemainingSize() const {
+  return size_known_ ? size_ - position_ : 0;
+}
+
+bool FormDataStream::Seek(int64_t /* offset */,
+                          Whence /* whence */,
+                          uint64_t* /* new_position */,
+                          ErrorPtr* error) {
+  return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+bool FormDataStream::ReadNonBlocking(void* buffer,
+                                     size_t size_to_read,
+                                     size_t* size_read,
+                                     bool* end_of_stream,
+                                     ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  char* data = static_cast<char*>(buffer);
+  size_t total = 0;
+  while (total < size_to_read && current_chunk_ < chunks_.size()) {
+    Chunk& chunk = chunks_[current_chunk_];
+    if (!chunk.stream) {
+      size_t size = std::min<uint64_t>(size_to_read - total,
+                                       chunk.text.size() - chunk.offset);
+      memcpy(data + total, chunk.text.data() + chunk.offset, size);
+      chunk.offset += size;
+      total += size;
+      if (chunk.offset == chunk.text.size()) {
+        std::string().swap(chunk.text);
+        current_chunk_++;
+      }
+      continue;
+    }
+
+    size_t size = size_to_read - total;
+    if (chunk.size_known)
+      size = std::min<uint64_t>(size, chunk.size - chunk.offset);
+    size_t read = 0;
+    bool eos = false;
+    if (size > 0 &&
+        !chunk.stream->ReadNonBlocking(data + total, size, &read, &eos,
+                                       error)) {
+      return false;
+    }
+    chunk.offset += read;
+    total += read;
+    if (eos && chunk.size_known && chunk.offset < chunk.size) {
+      Error::AddToPrintf(error, FROM_HERE, errors::stream::kDomain,
+                         errors::stream::kPartialData,
+                         "Form field data is shorter than declared: %" PRIu64
+                         " out of %" PRIu64 " bytes",
+                         chunk.offset, chunk.size);
+      return false;
+    }
+    if (!eos && chunk.size_known && chunk.offset == chunk.size) {
+      // Make sure the stream doesn't hold more data than declared, rather
+      // than silently cutting it off.
+      char extra = 0;
+      size_t extra_read = 0;
+      if (!chunk.stream->ReadNonBlocking(&extra, 1, &extra_read, &eos, error))
+        return false;
+      if (extra_read > 0) {
+        Error::AddToPrintf(error, FROM_HERE, errors::stream::kDomain,
+                           errors::stream::kPartialData,
+                           "Form field data is longer than declared: more "
+                           "than %" PRIu64 " bytes",
+                           chunk.size);
+        return false;
+      }
+      if (!eos)
+        break;  // Can't tell yet, wait for more data.
+    }
+    if (eos) {
+      chunk.stream.reset();
+      current_chunk_++;
+      continue;
+    }
+    if (read == 0)
+      break;  // No data available right now.
+  }
+  position_ += total;
+  *size_read = total;
+  if (end_of_stream)
+    *end_of_stream = (total == 0 && current_chunk_ == chunks_.size());
+  return true;
+}
+
+bool FormDataStream::WriteNonBlocking(const void* /* buffer */,
+                                      size_t /* size_to_write */,
+                                      size_t* /* size_written */,
+                                      ErrorPtr* error) {
+  return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+bool FormDataStream::FlushBlocking(ErrorPtr* error) {
+  return IsOpen() || stream_utils::ErrorStreamClosed(FROM_HERE, error);
+}
+
+bool FormDataStream::CloseBlocking(ErrorPtr* error) {
+  bool success = true;
+  for (Chunk& chunk : chunks_) {
+    if (chunk.stream && !chunk.stream->CloseBlocking(error))
+      success = false;  // Keep going for other streams...
+  }
+  chunks_.clear();
+  current_chunk_ = 0;
+  closed_ = true;
+  return success;
+}
+
+Stream* FormDataStream::GetCurrentStream() const {
+  if (current_chunk_ < chunks_.size())
+    return chunks_[current_chunk_].stream.get();
+  return nullptr;
+}
+
+bool FormDataStream::WaitForData(
+    AccessMode mode,
+    const base::Callback<void(AccessMode)>& callback,
+    ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (stream_utils::IsWriteAccessMode(mode))
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+  Stream* stream = GetCurrentStream();
+  if (stream)
+    return stream->WaitForData(mode, callback, error);
+
+  // Text (or the end of the body) is always available.
+  MessageLoop::current()->PostTask(FROM_HERE, base::Bind(callback, mode));
+  return true;
+}
+
+bool FormDataStream::WaitForDataBlocking(AccessMode in_mode,
+                                         base::TimeDelta timeout,
+                                         AccessMode* out_mode,
+                                         ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (stream_utils::IsWriteAccessMode(in_mode))
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+  Stream* stream = GetCurrentStream();
+  if (stream)
+    return stream->WaitForDataBlocking(in_mode, timeout, out_mode, error);
+
+  if (out_mode)
+    *out_mode = in_mode;
+  return true;
+}
+
+void FormDataStream::CancelPendingAsyncOperations() {
+  Stream* stream = GetCurrentStream();
+  if (stream)
+    stream->CancelPendingAsyncOperations();
+  Stream::CancelPendingAsyncOperations();
+}
+
 FormField::FormField(const std::string& name,
                      const std::string& content_disposition,
                      const std::string& content_type,
@@ -72,6 +271,15 @@ std::string FormField::GetContentHeader() const {
   return result;
 }
 
+bool FormField::AppendDataTo(FormDataStream* body) {
+  std::vector<StreamPtr> streams;
+  if (!ExtractDataStreams(&streams))
+    return false;
+  for (StreamPtr& stream : streams)
+    body->AppendStream(std::move(stream));
+  return true;
+}
+
 TextFormField::TextFormField(const std::string& name,
                              const std::string& data,
                              const std::string& content_type,
@@ -88,6 +296,11 @@ bool TextFormField::ExtractDataStreams(std::vector<StreamPtr>* streams) {
   return true;
 }
 
+bool TextFormField::AppendDataTo(FormDataStream* body) {
+  body->AppendText(data_);
+  return true;
+}
+
 FileFormField::FileFormField(const std::string& name,
                              StreamPtr stream,
                              const std::string& file_name,
@@ -112,6 +325,21 @@ bool FileFormField::ExtractDataStreams(std::vector<StreamPtr>* streams) {
   return true;
 }
 
+bool FileFormField::AppendDataTo(FormDataStream* body) {
+  if (!stream_)
+    return false;
+  if (data_size_known_)
+    body->AppendStream(std::move(stream_), data_size_);
+  else
+    body->AppendStream(std::move(stream_));
+  return true;
+}
+
+void FileFormField::SetDataSize(uint64_t size) {
+  data_size_known_ = true;
+  data_size_ = size;
+}
+
 MultiPartFormField::MultiPartFormField(const std::string& name,
                                        const std::string& content_type,
                                        const std::string& boundary)
@@ -140,6 +368,18 @@ bool MultiPartFormField::ExtractDataStreams(std::vector<StreamPtr>* streams) {
   return true;
 }
 
+bool MultiPartFormField::AppendDataTo(FormDataStream* body) {
+  for (auto& part : parts_) {
+    body->AppendText(GetBoundaryStart() + part->GetContentHeader());
+    if (!part->AppendDataTo(body))
+      return false;
+    body->AppendText("\r\n");
+  }
+  if (!parts_.empty())
+    body->AppendText(GetBoundaryEnd());
+  return true;
+}
+
 std::string MultiPartFormField::GetContentType() const {
   return base::StringPrintf(
       "%s; boundary=\"%s\"", content_type_.c_str(), boundary_.c_str());
@@ -211,9 +451,9 @@ std::string FormData::GetContentType() const {
 }
 
 StreamPtr FormData::ExtractDataStream() {
-  std::vector<StreamPtr> source_streams;
-  if (form_data_.ExtractDataStreams(&source_streams))
-    return InputStreamSet::Create(std::move(source_streams), nullptr);
+  std::unique_ptr<FormDataStream> stream{new FormDataStream};
+  if (form_data_.AppendDataTo(stream.get()))
+    return std::move(stream);
   return {};
 }
 
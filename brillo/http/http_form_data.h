@@ -23,6 +23,91 @@ BRILLO_EXPORT extern const char kFormData[];
 BRILLO_EXPORT extern const char kFile[];
 }  // namespace content_disposition
 
+// The body of a multipart request: a sequence of chunks of text held in
+// memory (part headers, boundaries and text fields) and of the data streams
+// of the file fields. Consecutive text is merged into one chunk and each read
+// gathers as much data across the chunks as fits in the caller's buffer, so
+// the parts are not wrapped into separate streams and the upload runs in
+// constant memory.
+//
+// The size of the body is known if the sizes of all the file streams are
+// known (or have been declared with FileFormField::SetDataSize()), so the
+// request can be sent with "Content-Length:" instead of using the chunked
+// transfer encoding.
+class BRILLO_EXPORT FormDataStream final : public Stream {
+ public:
+  FormDataStream() = default;
+
+  // Appends |text| to the body.
+  void AppendText(const std::string& text);
+  // Appends the data read from |stream|. If the stream can't report its
+  // size, the size of the body becomes unknown.
+  void AppendStream(StreamPtr stream);
+  // Appends |size| bytes of data read from |stream|. Reading the body fails
+  // with errors::stream::kPartialData if the stream ends before |size| bytes
+  // or has more data than that (so it must reach its end after |size| bytes).
+  void AppendStream(StreamPtr stream, uint64_t size);
+
+  // Overrides from Stream.
+  bool IsOpen() const override { return !closed_; }
+  bool CanRead() const override { return true; }
+  bool CanWrite() const override { return false; }
+  bool CanSeek() const override { return false; }
+  bool CanGetSize() const override { return size_known_; }
+  uint64_t GetSize() const override { return size_known_ ? size_ : 0; }
+  bool SetSizeBlocking(uint64_t size, ErrorPtr* error) override;
+  uint64_t GetRemainingSize() const override;
+  uint64_t GetPosition() const override { return position_; }
+  bool Seek(int64_t offset,
+            Whence whence,
+            uint64_t* new_position,
+            ErrorPtr* error) override;
+  bool ReadNonBlocking(void* buffer,
+                       size_t size_to_read,
+                       size_t* size_read,
+                       bool* end_of_stream,
+                       ErrorPtr* error) override;
+  bool WriteNonBlocking(const void* buffer,
+                        size_t size_to_write,
+                        size_t* size_written,
+                        ErrorPtr* error) override;
+  bool FlushBlocking(ErrorPtr* error) override;
+  bool CloseBlocking(ErrorPtr* error) override;
+  bool WaitForData(AccessMode mode,
+                   const base::Callback<void(AccessMode)>& callback,
+                   ErrorPtr* error) override;
+  bool WaitForDataBlocking(AccessMode in_mode,
+                           base::TimeDelta timeout,
+                           AccessMode* out_mode,
+                           ErrorPtr* error) override;
+  void CancelPendingAsyncOperations() override;
+
+ private:
+  struct Chunk {
+    // Either |text| or |stream| is used.
+    std::string text;
+    StreamPtr stream;
+    // The declared size of |stream| (if |size_known| is true).
+    bool size_known;
+    uint64_t size;
+    // The number of bytes of the chunk read so far.
+    uint64_t offset;
+  };
+
+  // Returns the stream of the current chunk or nullptr if it is text.
+  Stream* GetCurrentStream() const;
+
+  std::vector<Chunk> chunks_;
+  // The index of the chunk being read.
+  size_t current_chunk_{0};
+  bool size_known_{true};
+  uint64_t size_{0};
+  uint64_t position_{0};
+  bool closed_{false};
+
+  DISALLOW_COPY_AND_ASSIGN(FormDataStream);
+};
+
 // An abstract base class for all types of form fields used by FormData class.
 // This class represents basic information about a form part in
 // multipart/form-data and multipart/mixed content.
@@ -71,6 +156,11 @@ class BRILLO_EXPORT FormField {
   // types of form fields.
   virtual bool ExtractDataStreams(std::vector<StreamPtr>* streams) = 0;
 
+  // Appends the field data to |body|. The default implementation appends the
+  // streams returned by ExtractDataStreams(). Like ExtractDataStreams(), it
+  // can be guaranteed to succeed only on the first try.
+  virtual bool AppendDataTo(FormDataStream* body);
+
  protected:
   // Form field name. If not empty, it will be appended to Content-Disposition
   // field header using "name" attribute.
@@ -106,6 +196,7 @@ class BRILLO_EXPORT TextFormField : public FormField {
                 const std::string& transfer_encoding = {});
 
   bool ExtractDataStreams(std::vector<StreamPtr>* streams) override;
+  bool AppendDataTo(FormDataStream* body) override;
 
  private:
   std::string data_;  // Buffer/reader for field data.
@@ -136,10 +227,17 @@ class BRILLO_EXPORT FileFormField : public FormField {
   std::string GetContentDisposition() const override;
 
   bool ExtractDataStreams(std::vector<StreamPtr>* streams) override;
+  bool AppendDataTo(FormDataStream* body) override;
+
+  // Declares the size of the data of a stream which can't report it itself
+  // (e.g. a pipe), so the size of the request body can still be computed.
+  void SetDataSize(uint64_t size);
 
  private:
   StreamPtr stream_;
   std::string file_name_;
+  bool data_size_known_{false};
+  uint64_t data_size_{0};
 
   DISALLOW_COPY_AND_ASSIGN(FileFormField);
 };
@@ -164,6 +262,7 @@ class BRILLO_EXPORT MultiPartFormField : public FormField {
   std::string GetContentType() const override;
 
   bool ExtractDataStreams(std::vector<StreamPtr>* streams) override;
+  bool AppendDataTo(FormDataStream* body) override;
 
   // Adds a form field to the form data. The |field| could be a simple text
   // field, a file upload field or a multipart form field.
@@ -218,7 +317,9 @@ class BRILLO_EXPORT FormData final {
   std::string GetContentType() const;
 
   // Returns the data stream for the form data. This is a potentially
-  // destructive operation and can be called only once.
+  // destructive operation and can be called only once. The stream is a
+  // FormDataStream, which knows its size unless some of the file streams
+  // can't report theirs.
   StreamPtr ExtractDataStream();
 
  private:
@@ -8,9 +8,13 @@
 
 #include <base/files/file_util.h>
 #include <base/files/scoped_temp_dir.h>
+#include <base/test/simple_test_clock.h>
 #include <brillo/mime_utils.h>
+#include <brillo/streams/fake_stream.h>
 #include <brillo/streams/file_stream.h>
 #include <brillo/streams/input_stream_set.h>
+#include <brillo/streams/memory_stream.h>
+#include <brillo/streams/stream_errors.h>
 #include <gtest/gtest.h>
 
 namespace brillo {
@@ -171,6 +175,8 @@ TEST(HttpFormData, FormData) {
             form_data.GetContentType());
 
   StreamPtr stream = form_data.ExtractDataStream();
+  // All the sizes are known, so the body can be sent with "Content-Length:".
+  ASSERT_TRUE(stream->CanGetSize());
   std::vector<uint8_t> data(stream->GetSize());
   EXPECT_TRUE(stream->ReadAllBlocking(data.data(), data.size(), nullptr));
   const char expected_data[] =
@@ -197,6 +203,98 @@ TEST(HttpFormData, FormData) {
       "--boundary2--\r\n"
       "--boundary1--";
   EXPECT_EQ(expected_data, (std::string{data.begin(), data.end()}));
+  EXPECT_EQ(sizeof(expected_data) - 1, data.size());
+  EXPECT_EQ(data.size(), stream->GetPosition());
 }
+
+TEST(HttpFormData, FormDataStream) {
+  base::SimpleTestClock clock;
+  std::unique_ptr<FakeStream> part{
+      new FakeStream{Stream::AccessMode::READ, &clock}};
+  part->AddReadPacketString({}, "abc");
+  part->AddReadPacketString({}, "def");
+
+  FormDataStream stream;
+  stream.AppendText("--");
+  stream.AppendText("x\r\n");
+  stream.AppendStream(MemoryStream::OpenCopyOf("123", nullptr));
+  EXPECT_TRUE(stream.CanGetSize());
+  EXPECT_EQ(8u, stream.GetSize());
+  // The size of the fake stream is unknown.
+  stream.AppendStream(std::move(part));
+  stream.AppendText("\r\n");
+  EXPECT_FALSE(stream.CanGetSize());
+
+  std::string data;
+  char buffer[4];
+  size_t size_read = 0;
+  bool eos = false;
+  while (!eos) {
+    ASSERT_TRUE(stream.ReadNonBlocking(buffer, sizeof(buffer), &size_read,
+                                       &eos, nullptr));
+    data.append(buffer, size_read);
+  }
+  EXPECT_EQ("--x\r\n123abcdef\r\n", data);
+}
+
+TEST(HttpFormData, FileFormFieldDataSize) {
+  base::SimpleTestClock clock;
+  std::unique_ptr<FakeStream> part{
+      new FakeStream{Stream::AccessMode::READ, &clock}};
+  part->AddReadPacketString({}, "data");
+  std::unique_ptr<FileFormField> field{
+      new FileFormField{"file", std::move(part), "file.txt",
+                        content_disposition::kFormData, mime::text::kPlain}};
+  field->SetDataSize(4);
+  FormData form_data{"boundary"};
+  form_data.AddCustomField(std::move(field));
+
+  StreamPtr stream = form_data.ExtractDataStream();
+  ASSERT_TRUE(stream->CanGetSize());
+  std::vector<uint8_t> data(stream->GetSize());
+  EXPECT_TRUE(stream->ReadAllBlocking(data.data(), data.size(), nullptr));
+  const char expected_data[] =
+      "--boundary\r\n"
+      "Content-Disposition: form-data; name=\"file\"; "
+      "filename=\"file.txt\"\r\n"
+      "Content-Type: text/plain\r\n"
+      "\r\n"
+      "data\r\n"
+      "--boundary--";
+  EXPECT_EQ(expected_data, (std::string{data.begin(), data.end()}));
+}
+
+TEST(HttpFormData, FormDataStreamShortData) {
+  base::SimpleTestClock clock;
+  std::unique_ptr<FakeStream> part{
+      new FakeStream{Stream::AccessMode::READ, &clock}};
+  part->AddReadPacketString({}, "ab");
+  FormDataStream stream;
+  stream.AppendStream(std::move(part), 4);
+  stream.AppendText("end");
+  EXPECT_EQ(7u, stream.GetSize());
+
+  char buffer[7];
+  ErrorPtr error;
+  EXPECT_FALSE(stream.ReadAllBlocking(buffer, sizeof(buffer), &error));
+  ASSERT_NE(nullptr, error.get());
+  EXPECT_EQ(errors::stream::kDomain, error->GetDomain());
+  EXPECT_EQ(errors::stream::kPartialData, error->GetCode());
+}
+
+TEST(HttpFormData, FormDataStreamLongData) {
+  FormDataStream stream;
+  stream.AppendStream(MemoryStream::OpenCopyOf("abcdef", nullptr), 4);
+  stream.AppendText("end");
+  EXPECT_EQ(7u, stream.GetSize());
+
+  char buffer[7];
+  ErrorPtr error;
+  EXPECT_FALSE(stream.ReadAllBlocking(buffer, sizeof(buffer), &error));
+  ASSERT_NE(nullptr, error.get());
+  EXPECT_EQ(errors::stream::kDomain, error->GetDomain());
+  EXPECT_EQ(errors::stream::kPartialData, error->GetCode());
+}
+
 }  // namespace http
 }  // namespace brillo
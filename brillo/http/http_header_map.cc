@@ -0,0 +1,244 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/http/http_header_map.h>
+
+#include <unordered_map>
+
+#include <base/lazy_instance.h>
+#include <base/logging.h>
+#include <base/strings/string_util.h>
+#include <brillo/http/http_request.h>
+
+namespace brillo {
+namespace http {
+
+namespace {
+
+struct CaseInsensitiveHash {
+  size_t operator()(base::StringPiece str) const {
+    // FNV-1a over the lower-case characters.
+    size_t hash = 2166136261u;
+    for (char c : str) {
+      hash ^= static_cast<unsigned char>(base::ToLowerASCII(c));
+      hash *= 16777619u;
+    }
+    return hash;
+  }
+};
+
+struct CaseInsensitiveEqual {
+  bool operator()(base::StringPiece a, base::StringPiece b) const {
+    return base::EqualsCaseInsensitiveASCII(a, b);
+  }
+};
+
+// The table of the well-known header names.
+class KnownHeaders {
+ public:
+  KnownHeaders() {
+    const char* const kNames[] = {
+        request_header::kAccept,
+        request_header::kAcceptCharset,
+        request_header::kAcceptEncoding,
+        request_header::kAcceptLanguage,
+        request_header::kAllow,
+        request_header::kAuthorization,
+        request_header::kCacheControl,
+        request_header::kConnection,
+        request_header::kContentEncoding,
+        request_header::kContentLanguage,
+        request_header::kContentLength,
+        request_header::kContentLocation,
+        request_header::kContentMd5,
+        request_header::kContentRange,
+        request_header::kContentType,
+        request_header::kCookie,
+        request_header::kDate,
+        request_header::kExpect,
+        request_header::kExpires,
+        request_header::kFrom,
+        request_header::kHost,
+        request_header::kIfMatch,
+        request_header::kIfModifiedSince,
+        request_header::kIfNoneMatch,
+        request_header::kIfRange,
+        request_header::kIfUnmodifiedSince,
+        request_header::kLastModified,
+        request_header::kMaxForwards,
+        request_header::kPragma,
+        request_header::kProxyAuthorization,
+        request_header::kRange,
+        request_header::kReferer,
+        request_header::kTE,
+        request_header::kTrailer,
+        request_header::kTransferEncoding,
+        request_header::kUpgrade,
+        request_header::kUserAgent,
+        request_header::kVia,
+        request_header::kWarning,
+        response_header::kAcceptRanges,
+        response_header::kAge,
+        response_header::kAllow,
+        response_header::kCacheControl,
+        response_header::kConnection,
+        response_header::kContentEncoding,
+        response_header::kContentLanguage,
+        response_header::kContentLength,
+        response_header::kContentLocation,
+        response_header::kContentMd5,
+        response_header::kContentRange,
+        response_header::kContentType,
+        response_header::kDate,
+        response_header::kETag,
+        response_header::kExpires,
+        response_header::kLastModified,
+        response_header::kLocation,
+        response_header::kPragma,
+        response_header::kProxyAuthenticate,
+        response_header::kRetryAfter,
+        response_header::kServer,
+        response_header::kSetCookie,
+        response_header::kTrailer,
+        response_header::kTransferEncoding,
+        response_header::kUpgrade,
+        response_header::kVary,
+        response_header::kVia,
+        response_header::kWarning,
+        response_header::kWwwAuthenticate,
+    };
+    for (const char* name : kNames) {
+      // Many headers are both request and response headers, only add them
+      // once.
+      if (ids_.emplace(name, static_cast<int>(names_.size())).second)
+        names_.push_back(name);
+    }
+    CHECK_LE(names_.size(), HeaderMap::kMaxKnownHeaders);
+  }
+
+  // Returns the ID of the header |name| or -1 if it is not a known header.
+  int Find(base::StringPiece name) const {
+    auto p = ids_.find(name);
+    return p != ids_.end() ? p->second : -1;
+  }
+
+  const char* GetName(int id) const { return names_[id]; }
+
+ private:
+  // The keys point to the static header name constants.
+  std::unordered_map<base::StringPiece, int, CaseInsensitiveHash,
+                     CaseInsensitiveEqual> ids_;
+  std::vector<const char*> names_;
+};
+
+base::LazyInstance<KnownHeaders>::Leaky g_known_headers =
+    LAZY_INSTANCE_INITIALIZER;
+
+// Typical sizes of the response headers, to avoid reallocations while they
+// are being received.
+const size_t kInitialBufferSize = 512;
+const size_t kInitialHeaderCount = 16;
+
+}  // anonymous namespace
+
+HeaderMap::HeaderMap() {
+  buffer_.reserve(kInitialBufferSize);
+  entries_.reserve(kInitialHeaderCount);
+  first_entry_.fill(0);
+}
+
+HeaderMap::~HeaderMap() = default;
+
+void HeaderMap::Add(base::StringPiece name, base::StringPiece value) {
+  name = base::TrimWhitespaceASCII(name, base::TRIM_ALL);
+  value = base::TrimWhitespaceASCII(value, base::TRIM_ALL);
+  Entry entry{g_known_headers.Get().Find(name), 0, 0, 0, 0};
+  if (entry.known_id < 0) {
+    entry.name_offset = Store(name);
+    entry.name_size = name.size();
+  } else if (first_entry_[entry.known_id] == 0) {
+    first_entry_[entry.known_id] = entries_.size() + 1;
+  }
+  entry.value_offset = Store(value);
+  entry.value_size = value.size();
+  entries_.push_back(entry);
+}
+
+void HeaderMap::AddHeaders(const HeaderList& headers) {
+  for (const auto& pair : headers)
+    Add(pair.first, pair.second);
+}
+
+bool HeaderMap::AddHeaderLine(base::StringPiece line) {
+  size_t colon = line.find(':');
+  if (colon == base::StringPiece::npos || colon == 0)
+    return false;
+  Add(line.substr(0, colon), line.substr(colon + 1));
+  return true;
+}
+
+base::StringPiece HeaderMap::Get(base::StringPiece name) const {
+  int index = Find(name);
+  return index < 0 ? base::StringPiece{} : GetValue(index);
+}
+
+bool HeaderMap::Contains(base::StringPiece name) const {
+  return Find(name) >= 0;
+}
+
+base::StringPiece HeaderMap::GetName(size_t index) const {
+  const Entry& entry = entries_[index];
+  if (entry.known_id >= 0)
+    return g_known_headers.Get().GetName(entry.known_id);
+  return base::StringPiece{buffer_.data() + entry.name_offset,
+                           entry.name_size};
+}
+
+base::StringPiece HeaderMap::GetValue(size_t index) const {
+  const Entry& entry = entries_[index];
+  return base::StringPiece{buffer_.data() + entry.value_offset,
+                           entry.value_size};
+}
+
+void HeaderMap::Clear() {
+  buffer_.clear();
+  entries_.clear();
+  first_entry_.fill(0);
+}
+
+HeaderList HeaderMap::ToHeaderList() const {
+  HeaderList headers;
+  headers.reserve(entries_.size());
+  for (size_t i = 0; i < entries_.size(); i++)
+    headers.emplace_back(GetName(i).as_string(), GetValue(i).as_string());
+  return headers;
+}
+
+const char* HeaderMap::GetCanonicalName(base::StringPiece name) {
+  int id = g_known_headers.Get().Find(name);
+  return id < 0 ? nullptr : g_known_headers.Get().GetName(id);
+}
+
+int HeaderMap::Find(base::StringPiece name) const {
+  name = base::TrimWhitespaceASCII(name, base::TRIM_ALL);
+  int id = g_known_headers.Get().Find(name);
+  if (id >= 0)
+    return static_cast<int>(first_entry_[id]) - 1;
+  for (size_t i = 0; i < entries_.size(); i++) {
+    if (entries_[i].known_id < 0 &&
+        base::EqualsCaseInsensitiveASCII(GetName(i), name)) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+uint32_t HeaderMap::Store(base::StringPiece str) {
+  uint32_t offset = buffer_.size();
+  str.AppendToString(&buffer_);
+  return offset;
+}
+
+}  // namespace http
+}  // namespace brillo
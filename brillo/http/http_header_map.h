@@ -0,0 +1,102 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_HTTP_HTTP_HEADER_MAP_H_
+#define LIBBRILLO_BRILLO_HTTP_HTTP_HEADER_MAP_H_
+
+#include <stdint.h>
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include <base/macros.h>
+#include <base/strings/string_piece.h>
+#include <brillo/brillo_export.h>
+#include <brillo/http/http_transport.h>
+
+namespace brillo {
+namespace http {
+
+///////////////////////////////////////////////////////////////////////////////
+// HeaderMap is a compact container of HTTP headers used by the connections to
+// hold the request and response headers.
+//
+// Header names are matched case-insensitively. The well-known names (the ones
+// from request_header:: and response_header:: namespaces) are interned: they
+// are stored as a small integer ID, reported using their canonical spelling
+// and looked up in constant time. All the header values (and the names not
+// known in advance) are copied into a single buffer owned by the map, so
+// adding a header doesn't normally allocate any memory.
+//
+// The StringPiece objects returned by the map point into that buffer and are
+// invalidated by the next call to Add*() or Clear().
+///////////////////////////////////////////////////////////////////////////////
+class BRILLO_EXPORT HeaderMap final {
+ public:
+  HeaderMap();
+  ~HeaderMap();
+
+  // Adds a header. Leading and trailing whitespace is removed from both the
+  // name and the value. Multiple headers with the same name are allowed.
+  void Add(base::StringPiece name, base::StringPiece value);
+  void AddHeaders(const HeaderList& headers);
+  // Parses a "Name: value" header line and adds the header. Returns false if
+  // |line| is not a header line.
+  bool AddHeaderLine(base::StringPiece line);
+
+  // Returns the value of the first header called |name|, or an empty string
+  // if there is no such header.
+  base::StringPiece Get(base::StringPiece name) const;
+  bool Contains(base::StringPiece name) const;
+
+  // Access to the headers in the order they were added.
+  size_t size() const { return entries_.size(); }
+  bool empty() const { return entries_.empty(); }
+  base::StringPiece GetName(size_t index) const;
+  base::StringPiece GetValue(size_t index) const;
+
+  // Removes all the headers. The memory allocated by the map is retained, so
+  // the map can be reused without allocating again.
+  void Clear();
+
+  HeaderList ToHeaderList() const;
+
+  // Returns the canonical spelling of a well-known header name (such as
+  // "Content-Type" for "content-type"), or nullptr if |name| is not known.
+  static const char* GetCanonicalName(base::StringPiece name);
+
+  // The maximum number of well-known header names.
+  static const size_t kMaxKnownHeaders = 64;
+
+ private:
+  struct Entry {
+    // The ID of a well-known header name or -1 if the name is stored in
+    // |buffer_|.
+    int known_id;
+    uint32_t name_offset;
+    uint32_t name_size;
+    uint32_t value_offset;
+    uint32_t value_size;
+  };
+
+  // Returns the index of the first header called |name| or -1 if not found.
+  int Find(base::StringPiece name) const;
+  // Copies |str| to |buffer_| and returns its offset.
+  uint32_t Store(base::StringPiece str);
+
+  // The storage for the header values and unknown header names.
+  std::string buffer_;
+  std::vector<Entry> entries_;
+  // For each well-known header name, the index of its first entry plus one,
+  // or 0 if there is no header with that name.
+  std::array<uint32_t, kMaxKnownHeaders> first_entry_;
+
+  DISALLOW_COPY_AND_ASSIGN(HeaderMap);
+};
+
+}  // namespace http
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_HTTP_HTTP_HEADER_MAP_H_
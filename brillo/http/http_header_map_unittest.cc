@@ -0,0 +1,92 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/http/http_header_map.h>
+
+#include <brillo/http/http_request.h>
+#include <gtest/gtest.h>
+
+namespace brillo {
+namespace http {
+
+TEST(HttpHeaderMap, AddAndGet) {
+  HeaderMap headers;
+  EXPECT_TRUE(headers.empty());
+  headers.Add(response_header::kContentType, "text/plain");
+  headers.Add("X-Custom", "foo");
+  EXPECT_EQ(2u, headers.size());
+  EXPECT_EQ("text/plain", headers.Get(response_header::kContentType));
+  EXPECT_EQ("foo", headers.Get("X-Custom"));
+  EXPECT_EQ("", headers.Get(response_header::kETag));
+  EXPECT_EQ("", headers.Get("X-Other"));
+  EXPECT_TRUE(headers.Contains("X-Custom"));
+  EXPECT_FALSE(headers.Contains(response_header::kETag));
+}
+
+TEST(HttpHeaderMap, CaseInsensitive) {
+  HeaderMap headers;
+  headers.Add("content-LENGTH", "10");
+  headers.Add("x-custom", "foo");
+  EXPECT_EQ("10", headers.Get(response_header::kContentLength));
+  EXPECT_EQ("10", headers.Get("CONTENT-LENGTH"));
+  EXPECT_EQ("foo", headers.Get("X-Custom"));
+  // Well-known names are reported with their canonical spelling, the others
+  // as they were added.
+  EXPECT_EQ("Content-Length", headers.GetName(0));
+  EXPECT_EQ("x-custom", headers.GetName(1));
+}
+
+TEST(HttpHeaderMap, CanonicalName) {
+  EXPECT_EQ(response_header::kWwwAuthenticate,
+            std::string{HeaderMap::GetCanonicalName("www-authenticate")});
+  EXPECT_EQ(request_header::kTE,
+            std::string{HeaderMap::GetCanonicalName("te")});
+  EXPECT_EQ(nullptr, HeaderMap::GetCanonicalName("X-Custom"));
+}
+
+TEST(HttpHeaderMap, DuplicateHeaders) {
+  HeaderMap headers;
+  headers.Add(response_header::kSetCookie, "a=1");
+  headers.Add("X-Foo", "1");
+  headers.Add(response_header::kSetCookie, "b=2");
+  headers.Add("X-Foo", "2");
+  EXPECT_EQ(4u, headers.size());
+  // Get() returns the first value.
+  EXPECT_EQ("a=1", headers.Get(response_header::kSetCookie));
+  EXPECT_EQ("1", headers.Get("X-Foo"));
+  HeaderList expected{{response_header::kSetCookie, "a=1"},
+                      {"X-Foo", "1"},
+                      {response_header::kSetCookie, "b=2"},
+                      {"X-Foo", "2"}};
+  EXPECT_EQ(expected, headers.ToHeaderList());
+}
+
+TEST(HttpHeaderMap, AddHeaderLine) {
+  HeaderMap headers;
+  EXPECT_TRUE(headers.AddHeaderLine("Content-Type:  text/html "));
+  EXPECT_TRUE(headers.AddHeaderLine("X-Empty:"));
+  EXPECT_TRUE(headers.AddHeaderLine("Location: http://localhost:8080/"));
+  EXPECT_FALSE(headers.AddHeaderLine(""));
+  EXPECT_FALSE(headers.AddHeaderLine("no colon"));
+  EXPECT_FALSE(headers.AddHeaderLine(": value"));
+  EXPECT_EQ(3u, headers.size());
+  EXPECT_EQ("text/html", headers.Get(response_header::kContentType));
+  EXPECT_TRUE(headers.Contains("x-empty"));
+  EXPECT_EQ("", headers.Get("X-Empty"));
+  EXPECT_EQ("http://localhost:8080/", headers.Get(response_header::kLocation));
+}
+
+TEST(HttpHeaderMap, Clear) {
+  HeaderMap headers;
+  headers.AddHeaders({{request_header::kAccept, "*/*"}, {"X-Foo", "bar"}});
+  headers.Clear();
+  EXPECT_TRUE(headers.empty());
+  EXPECT_FALSE(headers.Contains(request_header::kAccept));
+  EXPECT_FALSE(headers.Contains("X-Foo"));
+  headers.Add(request_header::kAccept, "text/plain");
+  EXPECT_EQ("text/plain", headers.Get(request_header::kAccept));
+}
+
+}  // namespace http
+}  // namespace brillo
@@ -239,6 +239,15 @@ const std::string& Request::GetUserAgent() const {
   return user_agent_;
 }
 
+void Request::SetPriority(RequestPriority priority) {
+  DCHECK(transport_) << "Request already sent";
+  priority_ = priority;
+}
+
+RequestPriority Request::GetPriority() const {
+  return priority_;
+}
+
 bool Request::SendRequestIfNeeded(brillo::ErrorPtr* error) {
   if (transport_) {
     if (!connection_) {
@@ -273,6 +282,8 @@ bool Request::SendRequestIfNeeded(brillo::ErrorPtr* error) {
       }
       connection_ = transport_->CreateConnection(
           request_url_, method_, headers, user_agent_, referer_, error);
+      if (connection_)
+        connection_->SetPriority(priority_);
     }
 
     if (connection_)
@@ -353,5 +364,12 @@ std::string Response::GetHeader(const std::string& header_name) const {
   return std::string();
 }
 
+RequestTimings Response::GetTimings() const {
+  RequestTimings timings;
+  if (connection_ && !connection_->GetTimings(&timings))
+    timings = RequestTimings{};
+  return timings;
+}
+
 }  // namespace http
 }  // namespace brillo
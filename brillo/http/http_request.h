@@ -181,6 +181,10 @@ static const int RequestTooLarge = 413;
 static const int UriTooLong = 414;
 // Unsupported media type
 static const int UnsupportedMedia = 415;
+// Requested range cannot be satisfied
+static const int RangeNotSatisfiable = 416;
+// The client has sent too many requests (rate limiting).
+static const int TooManyRequests = 429;
 // Retry after doing the appropriate action.
 static const int RetryWith = 449;
 
@@ -275,6 +279,11 @@ class BRILLO_EXPORT Request final {
   void SetUserAgent(const std::string& user_agent);
   const std::string& GetUserAgent() const;
 
+  // Gets/Sets the priority of the request. Transports that limit the number
+  // of concurrent requests start higher priority requests first.
+  void SetPriority(RequestPriority priority);
+  RequestPriority GetPriority() const;
+
   // Sends the request to the server and blocks until the response is received,
   // which is returned as the response object.
   // In case the server couldn't be reached for whatever reason, returns
@@ -317,6 +326,8 @@ class BRILLO_EXPORT Request final {
   // List of acceptable response data types.
   // Sent to the server via "Accept: " header.
   std::string accept_ = "*/*";
+  // Scheduling priority of the request.
+  RequestPriority priority_{RequestPriority::MEDIUM};
 
   // List of optional request headers provided by the caller.
   std::multimap<std::string, std::string> headers_;
@@ -367,6 +378,10 @@ class BRILLO_EXPORT Response final {
   // Returns a value of a given response HTTP header.
   std::string GetHeader(const std::string& header_name) const;
 
+  // Returns the timing breakdown of the request. All the values are zero if
+  // the transport doesn't provide this information.
+  RequestTimings GetTimings() const;
+
  private:
   friend class HttpRequestTest;
 
@@ -0,0 +1,266 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/http/http_retry_policy.h>
+
+#include <utility>
+
+#include <base/bind.h>
+#include <base/strings/string_number_conversions.h>
+#include <brillo/http/http_utils.h>
+#include <brillo/url_utils.h>
+
+namespace brillo {
+namespace http {
+
+// A BackoffEntry using the clock of the policy, so the back-off follows the
+// virtual time in tests.
+class RetryPolicy::HostBackoffEntry : public BackoffEntry {
+ public:
+  HostBackoffEntry(const Policy* policy, base::Clock* clock)
+      : BackoffEntry{policy}, clock_{clock} {}
+
+  base::TimeTicks Now() const { return ImplGetTimeNow(); }
+
+ protected:
+  base::TimeTicks ImplGetTimeNow() const override {
+    return base::TimeTicks() + (clock_->Now() - base::Time());
+  }
+
+ private:
+  base::Clock* clock_;
+
+  DISALLOW_COPY_AND_ASSIGN(HostBackoffEntry);
+};
+
+RetryPolicy::RetryPolicy(const Options& options, base::Clock* clock)
+    : options_{options}, clock_{clock ? clock : &default_clock_} {}
+
+RetryPolicy::~RetryPolicy() {
+  while (!operations_.empty())
+    FinishOperation(operations_.begin()->first);
+}
+
+RequestID RetryPolicy::SendRequest(const std::string& method,
+                                   const std::string& url,
+                                   const void* data,
+                                   size_t data_size,
+                                   const std::string& mime_type,
+                                   const HeaderList& headers,
+                                   std::shared_ptr<Transport> transport,
+                                   const SuccessCallback& success_callback,
+                                   const ErrorCallback& error_callback) {
+  RequestID id = ++last_request_id_;
+  std::unique_ptr<Operation> operation{new Operation};
+  operation->method = method;
+  operation->url = url;
+  operation->host = url::GetHostAndPort(url);
+  if (data_size)
+    operation->data.assign(static_cast<const char*>(data), data_size);
+  operation->mime_type = mime_type;
+  operation->headers = headers;
+  operation->transport = std::move(transport);
+  operation->success_callback = success_callback;
+  operation->error_callback = error_callback;
+  bool idempotent = IsIdempotentMethod(method);
+  operation->can_retry = idempotent || options_.retry_non_idempotent;
+  operation->can_hedge = idempotent && options_.hedge;
+  operation->attempt_count = 0;
+  operation->task_id = MessageLoop::kTaskIdNull;
+  operations_.emplace(id, std::move(operation));
+  StartAttempt(id);
+  return id;
+}
+
+bool RetryPolicy::CancelRequest(RequestID request_id) {
+  if (operations_.find(request_id) == operations_.end())
+    return false;
+  FinishOperation(request_id);
+  return true;
+}
+
+base::TimeDelta RetryPolicy::GetBackoffDelay(const std::string& host) const {
+  auto p = backoff_entries_.find(host);
+  if (p == backoff_entries_.end())
+    return base::TimeDelta();
+  return p->second->GetTimeUntilRelease();
+}
+
+base::TimeDelta RetryPolicy::GetHedgeDelay(const std::string& host) const {
+  auto p = latencies_.find(host);
+  if (p == latencies_.end() ||
+      p->second.GetCount() < options_.hedge_min_samples) {
+    return options_.hedge_delay;
+  }
+  return p->second.GetPercentile(options_.hedge_percentile);
+}
+
+bool RetryPolicy::IsIdempotentMethod(const std::string& method) {
+  return method == request_type::kGet || method == request_type::kHead ||
+         method == request_type::kOptions || method == request_type::kPut ||
+         method == request_type::kDelete || method == request_type::kTrace;
+}
+
+bool RetryPolicy::IsRetryableStatus(int status) {
+  if (status == status_code::RequestTimeout ||
+      status == status_code::TooManyRequests) {
+    return true;
+  }
+  return status >= status_code::InternalServerError &&
+         status != status_code::NotSupported &&
+         status != status_code::VersionNotSupported;
+}
+
+RetryPolicy::HostBackoffEntry* RetryPolicy::GetBackoffEntry(
+    const std::string& host) {
+  std::unique_ptr<HostBackoffEntry>& entry = backoff_entries_[host];
+  if (!entry)
+    entry.reset(new HostBackoffEntry{&options_.backoff, clock_});
+  return entry.get();
+}
+
+void RetryPolicy::StartAttempt(RequestID id) {
+  Operation* operation = operations_[id].get();
+  operation->task_id = MessageLoop::kTaskIdNull;
+  base::TimeDelta delay = GetBackoffEntry(operation->host)
+                              ->GetTimeUntilRelease();
+  if (delay > base::TimeDelta()) {
+    operation->task_id = MessageLoop::current()->PostDelayedTask(
+        FROM_HERE,
+        base::Bind(&RetryPolicy::StartAttempt, weak_ptr_factory_.GetWeakPtr(),
+                   id),
+        delay);
+    return;
+  }
+
+  operation->attempt_count++;
+  SendCopy(id);
+
+  // The callbacks may have been called already, finishing the request or
+  // scheduling a retry.
+  auto p = operations_.find(id);
+  if (p == operations_.end() || !p->second->can_hedge ||
+      p->second->task_id != MessageLoop::kTaskIdNull) {
+    return;
+  }
+  p->second->task_id = MessageLoop::current()->PostDelayedTask(
+      FROM_HERE,
+      base::Bind(&RetryPolicy::OnHedgeTimeout, weak_ptr_factory_.GetWeakPtr(),
+                 id),
+      GetHedgeDelay(p->second->host));
+}
+
+void RetryPolicy::SendCopy(RequestID id) {
+  Operation* operation = operations_[id].get();
+  size_t attempt = operation->attempts.size();
+  operation->attempts.push_back(Attempt{0, clock_->Now(), false});
+  RequestID transport_id = http::SendRequest(
+      operation->method, operation->url, operation->data.data(),
+      operation->data.size(), operation->mime_type, operation->headers,
+      operation->transport,
+      base::Bind(&RetryPolicy::OnSuccess, weak_ptr_factory_.GetWeakPtr(), id,
+                 attempt),
+      base::Bind(&RetryPolicy::OnError, weak_ptr_factory_.GetWeakPtr(), id,
+                 attempt));
+  // With a synchronous transport, the attempt might have already finished
+  // and even been discarded to make room for a retry.
+  auto p = operations_.find(id);
+  if (p != operations_.end() && attempt < p->second->attempts.size() &&
+      !p->second->attempts[attempt].finished) {
+    p->second->attempts[attempt].transport_id = transport_id;
+  }
+}
+
+void RetryPolicy::OnHedgeTimeout(RequestID id) {
+  Operation* operation = operations_[id].get();
+  operation->task_id = MessageLoop::kTaskIdNull;
+  SendCopy(id);
+}
+
+void RetryPolicy::OnSuccess(RequestID id,
+                            size_t attempt,
+                            RequestID /* transport_id */,
+                            std::unique_ptr<Response> response) {
+  auto p = operations_.find(id);
+  if (p == operations_.end())
+    return;
+  Operation* operation = p->second.get();
+  operation->attempts[attempt].finished = true;
+  HostBackoffEntry* entry = GetBackoffEntry(operation->host);
+  if (IsRetryableStatus(response->GetStatusCode())) {
+    entry->InformOfRequest(false);
+    int64_t seconds = 0;
+    if (base::StringToInt64(response->GetHeader(response_header::kRetryAfter),
+                            &seconds) &&
+        seconds >= 0) {
+      entry->SetCustomReleaseTime(entry->Now() +
+                                  base::TimeDelta::FromSeconds(seconds));
+    }
+    // If the request is not retried, the last response is passed on to the
+    // caller as is.
+    if (OnAttemptFailed(id))
+      return;
+  } else {
+    entry->InformOfRequest(true);
+    latencies_[operation->host].AddSample(
+        clock_->Now() - operation->attempts[attempt].start_time);
+  }
+  std::unique_ptr<Operation> finished = FinishOperation(id);
+  finished->success_callback.Run(id, std::move(response));
+}
+
+void RetryPolicy::OnError(RequestID id,
+                          size_t attempt,
+                          RequestID /* transport_id */,
+                          const Error* error) {
+  auto p = operations_.find(id);
+  if (p == operations_.end())
+    return;
+  p->second->attempts[attempt].finished = true;
+  GetBackoffEntry(p->second->host)->InformOfRequest(false);
+  if (OnAttemptFailed(id))
+    return;
+  std::unique_ptr<Operation> finished = FinishOperation(id);
+  finished->error_callback.Run(id, error);
+}
+
+bool RetryPolicy::OnAttemptFailed(RequestID id) {
+  Operation* operation = operations_[id].get();
+  // Wait for the other copy of a hedged request.
+  for (const Attempt& attempt : operation->attempts) {
+    if (!attempt.finished)
+      return true;
+  }
+  if (!operation->can_retry ||
+      operation->attempt_count >= options_.max_attempts) {
+    return false;
+  }
+  // All the copies have finished, so their callbacks won't be called again.
+  operation->attempts.clear();
+  if (operation->task_id != MessageLoop::kTaskIdNull)
+    MessageLoop::current()->CancelTask(operation->task_id);
+  // StartAttempt() applies the back-off delay.
+  operation->task_id = MessageLoop::current()->PostTask(
+      FROM_HERE,
+      base::Bind(&RetryPolicy::StartAttempt, weak_ptr_factory_.GetWeakPtr(),
+                 id));
+  return true;
+}
+
+std::unique_ptr<RetryPolicy::Operation> RetryPolicy::FinishOperation(
+    RequestID id) {
+  auto p = operations_.find(id);
+  std::unique_ptr<Operation> operation = std::move(p->second);
+  operations_.erase(p);
+  if (operation->task_id != MessageLoop::kTaskIdNull)
+    MessageLoop::current()->CancelTask(operation->task_id);
+  for (const Attempt& attempt : operation->attempts) {
+    if (!attempt.finished && attempt.transport_id)
+      operation->transport->CancelRequest(attempt.transport_id);
+  }
+  return operation;
+}
+
+}  // namespace http
+}  // namespace brillo
@@ -0,0 +1,182 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_HTTP_HTTP_RETRY_POLICY_H_
+#define LIBBRILLO_BRILLO_HTTP_HTTP_RETRY_POLICY_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/macros.h>
+#include <base/memory/weak_ptr.h>
+#include <base/time/clock.h>
+#include <base/time/default_clock.h>
+#include <brillo/backoff_entry.h>
+#include <brillo/brillo_export.h>
+#include <brillo/http/http_request.h>
+#include <brillo/http/http_timing_stats.h>
+#include <brillo/http/http_transport.h>
+#include <brillo/message_loops/message_loop.h>
+
+namespace brillo {
+namespace http {
+
+///////////////////////////////////////////////////////////////////////////////
+// RetryPolicy sends asynchronous requests with automatic retries, replacing
+// the retry loops callers would otherwise write around http::SendRequest():
+//
+//    RetryPolicy::Options options;
+//    options.hedge = true;
+//    policy = std::make_shared<http::RetryPolicy>(options);
+//    policy->SendRequest(request_type::kGet, url, nullptr, 0, {}, {},
+//                        transport, base::Bind(&OnSuccess),
+//                        base::Bind(&OnError));
+//
+// A request is retried when the transport fails or the server replies with
+// 408, 429 or a 5xx status (other than 501 and 505), up to
+// Options::max_attempts times. Only idempotent methods are retried unless
+// Options::retry_non_idempotent is set. Failures are tracked per host with a
+// BackoffEntry, so all the requests to a failing host (not only the retries)
+// are delayed by the exponential back-off, and a "Retry-After:" reply
+// postpones them until the time the server asked for.
+//
+// With Options::hedge set, a second copy of an idempotent request is sent if
+// no response arrives within the Options::hedge_percentile latency of the
+// previous requests to the same host, and the first response to arrive is
+// used. This cuts the tail latency at the cost of a few extra requests.
+//
+// The delays use the current brillo::MessageLoop, so the policy can be tested
+// with http::fake::Transport and FakeMessageLoop virtual time. The policy must
+// outlive the requests sent through it; destroying it cancels them.
+///////////////////////////////////////////////////////////////////////////////
+class BRILLO_EXPORT RetryPolicy final {
+ public:
+  struct Options {
+    // The maximum number of times a request is sent, including the first one
+    // (but not the hedged copies).
+    int max_attempts = 3;
+    // The back-off applied to a host after failed requests: 1 s, doubled
+    // after each failure up to 1 minute, with 20% jitter.
+    BackoffEntry::Policy backoff = {0, 1000, 2.0, 0.2, 60 * 1000, -1, false};
+    // Whether to retry non-idempotent requests (e.g. POST) too.
+    bool retry_non_idempotent = false;
+    // Whether to send hedged copies of slow idempotent requests.
+    bool hedge = false;
+    // The percentile of the host's latency after which a request is hedged.
+    double hedge_percentile = 95.0;
+    // The hedging delay used until |hedge_min_samples| responses from the
+    // host have been received.
+    base::TimeDelta hedge_delay = base::TimeDelta::FromSeconds(1);
+    uint64_t hedge_min_samples = 20;
+  };
+
+  // |clock| is used to measure the request latency and to drive the
+  // back-off (the default clock is used if null).
+  explicit RetryPolicy(const Options& options, base::Clock* clock = nullptr);
+  ~RetryPolicy();
+
+  // Sends a request with |data| as the body (which can be empty). The
+  // arguments are the same as for http::SendRequest(), except that the
+  // data is kept in memory to be able to send it again. Exactly one of the
+  // callbacks is called, with the ID returned by this method.
+  RequestID SendRequest(const std::string& method,
+                        const std::string& url,
+                        const void* data,
+                        size_t data_size,
+                        const std::string& mime_type,
+                        const HeaderList& headers,
+                        std::shared_ptr<Transport> transport,
+                        const SuccessCallback& success_callback,
+                        const ErrorCallback& error_callback);
+
+  // Cancels a request sent with SendRequest(), including the pending
+  // retries. Returns false if there is no such request.
+  bool CancelRequest(RequestID request_id);
+
+  // Returns the number of requests still in progress.
+  size_t GetPendingRequestCount() const { return operations_.size(); }
+
+  // Returns how long new requests to |host| would be delayed by the back-off.
+  base::TimeDelta GetBackoffDelay(const std::string& host) const;
+  // Returns the delay after which requests to |host| are hedged.
+  base::TimeDelta GetHedgeDelay(const std::string& host) const;
+
+  // Returns true for the methods that can safely be sent more than once.
+  static bool IsIdempotentMethod(const std::string& method);
+  // Returns true for the status codes indicating a transient server error.
+  static bool IsRetryableStatus(int status_code);
+
+ private:
+  class HostBackoffEntry;
+
+  // One copy of the request sent to the transport.
+  struct Attempt {
+    RequestID transport_id;
+    base::Time start_time;
+    bool finished;
+  };
+
+  struct Operation {
+    std::string method;
+    std::string url;
+    std::string host;
+    std::string data;
+    std::string mime_type;
+    HeaderList headers;
+    std::shared_ptr<Transport> transport;
+    SuccessCallback success_callback;
+    ErrorCallback error_callback;
+    bool can_retry;
+    bool can_hedge;
+    // The number of times the request has been sent, not counting hedging.
+    int attempt_count;
+    std::vector<Attempt> attempts;
+    // The delayed retry or hedging task.
+    MessageLoop::TaskId task_id;
+  };
+
+  HostBackoffEntry* GetBackoffEntry(const std::string& host);
+
+  // Sends the request, unless the host is backing off, in which case the
+  // request is postponed.
+  void StartAttempt(RequestID id);
+  // Sends one copy of the request.
+  void SendCopy(RequestID id);
+  void OnHedgeTimeout(RequestID id);
+
+  void OnSuccess(RequestID id,
+                 size_t attempt,
+                 RequestID transport_id,
+                 std::unique_ptr<Response> response);
+  void OnError(RequestID id,
+               size_t attempt,
+               RequestID transport_id,
+               const Error* error);
+  // Called when a copy of the request failed with a transient error. Returns
+  // true if the request is retried (or another copy is still in flight).
+  bool OnAttemptFailed(RequestID id);
+
+  // Removes the operation |id|, cancelling its pending attempts and tasks.
+  std::unique_ptr<Operation> FinishOperation(RequestID id);
+
+  Options options_;
+  base::DefaultClock default_clock_;
+  base::Clock* clock_;
+
+  std::map<RequestID, std::unique_ptr<Operation>> operations_;
+  RequestID last_request_id_{0};
+  std::map<std::string, std::unique_ptr<HostBackoffEntry>> backoff_entries_;
+  // The latency of the successful requests to each host.
+  std::map<std::string, TimingHistogram> latencies_;
+
+  base::WeakPtrFactory<RetryPolicy> weak_ptr_factory_{this};
+  DISALLOW_COPY_AND_ASSIGN(RetryPolicy);
+};
+
+}  // namespace http
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_HTTP_HTTP_RETRY_POLICY_H_
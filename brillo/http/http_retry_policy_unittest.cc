@@ -0,0 +1,255 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/http/http_retry_policy.h>
+
+#include <string>
+
+#include <base/test/simple_test_clock.h>
+#include <brillo/bind_lambda.h>
+#include <brillo/http/http_transport_fake.h>
+#include <brillo/message_loops/fake_message_loop.h>
+#include <brillo/mime_utils.h>
+#include <gtest/gtest.h>
+
+namespace brillo {
+namespace http {
+
+namespace {
+
+const char kUrl[] = "http://localhost/data";
+const char kHost[] = "localhost";
+
+}  // anonymous namespace
+
+class HttpRetryPolicyTest : public testing::Test {
+ public:
+  void SetUp() override {
+    clock_.SetNow(base::Time::Now());
+    loop_.SetAsCurrent();
+    transport_ = std::make_shared<fake::Transport>();
+    // No jitter, to make the back-off delays predictable.
+    options_.backoff = {0, 1000, 2.0, 0.0, 60 * 1000, -1, false};
+  }
+
+  // Installs a handler failing the first |failures| requests with
+  // |error_status| and replying "200 OK" afterwards.
+  void AddHandler(int failures,
+                  int error_status = status_code::ServiceUnavailable,
+                  const HeaderList& error_headers = {}) {
+    auto handler = [this, failures, error_status, error_headers](
+        const fake::ServerRequest& /* request */,
+        fake::ServerResponse* response) {
+      if (handler_calls_++ < failures) {
+        response->ReplyText(error_status, "error", mime::text::kPlain);
+        response->AddHeaders(error_headers);
+        return;
+      }
+      response->ReplyText(status_code::Ok, "data", mime::text::kPlain);
+    };
+    transport_->AddHandler(kUrl, "*", base::Bind(handler));
+  }
+
+  RequestID Send(const std::string& method = request_type::kGet) {
+    if (!policy_)
+      policy_.reset(new RetryPolicy{options_, &clock_});
+    auto success_callback = [this](RequestID /* id */,
+                                   std::unique_ptr<Response> response) {
+      success_count_++;
+      last_status_ = response->GetStatusCode();
+    };
+    auto error_callback = [this](RequestID /* id */,
+                                 const Error* /* error */) { error_count_++; };
+    return policy_->SendRequest(method, kUrl, "body", 4, mime::text::kPlain,
+                                {}, transport_, base::Bind(success_callback),
+                                base::Bind(error_callback));
+  }
+
+ protected:
+  base::SimpleTestClock clock_;
+  FakeMessageLoop loop_{&clock_};
+  std::shared_ptr<fake::Transport> transport_;
+  RetryPolicy::Options options_;
+  std::unique_ptr<RetryPolicy> policy_;
+  int handler_calls_{0};
+  int success_count_{0};
+  int error_count_{0};
+  int last_status_{0};
+};
+
+TEST_F(HttpRetryPolicyTest, Success) {
+  AddHandler(0);
+  Send();
+  loop_.Run();
+  EXPECT_EQ(1, success_count_);
+  EXPECT_EQ(status_code::Ok, last_status_);
+  EXPECT_EQ(1, transport_->GetRequestCount());
+  EXPECT_EQ(0u, policy_->GetPendingRequestCount());
+}
+
+TEST_F(HttpRetryPolicyTest, RetriesWithBackoff) {
+  AddHandler(2);
+  base::Time start = clock_.Now();
+  Send();
+  loop_.Run();
+  EXPECT_EQ(1, success_count_);
+  EXPECT_EQ(status_code::Ok, last_status_);
+  EXPECT_EQ(3, transport_->GetRequestCount());
+  // Waited 1 s after the first failure and 2 s after the second.
+  EXPECT_EQ(base::TimeDelta::FromSeconds(3), clock_.Now() - start);
+}
+
+TEST_F(HttpRetryPolicyTest, GivesUp) {
+  AddHandler(10);
+  Send();
+  loop_.Run();
+  // The last response is passed on.
+  EXPECT_EQ(1, success_count_);
+  EXPECT_EQ(status_code::ServiceUnavailable, last_status_);
+  EXPECT_EQ(3, transport_->GetRequestCount());
+  // The following requests to the host are delayed too.
+  EXPECT_EQ(base::TimeDelta::FromSeconds(4), policy_->GetBackoffDelay(kHost));
+}
+
+TEST_F(HttpRetryPolicyTest, PermanentErrorNotRetried) {
+  AddHandler(10, status_code::NotFound);
+  Send();
+  loop_.Run();
+  EXPECT_EQ(status_code::NotFound, last_status_);
+  EXPECT_EQ(1, transport_->GetRequestCount());
+}
+
+TEST_F(HttpRetryPolicyTest, NonIdempotent) {
+  AddHandler(1);
+  Send(request_type::kPost);
+  loop_.Run();
+  EXPECT_EQ(status_code::ServiceUnavailable, last_status_);
+  EXPECT_EQ(1, transport_->GetRequestCount());
+
+  options_.retry_non_idempotent = true;
+  policy_.reset();
+  handler_calls_ = 0;
+  Send(request_type::kPost);
+  loop_.Run();
+  EXPECT_EQ(status_code::Ok, last_status_);
+  EXPECT_EQ(3, transport_->GetRequestCount());
+}
+
+TEST_F(HttpRetryPolicyTest, TransportError) {
+  AddHandler(0);
+  ErrorPtr error;
+  Error::AddTo(&error, FROM_HERE, "test", "connect", "Connection refused");
+  transport_->SetCreateConnectionError(std::move(error));
+  Send();
+  loop_.Run();
+  EXPECT_EQ(0, error_count_);
+  EXPECT_EQ(1, success_count_);
+  EXPECT_EQ(status_code::Ok, last_status_);
+
+  options_.max_attempts = 1;
+  policy_.reset();
+  error.reset();
+  Error::AddTo(&error, FROM_HERE, "test", "connect", "Connection refused");
+  transport_->SetCreateConnectionError(std::move(error));
+  Send();
+  loop_.Run();
+  EXPECT_EQ(1, error_count_);
+}
+
+TEST_F(HttpRetryPolicyTest, RetryAfter) {
+  AddHandler(1, status_code::TooManyRequests,
+             {{response_header::kRetryAfter, "30"}});
+  base::Time start = clock_.Now();
+  Send();
+  loop_.Run();
+  EXPECT_EQ(status_code::Ok, last_status_);
+  EXPECT_EQ(base::TimeDelta::FromSeconds(30), clock_.Now() - start);
+}
+
+TEST_F(HttpRetryPolicyTest, Cancel) {
+  AddHandler(0);
+  transport_->SetAsyncMode(true);
+  RequestID id = Send();
+  EXPECT_EQ(1u, policy_->GetPendingRequestCount());
+  EXPECT_TRUE(policy_->CancelRequest(id));
+  EXPECT_FALSE(policy_->CancelRequest(id));
+  transport_->HandleAllAsyncRequests();
+  loop_.Run();
+  EXPECT_EQ(0, success_count_);
+  EXPECT_EQ(0u, policy_->GetPendingRequestCount());
+}
+
+TEST_F(HttpRetryPolicyTest, Hedging) {
+  AddHandler(0);
+  transport_->SetAsyncMode(true);
+  options_.hedge = true;
+  options_.hedge_delay = base::TimeDelta::FromMilliseconds(100);
+  Send();
+  EXPECT_EQ(1, transport_->GetRequestCount());
+  // No response within the hedging delay: the second copy is sent.
+  base::Time start = clock_.Now();
+  EXPECT_TRUE(loop_.RunOnce(true));
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(100), clock_.Now() - start);
+  EXPECT_EQ(2, transport_->GetRequestCount());
+  // The first response is used and the other one is ignored.
+  EXPECT_TRUE(transport_->HandleOneAsyncRequest());
+  EXPECT_EQ(1, success_count_);
+  EXPECT_EQ(0u, policy_->GetPendingRequestCount());
+  EXPECT_TRUE(transport_->HandleOneAsyncRequest());
+  EXPECT_EQ(1, success_count_);
+  loop_.Run();
+  EXPECT_EQ(2, transport_->GetRequestCount());
+}
+
+// The fake transport runs the callbacks before SendRequest() returns by
+// default, so a failed attempt is already scheduled for a retry by then.
+TEST_F(HttpRetryPolicyTest, HedgingWithSynchronousRetries) {
+  AddHandler(2);
+  options_.hedge = true;
+  options_.hedge_delay = base::TimeDelta::FromMilliseconds(100);
+  base::Time start = clock_.Now();
+  Send();
+  EXPECT_EQ(1, transport_->GetRequestCount());
+  loop_.Run();
+  EXPECT_EQ(1, success_count_);
+  EXPECT_EQ(status_code::Ok, last_status_);
+  // No hedged copies: only the retries were sent, after the back-off.
+  EXPECT_EQ(3, transport_->GetRequestCount());
+  EXPECT_EQ(base::TimeDelta::FromSeconds(3), clock_.Now() - start);
+  EXPECT_EQ(0u, policy_->GetPendingRequestCount());
+}
+
+TEST_F(HttpRetryPolicyTest, HedgeDelayFromLatency) {
+  AddHandler(0);
+  transport_->SetAsyncMode(true);
+  options_.hedge_min_samples = 4;
+  options_.hedge_percentile = 50;
+  policy_.reset(new RetryPolicy{options_, &clock_});
+  for (int latency_ms : {10, 20, 30, 400}) {
+    EXPECT_EQ(options_.hedge_delay, policy_->GetHedgeDelay(kHost));
+    Send();
+    clock_.Advance(base::TimeDelta::FromMilliseconds(latency_ms));
+    transport_->HandleAllAsyncRequests();
+  }
+  EXPECT_EQ(4, success_count_);
+  // The median falls into the [16, 32) ms bucket.
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(32),
+            policy_->GetHedgeDelay(kHost));
+  // Not enough samples for other hosts.
+  EXPECT_EQ(options_.hedge_delay, policy_->GetHedgeDelay("example.com"));
+}
+
+TEST_F(HttpRetryPolicyTest, RetryableStatus) {
+  EXPECT_TRUE(RetryPolicy::IsRetryableStatus(status_code::RequestTimeout));
+  EXPECT_TRUE(RetryPolicy::IsRetryableStatus(status_code::TooManyRequests));
+  EXPECT_TRUE(RetryPolicy::IsRetryableStatus(status_code::BadGateway));
+  EXPECT_FALSE(RetryPolicy::IsRetryableStatus(status_code::NotSupported));
+  EXPECT_FALSE(RetryPolicy::IsRetryableStatus(status_code::NotFound));
+  EXPECT_FALSE(RetryPolicy::IsRetryableStatus(status_code::Ok));
+  EXPECT_TRUE(RetryPolicy::IsIdempotentMethod(request_type::kPut));
+  EXPECT_FALSE(RetryPolicy::IsIdempotentMethod(request_type::kPatch));
+}
+
+}  // namespace http
+}  // namespace brillo
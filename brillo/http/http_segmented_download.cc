@@ -0,0 +1,351 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/http/http_segmented_download.h>
+
+#include <inttypes.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#include <base/bind.h>
+#include <base/logging.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/string_util.h>
+#include <brillo/streams/stream_utils.h>
+
+namespace brillo {
+namespace http {
+
+namespace {
+
+// The size of the buffer used to copy the segment data when the transport
+// doesn't write it directly into the file.
+const size_t kCopyBufferSize = 64 * 1024;
+
+}  // anonymous namespace
+
+SegmentedDownload::SegmentedDownload(
+    const std::string& url,
+    const base::FilePath& file_path,
+    const std::shared_ptr<Transport>& transport,
+    const Options& options)
+    : url_{url},
+      file_path_{file_path},
+      transport_{transport},
+      options_(options) {
+  options_.max_segments = std::max<size_t>(options_.max_segments, 1);
+  options_.min_segment_size = std::max<uint64_t>(options_.min_segment_size, 1);
+}
+
+SegmentedDownload::~SegmentedDownload() {
+  Cancel();
+}
+
+void SegmentedDownload::Start(const SuccessCallback& success_callback,
+                              const ErrorCallback& error_callback) {
+  success_callback_ = success_callback;
+  error_callback_ = error_callback;
+
+  Request request{url_, request_type::kHead, transport_};
+  request.AddHeaders(options_.headers);
+  head_request_id_ = request.GetResponse(
+      base::Bind(&SegmentedDownload::OnHeadSuccess,
+                 weak_ptr_factory_.GetWeakPtr()),
+      base::Bind(&SegmentedDownload::OnHeadError,
+                 weak_ptr_factory_.GetWeakPtr()));
+}
+
+void SegmentedDownload::Cancel() {
+  weak_ptr_factory_.InvalidateWeakPtrs();
+  if (head_request_id_)
+    transport_->CancelRequest(head_request_id_);
+  head_request_id_ = 0;
+  for (Segment& segment : segments_) {
+    if (segment.request_id)
+      transport_->CancelRequest(segment.request_id);
+    segment.request_id = 0;
+    segment.connection.reset();
+  }
+  success_callback_.Reset();
+  error_callback_.Reset();
+}
+
+uint64_t SegmentedDownload::GetBytesDownloaded() const {
+  uint64_t total = 0;
+  for (const Segment& segment : segments_)
+    total += segment.written;
+  return total;
+}
+
+void SegmentedDownload::OnHeadSuccess(RequestID /* request_id */,
+                                      std::unique_ptr<Response> response) {
+  head_request_id_ = 0;
+  uint64_t total_size = 0;
+  bool ranges_supported = false;
+  // A failed HEAD request is not fatal. Some servers just don't implement it,
+  // so download the whole resource with a single request in this case.
+  if (response->IsSuccessful()) {
+    std::string length = response->GetHeader(response_header::kContentLength);
+    if (!base::StringToUint64(length, &total_size))
+      total_size = 0;
+    ranges_supported = base::EqualsCaseInsensitiveASCII(
+        response->GetHeader(response_header::kAcceptRanges), "bytes");
+    etag_ = response->GetHeader(response_header::kETag);
+  }
+  StartSegments(total_size, ranges_supported && total_size > 0);
+}
+
+void SegmentedDownload::OnHeadError(RequestID /* request_id */,
+                                    const Error* error) {
+  head_request_id_ = 0;
+  ReportError(error);
+}
+
+void SegmentedDownload::StartSegments(uint64_t total_size,
+                                      bool ranges_supported) {
+  ErrorPtr error;
+  StreamPtr stream = FileStream::Open(file_path_, Stream::AccessMode::WRITE,
+                                      FileStream::Disposition::CREATE_ALWAYS,
+                                      &error);
+  // Preallocate the file so that the segments can be written in any order.
+  if (!stream || !stream->SetSizeBlocking(total_size, &error)) {
+    ReportError(error.get());
+    return;
+  }
+  file_.reset(static_cast<FileStream*>(stream.release()));
+  total_size_ = total_size;
+  ranges_supported_ = ranges_supported;
+
+  size_t count = 1;
+  if (ranges_supported) {
+    uint64_t max_count = (total_size + options_.min_segment_size - 1) /
+                         options_.min_segment_size;
+    count = static_cast<size_t>(
+        std::min<uint64_t>(options_.max_segments, max_count));
+  }
+  uint64_t segment_size = (total_size + count - 1) / count;
+  segments_.clear();
+  for (uint64_t offset = 0; segments_.empty() || offset < total_size;
+       offset += segment_size) {
+    uint64_t size = std::min(segment_size, total_size - offset);
+    segments_.push_back(
+        Segment{offset, size, 0, 0, 0, 0, nullptr, false, false, false, false});
+  }
+  VLOG(1) << "Downloading " << url_ << " (" << total_size << " bytes) in "
+          << segments_.size() << " segment(s)";
+
+  // Issue all the requests up front, so that they run concurrently. With a
+  // synchronous transport, a request might complete the whole download (and
+  // destroy this object in the completion callback) before returning.
+  auto weak_this = weak_ptr_factory_.GetWeakPtr();
+  for (size_t i = 0; i < segments_.size(); i++) {
+    StartSegment(i);
+    if (!weak_this || error_callback_.is_null())
+      return;
+  }
+}
+
+void SegmentedDownload::StartSegment(size_t index) {
+  Segment& segment = segments_[index];
+  HeaderList headers = options_.headers;
+  segment.ranged =
+      ranges_supported_ && (segments_.size() > 1 || segment.written > 0);
+  if (segment.ranged) {
+    headers.emplace_back(
+        request_header::kRange,
+        "bytes=" + std::to_string(segment.offset + segment.written) + "-" +
+            std::to_string(segment.offset + segment.size - 1));
+    if (!etag_.empty())
+      headers.emplace_back(request_header::kIfRange, etag_);
+  } else {
+    // Without range support, the only option is to start over.
+    segment.written = 0;
+  }
+  segment.attempt_start = segment.written;
+  segment.response_started = false;
+  segment.store_data = false;
+
+  // The connection is used directly (rather than through Request) so that
+  // the response status can be checked as soon as the data starts arriving.
+  ErrorPtr error;
+  std::shared_ptr<Connection> connection = transport_->CreateConnection(
+      url_, request_type::kGet, headers, {}, {}, &error);
+  if (!connection) {
+    ReportError(error.get());
+    return;
+  }
+  // The data is written straight into the segment's place in the file.
+  connection->SetResponseData(stream_utils::CreateWriteCallbackStream(
+      base::Bind(&SegmentedDownload::WriteSegmentDataIfAlive,
+                 weak_ptr_factory_.GetWeakPtr(), index)));
+  segment.connection = connection;
+  auto weak_this = weak_ptr_factory_.GetWeakPtr();
+  RequestID request_id = connection->FinishRequestAsync(
+      base::Bind(&SegmentedDownload::OnSegmentSuccess, weak_this, index),
+      base::Bind(&SegmentedDownload::OnSegmentError, weak_this, index));
+  // The request might have already completed if the transport is synchronous.
+  if (weak_this && segments_[index].connection == connection)
+    segments_[index].request_id = request_id;
+}
+
+void SegmentedDownload::OnSegmentSuccess(size_t index,
+                                         RequestID /* request_id */,
+                                         std::unique_ptr<Response> response) {
+  Segment& segment = segments_[index];
+  OnSegmentResponseStarted(index);
+  segment.request_id = 0;
+  segment.connection.reset();
+  ErrorPtr error;
+  int code = response->GetStatusCode();
+  if (segment.ranged && code == status_code::Ok) {
+    // The server ignored the range, most likely because the resource has
+    // changed and "If-Range:" didn't match. The segments we already have are
+    // no good in this case.
+    Error::AddTo(&error, FROM_HERE, kErrorDomain, "resource_changed",
+                 "Server ignored the range request for " + url_);
+    ReportError(error.get());
+    return;
+  }
+  int expected_code =
+      segment.ranged ? status_code::PartialContent : status_code::Ok;
+  if (code != expected_code) {
+    Error::AddToPrintf(&error, FROM_HERE, kErrorDomain, "unexpected_status",
+                       "Unexpected HTTP status %d (%s) for segment %zu",
+                       code, response->GetStatusText().c_str(), index);
+    RetrySegment(index, error.get());
+    return;
+  }
+
+  // Transports that don't support custom response streams (e.g. the fake one)
+  // return the data in a stream of their own. Copy it into the file.
+  StreamPtr data = response->ExtractDataStream(nullptr);
+  if (data && data->CanRead()) {
+    std::vector<uint8_t> buffer(kCopyBufferSize);
+    size_t size_read = 0;
+    do {
+      if (!data->ReadBlocking(buffer.data(), buffer.size(), &size_read,
+                              &error) ||
+          !WriteSegmentData(index, buffer.data(), size_read, &error)) {
+        ReportError(error.get());
+        return;
+      }
+    } while (size_read > 0);
+  }
+
+  if (segment.size != segment.written) {
+    if (total_size_ == 0) {
+      // Size of the resource was unknown. Whatever we got is the whole thing.
+      total_size_ = segment.size = segment.written;
+    } else {
+      Error::AddToPrintf(&error, FROM_HERE, kErrorDomain, "partial_data",
+                         "Received %" PRIu64 " of %" PRIu64
+                         " bytes for segment %zu",
+                         segment.written, segment.size, index);
+      RetrySegment(index, error.get());
+      return;
+    }
+  }
+  segment.done = true;
+  VLOG(2) << "Segment " << index << " of " << url_ << " completed";
+  for (const Segment& other : segments_) {
+    if (!other.done)
+      return;
+  }
+  ReportSuccess();
+}
+
+void SegmentedDownload::OnSegmentError(size_t index,
+                                       RequestID /* request_id */,
+                                       const Error* error) {
+  segments_[index].request_id = 0;
+  segments_[index].connection.reset();
+  RetrySegment(index, error);
+}
+
+void SegmentedDownload::RetrySegment(size_t index, const Error* error) {
+  Segment& segment = segments_[index];
+  // Only the data of a response with the expected status is kept.
+  if (!segment.store_data)
+    segment.written = segment.attempt_start;
+  if (++segment.retries > options_.max_retries) {
+    ReportError(error);
+    return;
+  }
+  LOG(WARNING) << "Segment " << index << " of " << url_ << " failed ("
+               << (error ? error->GetMessage() : std::string{})
+               << "), retrying from byte " << segment.offset + segment.written;
+  StartSegment(index);
+}
+
+// static
+bool SegmentedDownload::WriteSegmentDataIfAlive(
+    const base::WeakPtr<SegmentedDownload>& download,
+    size_t index,
+    const void* buffer,
+    size_t size,
+    ErrorPtr* error) {
+  if (!download)
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  return download->WriteSegmentData(index, buffer, size, error);
+}
+
+void SegmentedDownload::OnSegmentResponseStarted(size_t index) {
+  Segment& segment = segments_[index];
+  if (segment.response_started || !segment.connection)
+    return;
+  segment.response_started = true;
+  // A server that ignores "If-Range:" replies with the whole resource (200)
+  // and an error page comes with a status of its own. Neither must end up in
+  // the segment, OnSegmentSuccess() deals with them once the request is done.
+  int expected_code =
+      segment.ranged ? status_code::PartialContent : status_code::Ok;
+  segment.store_data =
+      segment.connection->GetResponseStatusCode() == expected_code;
+}
+
+bool SegmentedDownload::WriteSegmentData(size_t index,
+                                         const void* buffer,
+                                         size_t size,
+                                         ErrorPtr* error) {
+  Segment& segment = segments_[index];
+  OnSegmentResponseStarted(index);
+  if (!segment.store_data)
+    return true;
+  if (ranges_supported_ && segment.written + size > segment.size) {
+    // Never let a misbehaving server overwrite the neighbouring segments.
+    Error::AddTo(error, FROM_HERE, kErrorDomain, "segment_overflow",
+                 "Received more data than requested for a segment");
+    return false;
+  }
+  if (!file_->WriteAtBlocking(segment.offset + segment.written, buffer, size,
+                              error)) {
+    return false;
+  }
+  segment.written += size;
+  return true;
+}
+
+void SegmentedDownload::ReportSuccess() {
+  ErrorPtr error;
+  if (!file_->CloseBlocking(&error)) {
+    ReportError(error.get());
+    return;
+  }
+  SuccessCallback callback = success_callback_;
+  Cancel();
+  callback.Run(total_size_);
+}
+
+void SegmentedDownload::ReportError(const Error* error) {
+  ErrorCallback callback = error_callback_;
+  Cancel();
+  if (file_)
+    file_->CloseBlocking(nullptr);
+  callback.Run(error);
+}
+
+}  // namespace http
+}  // namespace brillo
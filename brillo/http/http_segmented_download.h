@@ -0,0 +1,167 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_HTTP_HTTP_SEGMENTED_DOWNLOAD_H_
+#define LIBBRILLO_BRILLO_HTTP_HTTP_SEGMENTED_DOWNLOAD_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/callback.h>
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/memory/weak_ptr.h>
+#include <brillo/brillo_export.h>
+#include <brillo/errors/error.h>
+#include <brillo/http/http_connection.h>
+#include <brillo/http/http_request.h>
+#include <brillo/http/http_transport.h>
+#include <brillo/streams/file_stream.h>
+
+namespace brillo {
+namespace http {
+
+///////////////////////////////////////////////////////////////////////////////
+// SegmentedDownload fetches a remote resource into a local file over several
+// concurrent connections. The resource size is obtained with a HEAD request,
+// after which the file is split into byte ranges that are requested in
+// parallel using "Range:" requests. Each segment is written straight into its
+// place in the file (using FileStream::WriteAtBlocking()) as the data arrives,
+// so the segments can complete in any order.
+//
+// A failed segment is retried on its own (up to |max_retries| times), resuming
+// from the last byte received for that segment. If the server doesn't report
+// the size of the resource or doesn't support byte ranges, the download falls
+// back to a single GET request.
+//
+//    SegmentedDownload::Options options;
+//    options.max_segments = 8;
+//    download.reset(new SegmentedDownload{url, path, transport, options});
+//    download->Start(base::Bind(&OnDone), base::Bind(&OnError));
+//
+// Destroying the object cancels any outstanding requests.
+///////////////////////////////////////////////////////////////////////////////
+class BRILLO_EXPORT SegmentedDownload final {
+ public:
+  struct Options {
+    // The maximum number of segments (and concurrent requests).
+    size_t max_segments = 4;
+    // Segments are never made smaller than this (except the last one), so
+    // small files are downloaded with fewer requests.
+    uint64_t min_segment_size = 1024 * 1024;
+    // How many times each segment is retried before the download fails.
+    int max_retries = 3;
+    // Additional headers to send with every request.
+    HeaderList headers;
+  };
+
+  // Called with the size of the file once the download completes.
+  using SuccessCallback = base::Callback<void(uint64_t)>;
+  using ErrorCallback = base::Callback<void(const Error*)>;
+
+  SegmentedDownload(const std::string& url,
+                    const base::FilePath& file_path,
+                    const std::shared_ptr<Transport>& transport,
+                    const Options& options);
+  ~SegmentedDownload();
+
+  // Starts the download. Exactly one of the callbacks is invoked when the
+  // download is finished, unless it is cancelled first.
+  void Start(const SuccessCallback& success_callback,
+             const ErrorCallback& error_callback);
+
+  // Cancels all outstanding requests. No callbacks will be called afterwards.
+  void Cancel();
+
+  // Returns the size of the file being downloaded (0 until it is known).
+  uint64_t GetTotalSize() const { return total_size_; }
+  // Returns the number of bytes received and written to the file so far.
+  uint64_t GetBytesDownloaded() const;
+  // Returns the number of segments the file has been split into.
+  size_t GetSegmentCount() const { return segments_.size(); }
+
+ private:
+  struct Segment {
+    uint64_t offset;
+    // The size of the segment. Unknown (0) for a single-segment download of a
+    // resource of unknown size.
+    uint64_t size;
+    // The number of bytes of this segment written to the file.
+    uint64_t written;
+    // The value of |written| when the current request was started.
+    uint64_t attempt_start;
+    int retries;
+    RequestID request_id;
+    // The connection of the current request. Its response status is checked
+    // before any data is written to the file.
+    std::shared_ptr<Connection> connection;
+    // Whether the current request asks for a byte range.
+    bool ranged;
+    // Whether the response status of the current request has been examined,
+    // and whether it was the expected one (so the data can be stored).
+    bool response_started;
+    bool store_data;
+    bool done;
+  };
+
+  void OnHeadSuccess(RequestID request_id, std::unique_ptr<Response> response);
+  void OnHeadError(RequestID request_id, const Error* error);
+
+  // Creates the file and issues the requests for all the segments.
+  void StartSegments(uint64_t total_size, bool ranges_supported);
+  void StartSegment(size_t index);
+  void OnSegmentSuccess(size_t index,
+                        RequestID request_id,
+                        std::unique_ptr<Response> response);
+  void OnSegmentError(size_t index, RequestID request_id, const Error* error);
+  // Retries the segment |index| or fails the whole download if it ran out of
+  // retries.
+  void RetrySegment(size_t index, const Error* error);
+
+  // Examines the response status of segment |index| before the first chunk
+  // of its data is stored.
+  void OnSegmentResponseStarted(size_t index);
+  // Stores the data received for a segment.
+  bool WriteSegmentData(size_t index,
+                        const void* buffer,
+                        size_t size,
+                        ErrorPtr* error);
+  // The write callback of the segment response streams. Fails the write if
+  // the download has been cancelled or destroyed.
+  static bool WriteSegmentDataIfAlive(
+      const base::WeakPtr<SegmentedDownload>& download,
+      size_t index,
+      const void* buffer,
+      size_t size,
+      ErrorPtr* error);
+
+  void ReportSuccess();
+  void ReportError(const Error* error);
+
+  std::string url_;
+  base::FilePath file_path_;
+  std::shared_ptr<Transport> transport_;
+  Options options_;
+  SuccessCallback success_callback_;
+  ErrorCallback error_callback_;
+
+  // The "ETag:" of the resource, if provided. It is sent as "If-Range:" with
+  // segment requests to make sure all the segments come from the same
+  // version of the resource.
+  std::string etag_;
+  uint64_t total_size_{0};
+  bool ranges_supported_{false};
+  RequestID head_request_id_{0};
+  std::unique_ptr<FileStream> file_;
+  std::vector<Segment> segments_;
+
+  base::WeakPtrFactory<SegmentedDownload> weak_ptr_factory_{this};
+  DISALLOW_COPY_AND_ASSIGN(SegmentedDownload);
+};
+
+}  // namespace http
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_HTTP_HTTP_SEGMENTED_DOWNLOAD_H_
@@ -0,0 +1,314 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/http/http_segmented_download.h>
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <map>
+#include <set>
+#include <string>
+
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <brillo/bind_lambda.h>
+#include <brillo/http/http_transport_fake.h>
+#include <brillo/http/mock_transport.h>
+#include <brillo/mime_utils.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using testing::Invoke;
+using testing::NiceMock;
+using testing::_;
+
+namespace brillo {
+namespace http {
+
+namespace {
+
+const char kUrl[] = "http://localhost/image.bin";
+
+// A connection that writes the response body into the response stream while
+// the request is in progress (the way the curl transport does) and optionally
+// fails afterwards, as if the connection had been dropped.
+class StreamingConnection : public Connection {
+ public:
+  StreamingConnection(const std::shared_ptr<Transport>& transport,
+                      int status_code,
+                      const std::string& body,
+                      bool drop)
+      : Connection{transport},
+        status_code_{status_code},
+        body_{body},
+        drop_{drop} {}
+
+  void AddHeader(const std::string& name, const std::string& value) {
+    headers_[name] = value;
+  }
+
+  bool SendHeaders(const HeaderList& /* headers */,
+                   ErrorPtr* /* error */) override {
+    return true;
+  }
+  bool SetRequestData(StreamPtr /* stream */, ErrorPtr* /* error */) override {
+    return true;
+  }
+  void SetResponseData(StreamPtr stream) override {
+    response_stream_ = std::move(stream);
+  }
+  bool FinishRequest(ErrorPtr* /* error */) override { return true; }
+  RequestID FinishRequestAsync(const SuccessCallback& success_callback,
+                               const ErrorCallback& error_callback) override {
+    std::shared_ptr<Connection> self = shared_from_this();
+    ErrorPtr error;
+    bool written =
+        !response_stream_ ||
+        response_stream_->WriteAllBlocking(body_.data(), body_.size(), &error);
+    if (drop_ || !written) {
+      if (!error) {
+        Error::AddTo(&error, FROM_HERE, "test", "dropped",
+                     "Connection dropped");
+      }
+      error_callback.Run(1, error.get());
+    } else {
+      success_callback.Run(1, std::unique_ptr<Response>{new Response{self}});
+    }
+    return 1;
+  }
+  int GetResponseStatusCode() const override { return status_code_; }
+  std::string GetResponseStatusText() const override { return {}; }
+  std::string GetProtocolVersion() const override { return "HTTP/1.1"; }
+  std::string GetResponseHeader(const std::string& name) const override {
+    auto it = headers_.find(name);
+    return it != headers_.end() ? it->second : std::string{};
+  }
+  StreamPtr ExtractDataStream(ErrorPtr* /* error */) override {
+    return nullptr;
+  }
+
+ private:
+  int status_code_;
+  std::string body_;
+  bool drop_;
+  std::map<std::string, std::string> headers_;
+  StreamPtr response_stream_;
+};
+
+}  // anonymous namespace
+
+class HttpSegmentedDownloadTest : public testing::Test {
+ public:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    file_path_ = temp_dir_.GetPath().Append("image.bin");
+    for (int i = 0; i < 1000; i++)
+      data_.push_back(static_cast<char>('a' + i % 26 + i / 26 % 3));
+    transport_ = std::make_shared<fake::Transport>();
+    transport_->SetAsyncMode(true);
+    options_.max_segments = 4;
+    options_.min_segment_size = 100;
+  }
+
+  // Installs the HEAD and GET handlers serving |data_|.
+  void AddHandlers(bool ranges_supported) {
+    auto head_handler = [this, ranges_supported](
+        const fake::ServerRequest& /* request */,
+        fake::ServerResponse* response) {
+      response->ReplyText(status_code::Ok, data_,
+                          mime::application::kOctet_stream);
+      if (ranges_supported)
+        response->AddHeaders({{response_header::kAcceptRanges, "bytes"}});
+    };
+    auto get_handler = [this](const fake::ServerRequest& request,
+                              fake::ServerResponse* response) {
+      std::string range = request.GetHeader(request_header::kRange);
+      ranges_.insert(range);
+      if (range.empty()) {
+        response->ReplyText(status_code::Ok, data_,
+                            mime::application::kOctet_stream);
+        return;
+      }
+      uint64_t from = 0;
+      uint64_t to = 0;
+      ASSERT_EQ(2, sscanf(range.c_str(), "bytes=%" SCNu64 "-%" SCNu64, &from,
+                          &to));
+      if (ranges_.count(range + "#failed") < fail_count_) {
+        ranges_.insert(range + "#failed");
+        response->ReplyText(status_code::InternalServerError, "oops",
+                            mime::text::kPlain);
+        return;
+      }
+      response->ReplyText(status_code::PartialContent,
+                          data_.substr(from, to - from + 1),
+                          mime::application::kOctet_stream);
+    };
+    transport_->AddHandler(kUrl, request_type::kHead, base::Bind(head_handler));
+    transport_->AddHandler(kUrl, request_type::kGet, base::Bind(get_handler));
+  }
+
+  // Runs the download to completion and returns true on success.
+  bool Download() {
+    bool success = false;
+    bool done = false;
+    auto success_callback = [&success, &done, this](uint64_t size) {
+      EXPECT_EQ(data_.size(), size);
+      success = true;
+      done = true;
+    };
+    auto error_callback = [&done](const Error* /* error */) { done = true; };
+    download_.reset(
+        new SegmentedDownload{kUrl, file_path_, transport_, options_});
+    download_->Start(base::Bind(success_callback), base::Bind(error_callback));
+    transport_->HandleAllAsyncRequests();
+    EXPECT_TRUE(done);
+    return success;
+  }
+
+  std::string ReadFile() const {
+    std::string contents;
+    EXPECT_TRUE(base::ReadFileToString(file_path_, &contents));
+    return contents;
+  }
+
+ protected:
+  base::ScopedTempDir temp_dir_;
+  base::FilePath file_path_;
+  std::string data_;
+  std::shared_ptr<fake::Transport> transport_;
+  SegmentedDownload::Options options_;
+  std::unique_ptr<SegmentedDownload> download_;
+  // The "Range:" headers of the GET requests received by the server.
+  std::multiset<std::string> ranges_;
+  // How many times each range request fails before succeeding.
+  size_t fail_count_{0};
+};
+
+TEST_F(HttpSegmentedDownloadTest, Reassembly) {
+  AddHandlers(true);
+  EXPECT_TRUE(Download());
+  EXPECT_EQ(data_, ReadFile());
+  EXPECT_EQ(4u, download_->GetSegmentCount());
+  EXPECT_EQ(data_.size(), download_->GetBytesDownloaded());
+  // HEAD plus one request per segment.
+  EXPECT_EQ(5, transport_->GetRequestCount());
+  EXPECT_EQ(1u, ranges_.count("bytes=0-249"));
+  EXPECT_EQ(1u, ranges_.count("bytes=750-999"));
+}
+
+TEST_F(HttpSegmentedDownloadTest, SegmentsIssuedConcurrently) {
+  AddHandlers(true);
+  download_.reset(
+      new SegmentedDownload{kUrl, file_path_, transport_, options_});
+  download_->Start(base::Bind([](uint64_t) {}),
+                   base::Bind([](const Error*) { FAIL(); }));
+  // Complete the HEAD request. All the segment requests must be sent out
+  // before any of them completes.
+  EXPECT_TRUE(transport_->HandleOneAsyncRequest());
+  EXPECT_EQ(5, transport_->GetRequestCount());
+  EXPECT_EQ(4u, download_->GetSegmentCount());
+  EXPECT_EQ(0u, download_->GetBytesDownloaded());
+  transport_->HandleAllAsyncRequests();
+  EXPECT_EQ(data_, ReadFile());
+}
+
+TEST_F(HttpSegmentedDownloadTest, SmallFileSingleSegment) {
+  options_.min_segment_size = 4096;
+  AddHandlers(true);
+  EXPECT_TRUE(Download());
+  EXPECT_EQ(data_, ReadFile());
+  EXPECT_EQ(1u, download_->GetSegmentCount());
+  EXPECT_EQ(1u, ranges_.count(""));
+}
+
+TEST_F(HttpSegmentedDownloadTest, RangesNotSupported) {
+  AddHandlers(false);
+  EXPECT_TRUE(Download());
+  EXPECT_EQ(data_, ReadFile());
+  EXPECT_EQ(1u, download_->GetSegmentCount());
+  EXPECT_EQ(1u, ranges_.count(""));
+}
+
+TEST_F(HttpSegmentedDownloadTest, FailedSegmentsRetried) {
+  fail_count_ = 2;
+  AddHandlers(true);
+  EXPECT_TRUE(Download());
+  EXPECT_EQ(data_, ReadFile());
+  // HEAD plus three attempts per segment.
+  EXPECT_EQ(13, transport_->GetRequestCount());
+}
+
+TEST_F(HttpSegmentedDownloadTest, TooManyFailures) {
+  fail_count_ = 2;
+  options_.max_retries = 1;
+  AddHandlers(true);
+  EXPECT_FALSE(Download());
+}
+
+TEST_F(HttpSegmentedDownloadTest, ServerError) {
+  EXPECT_FALSE(Download());
+}
+
+// The data of a response that ignored "If-Range:" must never reach the file,
+// even when the transport streams it before the request completes.
+TEST_F(HttpSegmentedDownloadTest, IgnoredRangeNotWritten) {
+  auto transport = std::make_shared<NiceMock<MockTransport>>();
+  options_.max_segments = 2;
+  MockTransport* mock_transport = transport.get();
+  auto create_connection = [this, mock_transport](
+      const std::string& /* url */, const std::string& method,
+      const HeaderList& headers, const std::string& /* user_agent */,
+      const std::string& /* referer */, ErrorPtr* /* error */) {
+    std::string range;
+    for (const auto& header : headers) {
+      if (header.first == request_header::kRange)
+        range = header.second;
+    }
+    std::shared_ptr<Transport> transport = mock_transport->shared_from_this();
+    std::shared_ptr<StreamingConnection> connection;
+    if (method == request_type::kHead) {
+      connection = std::make_shared<StreamingConnection>(
+          transport, status_code::Ok, "", false);
+      connection->AddHeader(response_header::kContentLength,
+                            std::to_string(data_.size()));
+      connection->AddHeader(response_header::kAcceptRanges, "bytes");
+      connection->AddHeader(response_header::kETag, "\"v1\"");
+    } else if (range == "bytes=0-499") {
+      connection = std::make_shared<StreamingConnection>(
+          transport, status_code::PartialContent, data_.substr(0, 500), false);
+    } else if (range == "bytes=500-999") {
+      // Drop the connection after the first 100 bytes of the segment.
+      connection = std::make_shared<StreamingConnection>(
+          transport, status_code::PartialContent, data_.substr(500, 100),
+          true);
+    } else {
+      // The resource has changed. The server sends the new one instead.
+      connection = std::make_shared<StreamingConnection>(
+          transport, status_code::Ok, std::string(300, 'z'), false);
+    }
+    ranges_.insert(range);
+    return std::shared_ptr<Connection>{connection};
+  };
+  EXPECT_CALL(*transport, CreateConnection(_, _, _, _, _, _))
+      .WillRepeatedly(Invoke(create_connection));
+
+  std::string error_code;
+  download_.reset(
+      new SegmentedDownload{kUrl, file_path_, transport, options_});
+  download_->Start(base::Bind([](uint64_t) { FAIL(); }),
+                   base::Bind([&error_code](const Error* error) {
+                     error_code = error->GetCode();
+                   }));
+  EXPECT_EQ("resource_changed", error_code);
+  EXPECT_EQ(1u, ranges_.count("bytes=600-999"));
+  EXPECT_EQ(600u, download_->GetBytesDownloaded());
+  std::string contents = ReadFile();
+  ASSERT_EQ(data_.size(), contents.size());
+  EXPECT_EQ(data_.substr(0, 600), contents.substr(0, 600));
+  EXPECT_EQ(std::string(400, '\0'), contents.substr(600));
+}
+
+}  // namespace http
+}  // namespace brillo
@@ -0,0 +1,143 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/http/http_timing_stats.h>
+
+#include <inttypes.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <base/strings/stringprintf.h>
+#include <brillo/strings/string_utils.h>
+
+namespace brillo {
+namespace http {
+
+namespace {
+
+// Returns |to| - |from|, or zero if |to| comes before |from|.
+base::TimeDelta Interval(base::TimeDelta from, base::TimeDelta to) {
+  return std::max(to - from, base::TimeDelta());
+}
+
+// Appends the median, 90th percentile and maximum of |histogram| (in ms) to
+// |parts|, unless the histogram is empty.
+void FormatHistogram(const char* name,
+                     const TimingHistogram& histogram,
+                     std::vector<std::string>* parts) {
+  if (!histogram.GetCount())
+    return;
+  parts->push_back(base::StringPrintf(
+      "%s %" PRId64 "/%" PRId64 "/%" PRId64, name,
+      histogram.GetPercentile(50).InMilliseconds(),
+      histogram.GetPercentile(90).InMilliseconds(),
+      histogram.GetMax().InMilliseconds()));
+}
+
+}  // anonymous namespace
+
+void TimingHistogram::AddSample(base::TimeDelta sample) {
+  int64_t ms = sample.InMilliseconds();
+  size_t bucket = 0;
+  while (ms > 0 && bucket < kBucketCount - 1) {
+    ms >>= 1;
+    bucket++;
+  }
+  buckets_[bucket]++;
+  count_++;
+  sum_ += sample;
+  max_ = std::max(max_, sample);
+}
+
+base::TimeDelta TimingHistogram::GetBucketMin(size_t bucket) {
+  if (bucket == 0)
+    return base::TimeDelta();
+  return base::TimeDelta::FromMilliseconds(INT64_C(1) << (bucket - 1));
+}
+
+base::TimeDelta TimingHistogram::GetPercentile(double percentile) const {
+  if (!count_)
+    return base::TimeDelta();
+  uint64_t target = std::max<uint64_t>(
+      static_cast<uint64_t>(std::ceil(count_ * percentile / 100)), 1);
+  uint64_t total = 0;
+  for (size_t bucket = 0; bucket < kBucketCount - 1; bucket++) {
+    total += buckets_[bucket];
+    if (total >= target)
+      return std::min(GetBucketMin(bucket + 1), max_);
+  }
+  return max_;
+}
+
+void TimingStats::AddRequest(const std::string& host,
+                             const RequestTimings& timings) {
+  HostStats& stats = hosts_[host];
+  stats.request_count++;
+  stats.bytes_sent += timings.bytes_sent;
+  stats.bytes_received += timings.bytes_received;
+
+  base::TimeDelta request_sent = timings.connect;
+  if (timings.connection_reused) {
+    stats.reused_connections++;
+  } else {
+    stats.name_lookup.AddSample(timings.name_lookup);
+    stats.connect.AddSample(Interval(timings.name_lookup, timings.connect));
+    if (!timings.app_connect.is_zero()) {
+      stats.tls_handshake.AddSample(
+          Interval(timings.connect, timings.app_connect));
+      request_sent = timings.app_connect;
+    }
+  }
+  if (!timings.start_transfer.is_zero()) {
+    stats.server.AddSample(Interval(request_sent, timings.start_transfer));
+    stats.transfer.AddSample(
+        Interval(timings.start_transfer, timings.total));
+  }
+  stats.total.AddSample(timings.total);
+}
+
+const TimingStats::HostStats* TimingStats::GetHostStats(
+    const std::string& host) const {
+  auto p = hosts_.find(host);
+  return p != hosts_.end() ? &p->second : nullptr;
+}
+
+std::vector<std::string> TimingStats::GetHosts() const {
+  std::vector<std::string> hosts;
+  hosts.reserve(hosts_.size());
+  for (const auto& pair : hosts_)
+    hosts.push_back(pair.first);
+  return hosts;
+}
+
+void TimingStats::Reset() {
+  hosts_.clear();
+}
+
+std::string TimingStats::ToString() const {
+  std::string result;
+  for (const auto& pair : hosts_) {
+    const HostStats& stats = pair.second;
+    base::StringAppendF(
+        &result,
+        "%s: %" PRIu64 " requests (%" PRIu64 " reused connections), sent %"
+        PRIu64 " bytes, received %" PRIu64 " bytes; p50/p90/max ms: ",
+        pair.first.c_str(), stats.request_count, stats.reused_connections,
+        stats.bytes_sent, stats.bytes_received);
+    std::vector<std::string> parts;
+    FormatHistogram("name lookup", stats.name_lookup, &parts);
+    FormatHistogram("connect", stats.connect, &parts);
+    FormatHistogram("TLS", stats.tls_handshake, &parts);
+    FormatHistogram("server", stats.server, &parts);
+    FormatHistogram("transfer", stats.transfer, &parts);
+    FormatHistogram("total", stats.total, &parts);
+    result += string_utils::Join(", ", parts);
+    result += "\n";
+  }
+  return result;
+}
+
+}  // namespace http
+}  // namespace brillo
@@ -0,0 +1,98 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_HTTP_HTTP_TIMING_STATS_H_
+#define LIBBRILLO_BRILLO_HTTP_HTTP_TIMING_STATS_H_
+
+#include <stdint.h>
+
+#include <array>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <base/macros.h>
+#include <base/time/time.h>
+#include <brillo/brillo_export.h>
+#include <brillo/http/http_transport.h>
+
+namespace brillo {
+namespace http {
+
+// A histogram of durations with exponential buckets: bucket 0 counts the
+// samples below 1 ms, bucket N (N > 0) the samples in [2^(N-1), 2^N) ms and
+// the last bucket everything above.
+class BRILLO_EXPORT TimingHistogram final {
+ public:
+  static const size_t kBucketCount = 20;
+
+  void AddSample(base::TimeDelta sample);
+
+  uint64_t GetCount() const { return count_; }
+  base::TimeDelta GetSum() const { return sum_; }
+  base::TimeDelta GetMax() const { return max_; }
+  uint64_t GetBucketCount(size_t bucket) const { return buckets_[bucket]; }
+  // Returns the lower bound of the bucket |bucket|.
+  static base::TimeDelta GetBucketMin(size_t bucket);
+
+  // Returns an estimate of the given percentile (0-100): the upper bound of
+  // the bucket containing it, capped by the largest sample.
+  base::TimeDelta GetPercentile(double percentile) const;
+
+ private:
+  std::array<uint64_t, kBucketCount> buckets_{};
+  uint64_t count_{0};
+  base::TimeDelta sum_;
+  base::TimeDelta max_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// TimingStats aggregates the RequestTimings of the completed requests for
+// each host. The cumulative times reported by the transport are split into
+// the individual phases of a request, so the latency can be attributed to
+// one of them:
+//   name lookup  - resolving the host name,
+//   connect      - establishing the TCP connection,
+//   TLS          - the TLS handshake,
+//   server       - from sending the request to the first byte of the response,
+//   transfer     - receiving the rest of the response.
+///////////////////////////////////////////////////////////////////////////////
+class BRILLO_EXPORT TimingStats final {
+ public:
+  struct HostStats {
+    uint64_t request_count{0};
+    uint64_t reused_connections{0};
+    uint64_t bytes_sent{0};
+    uint64_t bytes_received{0};
+    TimingHistogram name_lookup;
+    TimingHistogram connect;
+    TimingHistogram tls_handshake;
+    TimingHistogram server;
+    TimingHistogram transfer;
+    TimingHistogram total;
+  };
+
+  TimingStats() = default;
+
+  void AddRequest(const std::string& host, const RequestTimings& timings);
+
+  // Returns the statistics for |host| or nullptr if no requests to the host
+  // have completed.
+  const HostStats* GetHostStats(const std::string& host) const;
+  std::vector<std::string> GetHosts() const;
+  void Reset();
+
+  // Returns a human-readable summary, one line per host.
+  std::string ToString() const;
+
+ private:
+  std::map<std::string, HostStats> hosts_;
+
+  DISALLOW_COPY_AND_ASSIGN(TimingStats);
+};
+
+}  // namespace http
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_HTTP_HTTP_TIMING_STATS_H_
@@ -0,0 +1,94 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/http/http_timing_stats.h>
+
+#include <gtest/gtest.h>
+
+namespace brillo {
+namespace http {
+
+namespace {
+
+base::TimeDelta Ms(int64_t ms) {
+  return base::TimeDelta::FromMilliseconds(ms);
+}
+
+}  // anonymous namespace
+
+TEST(HttpTimingHistogram, Buckets) {
+  TimingHistogram histogram;
+  histogram.AddSample(base::TimeDelta::FromMicroseconds(500));
+  histogram.AddSample(Ms(1));
+  histogram.AddSample(Ms(3));
+  histogram.AddSample(Ms(100));
+  histogram.AddSample(base::TimeDelta::FromDays(30));
+  EXPECT_EQ(5u, histogram.GetCount());
+  EXPECT_EQ(1u, histogram.GetBucketCount(0));
+  EXPECT_EQ(1u, histogram.GetBucketCount(1));
+  EXPECT_EQ(1u, histogram.GetBucketCount(2));
+  // 64 <= 100 < 128
+  EXPECT_EQ(1u, histogram.GetBucketCount(7));
+  EXPECT_EQ(1u, histogram.GetBucketCount(TimingHistogram::kBucketCount - 1));
+  EXPECT_EQ(Ms(64), TimingHistogram::GetBucketMin(7));
+  EXPECT_EQ(base::TimeDelta::FromDays(30), histogram.GetMax());
+}
+
+TEST(HttpTimingHistogram, Percentile) {
+  TimingHistogram histogram;
+  EXPECT_EQ(base::TimeDelta(), histogram.GetPercentile(50));
+  for (int i = 0; i < 9; i++)
+    histogram.AddSample(Ms(10));
+  histogram.AddSample(Ms(300));
+  // The upper bound of the [8, 16) ms bucket.
+  EXPECT_EQ(Ms(16), histogram.GetPercentile(50));
+  EXPECT_EQ(Ms(16), histogram.GetPercentile(90));
+  // Capped by the largest sample.
+  EXPECT_EQ(Ms(300), histogram.GetPercentile(99));
+}
+
+TEST(HttpTimingStats, PhasesPerHost) {
+  TimingStats stats;
+  RequestTimings timings;
+  timings.name_lookup = Ms(5);
+  timings.connect = Ms(20);
+  timings.app_connect = Ms(60);
+  timings.start_transfer = Ms(160);
+  timings.total = Ms(200);
+  timings.bytes_received = 1000;
+  stats.AddRequest("example.com", timings);
+
+  RequestTimings reused;
+  reused.start_transfer = Ms(50);
+  reused.total = Ms(70);
+  reused.bytes_received = 500;
+  reused.connection_reused = true;
+  stats.AddRequest("example.com", reused);
+  stats.AddRequest("localhost:8080", reused);
+
+  EXPECT_EQ((std::vector<std::string>{"example.com", "localhost:8080"}),
+            stats.GetHosts());
+  EXPECT_EQ(nullptr, stats.GetHostStats("other.com"));
+  const TimingStats::HostStats* host = stats.GetHostStats("example.com");
+  ASSERT_NE(nullptr, host);
+  EXPECT_EQ(2u, host->request_count);
+  EXPECT_EQ(1u, host->reused_connections);
+  EXPECT_EQ(1500u, host->bytes_received);
+  // The connection setup phases are only recorded for new connections.
+  EXPECT_EQ(1u, host->name_lookup.GetCount());
+  EXPECT_EQ(Ms(5), host->name_lookup.GetSum());
+  EXPECT_EQ(Ms(15), host->connect.GetSum());
+  EXPECT_EQ(Ms(40), host->tls_handshake.GetSum());
+  EXPECT_EQ(2u, host->server.GetCount());
+  EXPECT_EQ(Ms(150), host->server.GetSum());
+  EXPECT_EQ(Ms(60), host->transfer.GetSum());
+  EXPECT_EQ(Ms(270), host->total.GetSum());
+
+  EXPECT_NE(std::string::npos, stats.ToString().find("localhost:8080: 1"));
+  stats.Reset();
+  EXPECT_TRUE(stats.GetHosts().empty());
+}
+
+}  // namespace http
+}  // namespace brillo
@@ -11,6 +11,11 @@ namespace http {
 
 const char kErrorDomain[] = "http_transport";
 
+bool Transport::SetRequestPriority(RequestID /* request_id */,
+                                   RequestPriority /* priority */) {
+  return false;
+}
+
 std::shared_ptr<Transport> Transport::CreateDefault() {
   return std::make_shared<http::curl::Transport>(std::make_shared<CurlApi>());
 }
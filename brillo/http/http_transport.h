@@ -33,6 +33,37 @@ using SuccessCallback =
     base::Callback<void(RequestID, std::unique_ptr<Response>)>;
 using ErrorCallback = base::Callback<void(RequestID, const brillo::Error*)>;
 
+// The priority of a request. Transports that limit the number of concurrent
+// requests start the waiting requests with higher priority first.
+enum class RequestPriority {
+  IDLE,
+  LOW,
+  MEDIUM,
+  HIGH,
+};
+
+// The timing breakdown of a completed request. All the times are measured
+// from the start of the request, as reported by libcurl: |name_lookup| when
+// the host name was resolved, |connect| when the TCP connection was
+// established, |app_connect| when the TLS handshake was completed (zero for
+// plain HTTP), |start_transfer| when the first byte of the response was
+// received and |total| when the whole response was received. The phases that
+// didn't happen (e.g. for a reused connection) are reported as zero or as
+// the time of the preceding phase.
+struct RequestTimings {
+  base::TimeDelta name_lookup;
+  base::TimeDelta connect;
+  base::TimeDelta app_connect;
+  base::TimeDelta start_transfer;
+  base::TimeDelta total;
+  // The size of the request body and the size of the response (including the
+  // headers).
+  uint64_t bytes_sent{0};
+  uint64_t bytes_received{0};
+  // Whether an existing connection to the server was used for the request.
+  bool connection_reused{false};
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 // Transport is a base class for specific implementation of HTTP communication.
 // This class (and its underlying implementation) is used by http::Request and
@@ -79,6 +110,13 @@ class BRILLO_EXPORT Transport : public std::enable_shared_from_this<Transport> {
   // has already completed/its callbacks are dispatched).
   virtual bool CancelRequest(RequestID request_id) = 0;
 
+  // Changes the priority of a pending asynchronous request. This only affects
+  // the requests still waiting to be started by the transport.
+  // Returns false if such a request is not found or the transport doesn't
+  // support request priorities.
+  virtual bool SetRequestPriority(RequestID request_id,
+                                  RequestPriority priority);
+
   // Set the default timeout of requests made.
   virtual void SetDefaultTimeout(base::TimeDelta timeout) = 0;
 
@@ -0,0 +1,603 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/http/http_transport_caching.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <base/bind.h>
+#include <base/logging.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/string_util.h>
+#include <brillo/http/http_connection.h>
+#include <brillo/http/http_request.h>
+#include <brillo/streams/memory_stream.h>
+#include <brillo/streams/stream_utils.h>
+#include <brillo/strings/string_utils.h>
+
+namespace brillo {
+namespace http {
+
+namespace {
+
+// Response headers stored along with the cached response body.
+const char* const kStoredHeaders[] = {
+    response_header::kAge,
+    response_header::kCacheControl,
+    response_header::kContentEncoding,
+    response_header::kContentLanguage,
+    response_header::kContentType,
+    response_header::kDate,
+    response_header::kETag,
+    response_header::kExpires,
+    response_header::kLastModified,
+    response_header::kVary,
+};
+
+// Response headers that a "304 Not Modified" reply can update. "Age" is
+// handled separately since it must not outlive the reply it came with.
+const char* const kUpdatableHeaders[] = {
+    response_header::kCacheControl,
+    response_header::kDate,
+    response_header::kETag,
+    response_header::kExpires,
+    response_header::kLastModified,
+};
+
+struct CacheControl {
+  bool no_store{false};
+  bool no_cache{false};
+  bool has_max_age{false};
+  base::TimeDelta max_age;
+};
+
+CacheControl ParseCacheControl(const std::string& value) {
+  CacheControl cache_control;
+  for (const std::string& directive : string_utils::Split(value, ",")) {
+    std::string name;
+    std::string argument;
+    string_utils::SplitAtFirst(directive, "=", &name, &argument, true);
+    name = base::ToLowerASCII(name);
+    if (name == "no-store") {
+      cache_control.no_store = true;
+    } else if (name == "no-cache") {
+      cache_control.no_cache = true;
+    } else if (name == "max-age") {
+      int64_t seconds = 0;
+      base::TrimString(argument, "\"", &argument);
+      if (base::StringToInt64(argument, &seconds) && seconds >= 0) {
+        cache_control.has_max_age = true;
+        cache_control.max_age = base::TimeDelta::FromSeconds(seconds);
+      }
+    }
+  }
+  return cache_control;
+}
+
+// Returns the value of request header |name| (case-insensitive) from
+// |headers|, or an empty string if it is not present.
+std::string FindHeader(const HeaderList& headers, const std::string& name) {
+  for (const auto& pair : headers) {
+    if (base::EqualsCaseInsensitiveASCII(pair.first, name))
+      return pair.second;
+  }
+  return std::string();
+}
+
+// Returns how long |response| stays fresh after it was received, as
+// specified by RFC 7234, section 4.2.
+base::TimeDelta GetFreshnessLifetime(const CachedResponse& response) {
+  CacheControl cache_control =
+      ParseCacheControl(response.GetHeader(response_header::kCacheControl));
+  if (cache_control.no_cache)
+    return base::TimeDelta{};
+  if (cache_control.has_max_age)
+    return cache_control.max_age;
+
+  base::Time date;
+  if (!base::Time::FromString(
+          response.GetHeader(response_header::kDate).c_str(), &date)) {
+    date = response.response_time;
+  }
+
+  std::string expires = response.GetHeader(response_header::kExpires);
+  if (!expires.empty()) {
+    base::Time expiration;
+    // Invalid dates (like "0") mean the response has already expired.
+    if (!base::Time::FromString(expires.c_str(), &expiration) ||
+        expiration <= date) {
+      return base::TimeDelta{};
+    }
+    return expiration - date;
+  }
+
+  // Heuristic freshness: 10% of the time since the last modification.
+  base::Time last_modified;
+  if (base::Time::FromString(
+          response.GetHeader(response_header::kLastModified).c_str(),
+          &last_modified) &&
+      last_modified < date) {
+    return (date - last_modified) / 10;
+  }
+  return base::TimeDelta{};
+}
+
+// Returns the age of |response| at the time |now|, as specified by RFC 7234,
+// section 4.2.3. The response delay isn't known, so it is not accounted for.
+base::TimeDelta GetCurrentAge(const CachedResponse& response, base::Time now) {
+  base::TimeDelta apparent_age;
+  base::Time date;
+  if (base::Time::FromString(
+          response.GetHeader(response_header::kDate).c_str(), &date) &&
+      date < response.response_time) {
+    apparent_age = response.response_time - date;
+  }
+  int64_t age_seconds = 0;
+  if (base::StringToInt64(response.GetHeader(response_header::kAge),
+                          &age_seconds) &&
+      age_seconds > 0) {
+    apparent_age = std::max(apparent_age,
+                            base::TimeDelta::FromSeconds(age_seconds));
+  }
+  return apparent_age + (now - response.response_time);
+}
+
+// Returns the names of the request headers listed in the "Vary" header
+// |vary|.
+std::vector<std::string> ParseVary(const std::string& vary) {
+  std::vector<std::string> names;
+  for (const std::string& name : string_utils::Split(vary, ",")) {
+    if (!name.empty())
+      names.push_back(name);
+  }
+  return names;
+}
+
+// Returns true if the request with |headers| uses the same values of the
+// headers nominated by "Vary" as the request |response| was stored for.
+bool MatchesVary(const CachedResponse& response, const HeaderList& headers) {
+  for (const auto& pair : response.vary_headers) {
+    if (FindHeader(headers, pair.first) != pair.second)
+      return false;
+  }
+  return true;
+}
+
+bool HasValidators(const CachedResponse& response) {
+  return !response.GetHeader(response_header::kETag).empty() ||
+         !response.GetHeader(response_header::kLastModified).empty();
+}
+
+}  // anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// CachingConnection is the http::Connection returned by CachingTransport. For
+// cacheable requests, it either serves the response straight from the cache
+// or forwards the request to a connection of the underlying transport and then
+// decides whether to store the response or serve the cached one (on 304).
+// Other requests are just passed through, but still get their request ID from
+// CachingTransport.
+///////////////////////////////////////////////////////////////////////////////
+class CachingConnection : public Connection {
+ public:
+  CachingConnection(const std::shared_ptr<CachingTransport>& transport,
+                    const std::string& url,
+                    const HeaderList& request_headers,
+                    bool cacheable,
+                    std::unique_ptr<CachedResponse> cached_response,
+                    const std::shared_ptr<Connection>& connection)
+      : Connection{transport},
+        caching_transport_{transport.get()},
+        url_{url},
+        request_headers_{request_headers},
+        cached_response_{std::move(cached_response)},
+        connection_{connection},
+        store_allowed_{cacheable} {}
+
+  // Overrides from http::Connection.
+  bool SendHeaders(const HeaderList& headers, ErrorPtr* error) override {
+    return !connection_ || connection_->SendHeaders(headers, error);
+  }
+
+  bool SetRequestData(StreamPtr stream, ErrorPtr* error) override {
+    return !connection_ || connection_->SetRequestData(std::move(stream),
+                                                       error);
+  }
+
+  void SetResponseData(StreamPtr stream) override {
+    if (!connection_) {
+      response_stream_ = std::move(stream);
+      return;
+    }
+    // The caller wants the response data streamed to its own stream, so don't
+    // buffer it for the cache, but still serve a cached body on 304.
+    store_allowed_ = false;
+    connection_->SetResponseData(std::move(stream));
+  }
+
+  bool FinishRequest(ErrorPtr* error) override {
+    if (!connection_)
+      return ServeFromCache(error);
+    return connection_->FinishRequest(error) && OnNetworkResponse(error);
+  }
+
+  RequestID FinishRequestAsync(const SuccessCallback& success_callback,
+                               const ErrorCallback& error_callback) override {
+    auto self = std::static_pointer_cast<CachingConnection>(shared_from_this());
+    RequestID id = caching_transport_->AddRequest();
+    if (!connection_) {
+      transport_->RunCallbackAsync(
+          FROM_HERE, base::Bind(&CachingConnection::FinishFromCacheAsync, self,
+                                id, success_callback, error_callback));
+      return id;
+    }
+    connection_->SetPriority(GetPriority());
+    RequestID transport_id = connection_->FinishRequestAsync(
+        base::Bind(&CachingConnection::OnAsyncResponse, self, id,
+                   success_callback, error_callback),
+        base::Bind(&CachingConnection::OnAsyncError, self, id,
+                   error_callback));
+    if (transport_id == 0) {
+      // The request could not be started, its error is reported with ID 0.
+      caching_transport_->RemoveRequest(id);
+      return 0;
+    }
+    caching_transport_->SetTransportRequestId(id, transport_id);
+    return id;
+  }
+
+  int GetResponseStatusCode() const override {
+    if (serve_from_cache_)
+      return cached_response_->status_code;
+    return connection_->GetResponseStatusCode();
+  }
+
+  std::string GetResponseStatusText() const override {
+    if (serve_from_cache_)
+      return cached_response_->status_text;
+    return connection_->GetResponseStatusText();
+  }
+
+  std::string GetProtocolVersion() const override {
+    if (serve_from_cache_)
+      return cached_response_->protocol_version;
+    return connection_->GetProtocolVersion();
+  }
+
+  std::string GetResponseHeader(const std::string& header_name) const override {
+    if (serve_from_cache_)
+      return cached_response_->GetHeader(header_name);
+    return connection_->GetResponseHeader(header_name);
+  }
+
+  StreamPtr ExtractDataStream(ErrorPtr* error) override {
+    if (!serve_from_cache_)
+      return connection_->ExtractDataStream(error);
+    if (response_stream_)
+      return std::move(response_stream_);
+    if (body_extracted_) {
+      stream_utils::ErrorStreamClosed(FROM_HERE, error);
+      return nullptr;
+    }
+    body_extracted_ = true;
+    return MemoryStream::OpenCopyOf(std::move(body_), error);
+  }
+
+ private:
+  // Loads the cached response body and switches the connection to serve the
+  // cached response.
+  bool ServeFromCache(ErrorPtr* error) {
+    if (!caching_transport_->cache_.ReadBody(url_, &body_)) {
+      caching_transport_->cache_.Remove(url_);
+      Error::AddTo(error, FROM_HERE, kErrorDomain, "cache_read_failed",
+                   "Failed to read the cached response for " + url_);
+      return false;
+    }
+    VLOG(1) << "Serving " << url_ << " from the HTTP cache";
+    serve_from_cache_ = true;
+    if (response_stream_) {
+      // Mimic the underlying connections that write the response data into
+      // the stream provided by the caller.
+      if (!response_stream_->WriteAllBlocking(body_.data(), body_.size(),
+                                              error)) {
+        return false;
+      }
+      if (response_stream_->CanSeek() &&
+          !response_stream_->SetPosition(0, error)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Processes the response received from the server.
+  bool OnNetworkResponse(ErrorPtr* error) {
+    DiskCache* cache = &caching_transport_->cache_;
+    int code = connection_->GetResponseStatusCode();
+    if (code == status_code::NotModified && cached_response_) {
+      for (const char* header : kUpdatableHeaders) {
+        std::string value = connection_->GetResponseHeader(header);
+        if (!value.empty())
+          cached_response_->SetHeader(header, value);
+      }
+      std::string age = connection_->GetResponseHeader(response_header::kAge);
+      if (age.empty())
+        cached_response_->RemoveHeader(response_header::kAge);
+      else
+        cached_response_->SetHeader(response_header::kAge, age);
+      cached_response_->response_time = caching_transport_->Now();
+      cache->UpdateMetadata(*cached_response_);
+      if (!store_allowed_) {
+        // Reclaim the stream provided by the caller, so we can write the
+        // cached body into it.
+        response_stream_ = connection_->ExtractDataStream(nullptr);
+      }
+      return ServeFromCache(error);
+    }
+
+    CacheControl cache_control = ParseCacheControl(
+        connection_->GetResponseHeader(response_header::kCacheControl));
+    std::vector<std::string> vary =
+        ParseVary(connection_->GetResponseHeader(response_header::kVary));
+    // "Vary: *" means the response depends on more than the request headers.
+    bool vary_any = std::find(vary.begin(), vary.end(), "*") != vary.end();
+    if (code != status_code::Ok || cache_control.no_store || vary_any ||
+        !store_allowed_) {
+      if (cache_control.no_store || vary_any)
+        cache->Remove(url_);
+      return true;
+    }
+
+    std::unique_ptr<CachedResponse> response{new CachedResponse};
+    response->url = url_;
+    response->status_code = code;
+    response->status_text = connection_->GetResponseStatusText();
+    response->protocol_version = connection_->GetProtocolVersion();
+    response->response_time = caching_transport_->Now();
+    for (const char* header : kStoredHeaders) {
+      std::string value = connection_->GetResponseHeader(header);
+      if (!value.empty())
+        response->headers.emplace_back(header, value);
+    }
+    for (const std::string& name : vary) {
+      response->vary_headers.emplace_back(name,
+                                          FindHeader(request_headers_, name));
+    }
+    if (!CachingTransport::IsFresh(*response, response->response_time) &&
+        !HasValidators(*response)) {
+      // The response could never be used again without a full download.
+      return true;
+    }
+
+    StreamPtr stream = connection_->ExtractDataStream(error);
+    if (!stream)
+      return false;
+    std::vector<uint8_t> buffer(4096);
+    for (;;) {
+      size_t size_read = 0;
+      if (!stream->ReadBlocking(buffer.data(), buffer.size(), &size_read,
+                                error)) {
+        return false;
+      }
+      if (size_read == 0)
+        break;
+      body_.insert(body_.end(), buffer.begin(), buffer.begin() + size_read);
+    }
+
+    if (!cache->Store(*response, body_))
+      LOG(WARNING) << "Failed to store the response for " << url_;
+    cached_response_ = std::move(response);
+    serve_from_cache_ = true;
+    return true;
+  }
+
+  // Helpers for FinishRequestAsync(). They are static to let the bound
+  // callbacks keep the connection alive.
+  static void FinishFromCacheAsync(std::shared_ptr<CachingConnection> self,
+                                   RequestID id,
+                                   const SuccessCallback& success_callback,
+                                   const ErrorCallback& error_callback) {
+    // The request was cancelled.
+    if (!self->caching_transport_->RemoveRequest(id))
+      return;
+    ErrorPtr error;
+    if (!self->ServeFromCache(&error)) {
+      error_callback.Run(id, error.get());
+      return;
+    }
+    success_callback.Run(id, std::unique_ptr<Response>{new Response{self}});
+  }
+
+  static void OnAsyncResponse(std::shared_ptr<CachingConnection> self,
+                              RequestID id,
+                              const SuccessCallback& success_callback,
+                              const ErrorCallback& error_callback,
+                              RequestID /* transport_id */,
+                              std::unique_ptr<Response> /* response */) {
+    self->caching_transport_->RemoveRequest(id);
+    ErrorPtr error;
+    if (!self->OnNetworkResponse(&error)) {
+      error_callback.Run(id, error.get());
+      return;
+    }
+    success_callback.Run(id, std::unique_ptr<Response>{new Response{self}});
+  }
+
+  static void OnAsyncError(std::shared_ptr<CachingConnection> self,
+                           RequestID id,
+                           const ErrorCallback& error_callback,
+                           RequestID transport_id,
+                           const Error* error) {
+    self->caching_transport_->RemoveRequest(id);
+    error_callback.Run(transport_id == 0 ? 0 : id, error);
+  }
+
+  CachingTransport* caching_transport_;
+  std::string url_;
+  // The request headers (including User-Agent and Referer), used to record
+  // the values of the headers nominated by "Vary".
+  HeaderList request_headers_;
+  // The previously cached response, if any.
+  std::unique_ptr<CachedResponse> cached_response_;
+  // The connection of the underlying transport. Null if the response is
+  // served from the cache without contacting the server.
+  std::shared_ptr<Connection> connection_;
+
+  // Set when |cached_response_| and |body_| are the response to return.
+  bool serve_from_cache_{false};
+  std::vector<uint8_t> body_;
+  bool body_extracted_{false};
+  // The stream the caller wants the response data written to, if any.
+  StreamPtr response_stream_;
+  // False if the response must not be stored in the cache.
+  bool store_allowed_;
+
+  DISALLOW_COPY_AND_ASSIGN(CachingConnection);
+};
+
+CachingTransport::CachingTransport(const std::shared_ptr<Transport>& transport,
+                                   const base::FilePath& cache_dir,
+                                   uint64_t max_cache_size,
+                                   base::Clock* clock)
+    : transport_{transport},
+      cache_{cache_dir, max_cache_size},
+      clock_{clock ? clock : &default_clock_} {}
+
+CachingTransport::~CachingTransport() = default;
+
+std::shared_ptr<Connection> CachingTransport::CreateConnection(
+    const std::string& url,
+    const std::string& method,
+    const HeaderList& headers,
+    const std::string& user_agent,
+    const std::string& referer,
+    brillo::ErrorPtr* error) {
+  // The headers "Vary" can refer to, including the ones the underlying
+  // transport adds on its own.
+  HeaderList vary_headers = headers;
+  if (!user_agent.empty())
+    vary_headers.emplace_back(request_header::kUserAgent, user_agent);
+  if (!referer.empty())
+    vary_headers.emplace_back(request_header::kReferer, referer);
+  auto self = std::static_pointer_cast<CachingTransport>(shared_from_this());
+  auto create_connection = [&](const HeaderList& request_headers,
+                               bool cacheable,
+                               std::unique_ptr<CachedResponse> cached_response)
+      -> std::shared_ptr<Connection> {
+    std::shared_ptr<Connection> connection = transport_->CreateConnection(
+        url, method, request_headers, user_agent, referer, error);
+    if (!connection)
+      return nullptr;
+    return std::make_shared<CachingConnection>(self, url, vary_headers,
+                                               cacheable,
+                                               std::move(cached_response),
+                                               connection);
+  };
+
+  if (method != request_type::kGet) {
+    // Unsafe methods invalidate the cached response (RFC 7234, section 4.4).
+    if (method != request_type::kHead)
+      cache_.Remove(url);
+    return create_connection(headers, false, nullptr);
+  }
+
+  CacheControl cache_control =
+      ParseCacheControl(FindHeader(headers, request_header::kCacheControl));
+  if (cache_control.no_store ||
+      !FindHeader(headers, request_header::kRange).empty() ||
+      !FindHeader(headers, request_header::kIfNoneMatch).empty() ||
+      !FindHeader(headers, request_header::kIfModifiedSince).empty()) {
+    return create_connection(headers, false, nullptr);
+  }
+
+  std::unique_ptr<CachedResponse> cached_response{new CachedResponse};
+  if (!cache_.Lookup(url, cached_response.get()) ||
+      !MatchesVary(*cached_response, vary_headers)) {
+    // A response stored for other values of the Vary'd headers is replaced
+    // by the new one.
+    cached_response.reset();
+  } else if (!cache_control.no_cache && IsFresh(*cached_response, Now())) {
+    return std::make_shared<CachingConnection>(
+        self, url, vary_headers, true, std::move(cached_response), nullptr);
+  }
+
+  HeaderList request_headers = headers;
+  if (cached_response) {
+    std::string etag = cached_response->GetHeader(response_header::kETag);
+    if (!etag.empty())
+      request_headers.emplace_back(request_header::kIfNoneMatch, etag);
+    std::string last_modified =
+        cached_response->GetHeader(response_header::kLastModified);
+    if (!last_modified.empty()) {
+      request_headers.emplace_back(request_header::kIfModifiedSince,
+                                   last_modified);
+    }
+  }
+  return create_connection(request_headers, true, std::move(cached_response));
+}
+
+void CachingTransport::RunCallbackAsync(
+    const tracked_objects::Location& from_here,
+    const base::Closure& callback) {
+  transport_->RunCallbackAsync(from_here, callback);
+}
+
+RequestID CachingTransport::StartAsyncTransfer(
+    Connection* connection,
+    const SuccessCallback& success_callback,
+    const ErrorCallback& error_callback) {
+  return transport_->StartAsyncTransfer(connection, success_callback,
+                                        error_callback);
+}
+
+bool CachingTransport::CancelRequest(RequestID request_id) {
+  auto p = requests_.find(request_id);
+  if (p == requests_.end())
+    return false;
+  RequestID transport_id = p->second;
+  requests_.erase(p);
+  // Requests served from the cache have no request in |transport_|.
+  return transport_id == 0 || transport_->CancelRequest(transport_id);
+}
+
+bool CachingTransport::SetRequestPriority(RequestID request_id,
+                                          RequestPriority priority) {
+  auto p = requests_.find(request_id);
+  if (p == requests_.end())
+    return false;
+  return p->second == 0 ||
+         transport_->SetRequestPriority(p->second, priority);
+}
+
+void CachingTransport::SetDefaultTimeout(base::TimeDelta timeout) {
+  transport_->SetDefaultTimeout(timeout);
+}
+
+RequestID CachingTransport::AddRequest() {
+  RequestID id = ++last_request_id_;
+  requests_.emplace(id, 0);
+  return id;
+}
+
+void CachingTransport::SetTransportRequestId(RequestID request_id,
+                                             RequestID transport_id) {
+  // The request might have already completed.
+  auto p = requests_.find(request_id);
+  if (p != requests_.end())
+    p->second = transport_id;
+}
+
+bool CachingTransport::RemoveRequest(RequestID request_id) {
+  return requests_.erase(request_id) > 0;
+}
+
+bool CachingTransport::IsFresh(const CachedResponse& response,
+                               base::Time now) {
+  return GetCurrentAge(response, now) < GetFreshnessLifetime(response);
+}
+
+}  // namespace http
+}  // namespace brillo
@@ -0,0 +1,134 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_HTTP_HTTP_TRANSPORT_CACHING_H_
+#define LIBBRILLO_BRILLO_HTTP_HTTP_TRANSPORT_CACHING_H_
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/time/clock.h>
+#include <base/time/default_clock.h>
+#include <brillo/brillo_export.h>
+#include <brillo/http/http_cache.h>
+#include <brillo/http/http_transport.h>
+
+namespace brillo {
+namespace http {
+
+class CachingConnection;
+
+///////////////////////////////////////////////////////////////////////////////
+// CachingTransport is an http::Transport decorator that adds a persistent
+// private HTTP cache in front of another transport:
+//
+//    auto transport = std::make_shared<http::CachingTransport>(
+//        http::Transport::CreateDefault(), cache_dir, 10 * 1024 * 1024);
+//    auto response = http::GetAndBlock(url, {}, transport, &error);
+//
+// Successful GET responses are stored in a DiskCache. Fresh responses (as
+// determined by "Cache-Control: max-age", "Expires" or a heuristic based on
+// "Last-Modified") are returned without contacting the server. Stale responses
+// are revalidated using "If-None-Match"/"If-Modified-Since" and a "304 Not
+// Modified" reply from the server is transparently turned into the cached
+// "200 OK" response, so the callers use the normal http::Response API in all
+// cases.
+//
+// "Cache-Control: no-store" (in the request or the response) disables
+// caching, while "no-cache" forces revalidation. Requests with "Range" or
+// their own conditional headers are passed through as-is, and non-GET/HEAD
+// requests invalidate the cached response for their URL.
+//
+// One response is kept per URL. A response with "Vary" is only used for the
+// requests with the same values of the nominated headers as the request it
+// was received for, and "Vary: *" responses are not stored.
+//
+// Only the status line and the following response headers are stored: Age,
+// Cache-Control, Content-Encoding, Content-Language, Content-Type, Date, ETag,
+// Expires, Last-Modified and Vary.
+//
+// Request IDs are allocated by CachingTransport for all the requests,
+// including the ones served from the cache, and can be used with
+// CancelRequest() and SetRequestPriority() as usual.
+//
+// The cache is accessed synchronously, including from the completion callbacks
+// of the asynchronous requests, so the calling (message loop) thread blocks on
+// the file I/O. The cache is meant for small responses on local storage; use
+// the plain transport when that latency matters.
+///////////////////////////////////////////////////////////////////////////////
+class BRILLO_EXPORT CachingTransport : public Transport {
+ public:
+  // Creates a caching transport that sends requests through |transport| and
+  // stores responses in |cache_dir|, using up to |max_cache_size| bytes of
+  // disk space. |clock| is used to determine freshness of responses (the
+  // default clock is used if null).
+  CachingTransport(const std::shared_ptr<Transport>& transport,
+                   const base::FilePath& cache_dir,
+                   uint64_t max_cache_size,
+                   base::Clock* clock = nullptr);
+  ~CachingTransport() override;
+
+  // Overrides from http::Transport.
+  std::shared_ptr<Connection> CreateConnection(
+      const std::string& url,
+      const std::string& method,
+      const HeaderList& headers,
+      const std::string& user_agent,
+      const std::string& referer,
+      brillo::ErrorPtr* error) override;
+
+  void RunCallbackAsync(const tracked_objects::Location& from_here,
+                        const base::Closure& callback) override;
+
+  RequestID StartAsyncTransfer(Connection* connection,
+                               const SuccessCallback& success_callback,
+                               const ErrorCallback& error_callback) override;
+
+  bool CancelRequest(RequestID request_id) override;
+
+  bool SetRequestPriority(RequestID request_id,
+                          RequestPriority priority) override;
+
+  void SetDefaultTimeout(base::TimeDelta timeout) override;
+
+  // Returns the underlying disk cache.
+  DiskCache* GetCache() { return &cache_; }
+
+  // Returns true if |response| can still be used without revalidating it
+  // with the server at the time |now|.
+  static bool IsFresh(const CachedResponse& response, base::Time now);
+
+ private:
+  friend class CachingConnection;
+
+  base::Time Now() const { return clock_->Now(); }
+
+  // Allocates the ID of a request started by a CachingConnection.
+  RequestID AddRequest();
+  // Records the ID of the request in |transport_| the request |request_id|
+  // was forwarded to.
+  void SetTransportRequestId(RequestID request_id, RequestID transport_id);
+  // Removes a completed request. Returns false if it was cancelled.
+  bool RemoveRequest(RequestID request_id);
+
+  std::shared_ptr<Transport> transport_;
+  DiskCache cache_;
+  base::DefaultClock default_clock_;
+  base::Clock* clock_;
+
+  // Pending requests, mapped to the IDs of their requests in |transport_|
+  // (0 for the ones served from the cache).
+  std::map<RequestID, RequestID> requests_;
+  RequestID last_request_id_{0};
+
+  DISALLOW_COPY_AND_ASSIGN(CachingTransport);
+};
+
+}  // namespace http
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_HTTP_HTTP_TRANSPORT_CACHING_H_
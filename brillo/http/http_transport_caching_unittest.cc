@@ -0,0 +1,281 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/http/http_transport_caching.h>
+
+#include <string>
+#include <vector>
+
+#include <base/files/scoped_temp_dir.h>
+#include <base/test/simple_test_clock.h>
+#include <brillo/bind_lambda.h>
+#include <brillo/http/http_transport_fake.h>
+#include <brillo/http/http_utils.h>
+#include <brillo/mime_utils.h>
+#include <gtest/gtest.h>
+
+namespace brillo {
+namespace http {
+
+namespace {
+
+const char kUrl[] = "http://localhost/manifest";
+const char kETag[] = "\"v1\"";
+const char kVariantHeader[] = "X-Variant";
+
+}  // anonymous namespace
+
+class HttpCachingTransportTest : public testing::Test {
+ public:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    clock_.SetNow(base::Time::Now());
+    fake_transport_ = std::make_shared<fake::Transport>();
+    transport_ = std::make_shared<CachingTransport>(
+        fake_transport_, temp_dir_.GetPath(), 1024 * 1024, &clock_);
+  }
+
+  // Installs a handler on |kUrl| replying with |body| and extra |headers|.
+  // Replies with 304 if the request has a matching "If-None-Match" header.
+  void AddHandler(const std::string& body, const HeaderList& headers) {
+    auto handler = [this, body, headers](const fake::ServerRequest& request,
+                                         fake::ServerResponse* response) {
+      requests_.push_back(request.GetHeader(request_header::kIfNoneMatch));
+      if (request.GetHeader(request_header::kIfNoneMatch) == kETag) {
+        response->ReplyText(status_code::NotModified, "", mime::text::kPlain);
+      } else {
+        response->ReplyText(status_code::Ok, body, mime::text::kPlain);
+      }
+      response->AddHeaders(headers);
+    };
+    fake_transport_->AddHandler(kUrl, request_type::kGet,
+                                base::Bind(handler));
+  }
+
+  std::string Get(const HeaderList& headers = {}) {
+    auto response = GetAndBlock(kUrl, headers, transport_, nullptr);
+    EXPECT_NE(nullptr, response);
+    if (!response)
+      return std::string();
+    EXPECT_EQ(status_code::Ok, response->GetStatusCode());
+    return response->ExtractDataAsString();
+  }
+
+ protected:
+  base::ScopedTempDir temp_dir_;
+  base::SimpleTestClock clock_;
+  std::shared_ptr<fake::Transport> fake_transport_;
+  std::shared_ptr<CachingTransport> transport_;
+  // The If-None-Match header of each request received by the server.
+  std::vector<std::string> requests_;
+};
+
+TEST_F(HttpCachingTransportTest, FreshResponseServedFromCache) {
+  AddHandler("data", {{response_header::kCacheControl, "max-age=60"}});
+  EXPECT_EQ("data", Get());
+  EXPECT_EQ("data", Get());
+  EXPECT_EQ(1, fake_transport_->GetRequestCount());
+  EXPECT_EQ(1u, transport_->GetCache()->GetEntryCount());
+}
+
+TEST_F(HttpCachingTransportTest, CachedHeaders) {
+  AddHandler("data", {{response_header::kCacheControl, "max-age=60"},
+                      {response_header::kETag, kETag}});
+  Get();
+  auto response = GetAndBlock(kUrl, {}, transport_, nullptr);
+  ASSERT_NE(nullptr, response);
+  EXPECT_EQ(1, fake_transport_->GetRequestCount());
+  EXPECT_EQ(mime::text::kPlain, response->GetContentType());
+  EXPECT_EQ(kETag, response->GetHeader(response_header::kETag));
+}
+
+TEST_F(HttpCachingTransportTest, StaleResponseRevalidated) {
+  AddHandler("data", {{response_header::kCacheControl, "max-age=60"},
+                      {response_header::kETag, kETag}});
+  EXPECT_EQ("data", Get());
+  clock_.Advance(base::TimeDelta::FromSeconds(61));
+  // The server replies with 304, the client still sees the cached 200.
+  EXPECT_EQ("data", Get());
+  EXPECT_EQ(2, fake_transport_->GetRequestCount());
+  ASSERT_EQ(2u, requests_.size());
+  EXPECT_EQ("", requests_[0]);
+  EXPECT_EQ(kETag, requests_[1]);
+
+  // The revalidation made the response fresh again.
+  EXPECT_EQ("data", Get());
+  EXPECT_EQ(2, fake_transport_->GetRequestCount());
+}
+
+TEST_F(HttpCachingTransportTest, NoCacheAlwaysRevalidates) {
+  AddHandler("data", {{response_header::kCacheControl, "no-cache"},
+                      {response_header::kETag, kETag}});
+  EXPECT_EQ("data", Get());
+  EXPECT_EQ("data", Get());
+  EXPECT_EQ(2, fake_transport_->GetRequestCount());
+  EXPECT_EQ(kETag, requests_.back());
+}
+
+TEST_F(HttpCachingTransportTest, NoStoreNotCached) {
+  AddHandler("data", {{response_header::kCacheControl, "no-store"},
+                      {response_header::kETag, kETag}});
+  EXPECT_EQ("data", Get());
+  EXPECT_EQ("data", Get());
+  EXPECT_EQ(2, fake_transport_->GetRequestCount());
+  EXPECT_EQ(0u, transport_->GetCache()->GetEntryCount());
+}
+
+TEST_F(HttpCachingTransportTest, RequestNoCache) {
+  AddHandler("data", {{response_header::kCacheControl, "max-age=60"},
+                      {response_header::kETag, kETag}});
+  Get();
+  Get({{request_header::kCacheControl, "no-cache"}});
+  EXPECT_EQ(2, fake_transport_->GetRequestCount());
+  EXPECT_EQ(kETag, requests_.back());
+}
+
+TEST_F(HttpCachingTransportTest, UnsafeMethodInvalidates) {
+  AddHandler("data", {{response_header::kCacheControl, "max-age=60"}});
+  fake_transport_->AddSimpleReplyHandler(kUrl, request_type::kPost,
+                                         status_code::Ok, "", "text/plain");
+  Get();
+  EXPECT_EQ(1u, transport_->GetCache()->GetEntryCount());
+  PostTextAndBlock(kUrl, "x", mime::text::kPlain, {}, transport_, nullptr);
+  EXPECT_EQ(0u, transport_->GetCache()->GetEntryCount());
+}
+
+TEST_F(HttpCachingTransportTest, PersistsAcrossInstances) {
+  AddHandler("data", {{response_header::kCacheControl, "max-age=60"}});
+  Get();
+  transport_ = std::make_shared<CachingTransport>(
+      fake_transport_, temp_dir_.GetPath(), 1024 * 1024, &clock_);
+  EXPECT_EQ("data", Get());
+  EXPECT_EQ(1, fake_transport_->GetRequestCount());
+}
+
+TEST_F(HttpCachingTransportTest, AsyncCacheHit) {
+  AddHandler("data", {{response_header::kCacheControl, "max-age=60"}});
+  Get();
+  std::string data;
+  auto success_callback = [&data](RequestID /* id */,
+                                  std::unique_ptr<Response> response) {
+    data = response->ExtractDataAsString();
+  };
+  auto error_callback = [](RequestID /* id */, const Error* /* error */) {
+    FAIL();
+  };
+  http::Get(kUrl, {}, transport_, base::Bind(success_callback),
+            base::Bind(error_callback));
+  EXPECT_EQ("data", data);
+  EXPECT_EQ(1, fake_transport_->GetRequestCount());
+}
+
+TEST_F(HttpCachingTransportTest, AsyncCacheHitRequestId) {
+  AddHandler("data", {{response_header::kCacheControl, "max-age=60"}});
+  Get();
+  fake_transport_->SetAsyncMode(true);
+  RequestID callback_id = 0;
+  auto success_callback = [&callback_id](RequestID id,
+                                         std::unique_ptr<Response> /* resp */) {
+    callback_id = id;
+  };
+  auto error_callback = [](RequestID /* id */, const Error* /* error */) {
+    FAIL();
+  };
+  RequestID id = http::Get(kUrl, {}, transport_, base::Bind(success_callback),
+                           base::Bind(error_callback));
+  EXPECT_NE(0, id);
+  fake_transport_->HandleAllAsyncRequests();
+  EXPECT_EQ(id, callback_id);
+
+  // Cache hits can be cancelled like any other request.
+  callback_id = 0;
+  id = http::Get(kUrl, {}, transport_, base::Bind(success_callback),
+                 base::Bind(error_callback));
+  EXPECT_TRUE(transport_->CancelRequest(id));
+  fake_transport_->HandleAllAsyncRequests();
+  EXPECT_EQ(0, callback_id);
+  EXPECT_FALSE(transport_->CancelRequest(id));
+  EXPECT_EQ(1, fake_transport_->GetRequestCount());
+}
+
+TEST_F(HttpCachingTransportTest, VaryMatchesRequestHeaders) {
+  AddHandler("data", {{response_header::kCacheControl, "max-age=60"},
+                      {response_header::kVary, kVariantHeader}});
+  EXPECT_EQ("data", Get({{kVariantHeader, "a"}}));
+  EXPECT_EQ("data", Get({{kVariantHeader, "a"}}));
+  EXPECT_EQ(1, fake_transport_->GetRequestCount());
+  // The response is not used for other values of the Vary'd header.
+  EXPECT_EQ("data", Get({{kVariantHeader, "b"}}));
+  EXPECT_EQ(2, fake_transport_->GetRequestCount());
+  EXPECT_EQ("data", Get());
+  EXPECT_EQ(3, fake_transport_->GetRequestCount());
+}
+
+TEST_F(HttpCachingTransportTest, VaryStarNotStored) {
+  AddHandler("data", {{response_header::kCacheControl, "max-age=60"},
+                      {response_header::kVary, "*"}});
+  EXPECT_EQ("data", Get());
+  EXPECT_EQ("data", Get());
+  EXPECT_EQ(2, fake_transport_->GetRequestCount());
+  EXPECT_EQ(0u, transport_->GetCache()->GetEntryCount());
+}
+
+TEST_F(HttpCachingTransportTest, AgeReducesFreshness) {
+  AddHandler("data", {{response_header::kCacheControl, "max-age=60"},
+                      {response_header::kAge, "50"}});
+  Get();
+  clock_.Advance(base::TimeDelta::FromSeconds(5));
+  Get();
+  EXPECT_EQ(1, fake_transport_->GetRequestCount());
+  // The response was already 50 seconds old when it was received.
+  clock_.Advance(base::TimeDelta::FromSeconds(6));
+  Get();
+  EXPECT_EQ(2, fake_transport_->GetRequestCount());
+}
+
+TEST(HttpDiskCache, LruEviction) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  DiskCache cache{temp_dir.GetPath(), 1000};
+  CachedResponse response;
+  response.status_code = status_code::Ok;
+  std::vector<uint8_t> body(200, 'x');
+  for (const char* url : {"http://a", "http://b", "http://c"}) {
+    response.url = url;
+    EXPECT_TRUE(cache.Store(response, body));
+  }
+  // Use "a" so "b" becomes the least recently used entry.
+  EXPECT_TRUE(cache.Lookup("http://a", &response));
+  response.url = "http://d";
+  EXPECT_TRUE(cache.Store(response, body));
+
+  EXPECT_LE(cache.GetTotalSize(), 1000u);
+  EXPECT_FALSE(cache.Lookup("http://b", &response));
+  EXPECT_TRUE(cache.Lookup("http://a", &response));
+  EXPECT_TRUE(cache.Lookup("http://d", &response));
+}
+
+TEST(HttpDiskCache, HeadersStoredVerbatim) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  DiskCache cache{temp_dir.GetPath(), 1000};
+  CachedResponse response;
+  response.url = "http://a";
+  response.status_code = status_code::Ok;
+  response.status_text = "OK\\";
+  response.headers = {{"X-Name=Value", "trailing\\"},
+                      {"X-Lines", "a\nb:c"},
+                      {"X-Empty", ""}};
+  response.vary_headers = {{"Accept", "text/plain\\"}};
+  EXPECT_TRUE(cache.Store(response, {}));
+
+  CachedResponse cached;
+  ASSERT_TRUE(cache.Lookup("http://a", &cached));
+  EXPECT_EQ(response.status_text, cached.status_text);
+  EXPECT_EQ(response.headers, cached.headers);
+  EXPECT_EQ(response.vary_headers, cached.vary_headers);
+}
+
+}  // namespace http
+}  // namespace brillo
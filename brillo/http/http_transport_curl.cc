@@ -4,14 +4,17 @@
 
 #include <brillo/http/http_transport_curl.h>
 
+#include <algorithm>
 #include <limits>
+#include <vector>
 
 #include <base/bind.h>
 #include <base/logging.h>
-#include <base/message_loop/message_loop.h>
 #include <brillo/http/http_connection_curl.h>
 #include <brillo/http/http_request.h>
+#include <brillo/message_loops/message_loop.h>
 #include <brillo/strings/string_utils.h>
+#include <brillo/url_utils.h>
 
 namespace {
 
@@ -28,61 +31,16 @@ namespace brillo {
 namespace http {
 namespace curl {
 
-// This is a class that stores connection data on particular CURL socket
-// and provides file descriptor watcher to monitor read and/or write operations
-// on the socket's file descriptor.
-class Transport::SocketPollData : public base::MessageLoopForIO::Watcher {
- public:
-  SocketPollData(const std::shared_ptr<CurlInterface>& curl_interface,
-                 CURLM* curl_multi_handle,
-                 Transport* transport,
-                 curl_socket_t socket_fd)
-      : curl_interface_(curl_interface),
-        curl_multi_handle_(curl_multi_handle),
-        transport_(transport),
-        socket_fd_(socket_fd),
-        file_descriptor_watcher_(FROM_HERE) {}
-
-  // Returns the pointer for the socket-specific file descriptor watcher.
-  base::MessageLoopForIO::FileDescriptorWatcher* GetWatcher() {
-    return &file_descriptor_watcher_;
-  }
-
- private:
-  // Overrides from base::MessageLoopForIO::Watcher.
-  void OnFileCanReadWithoutBlocking(int fd) override {
-    OnSocketReady(fd, CURL_CSELECT_IN);
-  }
-  void OnFileCanWriteWithoutBlocking(int fd) override {
-    OnSocketReady(fd, CURL_CSELECT_OUT);
-  }
-
-  // Data on the socket is available to be read from or written to.
-  // Notify CURL of the action it needs to take on the socket file descriptor.
-  void OnSocketReady(int fd, int action) {
-    CHECK_EQ(socket_fd_, fd) << "Unexpected socket file descriptor";
-    int still_running_count = 0;
-    CURLMcode code = curl_interface_->MultiSocketAction(
-        curl_multi_handle_, socket_fd_, action, &still_running_count);
-    CHECK_NE(CURLM_CALL_MULTI_PERFORM, code)
-        << "CURL should no longer return CURLM_CALL_MULTI_PERFORM here";
-
-    if (code == CURLM_OK)
-      transport_->ProcessAsyncCurlMessages();
-  }
-
-  // The CURL interface to use.
-  std::shared_ptr<CurlInterface> curl_interface_;
-  // CURL multi-handle associated with the transport.
-  CURLM* curl_multi_handle_;
-  // Transport object itself.
-  Transport* transport_;
-  // The socket file descriptor for the connection.
-  curl_socket_t socket_fd_;
-  // File descriptor watcher to notify us of asynchronous I/O on the FD.
-  base::MessageLoopForIO::FileDescriptorWatcher file_descriptor_watcher_;
-
-  DISALLOW_COPY_AND_ASSIGN(SocketPollData);
+// The data attached to a CURL socket: the message loop tasks watching its
+// file descriptor. The watches are persistent and are only added or removed
+// when CURL changes the set of events it waits for on the socket, so there is
+// no allocation per socket event.
+struct Transport::SocketPollData {
+  // The CURL handle the socket was last reported for.
+  CURL* easy;
+  curl_socket_t socket_fd;
+  MessageLoop::TaskId read_task_id;
+  MessageLoop::TaskId write_task_id;
 };
 
 // The request data associated with an asynchronous operation on a particular
@@ -96,6 +54,14 @@ struct Transport::AsyncRequestData {
   std::shared_ptr<Connection> connection;
   // The ID of this request.
   RequestID request_id;
+  // The host the request is sent to and its priority.
+  std::string host;
+  RequestPriority priority;
+  // Whether the request has been started (added to the CURL multi-handle).
+  bool started{false};
+  // The position in the queue of a waiting request and the time it was queued.
+  QueueKey queue_key;
+  base::TimeTicks queued_time;
 };
 
 Transport::Transport(const std::shared_ptr<CurlInterface>& curl_interface)
@@ -194,8 +160,11 @@ std::shared_ptr<http::Connection> Transport::CreateConnection(
     return connection;
   }
 
-  connection = std::make_shared<http::curl::Connection>(
+  auto curl_connection = std::make_shared<http::curl::Connection>(
       curl_handle, method, curl_interface_, shared_from_this());
+  curl_connection->host_ = url::GetHostAndPort(url);
+  curl_connection->timing_stats_ = timing_stats_;
+  connection = curl_connection;
   if (!connection->SendHeaders(headers, error)) {
     connection.reset();
   }
@@ -204,8 +173,7 @@ std::shared_ptr<http::Connection> Transport::CreateConnection(
 
 void Transport::RunCallbackAsync(const tracked_objects::Location& from_here,
                                  const base::Closure& callback) {
-  base::MessageLoopForIO::current()->task_runner()->PostTask(
-      from_here, callback);
+  MessageLoop::current()->PostTask(from_here, callback);
 }
 
 RequestID Transport::StartAsyncTransfer(http::Connection* connection,
@@ -230,15 +198,24 @@ RequestID Transport::StartAsyncTransfer(http::Connection* connection,
   request_data->connection =
       std::static_pointer_cast<Connection>(curl_connection->shared_from_this());
   request_data->request_id = request_id;
+  request_data->host = curl_connection->host_;
+  request_data->priority = connection->GetPriority();
+  AsyncRequestData* data = request_data.get();
   async_requests_.emplace(curl_connection, std::move(request_data));
   request_id_map_.emplace(request_id, curl_connection);
 
-  // Add the connection's CURL handle to the multi-handle.
-  CURLMcode code = curl_interface_->MultiAddHandle(
-      curl_multi_handle_, curl_connection->curl_handle_);
-  if (code != CURLM_OK) {
-    brillo::ErrorPtr error;
-    AddMultiCurlError(&error, FROM_HERE, code, curl_interface_.get());
+  if (!CanStartRequest(data->host)) {
+    data->queue_key =
+        QueueKey{-static_cast<int>(data->priority), queue_sequence_++};
+    data->queued_time = base::TimeTicks::Now();
+    queued_requests_.emplace(data->queue_key, curl_connection);
+    stats_.max_queued_requests =
+        std::max(stats_.max_queued_requests, queued_requests_.size());
+    LOG(INFO) << "Queued asynchronous HTTP request with ID " << request_id;
+    return request_id;
+  }
+
+  if (!StartRequest(data, &error)) {
     RunCallbackAsync(
         FROM_HERE, base::Bind(error_callback, 0, base::Owned(error.release())));
     async_requests_.erase(curl_connection);
@@ -262,10 +239,47 @@ bool Transport::CancelRequest(RequestID request_id) {
   return true;
 }
 
+bool Transport::SetRequestPriority(RequestID request_id,
+                                   RequestPriority priority) {
+  auto p = request_id_map_.find(request_id);
+  if (p == request_id_map_.end())
+    return false;
+  auto request = async_requests_.find(p->second);
+  DCHECK(request != async_requests_.end());
+  AsyncRequestData* request_data = request->second.get();
+  // A running request can't be rescheduled, leave it as it is.
+  if (request_data->started)
+    return false;
+  request_data->priority = priority;
+  // Move the request to its new place in the queue, keeping its original
+  // order relative to the other requests of the same priority.
+  queued_requests_.erase(request_data->queue_key);
+  request_data->queue_key.first = -static_cast<int>(priority);
+  queued_requests_.emplace(request_data->queue_key, p->second);
+  return true;
+}
+
 void Transport::SetDefaultTimeout(base::TimeDelta timeout) {
   connection_timeout_ = timeout;
 }
 
+void Transport::SetMaxConcurrentRequests(size_t max_requests) {
+  max_requests_ = max_requests;
+  StartQueuedRequests();
+}
+
+void Transport::SetMaxConcurrentRequestsPerHost(size_t max_requests) {
+  max_requests_per_host_ = max_requests;
+  StartQueuedRequests();
+}
+
+Transport::SchedulerStats Transport::GetSchedulerStats() const {
+  SchedulerStats stats = stats_;
+  stats.active_requests = active_request_count_;
+  stats.queued_requests = queued_requests_.size();
+  return stats;
+}
+
 void Transport::AddEasyCurlError(brillo::ErrorPtr* error,
                                  const tracked_objects::Location& location,
                                  CURLcode code,
@@ -314,10 +328,15 @@ void Transport::ShutDownAsyncCurl() {
     return;
   LOG_IF(WARNING, !poll_data_map_.empty())
       << "There are pending requests at the time of transport's shutdown";
-  // Make sure we are not leaking any memory here.
-  for (const auto& pair : poll_data_map_)
-    delete pair.second;
+  for (const auto& pair : poll_data_map_) {
+    WatchSocket(pair.second.get(), MessageLoop::kWatchRead, false);
+    WatchSocket(pair.second.get(), MessageLoop::kWatchWrite, false);
+  }
   poll_data_map_.clear();
+  if (timer_task_id_ != MessageLoop::kTaskIdNull) {
+    MessageLoop::current()->CancelTask(timer_task_id_);
+    timer_task_id_ = MessageLoop::kTaskIdNull;
+  }
   curl_interface_->MultiCleanup(curl_multi_handle_);
   curl_multi_handle_ = nullptr;
 }
@@ -332,82 +351,120 @@ int Transport::MultiSocketCallback(CURL* easy,
   auto poll_data = static_cast<SocketPollData*>(socketp);
   if (!poll_data) {
     // We haven't attached polling data to this socket yet. Let's do this now.
-    poll_data = new SocketPollData{transport->curl_interface_,
-                                   transport->curl_multi_handle_,
-                                   transport,
-                                   s};
-    transport->poll_data_map_.emplace(std::make_pair(easy, s), poll_data);
+    std::unique_ptr<SocketPollData>& data = transport->poll_data_map_[s];
+    if (!data) {
+      data.reset(new SocketPollData{easy, s, MessageLoop::kTaskIdNull,
+                                    MessageLoop::kTaskIdNull});
+    }
+    poll_data = data.get();
     transport->curl_interface_->MultiAssign(
         transport->curl_multi_handle_, s, poll_data);
   }
+  poll_data->easy = easy;
 
-  if (what == CURL_POLL_NONE) {
-    return 0;
-  } else if (what == CURL_POLL_REMOVE) {
-    // Remove the attached data from the socket.
-    transport->curl_interface_->MultiAssign(
-        transport->curl_multi_handle_, s, nullptr);
-    transport->poll_data_map_.erase(std::make_pair(easy, s));
-
-    // Make sure we stop watching the socket file descriptor now, before
-    // we schedule the SocketPollData for deletion.
-    poll_data->GetWatcher()->StopWatchingFileDescriptor();
-    // This method can be called indirectly from SocketPollData::OnSocketReady,
-    // so delay destruction of SocketPollData object till the next loop cycle.
-    base::MessageLoopForIO::current()->task_runner()->
-        DeleteSoon(FROM_HERE, poll_data);
-    return 0;
-  }
-
-  base::MessageLoopForIO::Mode watch_mode = base::MessageLoopForIO::WATCH_READ;
+  bool watch_read = false;
+  bool watch_write = false;
   switch (what) {
+    case CURL_POLL_NONE:
+      break;
     case CURL_POLL_IN:
-      watch_mode = base::MessageLoopForIO::WATCH_READ;
+      watch_read = true;
       break;
     case CURL_POLL_OUT:
-      watch_mode = base::MessageLoopForIO::WATCH_WRITE;
+      watch_write = true;
       break;
     case CURL_POLL_INOUT:
-      watch_mode = base::MessageLoopForIO::WATCH_READ_WRITE;
+      watch_read = true;
+      watch_write = true;
       break;
+    case CURL_POLL_REMOVE:
+      transport->RemoveSocketPollData(poll_data);
+      return 0;
     default:
       LOG(FATAL) << "Unknown CURL socket action: " << what;
       break;
   }
 
-  // WatchFileDescriptor() can be called with the same controller object
-  // (watcher) to amend the watch mode, however this has cumulative effect.
-  // For example, if we were watching a file descriptor for READ operations
-  // and now call it to watch for WRITE, it will end up watching for both
-  // READ and WRITE. This is not what we want here, so stop watching the
-  // file descriptor on previous controller before starting with a different
-  // mode.
-  if (!poll_data->GetWatcher()->StopWatchingFileDescriptor())
-    LOG(WARNING) << "Failed to stop watching the previous socket descriptor";
-  CHECK(base::MessageLoopForIO::current()->WatchFileDescriptor(
-      s, true, watch_mode, poll_data->GetWatcher(), poll_data))
-      << "Failed to watch the CURL socket.";
+  // Only the watches for the events CURL is no longer interested in are
+  // removed; the others keep running.
+  transport->WatchSocket(poll_data, MessageLoop::kWatchRead, watch_read);
+  transport->WatchSocket(poll_data, MessageLoop::kWatchWrite, watch_write);
   return 0;
 }
 
+void Transport::WatchSocket(SocketPollData* poll_data,
+                            MessageLoop::WatchMode mode,
+                            bool watch) {
+  MessageLoop::TaskId* task_id = (mode == MessageLoop::kWatchRead)
+                                     ? &poll_data->read_task_id
+                                     : &poll_data->write_task_id;
+  if (watch == (*task_id != MessageLoop::kTaskIdNull))
+    return;
+
+  if (!watch) {
+    // This can be called from OnSocketReady() running as the very task
+    // being canceled, which MessageLoop allows for persistent watches.
+    MessageLoop::current()->CancelTask(*task_id);
+    *task_id = MessageLoop::kTaskIdNull;
+    return;
+  }
+
+  int action =
+      (mode == MessageLoop::kWatchRead) ? CURL_CSELECT_IN : CURL_CSELECT_OUT;
+  *task_id = MessageLoop::current()->WatchFileDescriptor(
+      FROM_HERE, poll_data->socket_fd, mode, true,
+      base::Bind(&Transport::OnSocketReady, weak_ptr_factory_.GetWeakPtr(),
+                 poll_data->socket_fd, action));
+  CHECK_NE(MessageLoop::kTaskIdNull, *task_id)
+      << "Failed to watch the CURL socket.";
+}
+
+void Transport::RemoveSocketPollData(SocketPollData* poll_data) {
+  curl_socket_t socket_fd = poll_data->socket_fd;
+  WatchSocket(poll_data, MessageLoop::kWatchRead, false);
+  WatchSocket(poll_data, MessageLoop::kWatchWrite, false);
+  curl_interface_->MultiAssign(curl_multi_handle_, socket_fd, nullptr);
+  // The socket callbacks are bound to the file descriptor rather than to
+  // |poll_data|, so it can be deleted right away.
+  poll_data_map_.erase(socket_fd);
+}
+
+void Transport::OnSocketReady(curl_socket_t socket_fd, int action) {
+  int still_running_count = 0;
+  CURLMcode code = curl_interface_->MultiSocketAction(
+      curl_multi_handle_, socket_fd, action, &still_running_count);
+  CHECK_NE(CURLM_CALL_MULTI_PERFORM, code)
+      << "CURL should no longer return CURLM_CALL_MULTI_PERFORM here";
+
+  if (code == CURLM_OK)
+    ProcessAsyncCurlMessages();
+}
+
 // CURL actually uses "long" types in callback signatures, so we must comply.
 int Transport::MultiTimerCallback(CURLM* /* multi */,
                                   long timeout_ms,  // NOLINT(runtime/int)
                                   void* userp) {
   auto transport = static_cast<Transport*>(userp);
-  // Cancel any previous timer callbacks.
-  transport->weak_ptr_factory_for_timer_.InvalidateWeakPtrs();
-  if (timeout_ms >= 0) {
-    base::MessageLoopForIO::current()->task_runner()->PostDelayedTask(
+  MessageLoop::TaskId* task_id = &transport->timer_task_id_;
+  // CURL only calls this when its earliest expiry changes, so the new timeout
+  // always replaces the pending one, even if it is later. Keeping an earlier
+  // timer would leave the new expiry unarmed once that timer has fired.
+  if (*task_id != MessageLoop::kTaskIdNull)
+    MessageLoop::current()->CancelTask(*task_id);
+  *task_id = MessageLoop::kTaskIdNull;
+  if (timeout_ms < 0)
+    return 0;
+
+  *task_id = MessageLoop::current()->PostDelayedTask(
       FROM_HERE,
       base::Bind(&Transport::OnTimer,
-                 transport->weak_ptr_factory_for_timer_.GetWeakPtr()),
+                 transport->weak_ptr_factory_.GetWeakPtr()),
       base::TimeDelta::FromMilliseconds(timeout_ms));
-  }
   return 0;
 }
 
 void Transport::OnTimer() {
+  timer_task_id_ = MessageLoop::kTaskIdNull;
   if (curl_multi_handle_) {
     int still_running_count = 0;
     curl_interface_->MultiSocketAction(
@@ -452,6 +509,7 @@ void Transport::OnTransferComplete(Connection* connection, CURLcode code) {
   } else {
     LOG(INFO) << "Response: " << connection->GetResponseStatusCode() << " ("
               << connection->GetResponseStatusText() << ")";
+    connection->CollectTimings();
     brillo::ErrorPtr error;
     // Rewind the response data stream to the beginning so the clients can
     // read the data back.
@@ -493,24 +551,111 @@ void Transport::CleanAsyncConnection(Connection* connection) {
   // Remove associated request ID.
   request_id_map_.erase(request_data->request_id);
 
-  // Remove the connection's CURL handle from multi-handle.
-  curl_interface_->MultiRemoveHandle(curl_multi_handle_,
-                                     connection->curl_handle_);
+  if (request_data->started) {
+    // Remove the connection's CURL handle from multi-handle.
+    curl_interface_->MultiRemoveHandle(curl_multi_handle_,
+                                       connection->curl_handle_);
 
-  // Remove all the socket data associated with this connection.
-  auto iter = poll_data_map_.begin();
-  while (iter != poll_data_map_.end()) {
-    if (iter->first.first == connection->curl_handle_)
-      iter = poll_data_map_.erase(iter);
-    else
-      ++iter;
+    // Remove the socket data CURL left associated with this connection.
+    std::vector<SocketPollData*> sockets;
+    for (const auto& pair : poll_data_map_) {
+      if (pair.second->easy == connection->curl_handle_)
+        sockets.push_back(pair.second.get());
+    }
+    for (SocketPollData* poll_data : sockets)
+      RemoveSocketPollData(poll_data);
+
+    active_request_count_--;
+    auto host = active_requests_per_host_.find(request_data->host);
+    if (--host->second == 0)
+      active_requests_per_host_.erase(host);
+    // Let the waiting requests take the freed slot. They hold references to
+    // their connections (and to this transport) so this is safe to do before
+    // the request data is destroyed below.
+    StartQueuedRequests();
+  } else {
+    auto queued = queued_requests_.find(request_data->queue_key);
+    if (queued != queued_requests_.end() && queued->second == connection)
+      queued_requests_.erase(queued);
   }
+
   // Remove pending asynchronous request data.
   // This must be last since there is a chance of this object being
   // destroyed as the result. See the comment in Transport::OnTransferComplete.
   async_requests_.erase(p);
 }
 
+bool Transport::CanStartRequest(const std::string& host) const {
+  if (max_requests_ && active_request_count_ >= max_requests_)
+    return false;
+  if (max_requests_per_host_) {
+    auto p = active_requests_per_host_.find(host);
+    if (p != active_requests_per_host_.end() &&
+        p->second >= max_requests_per_host_) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Transport::StartRequest(AsyncRequestData* request_data,
+                             brillo::ErrorPtr* error) {
+  // Add the connection's CURL handle to the multi-handle.
+  CURLMcode code = curl_interface_->MultiAddHandle(
+      curl_multi_handle_, request_data->connection->curl_handle_);
+  if (code != CURLM_OK) {
+    AddMultiCurlError(error, FROM_HERE, code, curl_interface_.get());
+    return false;
+  }
+  request_data->started = true;
+  active_request_count_++;
+  active_requests_per_host_[request_data->host]++;
+  stats_.started_requests++;
+  return true;
+}
+
+void Transport::StartQueuedRequests() {
+  auto iter = queued_requests_.begin();
+  while (iter != queued_requests_.end()) {
+    if (max_requests_ && active_request_count_ >= max_requests_)
+      break;
+    Connection* connection = iter->second;
+    auto request = async_requests_.find(connection);
+    DCHECK(request != async_requests_.end());
+    AsyncRequestData* request_data = request->second.get();
+    if (!CanStartRequest(request_data->host)) {
+      // The host is busy. Maybe the requests to other hosts can go ahead.
+      ++iter;
+      continue;
+    }
+    iter = queued_requests_.erase(iter);
+
+    base::TimeDelta queue_time =
+        base::TimeTicks::Now() - request_data->queued_time;
+    stats_.delayed_requests++;
+    stats_.total_queue_time += queue_time;
+    stats_.max_queue_time = std::max(stats_.max_queue_time, queue_time);
+
+    brillo::ErrorPtr error;
+    if (!StartRequest(request_data, &error)) {
+      RunCallbackAsync(FROM_HERE,
+                       base::Bind(request_data->error_callback,
+                                  request_data->request_id,
+                                  base::Owned(error.release())));
+      // Don't clean up right away, the connection might be the last reference
+      // to this transport. See the comment in Transport::OnTransferComplete.
+      RunCallbackAsync(FROM_HERE,
+                       base::Bind(&Transport::CleanAsyncConnection,
+                                  weak_ptr_factory_.GetWeakPtr(),
+                                  connection));
+      continue;
+    }
+    LOG(INFO) << "Started queued asynchronous HTTP request with ID "
+              << request_data->request_id << " after "
+              << queue_time.InMilliseconds() << " ms";
+  }
+}
+
 }  // namespace curl
 }  // namespace http
 }  // namespace brillo
@@ -6,13 +6,17 @@
 #define LIBBRILLO_BRILLO_HTTP_HTTP_TRANSPORT_CURL_H_
 
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 
 #include <base/memory/weak_ptr.h>
+#include <base/time/time.h>
 #include <brillo/brillo_export.h>
 #include <brillo/http/curl_api.h>
+#include <brillo/http/http_timing_stats.h>
 #include <brillo/http/http_transport.h>
+#include <brillo/message_loops/message_loop.h>
 
 namespace brillo {
 namespace http {
@@ -29,7 +33,7 @@ class Connection;
 ///////////////////////////////////////////////////////////////////////////////
 class BRILLO_EXPORT Transport : public http::Transport {
  public:
-  // Constructs the transport using the current message loop for async
+  // Constructs the transport using the current brillo::MessageLoop for async
   // operations.
   explicit Transport(const std::shared_ptr<CurlInterface>& curl_interface);
   // Creates a transport object using a proxy.
@@ -57,8 +61,42 @@ class BRILLO_EXPORT Transport : public http::Transport {
 
   bool CancelRequest(RequestID request_id) override;
 
+  bool SetRequestPriority(RequestID request_id,
+                          RequestPriority priority) override;
+
   void SetDefaultTimeout(base::TimeDelta timeout) override;
 
+  // Statistics of the asynchronous request scheduler.
+  struct SchedulerStats {
+    // The number of requests currently running and waiting to be started.
+    size_t active_requests{0};
+    size_t queued_requests{0};
+    // The largest number of requests waiting at the same time so far.
+    size_t max_queued_requests{0};
+    // The number of requests started so far and how many of them had to wait
+    // in the queue.
+    uint64_t started_requests{0};
+    uint64_t delayed_requests{0};
+    // The total and the longest time the delayed requests spent in the queue.
+    base::TimeDelta total_queue_time;
+    base::TimeDelta max_queue_time;
+  };
+
+  // Set the maximum number of asynchronous requests running at the same time,
+  // in total and to the same host (and port). The requests exceeding the
+  // limits wait in a queue and are started in the order of their priority,
+  // and in the order they were made for the same priority. A value of 0
+  // removes the limit. There are no limits by default.
+  void SetMaxConcurrentRequests(size_t max_requests);
+  void SetMaxConcurrentRequestsPerHost(size_t max_requests);
+
+  // Returns the current state and the statistics of the request scheduler.
+  SchedulerStats GetSchedulerStats() const;
+
+  // Returns the per-host timing statistics of the requests completed by this
+  // transport.
+  TimingStats* GetTimingStats() { return timing_stats_.get(); }
+
   // Helper methods to convert CURL error codes (CURLcode and CURLMcode)
   // into brillo::Error object.
   static void AddEasyCurlError(brillo::ErrorPtr* error,
@@ -74,7 +112,12 @@ class BRILLO_EXPORT Transport : public http::Transport {
  private:
   // Forward-declaration of internal implementation structures.
   struct AsyncRequestData;
-  class SocketPollData;
+  struct SocketPollData;
+
+  // The position of a waiting request in |queued_requests_|: the negated
+  // priority (so the higher priority requests come first) and the sequence
+  // number of the request.
+  using QueueKey = std::pair<int, uint64_t>;
 
   // Initializes CURL for async operation.
   bool SetupAsyncCurl(brillo::ErrorPtr* error);
@@ -93,9 +136,30 @@ class BRILLO_EXPORT Transport : public http::Transport {
   // on a connection.
   void CleanAsyncConnection(http::curl::Connection* connection);
 
+  // Returns true if a new request to |host| is allowed to start right now.
+  bool CanStartRequest(const std::string& host) const;
+
+  // Adds the request's CURL handle to the multi-handle.
+  bool StartRequest(AsyncRequestData* request_data, brillo::ErrorPtr* error);
+
+  // Starts as many queued requests as the concurrency limits allow.
+  void StartQueuedRequests();
+
   // Called after a timeout delay requested by CURL has elapsed.
   void OnTimer();
 
+  // Starts or stops watching the socket of |poll_data| for |mode|. An
+  // existing watch for the same mode is kept as is.
+  void WatchSocket(SocketPollData* poll_data,
+                   MessageLoop::WatchMode mode,
+                   bool watch);
+
+  // Stops watching the socket and detaches |poll_data| from it.
+  void RemoveSocketPollData(SocketPollData* poll_data);
+
+  // Notifies CURL that the socket is ready for the |action|.
+  void OnSocketReady(curl_socket_t socket_fd, int action);
+
   // Callback for CURL to handle curl_socket_callback() notifications.
   // The parameters correspond to those of curl_socket_callback().
   static int MultiSocketCallback(CURL* easy,
@@ -121,14 +185,30 @@ class BRILLO_EXPORT Transport : public http::Transport {
   // and error callbacks that need to be called at the end of the async
   // operation).
   std::map<Connection*, std::unique_ptr<AsyncRequestData>> async_requests_;
-  // Internal data associated with in-progress asynchronous operations.
-  std::map<std::pair<CURL*, curl_socket_t>, SocketPollData*> poll_data_map_;
+  // The sockets CURL asked us to watch. The data is attached to the socket
+  // with curl_multi_assign() and lives until CURL removes the socket.
+  std::map<curl_socket_t, std::unique_ptr<SocketPollData>> poll_data_map_;
+  // The pending CURL timeout task.
+  MessageLoop::TaskId timer_task_id_{MessageLoop::kTaskIdNull};
   // The last request ID used for asynchronous operations.
   RequestID last_request_id_{0};
+  // Requests waiting to be started, in the order they should be started in.
+  std::map<QueueKey, Connection*> queued_requests_;
+  // The sequence number for the next queued request.
+  uint64_t queue_sequence_{0};
+  // The number of running requests, in total and for each host.
+  size_t active_request_count_{0};
+  std::map<std::string, size_t> active_requests_per_host_;
+  // Concurrency limits. See SetMaxConcurrentRequests().
+  size_t max_requests_{0};
+  size_t max_requests_per_host_{0};
+  SchedulerStats stats_;
+  // Shared with the connections, which report their timings when they
+  // complete.
+  std::shared_ptr<TimingStats> timing_stats_{std::make_shared<TimingStats>()};
   // The connection timeout for the requests made.
   base::TimeDelta connection_timeout_;
 
-  base::WeakPtrFactory<Transport> weak_ptr_factory_for_timer_{this};
   base::WeakPtrFactory<Transport> weak_ptr_factory_{this};
   DISALLOW_COPY_AND_ASSIGN(Transport);
 };
@@ -4,13 +4,34 @@
 
 #include <brillo/http/http_transport_curl.h>
 
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <base/at_exit.h>
+#include <base/logging.h>
 #include <base/message_loop/message_loop.h>
 #include <base/run_loop.h>
+#include <base/strings/stringprintf.h>
+#include <base/test/simple_test_clock.h>
+#include <base/time/time.h>
 #include <brillo/bind_lambda.h>
+#include <brillo/http/curl_api.h>
 #include <brillo/http/http_connection_curl.h>
 #include <brillo/http/http_request.h>
+#include <brillo/http/http_utils.h>
 #include <brillo/http/mock_curl_api.h>
+#include <brillo/message_loops/base_message_loop.h>
+#include <brillo/message_loops/fake_message_loop.h>
+#include <brillo/message_loops/message_loop_utils.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
@@ -191,6 +212,8 @@ TEST_F(HttpCurlTransportAsyncTest, StartAsyncTransfer) {
   // For this, create a temporary I/O message loop and run it ourselves for the
   // duration of the test.
   base::MessageLoopForIO message_loop;
+  BaseMessageLoop brillo_loop{&message_loop};
+  brillo_loop.SetAsCurrent();
   base::RunLoop run_loop;
 
   // Initial expectations for creating a CURL connection.
@@ -222,6 +245,12 @@ TEST_F(HttpCurlTransportAsyncTest, StartAsyncTransfer) {
   EXPECT_CALL(*curl_api_, MultiInit()).WillOnce(Return(multi_handle_));
   EXPECT_CALL(*curl_api_, EasyGetInfoInt(handle_, CURLINFO_RESPONSE_CODE, _))
       .WillRepeatedly(DoAll(SetArgPointee<2>(200), Return(CURLE_OK)));
+  EXPECT_CALL(*curl_api_, EasyGetInfoInt(handle_, CURLINFO_HEADER_SIZE, _))
+      .WillOnce(DoAll(SetArgPointee<2>(0), Return(CURLE_OK)));
+  EXPECT_CALL(*curl_api_, EasyGetInfoInt(handle_, CURLINFO_NUM_CONNECTS, _))
+      .WillOnce(DoAll(SetArgPointee<2>(0), Return(CURLE_OK)));
+  EXPECT_CALL(*curl_api_, EasyGetInfoDbl(handle_, _, _))
+      .WillRepeatedly(DoAll(SetArgPointee<2>(0.0), Return(CURLE_OK)));
 
   curl_socket_callback socket_callback = nullptr;
   EXPECT_CALL(*curl_api_,
@@ -283,6 +312,13 @@ TEST_F(HttpCurlTransportAsyncTest, StartAsyncTransfer) {
   run_loop.Run();
   EXPECT_EQ(1, success_call_count);
 
+  // The timings of the request are added to the transport statistics.
+  const TimingStats::HostStats* stats =
+      transport_->GetTimingStats()->GetHostStats("foo.bar");
+  ASSERT_NE(nullptr, stats);
+  EXPECT_EQ(1u, stats->request_count);
+  EXPECT_EQ(1u, stats->reused_connections);
+
   EXPECT_CALL(*curl_api_, EasyCleanup(handle_)).Times(1);
   connection.reset();
 
@@ -308,6 +344,370 @@ TEST_F(HttpCurlTransportTest, RequestGetTimeout) {
   connection.reset();
 }
 
+class HttpCurlTransportSchedulerTest : public testing::Test {
+ public:
+  void SetUp() override {
+    curl_api_ = std::make_shared<MockCurlInterface>();
+    transport_ = std::make_shared<Transport>(curl_api_);
+    EXPECT_CALL(*curl_api_, EasyInit()).WillRepeatedly(Invoke([this]() {
+      return reinterpret_cast<CURL*>(++last_handle_);
+    }));
+    EXPECT_CALL(*curl_api_, EasySetOptStr(_, _, _))
+        .WillRepeatedly(Return(CURLE_OK));
+    EXPECT_CALL(*curl_api_, EasySetOptInt(_, _, _))
+        .WillRepeatedly(Return(CURLE_OK));
+    EXPECT_CALL(*curl_api_, EasySetOptPtr(_, _, _))
+        .WillRepeatedly(Return(CURLE_OK));
+    EXPECT_CALL(*curl_api_, EasyCleanup(_)).Times(testing::AnyNumber());
+    EXPECT_CALL(*curl_api_, MultiInit()).WillOnce(Return(multi_handle_));
+    EXPECT_CALL(*curl_api_, MultiSetSocketCallback(multi_handle_, _, _))
+        .WillOnce(DoAll(SaveArg<1>(&socket_callback_), Return(CURLM_OK)));
+    EXPECT_CALL(*curl_api_, MultiSetTimerCallback(multi_handle_, _, _))
+        .WillOnce(DoAll(SaveArg<1>(&timer_callback_), Return(CURLM_OK)));
+    EXPECT_CALL(*curl_api_, MultiAddHandle(multi_handle_, _))
+        .WillRepeatedly(Invoke([this](CURLM* /* multi */, CURL* handle) {
+          started_.push_back(reinterpret_cast<intptr_t>(handle));
+          return CURLM_OK;
+        }));
+    EXPECT_CALL(*curl_api_, MultiRemoveHandle(multi_handle_, _))
+        .WillRepeatedly(Return(CURLM_OK));
+    EXPECT_CALL(*curl_api_, MultiCleanup(multi_handle_))
+        .WillOnce(Return(CURLM_OK));
+  }
+
+  void TearDown() override {
+    // Release the connections of the outstanding requests.
+    for (RequestID id = 1; id <= last_handle_; id++)
+      transport_->CancelRequest(id);
+    transport_.reset();
+    curl_api_.reset();
+  }
+
+  // Starts an asynchronous request to |url|. The requests (and their CURL
+  // handles) are numbered sequentially starting from 1.
+  RequestID StartRequest(const std::string& url,
+                         RequestPriority priority = RequestPriority::MEDIUM) {
+    auto connection = transport_->CreateConnection(
+        url, request_type::kGet, {}, "", "", nullptr);
+    connection->SetPriority(priority);
+    auto success_callback = [](RequestID, std::unique_ptr<http::Response>) {};
+    auto error_callback = [](RequestID, const Error*) {};
+    return transport_->StartAsyncTransfer(connection.get(),
+                                          base::Bind(success_callback),
+                                          base::Bind(error_callback));
+  }
+
+ protected:
+  std::shared_ptr<MockCurlInterface> curl_api_;
+  std::shared_ptr<Transport> transport_;
+  CURLM* multi_handle_{reinterpret_cast<CURLM*>(456)};  // Mock handle value.
+  int last_handle_{0};
+  // The requests added to the CURL multi-handle, in order.
+  std::vector<intptr_t> started_;
+  curl_socket_callback socket_callback_{nullptr};
+  curl_multi_timer_callback timer_callback_{nullptr};
+};
+
+TEST_F(HttpCurlTransportSchedulerTest, UnlimitedByDefault) {
+  for (int i = 1; i <= 20; i++)
+    StartRequest("http://foo.bar/" + std::to_string(i));
+  EXPECT_EQ(20u, started_.size());
+  auto stats = transport_->GetSchedulerStats();
+  EXPECT_EQ(20u, stats.active_requests);
+  EXPECT_EQ(0u, stats.queued_requests);
+  EXPECT_EQ(0u, stats.delayed_requests);
+}
+
+TEST_F(HttpCurlTransportSchedulerTest, PriorityOrder) {
+  transport_->SetMaxConcurrentRequests(1);
+  EXPECT_EQ(1, StartRequest("http://foo.bar/1"));
+  EXPECT_EQ(2, StartRequest("http://foo.bar/2", RequestPriority::LOW));
+  EXPECT_EQ(3, StartRequest("http://foo.bar/3", RequestPriority::HIGH));
+  EXPECT_EQ(4, StartRequest("http://foo.bar/4"));
+  EXPECT_EQ(5, StartRequest("http://foo.bar/5", RequestPriority::HIGH));
+  EXPECT_EQ(std::vector<intptr_t>{1}, started_);
+  EXPECT_EQ(4u, transport_->GetSchedulerStats().queued_requests);
+
+  for (RequestID id : {1, 3, 5, 4})
+    EXPECT_TRUE(transport_->CancelRequest(id));
+  EXPECT_EQ((std::vector<intptr_t>{1, 3, 5, 4, 2}), started_);
+
+  auto stats = transport_->GetSchedulerStats();
+  EXPECT_EQ(1u, stats.active_requests);
+  EXPECT_EQ(0u, stats.queued_requests);
+  EXPECT_EQ(4u, stats.max_queued_requests);
+  EXPECT_EQ(5u, stats.started_requests);
+  EXPECT_EQ(4u, stats.delayed_requests);
+}
+
+TEST_F(HttpCurlTransportSchedulerTest, PerHostLimit) {
+  transport_->SetMaxConcurrentRequestsPerHost(2);
+  StartRequest("http://foo.bar/1");
+  StartRequest("http://FOO.bar/2");
+  StartRequest("http://foo.bar/3", RequestPriority::HIGH);
+  StartRequest("https://user@baz.com:8080/4");
+  StartRequest("http://foo.bar:8080/5");
+  EXPECT_EQ((std::vector<intptr_t>{1, 2, 4, 5}), started_);
+
+  // Requests to other hosts don't free up a slot for foo.bar.
+  EXPECT_TRUE(transport_->CancelRequest(4));
+  EXPECT_EQ(4u, started_.size());
+  EXPECT_TRUE(transport_->CancelRequest(2));
+  EXPECT_EQ((std::vector<intptr_t>{1, 2, 4, 5, 3}), started_);
+}
+
+TEST_F(HttpCurlTransportSchedulerTest, ChangePriority) {
+  transport_->SetMaxConcurrentRequests(1);
+  StartRequest("http://foo.bar/1");
+  StartRequest("http://foo.bar/2", RequestPriority::LOW);
+  StartRequest("http://foo.bar/3");
+  EXPECT_FALSE(transport_->SetRequestPriority(1, RequestPriority::IDLE));
+  EXPECT_TRUE(transport_->SetRequestPriority(2, RequestPriority::HIGH));
+  EXPECT_FALSE(transport_->SetRequestPriority(10, RequestPriority::HIGH));
+  EXPECT_TRUE(transport_->CancelRequest(1));
+  EXPECT_EQ((std::vector<intptr_t>{1, 2}), started_);
+}
+
+TEST_F(HttpCurlTransportSchedulerTest, CancelQueued) {
+  transport_->SetMaxConcurrentRequests(1);
+  StartRequest("http://foo.bar/1");
+  StartRequest("http://foo.bar/2");
+  StartRequest("http://foo.bar/3");
+  EXPECT_TRUE(transport_->CancelRequest(2));
+  EXPECT_EQ(1u, transport_->GetSchedulerStats().queued_requests);
+  EXPECT_TRUE(transport_->CancelRequest(1));
+  EXPECT_EQ((std::vector<intptr_t>{1, 3}), started_);
+  EXPECT_FALSE(transport_->CancelRequest(2));
+}
+
+TEST_F(HttpCurlTransportSchedulerTest, RaiseLimit) {
+  transport_->SetMaxConcurrentRequests(1);
+  StartRequest("http://foo.bar/1");
+  StartRequest("http://foo.bar/2");
+  StartRequest("http://foo.bar/3");
+  EXPECT_EQ(1u, started_.size());
+  transport_->SetMaxConcurrentRequests(3);
+  EXPECT_EQ((std::vector<intptr_t>{1, 2, 3}), started_);
+}
+
+TEST_F(HttpCurlTransportSchedulerTest, SocketWatches) {
+  FakeMessageLoop loop{nullptr};
+  loop.SetAsCurrent();
+  StartRequest("http://foo.bar/1");
+  CURL* handle = reinterpret_cast<CURL*>(1);
+  const curl_socket_t kSocket = 10;
+
+  void* socket_data = nullptr;
+  EXPECT_CALL(*curl_api_, MultiAssign(multi_handle_, kSocket, _))
+      .WillRepeatedly(DoAll(SaveArg<2>(&socket_data), Return(CURLM_OK)));
+  std::vector<int> actions;
+  EXPECT_CALL(*curl_api_, MultiSocketAction(multi_handle_, kSocket, _, _))
+      .WillRepeatedly(Invoke([&actions](CURLM* /* multi */,
+                                        curl_socket_t /* socket */,
+                                        int action,
+                                        int* /* running_handles */) {
+        actions.push_back(action);
+        return CURLM_OK;
+      }));
+  EXPECT_CALL(*curl_api_, MultiInfoRead(multi_handle_, _))
+      .WillRepeatedly(Return(nullptr));
+  auto socket_action = [this, handle, kSocket, &socket_data](int what) {
+    EXPECT_EQ(0, socket_callback_(handle, kSocket, what, transport_.get(),
+                                  socket_data));
+  };
+
+  // The watch keeps running while CURL waits for the same event.
+  socket_action(CURL_POLL_IN);
+  ASSERT_NE(nullptr, socket_data);
+  loop.SetFileDescriptorReadiness(kSocket, MessageLoop::kWatchRead, true);
+  EXPECT_TRUE(loop.RunOnce(false));
+  socket_action(CURL_POLL_IN);
+  EXPECT_TRUE(loop.RunOnce(false));
+  EXPECT_EQ((std::vector<int>{CURL_CSELECT_IN, CURL_CSELECT_IN}), actions);
+
+  // Only the write watch is left.
+  socket_action(CURL_POLL_OUT);
+  EXPECT_FALSE(loop.RunOnce(false));
+  loop.SetFileDescriptorReadiness(kSocket, MessageLoop::kWatchWrite, true);
+  EXPECT_TRUE(loop.RunOnce(false));
+  EXPECT_EQ(CURL_CSELECT_OUT, actions.back());
+
+  socket_action(CURL_POLL_REMOVE);
+  EXPECT_EQ(nullptr, socket_data);
+  EXPECT_FALSE(loop.PendingTasks());
+}
+
+TEST_F(HttpCurlTransportSchedulerTest, Timer) {
+  base::SimpleTestClock clock;
+  FakeMessageLoop loop{&clock};
+  loop.SetAsCurrent();
+  StartRequest("http://foo.bar/1");
+  int timeouts = 0;
+  EXPECT_CALL(*curl_api_,
+              MultiSocketAction(multi_handle_, CURL_SOCKET_TIMEOUT, 0, _))
+      .WillRepeatedly(Invoke([&timeouts](CURLM* /* multi */,
+                                         curl_socket_t /* socket */,
+                                         int /* action */,
+                                         int* /* running_handles */) {
+        timeouts++;
+        return CURLM_OK;
+      }));
+  EXPECT_CALL(*curl_api_, MultiInfoRead(multi_handle_, _))
+      .WillRepeatedly(Return(nullptr));
+
+  // Each new timeout replaces the pending timer, whether it is earlier or
+  // later.
+  base::Time start = clock.Now();
+  timer_callback_(multi_handle_, 100, transport_.get());
+  timer_callback_(multi_handle_, 50, transport_.get());
+  timer_callback_(multi_handle_, 200, transport_.get());
+  EXPECT_TRUE(loop.RunOnce(true));
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(200), clock.Now() - start);
+  EXPECT_EQ(1, timeouts);
+  EXPECT_FALSE(loop.RunOnce(true));
+
+  timer_callback_(multi_handle_, 10, transport_.get());
+  timer_callback_(multi_handle_, -1, transport_.get());
+  EXPECT_FALSE(loop.RunOnce(true));
+  EXPECT_EQ(1, timeouts);
+}
+
+namespace {
+
+// A minimal HTTP server on the loopback interface for the benchmark below. It
+// answers every request with a short fixed response, closes the connection
+// and stops after answering the given number of requests.
+class LoopbackHttpServer {
+ public:
+  LoopbackHttpServer() = default;
+  ~LoopbackHttpServer() {
+    if (thread_.joinable())
+      thread_.join();
+    if (listen_fd_ >= 0)
+      close(listen_fd_);
+  }
+
+  // Starts serving |request_count| requests on its own thread. Returns the
+  // port the server listens on, or 0 on failure.
+  uint16_t Start(int request_count) {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(addr);
+    sockaddr* addr_ptr = reinterpret_cast<sockaddr*>(&addr);
+    if (listen_fd_ < 0 || bind(listen_fd_, addr_ptr, size) != 0 ||
+        listen(listen_fd_, SOMAXCONN) != 0 ||
+        getsockname(listen_fd_, addr_ptr, &size) != 0) {
+      return 0;
+    }
+    thread_ = std::thread{&LoopbackHttpServer::Run, this, request_count};
+    return ntohs(addr.sin_port);
+  }
+
+ private:
+  void Run(int request_count) {
+    const char kResponse[] =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Length: 5\r\n"
+        "Connection: close\r\n"
+        "\r\n"
+        "hello";
+    // The listening socket comes first, followed by the client connections
+    // and the request data received from each of them.
+    std::vector<pollfd> fds{pollfd{listen_fd_, POLLIN, 0}};
+    std::vector<std::string> requests(1);
+    while (request_count > 0 && poll(fds.data(), fds.size(), 10000) > 0) {
+      for (size_t i = fds.size() - 1; i > 0; i--) {
+        if (!fds[i].revents)
+          continue;
+        char buffer[4096];
+        ssize_t size = read(fds[i].fd, buffer, sizeof(buffer));
+        if (size < 0 && errno == EAGAIN)
+          continue;
+        if (size > 0) {
+          requests[i].append(buffer, size);
+          if (requests[i].find("\r\n\r\n") == std::string::npos)
+            continue;
+          if (write(fds[i].fd, kResponse, sizeof(kResponse) - 1) > 0)
+            request_count--;
+        }
+        close(fds[i].fd);
+        fds.erase(fds.begin() + i);
+        requests.erase(requests.begin() + i);
+      }
+      if (fds[0].revents) {
+        int fd = -1;
+        while ((fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK)) >=
+               0) {
+          fds.push_back(pollfd{fd, POLLIN, 0});
+          requests.emplace_back();
+        }
+      }
+    }
+    for (size_t i = 1; i < fds.size(); i++)
+      close(fds[i].fd);
+  }
+
+  int listen_fd_{-1};
+  std::thread thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(LoopbackHttpServer);
+};
+
+}  // anonymous namespace
+
+// Runs 1000 concurrent GET requests through the real libcurl against a local
+// server to measure the overhead of the socket and timer handling on the
+// message loop. Run with --gtest_also_run_disabled_tests.
+TEST(HttpCurlTransportBenchmark, DISABLED_ConcurrentTransfers) {
+  const int kTransferCount = 1000;
+  // Both ends of every connection live in this process.
+  rlimit limit;
+  ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &limit));
+  limit.rlim_cur = limit.rlim_max;
+  ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &limit));
+  ASSERT_GE(limit.rlim_cur, static_cast<rlim_t>(2 * kTransferCount + 64));
+
+  base::MessageLoopForIO message_loop;
+  BaseMessageLoop brillo_loop{&message_loop};
+  brillo_loop.SetAsCurrent();
+
+  LoopbackHttpServer server;
+  uint16_t port = server.Start(kTransferCount);
+  ASSERT_NE(0, port);
+  std::string url = base::StringPrintf("http://127.0.0.1:%u/", port);
+  auto transport = std::make_shared<Transport>(std::make_shared<CurlApi>());
+
+  int succeeded = 0;
+  int failed = 0;
+  auto success_callback = [&succeeded](RequestID /* id */,
+                                       std::unique_ptr<Response> response) {
+    EXPECT_EQ(status_code::Ok, response->GetStatusCode());
+    succeeded++;
+  };
+  auto error_callback = [&failed](RequestID /* id */, const Error* error) {
+    ADD_FAILURE() << error->GetMessage();
+    failed++;
+  };
+  auto done = [&succeeded, &failed]() {
+    return succeeded + failed == kTransferCount;
+  };
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (int i = 0; i < kTransferCount; i++) {
+    http::Get(url, {}, transport, base::Bind(success_callback),
+              base::Bind(error_callback));
+  }
+  MessageLoopRunUntil(&brillo_loop, base::TimeDelta::FromSeconds(60),
+                      base::Bind(done));
+  base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+
+  EXPECT_EQ(kTransferCount, succeeded);
+  LOG(INFO) << kTransferCount << " concurrent transfers took "
+            << elapsed.InMilliseconds() << " ms";
+}
+
 }  // namespace curl
 }  // namespace http
 }  // namespace brillo
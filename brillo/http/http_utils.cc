@@ -4,16 +4,29 @@
 
 #include <brillo/http/http_utils.h>
 
+#include <inttypes.h>
+#include <stdio.h>
+
 #include <algorithm>
 
 #include <base/bind.h>
+#include <base/files/file_util.h>
+#include <base/files/important_file_writer.h>
 #include <base/json/json_reader.h>
 #include <base/json/json_writer.h>
+#include <base/logging.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/string_util.h>
 #include <base/values.h>
 #include <brillo/data_encoding.h>
 #include <brillo/errors/error_codes.h>
+#include <brillo/http/http_connection.h>
+#include <brillo/key_value_store.h>
 #include <brillo/mime_utils.h>
+#include <brillo/streams/file_stream.h>
+#include <brillo/streams/json_stream_parser.h>
 #include <brillo/streams/memory_stream.h>
+#include <brillo/streams/stream_utils.h>
 
 using brillo::mime::AppendParameter;
 using brillo::mime::RemoveParameters;
@@ -372,6 +385,330 @@ RequestID PatchJson(const std::string& url,
                      error_callback);
 }
 
+namespace {
+
+const char kCheckpointExtension[] = "checkpoint";
+
+// Keys of the download checkpoint file.
+const char kCheckpointUrlKey[] = "url";
+const char kCheckpointETagKey[] = "etag";
+const char kCheckpointLastModifiedKey[] = "last_modified";
+const char kCheckpointLengthKey[] = "length";
+const char kCheckpointOffsetKey[] = "offset";
+
+// How often the download progress is saved in the checkpoint file.
+const uint64_t kCheckpointInterval = 4 * 1024 * 1024;
+
+// The state of a resumable download, as stored in the checkpoint file.
+struct DownloadCheckpoint {
+  std::string url;
+  std::string etag;
+  std::string last_modified;
+  // The full size of the resource, or -1 if unknown.
+  int64_t length{-1};
+  // The number of bytes of the resource stored in the file.
+  uint64_t offset{0};
+
+  bool Load(const base::FilePath& path) {
+    KeyValueStore store;
+    std::string value;
+    if (!store.Load(path) || !store.GetString(kCheckpointUrlKey, &url) ||
+        !store.GetString(kCheckpointLengthKey, &value) ||
+        !base::StringToInt64(value, &length) ||
+        !store.GetString(kCheckpointOffsetKey, &value) ||
+        !base::StringToUint64(value, &offset)) {
+      return false;
+    }
+    store.GetString(kCheckpointETagKey, &etag);
+    store.GetString(kCheckpointLastModifiedKey, &last_modified);
+    return true;
+  }
+
+  bool Save(const base::FilePath& path) const {
+    KeyValueStore store;
+    store.SetString(kCheckpointUrlKey, url);
+    store.SetString(kCheckpointETagKey, etag);
+    store.SetString(kCheckpointLastModifiedKey, last_modified);
+    store.SetString(kCheckpointLengthKey, std::to_string(length));
+    store.SetString(kCheckpointOffsetKey, std::to_string(offset));
+    return base::ImportantFileWriter::WriteFileAtomically(
+        path, store.SaveToString());
+  }
+
+  // Returns the validator to send in "If-Range:". Weak entity tags can't be
+  // used with range requests.
+  std::string GetValidator() const {
+    if (!etag.empty() &&
+        !base::StartsWith(etag, "W/", base::CompareCase::SENSITIVE)) {
+      return etag;
+    }
+    return last_modified;
+  }
+};
+
+// Parses "Content-Range: bytes <first>-<last>/<length>". |length| is set to
+// -1 if the server doesn't know the full size ("*").
+bool ParseContentRange(const std::string& value,
+                       uint64_t* first,
+                       int64_t* length) {
+  uint64_t last = 0;
+  *length = -1;
+  int count = sscanf(value.c_str(), "bytes %" SCNu64 "-%" SCNu64 "/%" SCNd64,
+                     first, &last, length);
+  return count >= 2 && last >= *first;
+}
+
+// Performs the requests for DownloadFileAndBlock().
+class ResumableDownload final {
+ public:
+  ResumableDownload(const std::string& url,
+                    const base::FilePath& file_path,
+                    const HeaderList& headers,
+                    std::shared_ptr<Transport> transport)
+      : url_{url},
+        file_path_{file_path},
+        checkpoint_path_{GetDownloadCheckpointPath(file_path)},
+        headers_{headers},
+        transport_{transport} {}
+
+  bool Run(ErrorPtr* error) {
+    Result result = Attempt(true, error);
+    if (result == Result::kRestart) {
+      LOG(WARNING) << "Can't resume the download of " << url_
+                   << ", starting over";
+      result = Attempt(false, error);
+    }
+    if (result == Result::kRestart) {
+      Error::AddTo(error, FROM_HERE, kErrorDomain, "unexpected_range",
+                   "Server returned an unexpected range of " + url_);
+    }
+    return result == Result::kSuccess;
+  }
+
+  // Stores a chunk of the response body in the file.
+  bool OnData(const void* buffer, size_t size, ErrorPtr* error) {
+    if (!OnResponseStarted(error))
+      return false;
+    // Drop the error pages and the ranges we can't use.
+    if (!store_data_)
+      return true;
+    if (!file_->WriteAllBlocking(buffer, size, error))
+      return false;
+    checkpoint_.offset += size;
+    if (checkpoint_.offset - saved_offset_ >= kCheckpointInterval)
+      return SaveCheckpoint(error);
+    return true;
+  }
+
+ private:
+  enum class Result { kSuccess, kFailure, kRestart };
+
+  // Requests the resource (or the rest of it, if |resume| is true and there
+  // is a usable checkpoint) and stores it in the file.
+  Result Attempt(bool resume, ErrorPtr* error) {
+    uint64_t offset = 0;
+    int64_t file_size = 0;
+    if (resume && checkpoint_.Load(checkpoint_path_) &&
+        checkpoint_.url == url_ && !checkpoint_.GetValidator().empty() &&
+        base::GetFileSize(file_path_, &file_size)) {
+      // Data past the recorded offset might not have been written completely.
+      offset = std::min<uint64_t>(file_size, checkpoint_.offset);
+    }
+    if (offset == 0) {
+      checkpoint_ = DownloadCheckpoint{};
+      checkpoint_.url = url_;
+    }
+    checkpoint_.offset = offset;
+    saved_offset_ = offset;
+
+    file_ = FileStream::Open(file_path_, Stream::AccessMode::WRITE,
+                             offset ? FileStream::Disposition::OPEN_EXISTING
+                                    : FileStream::Disposition::CREATE_ALWAYS,
+                             error);
+    if (!file_ || !file_->SetSizeBlocking(offset, error) ||
+        !file_->SetPosition(offset, error)) {
+      return Result::kFailure;
+    }
+
+    HeaderList request_headers = headers_;
+    if (offset > 0) {
+      VLOG(1) << "Resuming the download of " << url_ << " from byte "
+              << offset;
+      request_headers.emplace_back(request_header::kRange,
+                                   "bytes=" + std::to_string(offset) + "-");
+      request_headers.emplace_back(request_header::kIfRange,
+                                   checkpoint_.GetValidator());
+    }
+    response_started_ = false;
+    store_data_ = false;
+    restart_ = false;
+    connection_ = transport_->CreateConnection(
+        url_, request_type::kGet, request_headers, {}, {}, error);
+    if (!connection_)
+      return Result::kFailure;
+    connection_->SetResponseData(stream_utils::CreateWriteCallbackStream(
+        base::Bind(&ResumableDownload::OnData, base::Unretained(this))));
+    bool finished = connection_->FinishRequest(error);
+    if (finished && !CopyBufferedData(error))
+      finished = false;
+    int code = connection_->GetResponseStatusCode();
+    std::string status_text = connection_->GetResponseStatusText();
+    connection_.reset();
+    if (!finished || !file_->CloseBlocking(error)) {
+      // Keep what we've got for the next attempt.
+      if (store_data_)
+        checkpoint_.Save(checkpoint_path_);
+      return Result::kFailure;
+    }
+
+    if (restart_ || (code == status_code::RangeNotSatisfiable && offset > 0))
+      return Result::kRestart;
+    if (code != status_code::Ok && code != status_code::PartialContent) {
+      Error::AddToPrintf(error, FROM_HERE, kErrorDomain, "unexpected_status",
+                         "Unexpected HTTP status %d (%s) downloading %s",
+                         code, status_text.c_str(), url_.c_str());
+      return Result::kFailure;
+    }
+    if (checkpoint_.length >= 0 &&
+        checkpoint_.offset != static_cast<uint64_t>(checkpoint_.length)) {
+      Error::AddToPrintf(error, FROM_HERE, kErrorDomain, "partial_data",
+                         "Received %" PRIu64 " of %" PRId64 " bytes of %s",
+                         checkpoint_.offset, checkpoint_.length,
+                         url_.c_str());
+      checkpoint_.Save(checkpoint_path_);
+      return Result::kFailure;
+    }
+    base::DeleteFile(checkpoint_path_, false);
+    return Result::kSuccess;
+  }
+
+  // Examines the response status and headers before the first chunk of the
+  // response body is stored and decides what to do with the data.
+  bool OnResponseStarted(ErrorPtr* error) {
+    if (response_started_)
+      return true;
+    response_started_ = true;
+    int code = connection_->GetResponseStatusCode();
+    if (code == status_code::PartialContent) {
+      uint64_t first = 0;
+      int64_t length = -1;
+      if (checkpoint_.offset == 0 ||
+          !ParseContentRange(
+              connection_->GetResponseHeader(response_header::kContentRange),
+              &first, &length) ||
+          first != checkpoint_.offset ||
+          (checkpoint_.length >= 0 && length != checkpoint_.length)) {
+        restart_ = true;
+        return true;
+      }
+      store_data_ = true;
+      return true;
+    }
+    if (code != status_code::Ok)
+      return true;
+
+    if (checkpoint_.offset > 0) {
+      // The server sent the whole resource instead of the requested range,
+      // either because it has changed or because ranges are not supported.
+      VLOG(1) << "Server ignored the range, downloading " << url_
+              << " from the beginning";
+      if (!file_->SetSizeBlocking(0, error) || !file_->SetPosition(0, error))
+        return false;
+    }
+    checkpoint_ = DownloadCheckpoint{};
+    checkpoint_.url = url_;
+    checkpoint_.etag = connection_->GetResponseHeader(response_header::kETag);
+    checkpoint_.last_modified =
+        connection_->GetResponseHeader(response_header::kLastModified);
+    if (!base::StringToInt64(
+            connection_->GetResponseHeader(response_header::kContentLength),
+            &checkpoint_.length)) {
+      checkpoint_.length = -1;
+    }
+    store_data_ = true;
+    return SaveCheckpoint(error);
+  }
+
+  // Transports that don't support custom response streams (e.g. the fake one)
+  // return the response data in a stream of their own. Copy it into the file.
+  bool CopyBufferedData(ErrorPtr* error) {
+    if (!OnResponseStarted(error))
+      return false;
+    StreamPtr data = connection_->ExtractDataStream(nullptr);
+    if (!data || !data->CanRead())
+      return true;
+    std::vector<uint8_t> buffer(64 * 1024);
+    size_t size_read = 0;
+    do {
+      if (!data->ReadBlocking(buffer.data(), buffer.size(), &size_read,
+                              error) ||
+          !OnData(buffer.data(), size_read, error)) {
+        return false;
+      }
+    } while (size_read > 0);
+    return true;
+  }
+
+  bool SaveCheckpoint(ErrorPtr* error) {
+    saved_offset_ = checkpoint_.offset;
+    if (checkpoint_.Save(checkpoint_path_))
+      return true;
+    Error::AddTo(error, FROM_HERE, kErrorDomain, "checkpoint_failed",
+                 "Failed to write " + checkpoint_path_.value());
+    return false;
+  }
+
+  std::string url_;
+  base::FilePath file_path_;
+  base::FilePath checkpoint_path_;
+  HeaderList headers_;
+  std::shared_ptr<Transport> transport_;
+
+  std::shared_ptr<Connection> connection_;
+  StreamPtr file_;
+  DownloadCheckpoint checkpoint_;
+  // The value of |checkpoint_.offset| last written to the checkpoint file.
+  uint64_t saved_offset_{0};
+  bool response_started_{false};
+  bool store_data_{false};
+  bool restart_{false};
+
+  DISALLOW_COPY_AND_ASSIGN(ResumableDownload);
+};
+
+}  // anonymous namespace
+
+bool DownloadFileAndBlock(const std::string& url,
+                          const base::FilePath& file_path,
+                          const HeaderList& headers,
+                          std::shared_ptr<Transport> transport,
+                          brillo::ErrorPtr* error) {
+  ResumableDownload download{url, file_path, headers, transport};
+  return download.Run(error);
+}
+
+base::FilePath GetDownloadCheckpointPath(const base::FilePath& file_path) {
+  return file_path.AddExtension(kCheckpointExtension);
+}
+
+namespace {
+
+// Makes sure the response has a correct content type. Do not try to parse
+// binary files, or HTML output. Limit to application/json and text/plain.
+bool CheckJsonContentType(Response* response, brillo::ErrorPtr* error) {
+  auto content_type = RemoveParameters(response->GetContentType());
+  if (content_type != brillo::mime::application::kJson &&
+      content_type != brillo::mime::text::kPlain) {
+    brillo::Error::AddTo(error, FROM_HERE, brillo::errors::json::kDomain,
+                         "non_json_content_type",
+                         "Unexpected response content type: " + content_type);
+    return false;
+  }
+  return true;
+}
+
+}  // anonymous namespace
+
 std::unique_ptr<base::DictionaryValue> ParseJsonResponse(
     Response* response,
     int* status_code,
@@ -383,16 +720,8 @@ std::unique_ptr<base::DictionaryValue> ParseJsonResponse(
   if (status_code)
     *status_code = response->GetStatusCode();
 
-  // Make sure we have a correct content type. Do not try to parse
-  // binary files, or HTML output. Limit to application/json and text/plain.
-  auto content_type = RemoveParameters(response->GetContentType());
-  if (content_type != brillo::mime::application::kJson &&
-      content_type != brillo::mime::text::kPlain) {
-    brillo::Error::AddTo(error, FROM_HERE, brillo::errors::json::kDomain,
-                         "non_json_content_type",
-                         "Unexpected response content type: " + content_type);
+  if (!CheckJsonContentType(response, error))
     return result;
-  }
 
   std::string json = response->ExtractDataAsString();
   std::string error_message;
@@ -415,6 +744,26 @@ std::unique_ptr<base::DictionaryValue> ParseJsonResponse(
   return result;
 }
 
+bool ParseJsonResponse(Response* response,
+                       int* status_code,
+                       JsonHandler* handler,
+                       brillo::ErrorPtr* error) {
+  if (!response)
+    return false;
+
+  if (status_code)
+    *status_code = response->GetStatusCode();
+
+  if (!CheckJsonContentType(response, error))
+    return false;
+
+  StreamPtr stream = response->ExtractDataStream(error);
+  if (!stream)
+    return false;
+  JsonStreamParser parser{handler};
+  return parser.ParseBlocking(stream.get(), error);
+}
+
 std::string GetCanonicalHeaderName(const std::string& name) {
   std::string canonical_name = name;
   bool word_begin = true;
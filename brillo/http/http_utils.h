@@ -9,10 +9,12 @@
 #include <utility>
 #include <vector>
 
+#include <base/files/file_path.h>
 #include <brillo/brillo_export.h>
 #include <brillo/errors/error.h>
 #include <brillo/http/http_form_data.h>
 #include <brillo/http/http_request.h>
+#include <brillo/streams/json_binding.h>
 
 namespace base {
 class Value;
@@ -300,6 +302,28 @@ BRILLO_EXPORT RequestID PatchJson(
     const SuccessCallback& success_callback,
     const ErrorCallback& error_callback);
 
+// Downloads |url| into |file_path| using a GET request. The download can be
+// resumed if interrupted: the progress and the validators of the resource
+// ("ETag:"/"Last-Modified:" and the length) are recorded in a checkpoint file
+// next to |file_path| (see GetDownloadCheckpointPath()) while the data is
+// received. If a checkpoint for the same URL exists when the function is
+// called, the partial file is appended to using a "Range:" request with
+// "If-Range:", so the server sends the rest of the data only if the resource
+// hasn't changed. If the server ignores the range or the returned range
+// doesn't match the partial file, the download starts over from the
+// beginning. Returns true once the whole resource has been written to
+// |file_path|, after which the checkpoint file is removed.
+BRILLO_EXPORT bool DownloadFileAndBlock(const std::string& url,
+                                        const base::FilePath& file_path,
+                                        const HeaderList& headers,
+                                        std::shared_ptr<Transport> transport,
+                                        brillo::ErrorPtr* error);
+
+// Returns the path to the checkpoint file used by DownloadFileAndBlock() for
+// the download target |file_path|.
+BRILLO_EXPORT base::FilePath GetDownloadCheckpointPath(
+    const base::FilePath& file_path);
+
 // Given an http::Response object, parse the body data into Json object.
 // Returns null if failed. Optional |error| can be passed in to
 // get the extended error information as to why the parse failed.
@@ -308,6 +332,26 @@ BRILLO_EXPORT std::unique_ptr<base::DictionaryValue> ParseJsonResponse(
     int* status_code,
     brillo::ErrorPtr* error);
 
+// Parses the body of |response| incrementally as it is read from the data
+// stream, reporting the values to |handler| (see JsonStreamParser), so large
+// documents are never buffered or converted to base::Value as a whole.
+// Returns false if the content type is not JSON or the parsing fails.
+BRILLO_EXPORT bool ParseJsonResponse(Response* response,
+                                     int* status_code,
+                                     JsonHandler* handler,
+                                     brillo::ErrorPtr* error);
+
+// Parses the body of |response| straight into |value| using |binding|.
+template <typename T>
+bool ParseJsonResponse(Response* response,
+                       int* status_code,
+                       const JsonObjectBinding<T>& binding,
+                       T* value,
+                       brillo::ErrorPtr* error) {
+  JsonBinder binder{binding, value};
+  return ParseJsonResponse(response, status_code, &binder, error);
+}
+
 // Converts a request header name to canonical form (lowercase with uppercase
 // first letter and each letter after a hyphen ('-')).
 // "content-TYPE" will be converted to "Content-Type".
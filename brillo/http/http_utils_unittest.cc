@@ -2,10 +2,15 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <string.h>
+
+#include <algorithm>
 #include <numeric>
 #include <string>
 #include <vector>
 
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
 #include <base/values.h>
 #include <brillo/bind_lambda.h>
 #include <brillo/http/http_transport_fake.h>
@@ -446,6 +451,42 @@ TEST(HttpUtils, ParseJsonResponse) {
   EXPECT_EQ(status_code::NotFound, code);
 }
 
+namespace {
+struct JsonReply {
+  std::string data;
+  std::string ignored;
+};
+}  // anonymous namespace
+
+TEST(HttpUtils, ParseJsonResponse_Binding) {
+  auto JsonHandler =
+      [](const fake::ServerRequest& request, fake::ServerResponse* response) {
+    response->ReplyJson(status_code::Ok, {{"data", "value"}, {"extra", "x"}});
+  };
+  std::shared_ptr<fake::Transport> transport(new fake::Transport);
+  transport->AddHandler(kFakeUrl, request_type::kGet, base::Bind(JsonHandler));
+
+  JsonObjectBinding<JsonReply> binding;
+  binding.AddField("data", &JsonReply::data);
+
+  auto response = http::GetAndBlock(kFakeUrl, {}, transport, nullptr);
+  int code = 0;
+  JsonReply reply;
+  EXPECT_TRUE(
+      http::ParseJsonResponse(response.get(), &code, binding, &reply, nullptr));
+  EXPECT_EQ(status_code::Ok, code);
+  EXPECT_EQ("value", reply.data);
+  EXPECT_TRUE(reply.ignored.empty());
+
+  // Non-JSON response.
+  response = http::GetAndBlock("http://bad.url", {}, transport, nullptr);
+  ErrorPtr error;
+  EXPECT_FALSE(
+      http::ParseJsonResponse(response.get(), &code, binding, &reply, &error));
+  EXPECT_EQ(status_code::NotFound, code);
+  EXPECT_EQ("non_json_content_type", error->GetCode());
+}
+
 TEST(HttpUtils, SendRequest_Failure) {
   std::shared_ptr<fake::Transport> transport(new fake::Transport);
   transport->AddHandler(kMethodEchoUrl, "*", base::Bind(EchoMethodHandler));
@@ -485,6 +526,147 @@ TEST(HttpUtils, SendRequestAsync_Failure) {
                               base::Bind(error_callback));
 }
 
+// Serves |data| with the "ETag:" |etag| and handles "Range:"/"If-Range:" like
+// a real server would. Only the first |max_bytes| bytes of each response body
+// are sent, to simulate interrupted transfers.
+struct DownloadServer {
+  std::string data;
+  std::string etag;
+  size_t max_bytes{std::string::npos};
+  std::vector<std::string> ranges;
+  // Whether to return a wrong "Content-Range:".
+  bool bad_range{false};
+
+  void HandleRequest(const fake::ServerRequest& request,
+                     fake::ServerResponse* response) {
+    std::string range = request.GetHeader(request_header::kRange);
+    ranges.push_back(range);
+    size_t offset = 0;
+    if (!range.empty() &&
+        request.GetHeader(request_header::kIfRange) == etag) {
+      offset = std::stoul(range.substr(strlen("bytes=")));
+    }
+    std::string body = data.substr(offset).substr(0, max_bytes);
+    if (offset > 0) {
+      response->ReplyText(status_code::PartialContent, body,
+                          brillo::mime::application::kOctet_stream);
+      size_t first = bad_range ? offset + 1 : offset;
+      response->AddHeaders(
+          {{response_header::kContentRange,
+            "bytes " + std::to_string(first) + "-" +
+                std::to_string(data.size() - 1) + "/" +
+                std::to_string(data.size())}});
+    } else {
+      response->ReplyText(status_code::Ok, body,
+                          brillo::mime::application::kOctet_stream);
+    }
+    // Advertise the full length even if the body is cut short.
+    std::string length = std::to_string(data.size() - offset);
+    response->AddHeaders({{response_header::kContentLength, ""}});
+    response->AddHeaders({{response_header::kContentLength, length},
+                          {response_header::kETag, etag}});
+  }
+};
+
+class HttpUtilsDownloadTest : public testing::Test {
+ public:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    file_path_ = temp_dir_.GetPath().Append("file.bin");
+    for (int i = 0; i < 1000; i++)
+      server_.data.push_back(static_cast<char>('a' + i % 26));
+    server_.etag = "\"v1\"";
+    transport_->AddHandler(kFakeUrl, request_type::kGet,
+                           base::Bind(&DownloadServer::HandleRequest,
+                                      base::Unretained(&server_)));
+  }
+
+  std::string ReadFile() const {
+    std::string contents;
+    EXPECT_TRUE(base::ReadFileToString(file_path_, &contents));
+    return contents;
+  }
+
+  bool CheckpointExists() const {
+    return base::PathExists(GetDownloadCheckpointPath(file_path_));
+  }
+
+ protected:
+  base::ScopedTempDir temp_dir_;
+  base::FilePath file_path_;
+  DownloadServer server_;
+  std::shared_ptr<fake::Transport> transport_{new fake::Transport};
+};
+
+TEST_F(HttpUtilsDownloadTest, Download) {
+  EXPECT_TRUE(
+      DownloadFileAndBlock(kFakeUrl, file_path_, {}, transport_, nullptr));
+  EXPECT_EQ(server_.data, ReadFile());
+  EXPECT_FALSE(CheckpointExists());
+  EXPECT_EQ(std::vector<std::string>{""}, server_.ranges);
+}
+
+TEST_F(HttpUtilsDownloadTest, Resume) {
+  server_.max_bytes = 300;
+  ErrorPtr error;
+  EXPECT_FALSE(
+      DownloadFileAndBlock(kFakeUrl, file_path_, {}, transport_, &error));
+  EXPECT_EQ("partial_data", error->GetCode());
+  EXPECT_TRUE(CheckpointExists());
+  EXPECT_EQ(server_.data.substr(0, 300), ReadFile());
+
+  server_.max_bytes = std::string::npos;
+  EXPECT_TRUE(
+      DownloadFileAndBlock(kFakeUrl, file_path_, {}, transport_, nullptr));
+  EXPECT_EQ(server_.data, ReadFile());
+  EXPECT_FALSE(CheckpointExists());
+  EXPECT_EQ((std::vector<std::string>{"", "bytes=300-"}), server_.ranges);
+}
+
+TEST_F(HttpUtilsDownloadTest, ResumeChangedResource) {
+  server_.max_bytes = 300;
+  EXPECT_FALSE(
+      DownloadFileAndBlock(kFakeUrl, file_path_, {}, transport_, nullptr));
+
+  // "If-Range:" doesn't match, so the server sends the whole thing.
+  server_.max_bytes = std::string::npos;
+  server_.etag = "\"v2\"";
+  std::reverse(server_.data.begin(), server_.data.end());
+  EXPECT_TRUE(
+      DownloadFileAndBlock(kFakeUrl, file_path_, {}, transport_, nullptr));
+  EXPECT_EQ(server_.data, ReadFile());
+  EXPECT_EQ(2, transport_->GetRequestCount());
+}
+
+TEST_F(HttpUtilsDownloadTest, ResumeWrongRange) {
+  server_.max_bytes = 300;
+  EXPECT_FALSE(
+      DownloadFileAndBlock(kFakeUrl, file_path_, {}, transport_, nullptr));
+
+  // The returned range doesn't match the partial file. Start over.
+  server_.max_bytes = std::string::npos;
+  server_.bad_range = true;
+  EXPECT_TRUE(
+      DownloadFileAndBlock(kFakeUrl, file_path_, {}, transport_, nullptr));
+  EXPECT_EQ(server_.data, ReadFile());
+  EXPECT_EQ((std::vector<std::string>{"", "bytes=300-", ""}), server_.ranges);
+}
+
+TEST_F(HttpUtilsDownloadTest, DifferentUrlNotResumed) {
+  server_.max_bytes = 300;
+  EXPECT_FALSE(
+      DownloadFileAndBlock(kFakeUrl, file_path_, {}, transport_, nullptr));
+
+  server_.max_bytes = std::string::npos;
+  transport_->AddHandler(kEchoUrl, request_type::kGet,
+                         base::Bind(&DownloadServer::HandleRequest,
+                                    base::Unretained(&server_)));
+  EXPECT_TRUE(
+      DownloadFileAndBlock(kEchoUrl, file_path_, {}, transport_, nullptr));
+  EXPECT_EQ(server_.data, ReadFile());
+  EXPECT_EQ((std::vector<std::string>{"", ""}), server_.ranges);
+}
+
 TEST(HttpUtils, GetCanonicalHeaderName) {
   EXPECT_EQ("Foo", GetCanonicalHeaderName("foo"));
   EXPECT_EQ("Bar", GetCanonicalHeaderName("BaR"));
@@ -32,6 +32,7 @@ class MockTransport : public Transport {
                                              const SuccessCallback&,
                                              const ErrorCallback&));
   MOCK_METHOD1(CancelRequest, bool(RequestID));
+  MOCK_METHOD2(SetRequestPriority, bool(RequestID, RequestPriority));
   MOCK_METHOD1(SetDefaultTimeout, void(base::TimeDelta));
 
  private:
@@ -0,0 +1,177 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/shared_blob.h>
+
+#include <fcntl.h>
+#include <linux/memfd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <utility>
+
+#include <base/logging.h>
+#include <base/macros.h>
+#include <base/posix/eintr_wrapper.h>
+#include <google/protobuf/message_lite.h>
+
+// The sealing API was added in Linux 3.17, older C libraries don't define it.
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_GET_SEALS 1034
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#define F_SEAL_WRITE 0x0008
+#endif
+
+namespace brillo {
+
+namespace {
+
+const char kMemfdName[] = "brillo_shared_blob";
+
+// The seals a memfd must have for its contents to be immutable.
+const int kRequiredSeals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE;
+
+}  // anonymous namespace
+
+const size_t SharedBlob::kMinRecommendedSize = 64 * 1024;
+
+struct SharedBlob::Mapping {
+  Mapping(base::ScopedFD fd, const void* data, size_t size)
+      : fd{std::move(fd)}, data{static_cast<const uint8_t*>(data)},
+        size{size} {}
+  ~Mapping() {
+    if (data)
+      munmap(const_cast<uint8_t*>(data), size);
+  }
+
+  base::ScopedFD fd;
+  const uint8_t* data;
+  size_t size;
+
+  DISALLOW_COPY_AND_ASSIGN(Mapping);
+};
+
+SharedBlob::SharedBlob() = default;
+
+bool SharedBlob::Create(const void* data, size_t size, SharedBlob* blob) {
+  void* buffer = nullptr;
+  base::ScopedFD fd = Allocate(size, &buffer);
+  if (!fd.is_valid())
+    return false;
+  if (size)
+    memcpy(buffer, data, size);
+  return Seal(std::move(fd), buffer, size, blob);
+}
+
+bool SharedBlob::CreateFromString(const std::string& data, SharedBlob* blob) {
+  return Create(data.data(), data.size(), blob);
+}
+
+bool SharedBlob::CreateFromProto(const google::protobuf::MessageLite& proto,
+                                 SharedBlob* blob) {
+  size_t size = proto.ByteSize();
+  void* buffer = nullptr;
+  base::ScopedFD fd = Allocate(size, &buffer);
+  if (!fd.is_valid())
+    return false;
+  if (size)
+    proto.SerializeWithCachedSizesToArray(static_cast<uint8_t*>(buffer));
+  return Seal(std::move(fd), buffer, size, blob);
+}
+
+bool SharedBlob::CreateFromFileDescriptor(base::ScopedFD fd,
+                                          SharedBlob* blob) {
+  int seals = HANDLE_EINTR(fcntl(fd.get(), F_GET_SEALS));
+  if (seals < 0) {
+    PLOG(ERROR) << "Failed to get the seals of the shared blob";
+    return false;
+  }
+  if ((seals & kRequiredSeals) != kRequiredSeals) {
+    LOG(ERROR) << "Shared blob is not sealed against modification";
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd.get(), &info) < 0) {
+    PLOG(ERROR) << "Failed to get the size of the shared blob";
+    return false;
+  }
+  size_t size = info.st_size;
+  void* data = nullptr;
+  if (size) {
+    data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd.get(), 0);
+    if (data == MAP_FAILED) {
+      PLOG(ERROR) << "Failed to map the shared blob";
+      return false;
+    }
+  }
+  blob->mapping_ = std::make_shared<Mapping>(std::move(fd), data, size);
+  return true;
+}
+
+bool SharedBlob::ParseProto(google::protobuf::MessageLite* proto) const {
+  return proto->ParseFromArray(data(), size());
+}
+
+const uint8_t* SharedBlob::data() const {
+  return mapping_ ? mapping_->data : nullptr;
+}
+
+size_t SharedBlob::size() const {
+  return mapping_ ? mapping_->size : 0;
+}
+
+int SharedBlob::fd() const {
+  return mapping_ ? mapping_->fd.get() : -1;
+}
+
+std::string SharedBlob::ToString() const {
+  return std::string(reinterpret_cast<const char*>(data()), size());
+}
+
+base::ScopedFD SharedBlob::Allocate(size_t size, void** buffer) {
+  base::ScopedFD fd{static_cast<int>(syscall(
+      __NR_memfd_create, kMemfdName, MFD_CLOEXEC | MFD_ALLOW_SEALING))};
+  if (!fd.is_valid()) {
+    PLOG(ERROR) << "Failed to create a memfd";
+    return base::ScopedFD{};
+  }
+  if (HANDLE_EINTR(ftruncate(fd.get(), size)) < 0) {
+    PLOG(ERROR) << "Failed to resize the memfd to " << size << " bytes";
+    return base::ScopedFD{};
+  }
+  *buffer = nullptr;
+  if (size) {
+    void* data =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+    if (data == MAP_FAILED) {
+      PLOG(ERROR) << "Failed to map the memfd";
+      return base::ScopedFD{};
+    }
+    *buffer = data;
+  }
+  return fd;
+}
+
+bool SharedBlob::Seal(base::ScopedFD fd,
+                      void* buffer,
+                      size_t size,
+                      SharedBlob* blob) {
+  // F_SEAL_WRITE fails while there are writable shared mappings.
+  if (buffer)
+    munmap(buffer, size);
+  if (HANDLE_EINTR(fcntl(fd.get(), F_ADD_SEALS,
+                         kRequiredSeals | F_SEAL_SEAL)) < 0) {
+    PLOG(ERROR) << "Failed to seal the memfd";
+    return false;
+  }
+  return CreateFromFileDescriptor(std::move(fd), blob);
+}
+
+}  // namespace brillo
@@ -0,0 +1,83 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_SHARED_BLOB_H_
+#define LIBBRILLO_BRILLO_SHARED_BLOB_H_
+
+#include <memory>
+#include <string>
+
+#include <base/files/scoped_file.h>
+#include <brillo/brillo_export.h>
+
+namespace google {
+namespace protobuf {
+class MessageLite;
+}  // namespace protobuf
+}  // namespace google
+
+namespace brillo {
+
+// SharedBlob is an immutable chunk of memory backed by a sealed memfd, used to
+// pass large payloads (crash reports, policy data, firmware images...) between
+// processes without copying them around. Over D-Bus, a SharedBlob is sent as
+// a file descriptor (signature "h") which the receiver maps read-only, rather
+// than as an array of bytes copied into the message by libdbus and once more
+// by the bus daemon.
+//
+// The memfd is sealed against writing and resizing before it is shared, and a
+// received descriptor without these seals is rejected, so the receiver can
+// rely on the data not changing under it.
+//
+// Copies of a SharedBlob share the same descriptor and mapping.
+class BRILLO_EXPORT SharedBlob {
+ public:
+  // The payload size above which a SharedBlob is cheaper than an array of
+  // bytes. Creating and mapping the memfd has a fixed cost of a few syscalls.
+  static const size_t kMinRecommendedSize;
+
+  // Creates an empty blob, without a file descriptor.
+  SharedBlob();
+
+  // Creates a blob holding a copy of |size| bytes at |data|. Returns false
+  // if the memfd could not be created.
+  static bool Create(const void* data, size_t size, SharedBlob* blob);
+  static bool CreateFromString(const std::string& data, SharedBlob* blob);
+  // Creates a blob holding the serialized |proto|. The message is serialized
+  // directly into the shared memory.
+  static bool CreateFromProto(const google::protobuf::MessageLite& proto,
+                              SharedBlob* blob);
+  // Creates a blob from a memfd received from another process. Fails if the
+  // memfd is not sealed against writing and resizing.
+  static bool CreateFromFileDescriptor(base::ScopedFD fd, SharedBlob* blob);
+
+  // Parses the blob data into |proto|.
+  bool ParseProto(google::protobuf::MessageLite* proto) const;
+
+  const uint8_t* data() const;
+  size_t size() const;
+  bool empty() const { return size() == 0; }
+  // Returns the memfd, or -1 for a blob created by the default constructor.
+  int fd() const;
+
+  std::string ToString() const;
+
+ private:
+  struct Mapping;
+
+  // Creates a memfd of |size| bytes and maps it writable at |*buffer|.
+  static base::ScopedFD Allocate(size_t size, void** buffer);
+  // Unmaps |buffer| returned by Allocate(), seals |fd| and maps it
+  // read-only into |blob|.
+  static bool Seal(base::ScopedFD fd,
+                   void* buffer,
+                   size_t size,
+                   SharedBlob* blob);
+
+  std::shared_ptr<const Mapping> mapping_;
+};
+
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_SHARED_BLOB_H_
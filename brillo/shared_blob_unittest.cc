@@ -0,0 +1,90 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/shared_blob.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "brillo/dbus/test.pb.h"
+
+namespace brillo {
+
+TEST(SharedBlob, Empty) {
+  SharedBlob blob;
+  EXPECT_EQ(-1, blob.fd());
+  EXPECT_TRUE(blob.empty());
+  EXPECT_EQ(nullptr, blob.data());
+  EXPECT_EQ("", blob.ToString());
+
+  EXPECT_TRUE(SharedBlob::Create(nullptr, 0, &blob));
+  EXPECT_LE(0, blob.fd());
+  EXPECT_TRUE(blob.empty());
+}
+
+TEST(SharedBlob, CreateFromString) {
+  std::string data(1024 * 1024, 'a');
+  data[12345] = 'b';
+  SharedBlob blob;
+  ASSERT_TRUE(SharedBlob::CreateFromString(data, &blob));
+  EXPECT_EQ(data.size(), blob.size());
+  EXPECT_EQ(data, blob.ToString());
+
+  // Copies share the mapping.
+  SharedBlob copy = blob;
+  EXPECT_EQ(blob.fd(), copy.fd());
+  EXPECT_EQ(blob.data(), copy.data());
+}
+
+TEST(SharedBlob, Immutable) {
+  SharedBlob blob;
+  ASSERT_TRUE(SharedBlob::CreateFromString("data", &blob));
+  EXPECT_GT(0, write(blob.fd(), "x", 1));
+  EXPECT_GT(0, ftruncate(blob.fd(), 0));
+  EXPECT_EQ(MAP_FAILED, mmap(nullptr, blob.size(), PROT_READ | PROT_WRITE,
+                             MAP_SHARED, blob.fd(), 0));
+  EXPECT_EQ("data", blob.ToString());
+}
+
+TEST(SharedBlob, CreateFromFileDescriptor) {
+  SharedBlob blob;
+  ASSERT_TRUE(SharedBlob::CreateFromString("data", &blob));
+  SharedBlob received;
+  EXPECT_TRUE(SharedBlob::CreateFromFileDescriptor(
+      base::ScopedFD{dup(blob.fd())}, &received));
+  EXPECT_EQ("data", received.ToString());
+  EXPECT_NE(blob.data(), received.data());
+}
+
+TEST(SharedBlob, RejectsUnsealed) {
+  char path[] = "/tmp/shared_blob_XXXXXX";
+  base::ScopedFD fd{mkstemp(path)};
+  ASSERT_TRUE(fd.is_valid());
+  unlink(path);
+  ASSERT_EQ(4, write(fd.get(), "data", 4));
+  SharedBlob blob;
+  EXPECT_FALSE(SharedBlob::CreateFromFileDescriptor(std::move(fd), &blob));
+  EXPECT_EQ(-1, blob.fd());
+}
+
+TEST(SharedBlob, Proto) {
+  dbus_utils_test::TestMessage message;
+  message.set_foo(123);
+  message.set_bar(std::string(100000, 'x'));
+  SharedBlob blob;
+  ASSERT_TRUE(SharedBlob::CreateFromProto(message, &blob));
+  EXPECT_EQ(message.SerializeAsString(), blob.ToString());
+
+  dbus_utils_test::TestMessage message_out;
+  EXPECT_TRUE(blob.ParseProto(&message_out));
+  EXPECT_EQ(123, message_out.foo());
+  EXPECT_EQ(message.bar(), message_out.bar());
+}
+
+}  // namespace brillo
@@ -14,6 +14,7 @@
 #include <base/posix/eintr_wrapper.h>
 #include <brillo/errors/error_codes.h>
 #include <brillo/message_loops/message_loop.h>
+#include <brillo/pointer_utils.h>
 #include <brillo/streams/stream_errors.h>
 #include <brillo/streams/stream_utils.h>
 
@@ -46,6 +47,10 @@ class FileDescriptor : public FileStream::FileDescriptorInterface {
     return HANDLE_EINTR(write(fd_, buf, nbyte));
   }
 
+  ssize_t WriteAt(const void* buf, size_t nbyte, off64_t offset) override {
+    return HANDLE_EINTR(pwrite64(fd_, buf, nbyte, offset));
+  }
+
   off64_t Seek(off64_t offset, int whence) override {
     return lseek64(fd_, offset, whence);
   }
@@ -490,6 +495,38 @@ bool FileStream::WriteNonBlocking(const void* buffer,
   return true;
 }
 
+bool FileStream::WriteAtBlocking(uint64_t offset,
+                                 const void* buffer,
+                                 size_t size_to_write,
+                                 ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  if (!CanSeek() || !CanWrite())
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+  if (!stream_utils::CheckInt64Overflow(FROM_HERE, offset, size_to_write,
+                                        error)) {
+    return false;
+  }
+
+  while (size_to_write > 0) {
+    ssize_t written = fd_interface_->WriteAt(buffer, size_to_write, offset);
+    if (written < 0) {
+      errors::system::AddSystemError(error, FROM_HERE, errno);
+      return false;
+    }
+    if (written == 0) {
+      Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                   errors::stream::kPartialData,
+                   "Failed to write all the data");
+      return false;
+    }
+    size_to_write -= written;
+    offset += written;
+    buffer = AdvancePointer(buffer, written);
+  }
+  return true;
+}
+
 bool FileStream::FlushBlocking(ErrorPtr* error) {
   if (!IsOpen())
     return stream_utils::ErrorStreamClosed(FROM_HERE, error);
@@ -40,6 +40,7 @@ class BRILLO_EXPORT FileStream : public Stream {
     virtual bool IsOpen() const = 0;
     virtual ssize_t Read(void* buf, size_t nbyte) = 0;
     virtual ssize_t Write(const void* buf, size_t nbyte) = 0;
+    virtual ssize_t WriteAt(const void* buf, size_t nbyte, off64_t offset) = 0;
     virtual off64_t Seek(off64_t offset, int whence) = 0;
     virtual mode_t GetFileMode() const = 0;
     virtual uint64_t GetSize() const = 0;
@@ -124,6 +125,15 @@ class BRILLO_EXPORT FileStream : public Stream {
                         size_t* size_written,
                         ErrorPtr* error) override;
 
+  // Writes all of |size_to_write| bytes at the given |offset| in the file
+  // (using pwrite()) without changing the current stream position. Multiple
+  // writers can use this to fill in different parts of the same file.
+  // Only supported on seekable streams.
+  bool WriteAtBlocking(uint64_t offset,
+                       const void* buffer,
+                       size_t size_to_write,
+                       ErrorPtr* error);
+
   // == Finalizing/closing streams  ===========================================
   bool FlushBlocking(ErrorPtr* error) override;
   bool CloseBlocking(ErrorPtr* error) override;
@@ -124,6 +124,7 @@ class MockFileDescriptor : public FileStream::FileDescriptorInterface {
   MOCK_CONST_METHOD0(IsOpen, bool());
   MOCK_METHOD2(Read, ssize_t(void*, size_t));
   MOCK_METHOD2(Write, ssize_t(const void*, size_t));
+  MOCK_METHOD3(WriteAt, ssize_t(const void*, size_t, off64_t));
   MOCK_METHOD2(Seek, off64_t(off64_t, int));
   MOCK_CONST_METHOD0(GetFileMode, mode_t());
   MOCK_CONST_METHOD0(GetSize, uint64_t());
@@ -658,6 +659,27 @@ TEST_F(FileStreamTest, WriteAllBlocking_Fail) {
   EXPECT_EQ("EBADF", error->GetCode());
 }
 
+TEST_F(FileStreamTest, WriteAtBlocking) {
+  {
+    InSequence seq;
+    EXPECT_CALL(fd_mock(), WriteAt(test_write_buffer_, 100, 1000))
+        .WillOnce(Return(30));
+    EXPECT_CALL(fd_mock(), WriteAt(test_write_buffer_ + 30, 70, 1030))
+        .WillOnce(Return(70));
+  }
+  EXPECT_CALL(fd_mock(), Seek(_, _)).Times(0);
+  EXPECT_TRUE(stream_->WriteAtBlocking(1000, test_write_buffer_, 100, nullptr));
+}
+
+TEST_F(FileStreamTest, WriteAtBlocking_Fail) {
+  EXPECT_CALL(fd_mock(), WriteAt(test_write_buffer_, 80, 0))
+      .WillOnce(SetErrnoAndReturn(ENOSPC, -1));
+  brillo::ErrorPtr error;
+  EXPECT_FALSE(stream_->WriteAtBlocking(0, test_write_buffer_, 80, &error));
+  EXPECT_EQ(errors::system::kDomain, error->GetDomain());
+  EXPECT_EQ("ENOSPC", error->GetCode());
+}
+
 TEST_F(FileStreamTest, WaitForDataBlocking_Timeout) {
   EXPECT_CALL(fd_mock(), WaitForDataBlocking(Stream::AccessMode::WRITE, _, _))
       .WillOnce(Return(0));
@@ -0,0 +1,280 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/json_binding.h>
+
+#include <inttypes.h>
+
+#include <limits>
+
+#include <base/lazy_instance.h>
+#include <brillo/errors/error_codes.h>
+
+namespace brillo {
+
+namespace internal {
+
+namespace {
+
+class BoolDecoder : public JsonDecoder {
+ public:
+  bool DecodeBool(void* target,
+                  bool value,
+                  ErrorPtr* /* error */) const override {
+    *static_cast<bool*>(target) = value;
+    return true;
+  }
+  const char* GetTypeName() const override { return "boolean"; }
+};
+
+class IntDecoder : public JsonDecoder {
+ public:
+  bool DecodeInteger(void* target,
+                     int64_t value,
+                     ErrorPtr* error) const override {
+    if (value < std::numeric_limits<int>::min() ||
+        value > std::numeric_limits<int>::max()) {
+      Error::AddToPrintf(error, FROM_HERE, errors::json::kDomain,
+                         errors::json::kTypeMismatch,
+                         "Integer value %" PRId64 " is out of range", value);
+      return false;
+    }
+    *static_cast<int*>(target) = static_cast<int>(value);
+    return true;
+  }
+  const char* GetTypeName() const override { return "integer"; }
+};
+
+class Int64Decoder : public JsonDecoder {
+ public:
+  bool DecodeInteger(void* target,
+                     int64_t value,
+                     ErrorPtr* /* error */) const override {
+    *static_cast<int64_t*>(target) = value;
+    return true;
+  }
+  const char* GetTypeName() const override { return "integer"; }
+};
+
+class DoubleDecoder : public JsonDecoder {
+ public:
+  bool DecodeInteger(void* target,
+                     int64_t value,
+                     ErrorPtr* /* error */) const override {
+    *static_cast<double*>(target) = static_cast<double>(value);
+    return true;
+  }
+  bool DecodeDouble(void* target,
+                    double value,
+                    ErrorPtr* /* error */) const override {
+    *static_cast<double*>(target) = value;
+    return true;
+  }
+  const char* GetTypeName() const override { return "number"; }
+};
+
+class StringDecoder : public JsonDecoder {
+ public:
+  bool DecodeString(void* target,
+                    base::StringPiece value,
+                    ErrorPtr* /* error */) const override {
+    value.CopyToString(static_cast<std::string*>(target));
+    return true;
+  }
+  const char* GetTypeName() const override { return "string"; }
+};
+
+base::LazyInstance<BoolDecoder>::Leaky g_bool_decoder =
+    LAZY_INSTANCE_INITIALIZER;
+base::LazyInstance<IntDecoder>::Leaky g_int_decoder = LAZY_INSTANCE_INITIALIZER;
+base::LazyInstance<Int64Decoder>::Leaky g_int64_decoder =
+    LAZY_INSTANCE_INITIALIZER;
+base::LazyInstance<DoubleDecoder>::Leaky g_double_decoder =
+    LAZY_INSTANCE_INITIALIZER;
+base::LazyInstance<StringDecoder>::Leaky g_string_decoder =
+    LAZY_INSTANCE_INITIALIZER;
+
+}  // anonymous namespace
+
+bool JsonDecoder::DecodeNull(void* /* target */,
+                             ErrorPtr* /* error */) const {
+  // Nulls leave the target as is.
+  return true;
+}
+
+bool JsonDecoder::DecodeBool(void* /* target */,
+                             bool /* value */,
+                             ErrorPtr* error) const {
+  return TypeMismatch("boolean", error);
+}
+
+bool JsonDecoder::DecodeInteger(void* /* target */,
+                                int64_t /* value */,
+                                ErrorPtr* error) const {
+  return TypeMismatch("integer", error);
+}
+
+bool JsonDecoder::DecodeDouble(void* /* target */,
+                               double /* value */,
+                               ErrorPtr* error) const {
+  return TypeMismatch("number", error);
+}
+
+bool JsonDecoder::DecodeString(void* /* target */,
+                               base::StringPiece /* value */,
+                               ErrorPtr* error) const {
+  return TypeMismatch("string", error);
+}
+
+const JsonDecoder* JsonDecoder::GetMember(
+    void* /* target */,
+    base::StringPiece /* key */,
+    void** /* member_target */) const {
+  return nullptr;
+}
+
+const JsonDecoder* JsonDecoder::AddElement(
+    void* /* target */,
+    void** /* element_target */) const {
+  return nullptr;
+}
+
+bool JsonDecoder::TypeMismatch(const char* actual_type,
+                               ErrorPtr* error) const {
+  Error::AddToPrintf(error, FROM_HERE, errors::json::kDomain,
+                     errors::json::kTypeMismatch, "Expected %s, got %s",
+                     GetTypeName(), actual_type);
+  return false;
+}
+
+template <>
+const JsonDecoder* GetScalarDecoder<bool>() {
+  return g_bool_decoder.Pointer();
+}
+
+template <>
+const JsonDecoder* GetScalarDecoder<int>() {
+  return g_int_decoder.Pointer();
+}
+
+template <>
+const JsonDecoder* GetScalarDecoder<int64_t>() {
+  return g_int64_decoder.Pointer();
+}
+
+template <>
+const JsonDecoder* GetScalarDecoder<double>() {
+  return g_double_decoder.Pointer();
+}
+
+template <>
+const JsonDecoder* GetScalarDecoder<std::string>() {
+  return g_string_decoder.Pointer();
+}
+
+}  // namespace internal
+
+JsonBinder::JsonBinder(const internal::JsonDecoder* decoder, void* target)
+    : next_{decoder, target} {}
+
+bool JsonBinder::OnNull(ErrorPtr* error) {
+  Frame frame;
+  return !NextValue(&frame) || frame.decoder->DecodeNull(frame.target, error);
+}
+
+bool JsonBinder::OnBool(bool value, ErrorPtr* error) {
+  Frame frame;
+  return !NextValue(&frame) ||
+         frame.decoder->DecodeBool(frame.target, value, error);
+}
+
+bool JsonBinder::OnInteger(int64_t value, ErrorPtr* error) {
+  Frame frame;
+  return !NextValue(&frame) ||
+         frame.decoder->DecodeInteger(frame.target, value, error);
+}
+
+bool JsonBinder::OnDouble(double value, ErrorPtr* error) {
+  Frame frame;
+  return !NextValue(&frame) ||
+         frame.decoder->DecodeDouble(frame.target, value, error);
+}
+
+bool JsonBinder::OnString(base::StringPiece value, ErrorPtr* error) {
+  Frame frame;
+  return !NextValue(&frame) ||
+         frame.decoder->DecodeString(frame.target, value, error);
+}
+
+bool JsonBinder::OnStartObject(ErrorPtr* error) {
+  return StartContainer(true, error);
+}
+
+bool JsonBinder::OnKey(base::StringPiece key, ErrorPtr* /* error */) {
+  if (skip_depth_)
+    return true;
+  const Frame& object = stack_.back();
+  void* member_target = nullptr;
+  const internal::JsonDecoder* decoder =
+      object.decoder->GetMember(object.target, key, &member_target);
+  if (!decoder) {
+    skip_next_ = true;
+    return true;
+  }
+  next_ = Frame{decoder, member_target};
+  return true;
+}
+
+bool JsonBinder::OnEndObject(ErrorPtr* /* error */) {
+  EndContainer();
+  return true;
+}
+
+bool JsonBinder::OnStartArray(ErrorPtr* error) {
+  return StartContainer(false, error);
+}
+
+bool JsonBinder::OnEndArray(ErrorPtr* /* error */) {
+  EndContainer();
+  return true;
+}
+
+bool JsonBinder::NextValue(Frame* frame) {
+  if (skip_depth_)
+    return false;
+  if (skip_next_) {
+    skip_next_ = false;
+    return false;
+  }
+  if (!stack_.empty() && stack_.back().decoder->IsArray()) {
+    const Frame& array = stack_.back();
+    frame->decoder = array.decoder->AddElement(array.target, &frame->target);
+    return true;
+  }
+  *frame = next_;
+  return true;
+}
+
+bool JsonBinder::StartContainer(bool is_object, ErrorPtr* error) {
+  Frame frame;
+  if (!NextValue(&frame)) {
+    skip_depth_++;
+    return true;
+  }
+  bool matches =
+      is_object ? frame.decoder->IsObject() : frame.decoder->IsArray();
+  if (!matches)
+    return frame.decoder->TypeMismatch(is_object ? "object" : "array", error);
+  stack_.push_back(frame);
+  return true;
+}
+
+void JsonBinder::EndContainer() {
+  if (skip_depth_)
+    skip_depth_--;
+  else
+    stack_.pop_back();
+}
+
+}  // namespace brillo
@@ -0,0 +1,274 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_STREAMS_JSON_BINDING_H_
+#define LIBBRILLO_BRILLO_STREAMS_JSON_BINDING_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/macros.h>
+#include <base/strings/string_piece.h>
+#include <brillo/brillo_export.h>
+#include <brillo/errors/error.h>
+#include <brillo/streams/json_stream_parser.h>
+
+namespace brillo {
+
+namespace internal {
+
+// Decodes JSON values into C++ objects of one particular type. The objects
+// are passed as void* so the decoders of different types can be used through
+// the same interface by JsonBinder. Each Decode*() method other than
+// DecodeNull() fails with a type mismatch error unless overridden.
+class BRILLO_EXPORT JsonDecoder {
+ public:
+  virtual ~JsonDecoder() = default;
+
+  virtual bool DecodeNull(void* target, ErrorPtr* error) const;
+  virtual bool DecodeBool(void* target, bool value, ErrorPtr* error) const;
+  virtual bool DecodeInteger(void* target,
+                             int64_t value,
+                             ErrorPtr* error) const;
+  virtual bool DecodeDouble(void* target, double value, ErrorPtr* error) const;
+  virtual bool DecodeString(void* target,
+                            base::StringPiece value,
+                            ErrorPtr* error) const;
+
+  // JSON objects. Returns the decoder of the member |key| and sets
+  // |member_target| to the object it should decode into, or returns nullptr
+  // if the member should be ignored.
+  virtual bool IsObject() const { return false; }
+  virtual const JsonDecoder* GetMember(void* target,
+                                       base::StringPiece key,
+                                       void** member_target) const;
+
+  // JSON arrays. Adds a new element to |target|, sets |element_target| to it
+  // and returns the decoder of the element.
+  virtual bool IsArray() const { return false; }
+  virtual const JsonDecoder* AddElement(void* target,
+                                        void** element_target) const;
+
+  // The name of the expected JSON type, for error messages.
+  virtual const char* GetTypeName() const = 0;
+
+  // Adds a type mismatch error to |error| and returns false.
+  bool TypeMismatch(const char* actual_type, ErrorPtr* error) const;
+};
+
+// Returns the decoder of a scalar type: bool, int, int64_t, double or
+// std::string.
+template <typename T>
+const JsonDecoder* GetScalarDecoder();
+
+template <>
+BRILLO_EXPORT const JsonDecoder* GetScalarDecoder<bool>();
+template <>
+BRILLO_EXPORT const JsonDecoder* GetScalarDecoder<int>();
+template <>
+BRILLO_EXPORT const JsonDecoder* GetScalarDecoder<int64_t>();
+template <>
+BRILLO_EXPORT const JsonDecoder* GetScalarDecoder<double>();
+template <>
+BRILLO_EXPORT const JsonDecoder* GetScalarDecoder<std::string>();
+
+// Decodes a JSON array into std::vector<T>.
+template <typename T>
+class VectorDecoder : public JsonDecoder {
+ public:
+  explicit VectorDecoder(const JsonDecoder* element_decoder)
+      : element_decoder_{element_decoder} {}
+
+  bool IsArray() const override { return true; }
+  const JsonDecoder* AddElement(void* target,
+                                void** element_target) const override {
+    auto vector = static_cast<std::vector<T>*>(target);
+    vector->emplace_back();
+    *element_target = &vector->back();
+    return element_decoder_;
+  }
+  const char* GetTypeName() const override { return "array"; }
+
+ private:
+  const JsonDecoder* element_decoder_;
+};
+
+template <typename T>
+struct JsonFieldTraits {
+  static const JsonDecoder* GetDecoder() { return GetScalarDecoder<T>(); }
+};
+
+template <typename T>
+struct JsonFieldTraits<std::vector<T>> {
+  static const JsonDecoder* GetDecoder() {
+    static const JsonDecoder* decoder =
+        new VectorDecoder<T>{JsonFieldTraits<T>::GetDecoder()};
+    return decoder;
+  }
+};
+
+}  // namespace internal
+
+// JsonObjectBinding describes how the members of a JSON object map to the
+// fields of the C++ struct T, so JSON documents can be decoded straight into
+// the struct without building a base::Value tree first:
+//
+//    struct Device {
+//      std::string id;
+//      int64_t size = 0;
+//      std::vector<std::string> tags;
+//      Owner owner;
+//    };
+//
+//    JsonObjectBinding<Owner> owner_binding;
+//    owner_binding.AddField("name", &Owner::name);
+//    JsonObjectBinding<Device> binding;
+//    binding.AddField("id", &Device::id)
+//        .AddField("size", &Device::size)
+//        .AddField("tags", &Device::tags)
+//        .AddField("owner", &Device::owner, owner_binding);
+//
+//    Device device;
+//    if (!ReadJsonBlocking(stream.get(), binding, &device, &error))
+//      ...
+//
+// Supported field types are bool, int, int64_t, double, std::string, structs
+// with their own binding and std::vector of any of those. The members not
+// described by the binding are skipped, and the fields of the members missing
+// from the document keep their values. A JSON null leaves the field as is,
+// any other type mismatch is an error.
+//
+// A binding used by another one must outlive it.
+template <typename T>
+class JsonObjectBinding : public internal::JsonDecoder {
+ public:
+  JsonObjectBinding() = default;
+
+  // Binds a field of a scalar type or a vector of scalars.
+  template <typename M>
+  JsonObjectBinding& AddField(const std::string& name, M T::*field) {
+    return AddMember(name, field, internal::JsonFieldTraits<M>::GetDecoder());
+  }
+
+  // Binds a field of a struct type with its own binding.
+  template <typename M>
+  JsonObjectBinding& AddField(const std::string& name,
+                              M T::*field,
+                              const JsonObjectBinding<M>& binding) {
+    return AddMember(name, field, &binding);
+  }
+
+  // Binds a vector of structs with their own binding.
+  template <typename M>
+  JsonObjectBinding& AddField(const std::string& name,
+                              std::vector<M> T::*field,
+                              const JsonObjectBinding<M>& binding) {
+    owned_decoders_.emplace_back(new internal::VectorDecoder<M>{&binding});
+    return AddMember(name, field, owned_decoders_.back().get());
+  }
+
+  // Overrides from internal::JsonDecoder.
+  bool IsObject() const override { return true; }
+  const internal::JsonDecoder* GetMember(void* target,
+                                         base::StringPiece key,
+                                         void** member_target) const override {
+    for (const Member& member : members_) {
+      if (key == member.name) {
+        *member_target = member.get_field(static_cast<T*>(target));
+        return member.decoder;
+      }
+    }
+    return nullptr;
+  }
+  const char* GetTypeName() const override { return "object"; }
+
+ private:
+  struct Member {
+    std::string name;
+    std::function<void*(T*)> get_field;
+    const internal::JsonDecoder* decoder;
+  };
+
+  template <typename M>
+  JsonObjectBinding& AddMember(const std::string& name,
+                               M T::*field,
+                               const internal::JsonDecoder* decoder) {
+    members_.push_back(
+        Member{name, [field](T* object) -> void* { return &(object->*field); },
+               decoder});
+    return *this;
+  }
+
+  std::vector<Member> members_;
+  std::vector<std::unique_ptr<internal::JsonDecoder>> owned_decoders_;
+
+  DISALLOW_COPY_AND_ASSIGN(JsonObjectBinding);
+};
+
+// A JsonHandler decoding the parsed document into an object using its
+// binding. Use ReadJsonBlocking() or pass it to a JsonStreamParser directly
+// (e.g. for asynchronous parsing).
+class BRILLO_EXPORT JsonBinder : public JsonHandler {
+ public:
+  template <typename T>
+  JsonBinder(const JsonObjectBinding<T>& binding, T* value)
+      : JsonBinder{static_cast<const internal::JsonDecoder*>(&binding),
+                   static_cast<void*>(value)} {}
+
+  // Overrides from JsonHandler.
+  bool OnNull(ErrorPtr* error) override;
+  bool OnBool(bool value, ErrorPtr* error) override;
+  bool OnInteger(int64_t value, ErrorPtr* error) override;
+  bool OnDouble(double value, ErrorPtr* error) override;
+  bool OnString(base::StringPiece value, ErrorPtr* error) override;
+  bool OnStartObject(ErrorPtr* error) override;
+  bool OnKey(base::StringPiece key, ErrorPtr* error) override;
+  bool OnEndObject(ErrorPtr* error) override;
+  bool OnStartArray(ErrorPtr* error) override;
+  bool OnEndArray(ErrorPtr* error) override;
+
+ private:
+  struct Frame {
+    const internal::JsonDecoder* decoder;
+    void* target;
+  };
+
+  JsonBinder(const internal::JsonDecoder* decoder, void* target);
+
+  // Determines where the next value goes. Returns false if the value should
+  // be skipped.
+  bool NextValue(Frame* frame);
+  // Common implementation of OnStartObject() and OnStartArray().
+  bool StartContainer(bool is_object, ErrorPtr* error);
+  void EndContainer();
+
+  // The value expected next, when not inside an array.
+  Frame next_;
+  bool skip_next_{false};
+  // The objects and arrays being decoded.
+  std::vector<Frame> stack_;
+  // The nesting depth of the ignored value being skipped.
+  size_t skip_depth_{0};
+
+  DISALLOW_COPY_AND_ASSIGN(JsonBinder);
+};
+
+// Parses the JSON document read from |stream| into |value|.
+template <typename T>
+bool ReadJsonBlocking(Stream* stream,
+                      const JsonObjectBinding<T>& binding,
+                      T* value,
+                      ErrorPtr* error) {
+  JsonBinder binder{binding, value};
+  JsonStreamParser parser{&binder};
+  return parser.ParseBlocking(stream, error);
+}
+
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_STREAMS_JSON_BINDING_H_
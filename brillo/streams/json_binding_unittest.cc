@@ -0,0 +1,124 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/json_binding.h>
+
+#include <string>
+#include <vector>
+
+#include <brillo/errors/error_codes.h>
+#include <brillo/streams/memory_stream.h>
+#include <gtest/gtest.h>
+
+namespace brillo {
+
+namespace {
+
+struct Owner {
+  std::string name;
+  int uid{0};
+};
+
+struct Device {
+  std::string id;
+  int64_t size{0};
+  double ratio{0.0};
+  bool enabled{false};
+  std::vector<std::string> tags;
+  std::vector<std::vector<int>> matrix;
+  Owner owner;
+  std::vector<Owner> users;
+};
+
+}  // anonymous namespace
+
+class JsonBindingTest : public testing::Test {
+ public:
+  void SetUp() override {
+    owner_binding_.AddField("name", &Owner::name).AddField("uid", &Owner::uid);
+    binding_.AddField("id", &Device::id)
+        .AddField("size", &Device::size)
+        .AddField("ratio", &Device::ratio)
+        .AddField("enabled", &Device::enabled)
+        .AddField("tags", &Device::tags)
+        .AddField("matrix", &Device::matrix)
+        .AddField("owner", &Device::owner, owner_binding_)
+        .AddField("users", &Device::users, owner_binding_);
+  }
+
+  bool Parse(const std::string& json) {
+    device_ = Device{};
+    error_.reset();
+    auto stream = MemoryStream::OpenCopyOf(json, nullptr);
+    return ReadJsonBlocking(stream.get(), binding_, &device_, &error_);
+  }
+
+  JsonObjectBinding<Owner> owner_binding_;
+  JsonObjectBinding<Device> binding_;
+  Device device_;
+  ErrorPtr error_;
+};
+
+TEST_F(JsonBindingTest, AllFields) {
+  EXPECT_TRUE(Parse(R"({
+      "id": "dev1",
+      "size": 8589934592,
+      "ratio": 0.5,
+      "enabled": true,
+      "tags": ["a", "b"],
+      "matrix": [[1, 2], [], [3]],
+      "owner": {"name": "root", "uid": 0},
+      "users": [{"name": "alice", "uid": 1000}, {"uid": 1001}]
+    })"));
+  EXPECT_EQ("dev1", device_.id);
+  EXPECT_EQ(8589934592LL, device_.size);
+  EXPECT_DOUBLE_EQ(0.5, device_.ratio);
+  EXPECT_TRUE(device_.enabled);
+  EXPECT_EQ((std::vector<std::string>{"a", "b"}), device_.tags);
+  EXPECT_EQ((std::vector<std::vector<int>>{{1, 2}, {}, {3}}), device_.matrix);
+  EXPECT_EQ("root", device_.owner.name);
+  ASSERT_EQ(2u, device_.users.size());
+  EXPECT_EQ("alice", device_.users[0].name);
+  EXPECT_EQ(1000, device_.users[0].uid);
+  EXPECT_EQ("", device_.users[1].name);
+  EXPECT_EQ(1001, device_.users[1].uid);
+}
+
+TEST_F(JsonBindingTest, UnknownMembersAndNulls) {
+  EXPECT_TRUE(Parse(R"({
+      "extra": {"nested": [1, {"id": "wrong"}, [null]]},
+      "id": "dev2",
+      "more": [{"size": 1}],
+      "ratio": 2,
+      "owner": null,
+      "size": null
+    })"));
+  EXPECT_EQ("dev2", device_.id);
+  EXPECT_EQ(0, device_.size);
+  EXPECT_DOUBLE_EQ(2.0, device_.ratio);
+  EXPECT_EQ("", device_.owner.name);
+}
+
+TEST_F(JsonBindingTest, TypeMismatch) {
+  const char* const kInvalid[] = {
+      R"({"id": 1})",
+      R"({"size": 1.5})",
+      R"({"enabled": "true"})",
+      R"({"tags": "a"})",
+      R"({"tags": [1]})",
+      R"({"owner": []})",
+      R"({"owner": {"uid": 4294967296}})",
+      R"([])",
+  };
+  for (const char* json : kInvalid) {
+    EXPECT_FALSE(Parse(json)) << json;
+    ASSERT_NE(nullptr, error_.get()) << json;
+    EXPECT_EQ(errors::json::kDomain, error_->GetDomain());
+    EXPECT_EQ(errors::json::kTypeMismatch, error_->GetCode());
+  }
+  EXPECT_FALSE(Parse(R"({"id": "x",})"));
+  EXPECT_EQ(errors::json::kParseError, error_->GetCode());
+}
+
+}  // namespace brillo
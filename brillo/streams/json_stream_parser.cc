@@ -0,0 +1,479 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/json_stream_parser.h>
+
+#include <inttypes.h>
+
+#include <base/bind.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/string_util.h>
+#include <brillo/errors/error_codes.h>
+#include <brillo/streams/stream_errors.h>
+
+namespace brillo {
+
+namespace {
+
+// The size of the chunks read from the stream.
+const size_t kReadBufferSize = 4096;
+
+bool IsWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+// Returns true if |c| can be a part of a number token (not necessarily a
+// valid one).
+bool IsNumberChar(char c) {
+  return IsDigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' ||
+         c == 'E';
+}
+
+// Validates the number syntax of RFC 7159. Sets |is_integer| to true if the
+// number has no fraction or exponent.
+bool IsValidNumber(const std::string& number, bool* is_integer) {
+  size_t i = 0;
+  size_t size = number.size();
+  auto skip_digits = [&number, &i, size]() {
+    size_t start = i;
+    while (i < size && IsDigit(number[i]))
+      i++;
+    return i > start;
+  };
+
+  if (i < size && number[i] == '-')
+    i++;
+  if (i < size && number[i] == '0') {
+    i++;
+  } else if (!skip_digits()) {
+    return false;
+  }
+  *is_integer = true;
+  if (i < size && number[i] == '.') {
+    i++;
+    *is_integer = false;
+    if (!skip_digits())
+      return false;
+  }
+  if (i < size && (number[i] == 'e' || number[i] == 'E')) {
+    i++;
+    *is_integer = false;
+    if (i < size && (number[i] == '+' || number[i] == '-'))
+      i++;
+    if (!skip_digits())
+      return false;
+  }
+  return i == size;
+}
+
+// Appends |code_point| to |str| encoded as UTF-8.
+void AppendUTF8(uint32_t code_point, std::string* str) {
+  if (code_point < 0x80) {
+    str->push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    str->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+    str->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point < 0x10000) {
+    str->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+    str->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    str->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else {
+    str->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+    str->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    str->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    str->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+}
+
+}  // anonymous namespace
+
+JsonStreamParser::JsonStreamParser(JsonHandler* handler, size_t max_depth)
+    : handler_{handler}, max_depth_{max_depth} {}
+
+JsonStreamParser::~JsonStreamParser() = default;
+
+bool JsonStreamParser::Feed(const void* data, size_t size, ErrorPtr* error) {
+  if (failed_) {
+    Error::AddTo(error, FROM_HERE, errors::json::kDomain,
+                 errors::json::kParseError, "The parser has already failed");
+    return false;
+  }
+
+  const char* begin = static_cast<const char*>(data);
+  const char* end = begin + size;
+  const char* p = begin;
+  bool success = true;
+  while (success && p < end) {
+    offset_ = bytes_fed_ + (p - begin);
+    switch (token_type_) {
+      case Token::NONE: {
+        char c = *p++;
+        if (!IsWhitespace(c))
+          success = ParseStructural(c, error);
+        break;
+      }
+
+      case Token::STRING: {
+        // Copy the run of unescaped characters in one go.
+        const char* run = p;
+        while (p < end && *p != '"' && *p != '\\' &&
+               static_cast<unsigned char>(*p) >= 0x20) {
+          p++;
+        }
+        if (p > run && high_surrogate_) {
+          success = SyntaxError(error, "Unpaired UTF-16 surrogate");
+          break;
+        }
+        token_.append(run, p - run);
+        if (p == end)
+          break;
+        char c = *p++;
+        if (c == '\\') {
+          token_type_ = Token::STRING_ESCAPE;
+        } else if (high_surrogate_) {
+          success = SyntaxError(error, "Unpaired UTF-16 surrogate");
+        } else if (c == '"') {
+          token_type_ = Token::NONE;
+          success = EndString(error);
+        } else {
+          success = SyntaxError(error, "Control character in a string");
+        }
+        break;
+      }
+
+      case Token::STRING_ESCAPE: {
+        char c = *p++;
+        token_type_ = Token::STRING;
+        if (high_surrogate_ && c != 'u') {
+          success = SyntaxError(error, "Unpaired UTF-16 surrogate");
+          break;
+        }
+        switch (c) {
+          case '"':
+          case '\\':
+          case '/':
+            token_.push_back(c);
+            break;
+          case 'b':
+            token_.push_back('\b');
+            break;
+          case 'f':
+            token_.push_back('\f');
+            break;
+          case 'n':
+            token_.push_back('\n');
+            break;
+          case 'r':
+            token_.push_back('\r');
+            break;
+          case 't':
+            token_.push_back('\t');
+            break;
+          case 'u':
+            token_type_ = Token::STRING_UNICODE;
+            code_point_ = 0;
+            code_point_digits_ = 0;
+            break;
+          default:
+            success = SyntaxError(error, "Invalid escape sequence");
+            break;
+        }
+        break;
+      }
+
+      case Token::STRING_UNICODE: {
+        char c = *p++;
+        uint32_t digit = 0;
+        if (IsDigit(c)) {
+          digit = c - '0';
+        } else if (base::IsHexDigit(c)) {
+          digit = base::ToLowerASCII(c) - 'a' + 10;
+        } else {
+          success = SyntaxError(error, "Invalid \\u escape sequence");
+          break;
+        }
+        code_point_ = (code_point_ << 4) | digit;
+        if (++code_point_digits_ == 4) {
+          token_type_ = Token::STRING;
+          success = AddCodePoint(error);
+        }
+        break;
+      }
+
+      case Token::NUMBER:
+      case Token::LITERAL: {
+        const char* run = p;
+        if (token_type_ == Token::NUMBER) {
+          while (p < end && IsNumberChar(*p))
+            p++;
+        } else {
+          while (p < end && base::IsAsciiAlpha(*p))
+            p++;
+        }
+        token_.append(run, p - run);
+        // The token ends at the first character not belonging to it, which
+        // is then parsed as a structural character.
+        if (p < end) {
+          bool is_number = (token_type_ == Token::NUMBER);
+          token_type_ = Token::NONE;
+          success = is_number ? EndNumber(error) : EndLiteral(error);
+        }
+        break;
+      }
+    }
+  }
+  bytes_fed_ += size;
+  if (!success)
+    failed_ = true;
+  return success;
+}
+
+bool JsonStreamParser::Finish(ErrorPtr* error) {
+  if (failed_) {
+    Error::AddTo(error, FROM_HERE, errors::json::kDomain,
+                 errors::json::kParseError, "The parser has already failed");
+    return false;
+  }
+  offset_ = bytes_fed_;
+  bool success = true;
+  if (token_type_ == Token::NUMBER) {
+    token_type_ = Token::NONE;
+    success = EndNumber(error);
+  } else if (token_type_ == Token::LITERAL) {
+    token_type_ = Token::NONE;
+    success = EndLiteral(error);
+  } else if (token_type_ != Token::NONE) {
+    success = SyntaxError(error, "Unterminated string");
+  }
+  if (success && state_ != State::DONE)
+    success = SyntaxError(error, "Unexpected end of data");
+  if (!success)
+    failed_ = true;
+  return success;
+}
+
+bool JsonStreamParser::ParseBlocking(Stream* stream, ErrorPtr* error) {
+  std::vector<char> buffer(kReadBufferSize);
+  for (;;) {
+    size_t size_read = 0;
+    if (!stream->ReadBlocking(buffer.data(), buffer.size(), &size_read, error))
+      return false;
+    if (size_read == 0)
+      return Finish(error);
+    if (!Feed(buffer.data(), size_read, error))
+      return false;
+  }
+}
+
+bool JsonStreamParser::ParseAsync(Stream* stream,
+                                  const base::Closure& success_callback,
+                                  const Stream::ErrorCallback& error_callback,
+                                  ErrorPtr* error) {
+  if (stream_) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kOperationNotSupported,
+                 "Another asynchronous operation is still pending");
+    return false;
+  }
+  buffer_.resize(kReadBufferSize);
+  if (!stream->ReadAsync(
+          buffer_.data(), buffer_.size(),
+          base::Bind(&JsonStreamParser::OnReadDone,
+                     weak_ptr_factory_.GetWeakPtr()),
+          base::Bind(&JsonStreamParser::OnReadError,
+                     weak_ptr_factory_.GetWeakPtr()),
+          error)) {
+    return false;
+  }
+  stream_ = stream;
+  success_callback_ = success_callback;
+  error_callback_ = error_callback;
+  return true;
+}
+
+bool JsonStreamParser::ParseStructural(char c, ErrorPtr* error) {
+  switch (state_) {
+    case State::DONE:
+      return SyntaxError(error, "Unexpected data after the end of the value");
+
+    case State::COLON:
+      if (c != ':')
+        return SyntaxError(error, "Expected ':'");
+      state_ = State::VALUE;
+      return true;
+
+    case State::AFTER_VALUE:
+      if (c == ',') {
+        state_ = stack_.back() == '{' ? State::KEY : State::VALUE;
+        return true;
+      }
+      return EndContainer(c, error);
+
+    case State::FIRST_KEY:
+    case State::KEY:
+      if (c == '}' && state_ == State::FIRST_KEY)
+        return EndContainer(c, error);
+      if (c != '"')
+        return SyntaxError(error, "Expected an object member name");
+      token_type_ = Token::STRING;
+      token_.clear();
+      is_key_ = true;
+      return true;
+
+    case State::FIRST_ARRAY_VALUE:
+    case State::VALUE:
+      if (c == ']' && state_ == State::FIRST_ARRAY_VALUE)
+        return EndContainer(c, error);
+      return StartValue(c, error);
+  }
+  return false;
+}
+
+bool JsonStreamParser::StartValue(char c, ErrorPtr* error) {
+  if (c == '{' || c == '[') {
+    if (stack_.size() >= max_depth_)
+      return SyntaxError(error, "Maximum nesting depth exceeded");
+    stack_.push_back(c);
+    if (c == '{') {
+      state_ = State::FIRST_KEY;
+      return handler_->OnStartObject(error);
+    }
+    state_ = State::FIRST_ARRAY_VALUE;
+    return handler_->OnStartArray(error);
+  }
+
+  token_.clear();
+  if (c == '"') {
+    token_type_ = Token::STRING;
+    is_key_ = false;
+  } else if (c == '-' || IsDigit(c)) {
+    token_type_ = Token::NUMBER;
+    token_.push_back(c);
+  } else if (base::IsAsciiAlpha(c)) {
+    token_type_ = Token::LITERAL;
+    token_.push_back(c);
+  } else {
+    return SyntaxError(error, "Unexpected character");
+  }
+  return true;
+}
+
+bool JsonStreamParser::EndString(ErrorPtr* error) {
+  if (is_key_) {
+    state_ = State::COLON;
+    return handler_->OnKey(token_, error);
+  }
+  ValueDone();
+  return handler_->OnString(token_, error);
+}
+
+bool JsonStreamParser::EndNumber(ErrorPtr* error) {
+  bool is_integer = false;
+  if (!IsValidNumber(token_, &is_integer))
+    return SyntaxError(error, "Invalid number");
+  ValueDone();
+  int64_t int_value = 0;
+  if (is_integer && base::StringToInt64(token_, &int_value))
+    return handler_->OnInteger(int_value, error);
+  double double_value = 0.0;
+  if (!base::StringToDouble(token_, &double_value))
+    return SyntaxError(error, "Invalid number");
+  return handler_->OnDouble(double_value, error);
+}
+
+bool JsonStreamParser::EndLiteral(ErrorPtr* error) {
+  if (token_ == "null") {
+    ValueDone();
+    return handler_->OnNull(error);
+  }
+  if (token_ == "true" || token_ == "false") {
+    ValueDone();
+    return handler_->OnBool(token_ == "true", error);
+  }
+  return SyntaxError(error, "Invalid literal");
+}
+
+bool JsonStreamParser::EndContainer(char c, ErrorPtr* error) {
+  char open = (c == '}') ? '{' : '[';
+  if ((c != '}' && c != ']') || stack_.empty() || stack_.back() != open)
+    return SyntaxError(error, "Expected ',' or the end of the container");
+  stack_.pop_back();
+  ValueDone();
+  return c == '}' ? handler_->OnEndObject(error) : handler_->OnEndArray(error);
+}
+
+bool JsonStreamParser::AddCodePoint(ErrorPtr* error) {
+  uint32_t code_point = code_point_;
+  if (high_surrogate_) {
+    if (code_point < 0xDC00 || code_point > 0xDFFF)
+      return SyntaxError(error, "Unpaired UTF-16 surrogate");
+    code_point =
+        0x10000 + ((high_surrogate_ - 0xD800) << 10) + (code_point - 0xDC00);
+    high_surrogate_ = 0;
+  } else if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+    // Must be followed by the low surrogate.
+    high_surrogate_ = code_point;
+    return true;
+  } else if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+    return SyntaxError(error, "Unpaired UTF-16 surrogate");
+  }
+  AppendUTF8(code_point, &token_);
+  return true;
+}
+
+void JsonStreamParser::ValueDone() {
+  state_ = stack_.empty() ? State::DONE : State::AFTER_VALUE;
+}
+
+bool JsonStreamParser::SyntaxError(ErrorPtr* error, const char* message) {
+  Error::AddToPrintf(error, FROM_HERE, errors::json::kDomain,
+                     errors::json::kParseError, "%s at offset %" PRIu64,
+                     message, offset_);
+  return false;
+}
+
+void JsonStreamParser::ReadNextChunkAsync() {
+  ErrorPtr error;
+  if (!stream_->ReadAsync(buffer_.data(), buffer_.size(),
+                          base::Bind(&JsonStreamParser::OnReadDone,
+                                     weak_ptr_factory_.GetWeakPtr()),
+                          base::Bind(&JsonStreamParser::OnReadError,
+                                     weak_ptr_factory_.GetWeakPtr()),
+                          &error)) {
+    OnReadError(error.get());
+  }
+}
+
+void JsonStreamParser::OnReadDone(size_t size_read) {
+  ErrorPtr error;
+  bool success = (size_read == 0) ? Finish(&error)
+                                  : Feed(buffer_.data(), size_read, &error);
+  if (!success) {
+    OnReadError(error.get());
+    return;
+  }
+  if (size_read > 0) {
+    ReadNextChunkAsync();
+    return;
+  }
+  stream_ = nullptr;
+  base::Closure callback = success_callback_;
+  error_callback_.Reset();
+  success_callback_.Reset();
+  callback.Run();
+}
+
+void JsonStreamParser::OnReadError(const Error* error) {
+  stream_ = nullptr;
+  Stream::ErrorCallback callback = error_callback_;
+  error_callback_.Reset();
+  success_callback_.Reset();
+  callback.Run(error);
+}
+
+}  // namespace brillo
@@ -0,0 +1,162 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_STREAMS_JSON_STREAM_PARSER_H_
+#define LIBBRILLO_BRILLO_STREAMS_JSON_STREAM_PARSER_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/memory/weak_ptr.h>
+#include <base/strings/string_piece.h>
+#include <brillo/brillo_export.h>
+#include <brillo/errors/error.h>
+#include <brillo/streams/stream.h>
+
+namespace brillo {
+
+// The interface receiving the events from JsonStreamParser. Each method
+// returns false to abort the parsing, in which case it should add the reason
+// to |error|. The StringPiece arguments are valid only during the call.
+class BRILLO_EXPORT JsonHandler {
+ public:
+  virtual ~JsonHandler() = default;
+
+  virtual bool OnNull(ErrorPtr* error) = 0;
+  virtual bool OnBool(bool value, ErrorPtr* error) = 0;
+  // Called for numbers without a fraction or exponent which fit in int64_t.
+  virtual bool OnInteger(int64_t value, ErrorPtr* error) = 0;
+  // Called for all the other numbers.
+  virtual bool OnDouble(double value, ErrorPtr* error) = 0;
+  virtual bool OnString(base::StringPiece value, ErrorPtr* error) = 0;
+  virtual bool OnStartObject(ErrorPtr* error) = 0;
+  // Called with the name of each object member, before its value.
+  virtual bool OnKey(base::StringPiece key, ErrorPtr* error) = 0;
+  virtual bool OnEndObject(ErrorPtr* error) = 0;
+  virtual bool OnStartArray(ErrorPtr* error) = 0;
+  virtual bool OnEndArray(ErrorPtr* error) = 0;
+};
+
+// JsonStreamParser is an incremental (SAX-style) parser of JSON (RFC 7159)
+// documents. The data can be fed to the parser in chunks of any size, and the
+// values are reported to a JsonHandler as soon as they are complete, so the
+// document never has to be held in memory as a whole:
+//
+//    JsonStreamParser parser{&handler};
+//    if (!parser.ParseBlocking(stream.get(), &error))
+//      ...
+//
+// Strings are unescaped into a buffer reused for the whole document; no
+// other memory is allocated per value.
+class BRILLO_EXPORT JsonStreamParser {
+ public:
+  // |handler| must outlive the parser. Documents nested deeper than
+  // |max_depth| are rejected.
+  explicit JsonStreamParser(JsonHandler* handler, size_t max_depth = 100);
+  ~JsonStreamParser();
+
+  // Parses the next chunk of the document.
+  bool Feed(const void* data, size_t size, ErrorPtr* error);
+  // Must be called once all the data has been fed to the parser. Fails if the
+  // document is incomplete.
+  bool Finish(ErrorPtr* error);
+
+  // Reads |stream| to the end, parsing the data as it is read.
+  bool ParseBlocking(Stream* stream, ErrorPtr* error);
+
+  // Asynchronous version of ParseBlocking(). |stream| must outlive the
+  // parser. |success_callback| is called once the whole document is parsed,
+  // or |error_callback| if reading or parsing fails. Returns false and sets
+  // |error| if the operation can't be started.
+  bool ParseAsync(Stream* stream,
+                  const base::Closure& success_callback,
+                  const Stream::ErrorCallback& error_callback,
+                  ErrorPtr* error);
+
+  // Returns true once a complete top-level value has been parsed.
+  bool IsComplete() const { return state_ == State::DONE; }
+
+ private:
+  // What the parser expects next outside of a token.
+  enum class State {
+    VALUE,               // Any value.
+    FIRST_ARRAY_VALUE,   // A value or ']'.
+    FIRST_KEY,           // An object member name or '}'.
+    KEY,                 // An object member name.
+    COLON,               // ':' after the member name.
+    AFTER_VALUE,         // ',' or the end of the enclosing container.
+    DONE,                // Only whitespace.
+  };
+
+  // The token being parsed, which may span several chunks of data.
+  enum class Token {
+    NONE,
+    STRING,
+    STRING_ESCAPE,
+    STRING_UNICODE,
+    NUMBER,
+    LITERAL,
+  };
+
+  // Handles a character outside of a token.
+  bool ParseStructural(char c, ErrorPtr* error);
+  // Handles the first character of a value.
+  bool StartValue(char c, ErrorPtr* error);
+  // Handles the end of a string, number or literal token.
+  bool EndString(ErrorPtr* error);
+  bool EndNumber(ErrorPtr* error);
+  bool EndLiteral(ErrorPtr* error);
+  bool EndContainer(char c, ErrorPtr* error);
+  // Adds the code point of a \uXXXX escape sequence to the string.
+  bool AddCodePoint(ErrorPtr* error);
+  // Updates the state after a complete value.
+  void ValueDone();
+
+  bool SyntaxError(ErrorPtr* error, const char* message);
+
+  // Helper callbacks for ParseAsync().
+  void ReadNextChunkAsync();
+  void OnReadDone(size_t size_read);
+  void OnReadError(const Error* error);
+
+  JsonHandler* handler_;
+  size_t max_depth_;
+
+  State state_{State::VALUE};
+  // The open containers: '{' or '['.
+  std::vector<char> stack_;
+
+  Token token_type_{Token::NONE};
+  std::string token_;
+  // Whether the string being parsed is an object member name.
+  bool is_key_{false};
+  // The \uXXXX escape sequence being parsed.
+  uint32_t code_point_{0};
+  size_t code_point_digits_{0};
+  // The high surrogate of a UTF-16 surrogate pair waiting for the low one.
+  uint32_t high_surrogate_{0};
+
+  // The number of bytes passed to Feed() before the current call and the
+  // offset of the character being parsed, for error messages.
+  uint64_t bytes_fed_{0};
+  uint64_t offset_{0};
+  bool failed_{false};
+
+  // The state of ParseAsync().
+  Stream* stream_{nullptr};
+  std::vector<char> buffer_;
+  base::Closure success_callback_;
+  Stream::ErrorCallback error_callback_;
+
+  base::WeakPtrFactory<JsonStreamParser> weak_ptr_factory_{this};
+  DISALLOW_COPY_AND_ASSIGN(JsonStreamParser);
+};
+
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_STREAMS_JSON_STREAM_PARSER_H_
@@ -0,0 +1,207 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/json_stream_parser.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <base/bind.h>
+#include <base/strings/string_number_conversions.h>
+#include <brillo/errors/error_codes.h>
+#include <brillo/message_loops/fake_message_loop.h>
+#include <brillo/streams/memory_stream.h>
+#include <brillo/strings/string_utils.h>
+#include <gtest/gtest.h>
+
+namespace brillo {
+
+namespace {
+
+// Records the parser events as strings.
+class RecordingHandler : public JsonHandler {
+ public:
+  bool OnNull(ErrorPtr* error) override { return Add("null"); }
+  bool OnBool(bool value, ErrorPtr* error) override {
+    return Add(value ? "true" : "false");
+  }
+  bool OnInteger(int64_t value, ErrorPtr* error) override {
+    return Add("i:" + base::Int64ToString(value));
+  }
+  bool OnDouble(double value, ErrorPtr* error) override {
+    return Add("d:" + base::DoubleToString(value));
+  }
+  bool OnString(base::StringPiece value, ErrorPtr* error) override {
+    return Add("s:" + value.as_string());
+  }
+  bool OnStartObject(ErrorPtr* error) override { return Add("{"); }
+  bool OnKey(base::StringPiece key, ErrorPtr* error) override {
+    return Add("k:" + key.as_string());
+  }
+  bool OnEndObject(ErrorPtr* error) override { return Add("}"); }
+  bool OnStartArray(ErrorPtr* error) override { return Add("["); }
+  bool OnEndArray(ErrorPtr* error) override { return Add("]"); }
+
+  std::string GetEvents() const { return string_utils::Join(" ", events_); }
+
+ private:
+  bool Add(const std::string& event) {
+    events_.push_back(event);
+    return true;
+  }
+
+  std::vector<std::string> events_;
+};
+
+}  // anonymous namespace
+
+class JsonStreamParserTest : public testing::Test {
+ protected:
+  // Parses |json| fed to the parser in chunks of |chunk_size| bytes.
+  bool Parse(const std::string& json, size_t chunk_size = 0) {
+    handler_ = RecordingHandler{};
+    error_.reset();
+    JsonStreamParser parser{&handler_, 4};
+    if (chunk_size == 0)
+      chunk_size = json.size();
+    for (size_t pos = 0; pos < json.size(); pos += chunk_size) {
+      size_t size = std::min(chunk_size, json.size() - pos);
+      if (!parser.Feed(json.data() + pos, size, &error_))
+        return false;
+    }
+    return parser.Finish(&error_);
+  }
+
+  RecordingHandler handler_;
+  ErrorPtr error_;
+};
+
+TEST_F(JsonStreamParserTest, Values) {
+  EXPECT_TRUE(Parse("null"));
+  EXPECT_EQ("null", handler_.GetEvents());
+  EXPECT_TRUE(Parse(" true "));
+  EXPECT_EQ("true", handler_.GetEvents());
+  EXPECT_TRUE(Parse("-12"));
+  EXPECT_EQ("i:-12", handler_.GetEvents());
+  EXPECT_TRUE(Parse("1.5e2"));
+  EXPECT_EQ("d:150", handler_.GetEvents());
+  // Integers out of the int64_t range are reported as doubles.
+  EXPECT_TRUE(Parse("12345678901234567890"));
+  EXPECT_EQ(0u, handler_.GetEvents().find("d:"));
+  EXPECT_TRUE(Parse("\"abc\""));
+  EXPECT_EQ("s:abc", handler_.GetEvents());
+}
+
+TEST_F(JsonStreamParserTest, Containers) {
+  const char kJson[] =
+      "{\"a\": [1, 2.5, \"x\", [], {}], \"b\": {\"c\": false, \"d\": null}}";
+  const char kEvents[] =
+      "{ k:a [ i:1 d:2.5 s:x [ ] { } ] k:b { k:c false k:d null } }";
+  EXPECT_TRUE(Parse(kJson));
+  EXPECT_EQ(kEvents, handler_.GetEvents());
+  // The result must not depend on how the data is split.
+  for (size_t chunk_size = 1; chunk_size < 8; chunk_size++) {
+    EXPECT_TRUE(Parse(kJson, chunk_size));
+    EXPECT_EQ(kEvents, handler_.GetEvents());
+  }
+}
+
+TEST_F(JsonStreamParserTest, Escapes) {
+  const char kJson[] = "\"a\\\"\\\\\\/\\b\\f\\n\\r\\t\\u0041\\u00e9\\u20AC"
+                       "\\ud83d\\ude00\"";
+  for (size_t chunk_size : {0, 1, 3}) {
+    EXPECT_TRUE(Parse(kJson, chunk_size));
+    EXPECT_EQ("s:a\"\\/\b\f\n\r\tA\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80",
+              handler_.GetEvents());
+  }
+}
+
+TEST_F(JsonStreamParserTest, Errors) {
+  const char* const kInvalid[] = {
+      "", "{", "[1,]", "{\"a\" 1}", "{\"a\":1,}", "[1 2]", "01", "1.", "-",
+      "1e", "tru", "nul", "\"abc", "\"\\x\"", "\"\\u12\"", "\"\\ud83d\"",
+      "\"\\ude00\"", "\"a\nb\"", "1 2", "[}", "{1: 2}", "[[[[[1]]]]]",
+  };
+  for (const char* json : kInvalid) {
+    EXPECT_FALSE(Parse(json)) << json;
+    ASSERT_NE(nullptr, error_.get()) << json;
+    EXPECT_EQ(errors::json::kDomain, error_->GetDomain());
+    EXPECT_EQ(errors::json::kParseError, error_->GetCode());
+  }
+  // The maximum depth is fine.
+  EXPECT_TRUE(Parse("[[[[1]]]]"));
+}
+
+TEST_F(JsonStreamParserTest, ErrorOffset) {
+  EXPECT_FALSE(Parse("[1, 2, x]", 2));
+  EXPECT_EQ("Unexpected character at offset 7", error_->GetMessage());
+}
+
+TEST_F(JsonStreamParserTest, HandlerError) {
+  class FailingHandler : public RecordingHandler {
+   public:
+    bool OnKey(base::StringPiece key, ErrorPtr* error) override {
+      Error::AddTo(error, FROM_HERE, "test", "bad_key", "Bad key");
+      return false;
+    }
+  };
+  FailingHandler handler;
+  JsonStreamParser parser{&handler};
+  std::string json = "{\"a\": 1}";
+  EXPECT_FALSE(parser.Feed(json.data(), json.size(), &error_));
+  EXPECT_EQ("bad_key", error_->GetCode());
+  EXPECT_FALSE(parser.Finish(nullptr));
+}
+
+TEST_F(JsonStreamParserTest, ParseBlocking) {
+  std::string json = "[";
+  for (int i = 0; i < 2000; i++)
+    json += base::IntToString(i) + ",";
+  json += "\"end\"]";
+  auto stream = MemoryStream::OpenCopyOf(json, nullptr);
+  JsonStreamParser parser{&handler_};
+  EXPECT_TRUE(parser.ParseBlocking(stream.get(), &error_));
+  EXPECT_TRUE(parser.IsComplete());
+  std::string events = handler_.GetEvents();
+  EXPECT_EQ("[ i:0 i:1 ", events.substr(0, 10));
+  EXPECT_EQ(" i:1999 s:end ]", events.substr(events.size() - 15));
+}
+
+TEST_F(JsonStreamParserTest, ParseAsync) {
+  FakeMessageLoop loop{nullptr};
+  loop.SetAsCurrent();
+  auto stream = MemoryStream::OpenCopyOf("{\"a\": [true]}", nullptr);
+  JsonStreamParser parser{&handler_};
+  bool done = false;
+  auto on_success = [](bool* done) { *done = true; };
+  auto on_error = [](const Error* error) { ADD_FAILURE(); };
+  EXPECT_TRUE(parser.ParseAsync(stream.get(),
+                                base::Bind(on_success, &done),
+                                base::Bind(on_error),
+                                &error_));
+  loop.Run();
+  EXPECT_TRUE(done);
+  EXPECT_EQ("{ k:a [ true ] }", handler_.GetEvents());
+}
+
+TEST_F(JsonStreamParserTest, ParseAsyncError) {
+  FakeMessageLoop loop{nullptr};
+  loop.SetAsCurrent();
+  auto stream = MemoryStream::OpenCopyOf("{\"a\" 1}", nullptr);
+  JsonStreamParser parser{&handler_};
+  std::string code;
+  auto on_success = []() { ADD_FAILURE(); };
+  auto on_error = [](std::string* code, const Error* error) {
+    *code = error->GetCode();
+  };
+  EXPECT_TRUE(parser.ParseAsync(stream.get(),
+                                base::Bind(on_success),
+                                base::Bind(on_error, &code),
+                                &error_));
+  loop.Run();
+  EXPECT_EQ(errors::json::kParseError, code);
+}
+
+}  // namespace brillo
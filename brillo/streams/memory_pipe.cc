@@ -0,0 +1,369 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/memory_pipe.h>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <base/bind.h>
+#include <base/logging.h>
+#include <base/memory/weak_ptr.h>
+#include <base/posix/eintr_wrapper.h>
+#include <brillo/errors/error_codes.h>
+#include <brillo/message_loops/message_loop.h>
+#include <brillo/pointer_utils.h>
+#include <brillo/streams/stream_errors.h>
+#include <brillo/streams/stream_utils.h>
+
+namespace brillo {
+
+namespace {
+
+// Waits for the eventfd |fd| to be signaled (become readable) for up to
+// |timeout|. Returns 1 if signaled, 0 on timeout and -1 on error.
+int WaitForEvent(int fd, base::TimeDelta timeout) {
+  pollfd poll_fd{fd, POLLIN, 0};
+  int timeout_ms = -1;
+  if (timeout != base::TimeDelta::Max()) {
+    timeout_ms = static_cast<int>(std::min<int64_t>(
+        timeout.InMilliseconds(), std::numeric_limits<int>::max()));
+  }
+  return HANDLE_EINTR(poll(&poll_fd, 1, timeout_ms));
+}
+
+void SignalEvent(int fd) {
+  uint64_t value = 1;
+  if (HANDLE_EINTR(write(fd, &value, sizeof(value))) < 0)
+    PLOG(ERROR) << "Failed to signal memory pipe event";
+}
+
+void ResetEvent(int fd) {
+  uint64_t value = 0;
+  // The eventfd is non-blocking, so this fails with EAGAIN if the event
+  // wasn't signaled, which is fine.
+  ignore_result(HANDLE_EINTR(read(fd, &value, sizeof(value))));
+}
+
+// The state shared between the two ends of the pipe. |head_| and |tail_| are
+// the total number of bytes ever written to and read from the pipe. The
+// writer only ever modifies |head_| and the reader only ever modifies |tail_|
+// so the ring buffer needs no locking.
+class MemoryPipeBuffer {
+ public:
+  explicit MemoryPipeBuffer(size_t capacity) : buffer_(capacity) {
+    CHECK((capacity & (capacity - 1)) == 0) << "Capacity must be power of 2";
+  }
+
+  ~MemoryPipeBuffer() {
+    if (data_event_ >= 0)
+      IGNORE_EINTR(close(data_event_));
+    if (space_event_ >= 0)
+      IGNORE_EINTR(close(space_event_));
+  }
+
+  bool Init(ErrorPtr* error) {
+    data_event_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    space_event_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (data_event_ < 0 || space_event_ < 0) {
+      errors::system::AddSystemError(error, FROM_HERE, errno);
+      return false;
+    }
+    return true;
+  }
+
+  // Copies up to |size| bytes into the pipe. Returns the number of bytes
+  // actually written.
+  size_t Write(const void* data, size_t size) {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    uint64_t free_space = buffer_.size() - (head - tail_.load());
+    size = static_cast<size_t>(std::min<uint64_t>(size, free_space));
+    if (size == 0)
+      return 0;
+    CopyIn(head, data, size);
+    head_.store(head + size);
+    // Wake up the reader if the pipe was empty before this write and the
+    // reader might be waiting for the data.
+    if (tail_.load() == head)
+      SignalEvent(data_event_);
+    return size;
+  }
+
+  // Copies up to |size| bytes out of the pipe. Returns the number of bytes
+  // actually read.
+  size_t Read(void* data, size_t size) {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    uint64_t available = head_.load() - tail;
+    size = static_cast<size_t>(std::min<uint64_t>(size, available));
+    if (size == 0)
+      return 0;
+    CopyOut(tail, data, size);
+    tail_.store(tail + size);
+    // Wake up the writer if the pipe was full before this read.
+    if (head_.load() - tail == buffer_.size())
+      SignalEvent(space_event_);
+    return size;
+  }
+
+  bool IsEmpty() const { return head_.load() == tail_.load(); }
+  bool IsFull() const { return head_.load() - tail_.load() == buffer_.size(); }
+
+  void CloseReader() {
+    reader_closed_ = true;
+    SignalEvent(space_event_);
+  }
+
+  void CloseWriter() {
+    writer_closed_ = true;
+    SignalEvent(data_event_);
+  }
+
+  bool IsReaderClosed() const { return reader_closed_; }
+  bool IsWriterClosed() const { return writer_closed_; }
+
+  int data_event() const { return data_event_; }
+  int space_event() const { return space_event_; }
+
+ private:
+  void CopyIn(uint64_t position, const void* data, size_t size) {
+    size_t offset = static_cast<size_t>(position & (buffer_.size() - 1));
+    size_t first = std::min(size, buffer_.size() - offset);
+    std::memcpy(buffer_.data() + offset, data, first);
+    if (first < size)
+      std::memcpy(buffer_.data(), AdvancePointer(data, first), size - first);
+  }
+
+  void CopyOut(uint64_t position, void* data, size_t size) const {
+    size_t offset = static_cast<size_t>(position & (buffer_.size() - 1));
+    size_t first = std::min(size, buffer_.size() - offset);
+    std::memcpy(data, buffer_.data() + offset, first);
+    if (first < size)
+      std::memcpy(AdvancePointer(data, first), buffer_.data(), size - first);
+  }
+
+  std::vector<uint8_t> buffer_;
+  std::atomic<uint64_t> head_{0};
+  std::atomic<uint64_t> tail_{0};
+  std::atomic<bool> reader_closed_{false};
+  std::atomic<bool> writer_closed_{false};
+  // Signaled by the writer when data becomes available (or the writer closes).
+  int data_event_{-1};
+  // Signaled by the reader when space becomes available (or the reader
+  // closes).
+  int space_event_{-1};
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryPipeBuffer);
+};
+
+// One end of the memory pipe.
+class MemoryPipeStream : public Stream {
+ public:
+  MemoryPipeStream(std::shared_ptr<MemoryPipeBuffer> buffer, AccessMode mode)
+      : buffer_{std::move(buffer)}, mode_{mode} {}
+
+  ~MemoryPipeStream() override { CloseBlocking(nullptr); }
+
+  bool IsOpen() const override { return buffer_ != nullptr; }
+  bool CanRead() const override {
+    return IsOpen() && mode_ == AccessMode::READ;
+  }
+  bool CanWrite() const override {
+    return IsOpen() && mode_ == AccessMode::WRITE;
+  }
+  bool CanSeek() const override { return false; }
+  bool CanGetSize() const override { return false; }
+  uint64_t GetSize() const override { return 0; }
+  bool SetSizeBlocking(uint64_t /* size */, ErrorPtr* error) override {
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+  }
+  uint64_t GetRemainingSize() const override { return 0; }
+  uint64_t GetPosition() const override { return 0; }
+  bool Seek(int64_t /* offset */,
+            Whence /* whence */,
+            uint64_t* /* new_position */,
+            ErrorPtr* error) override {
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+  }
+
+  bool ReadNonBlocking(void* buffer,
+                       size_t size_to_read,
+                       size_t* size_read,
+                       bool* end_of_stream,
+                       ErrorPtr* error) override {
+    if (!IsOpen())
+      return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+    if (!CanRead())
+      return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+    *size_read = buffer_->Read(buffer, size_to_read);
+    if (*size_read == 0 && size_to_read > 0) {
+      // Reset the event before checking the buffer again, so that the writer
+      // adding data right now is guaranteed to signal it again.
+      ResetEvent(buffer_->data_event());
+      *size_read = buffer_->Read(buffer, size_to_read);
+    }
+    if (end_of_stream) {
+      *end_of_stream = *size_read == 0 && size_to_read > 0 &&
+                       buffer_->IsWriterClosed() && buffer_->IsEmpty();
+    }
+    return true;
+  }
+
+  bool WriteNonBlocking(const void* buffer,
+                        size_t size_to_write,
+                        size_t* size_written,
+                        ErrorPtr* error) override {
+    if (!IsOpen())
+      return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+    if (!CanWrite())
+      return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+    if (buffer_->IsReaderClosed()) {
+      errors::system::AddSystemError(error, FROM_HERE, EPIPE);
+      return false;
+    }
+
+    *size_written = buffer_->Write(buffer, size_to_write);
+    if (*size_written == 0 && size_to_write > 0) {
+      ResetEvent(buffer_->space_event());
+      *size_written = buffer_->Write(buffer, size_to_write);
+    }
+    return true;
+  }
+
+  bool FlushBlocking(ErrorPtr* error) override {
+    if (!IsOpen())
+      return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+    return true;
+  }
+
+  bool CloseBlocking(ErrorPtr* /* error */) override {
+    if (!IsOpen())
+      return true;
+    CancelPendingAsyncOperations();
+    if (mode_ == AccessMode::READ)
+      buffer_->CloseReader();
+    else
+      buffer_->CloseWriter();
+    buffer_.reset();
+    return true;
+  }
+
+  bool WaitForData(AccessMode mode,
+                   const base::Callback<void(AccessMode)>& callback,
+                   ErrorPtr* error) override {
+    if (!IsOpen())
+      return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+    if (mode != mode_)
+      return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+    MessageLoop::current()->CancelTask(watch_task_);
+    watch_task_ = MessageLoop::current()->WatchFileDescriptor(
+        FROM_HERE, GetEvent(), MessageLoop::WatchMode::kWatchRead,
+        false,  // persistent
+        base::Bind(&MemoryPipeStream::OnEventSignaled,
+                   weak_ptr_factory_.GetWeakPtr(), callback));
+    if (watch_task_ == MessageLoop::kTaskIdNull) {
+      Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                   errors::stream::kInvalidParameter,
+                   "Failed to watch the memory pipe event.");
+      return false;
+    }
+    return true;
+  }
+
+  bool WaitForDataBlocking(AccessMode in_mode,
+                           base::TimeDelta timeout,
+                           AccessMode* out_mode,
+                           ErrorPtr* error) override {
+    if (!IsOpen())
+      return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+    if (in_mode != mode_)
+      return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+    if (!IsReady()) {
+      int res = WaitForEvent(GetEvent(), timeout);
+      if (res < 0) {
+        errors::system::AddSystemError(error, FROM_HERE, errno);
+        return false;
+      }
+      if (res == 0)
+        return stream_utils::ErrorOperationTimeout(FROM_HERE, error);
+    }
+    if (out_mode)
+      *out_mode = mode_;
+    return true;
+  }
+
+  void CancelPendingAsyncOperations() override {
+    if (watch_task_ != MessageLoop::kTaskIdNull) {
+      MessageLoop::current()->CancelTask(watch_task_);
+      watch_task_ = MessageLoop::kTaskIdNull;
+    }
+    weak_ptr_factory_.InvalidateWeakPtrs();
+    Stream::CancelPendingAsyncOperations();
+  }
+
+ private:
+  // The event this end of the pipe waits on.
+  int GetEvent() const {
+    return mode_ == AccessMode::READ ? buffer_->data_event()
+                                     : buffer_->space_event();
+  }
+
+  // Checks whether a non-blocking operation would make progress right now.
+  bool IsReady() const {
+    if (mode_ == AccessMode::READ)
+      return !buffer_->IsEmpty() || buffer_->IsWriterClosed();
+    return !buffer_->IsFull() || buffer_->IsReaderClosed();
+  }
+
+  void OnEventSignaled(const base::Callback<void(AccessMode)>& callback) {
+    watch_task_ = MessageLoop::kTaskIdNull;
+    callback.Run(mode_);
+  }
+
+  std::shared_ptr<MemoryPipeBuffer> buffer_;
+  AccessMode mode_;
+  MessageLoop::TaskId watch_task_{MessageLoop::kTaskIdNull};
+
+  base::WeakPtrFactory<MemoryPipeStream> weak_ptr_factory_{this};
+  DISALLOW_COPY_AND_ASSIGN(MemoryPipeStream);
+};
+
+}  // anonymous namespace
+
+bool MemoryPipe::Create(size_t capacity,
+                        StreamPtr* read_stream,
+                        StreamPtr* write_stream,
+                        ErrorPtr* error) {
+  if (capacity == 0 || capacity > std::numeric_limits<size_t>::max() / 2) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kInvalidParameter,
+                 "Invalid memory pipe capacity");
+    return false;
+  }
+  // Round the capacity up to a power of two so that ring buffer offsets can be
+  // computed with a simple mask.
+  size_t rounded_capacity = 1;
+  while (rounded_capacity < capacity)
+    rounded_capacity <<= 1;
+
+  auto buffer = std::make_shared<MemoryPipeBuffer>(rounded_capacity);
+  if (!buffer->Init(error))
+    return false;
+
+  read_stream->reset(new MemoryPipeStream{buffer, Stream::AccessMode::READ});
+  write_stream->reset(new MemoryPipeStream{buffer, Stream::AccessMode::WRITE});
+  return true;
+}
+
+}  // namespace brillo
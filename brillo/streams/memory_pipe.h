@@ -0,0 +1,50 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_STREAMS_MEMORY_PIPE_H_
+#define LIBBRILLO_BRILLO_STREAMS_MEMORY_PIPE_H_
+
+#include <base/macros.h>
+#include <brillo/brillo_export.h>
+#include <brillo/errors/error.h>
+#include <brillo/streams/stream.h>
+
+namespace brillo {
+
+// MemoryPipe creates a pair of connected in-process streams, similar to the
+// ones obtained by wrapping the two ends of pipe(2) into FileStream, but
+// without going through the kernel for each chunk of data. Data written to
+// the write end of the pipe can be read from the read end of it.
+//
+// The data is passed through a single-producer/single-consumer lock-free ring
+// buffer, so the two ends of the pipe can be used from different threads (for
+// example, a decompressor thread writing into the pipe and an HTTP uploader
+// reading from it on the main message loop). Each end of the pipe, however,
+// must only be used from one thread at a time.
+//
+// Each end of the pipe has an eventfd used to wake up the other end when it is
+// waiting for data (or free space) to become available, so the asynchronous
+// operations of Stream (ReadAsync(), WriteAllAsync(), etc) as well as the
+// blocking ones work as usual.
+//
+// Closing the write end makes the read end report end-of-stream once all the
+// data buffered in the pipe has been read. Writing to a pipe whose read end
+// has been closed fails with EPIPE error.
+class BRILLO_EXPORT MemoryPipe {
+ public:
+  // Creates a new pipe with a ring buffer that can hold at least |capacity|
+  // bytes and returns its read and write ends in |read_stream| and
+  // |write_stream| respectively.
+  static bool Create(size_t capacity,
+                     StreamPtr* read_stream,
+                     StreamPtr* write_stream,
+                     ErrorPtr* error);
+
+ private:
+  DISALLOW_IMPLICIT_CONSTRUCTORS(MemoryPipe);
+};
+
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_STREAMS_MEMORY_PIPE_H_
@@ -0,0 +1,266 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/memory_pipe.h>
+
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <base/logging.h>
+#include <base/message_loop/message_loop.h>
+#include <base/time/time.h>
+#include <brillo/bind_lambda.h>
+#include <brillo/errors/error_codes.h>
+#include <brillo/message_loops/base_message_loop.h>
+#include <brillo/message_loops/message_loop_utils.h>
+#include <brillo/streams/file_stream.h>
+#include <brillo/streams/stream_errors.h>
+#include <gtest/gtest.h>
+
+namespace brillo {
+
+namespace {
+
+// Pushes |total_size| bytes from a producer thread through |writer| in
+// |chunk_size| chunks, reads them back from |reader| and returns the time the
+// transfer took.
+base::TimeDelta MeasureThroughput(Stream* reader,
+                                  Stream* writer,
+                                  size_t total_size,
+                                  size_t chunk_size) {
+  base::TimeTicks start = base::TimeTicks::Now();
+  std::thread producer{[writer, total_size, chunk_size]() {
+    std::vector<uint8_t> chunk(chunk_size, 'x');
+    for (size_t sent = 0; sent < total_size; sent += chunk_size)
+      EXPECT_TRUE(writer->WriteAllBlocking(chunk.data(), chunk_size, nullptr));
+    EXPECT_TRUE(writer->CloseBlocking(nullptr));
+  }};
+
+  std::vector<uint8_t> buffer(chunk_size);
+  size_t received = 0;
+  size_t size = 0;
+  while (reader->ReadBlocking(buffer.data(), buffer.size(), &size, nullptr) &&
+         size > 0) {
+    received += size;
+  }
+  producer.join();
+  EXPECT_EQ(total_size, received);
+  return base::TimeTicks::Now() - start;
+}
+
+}  // anonymous namespace
+
+class MemoryPipeTest : public testing::Test {
+ public:
+  void SetUp() override {
+    ASSERT_TRUE(MemoryPipe::Create(16, &reader_, &writer_, nullptr));
+  }
+
+ protected:
+  StreamPtr reader_;
+  StreamPtr writer_;
+};
+
+TEST_F(MemoryPipeTest, Create_InvalidCapacity) {
+  StreamPtr reader;
+  StreamPtr writer;
+  ErrorPtr error;
+  EXPECT_FALSE(MemoryPipe::Create(0, &reader, &writer, &error));
+  EXPECT_EQ(errors::stream::kInvalidParameter, error->GetCode());
+}
+
+TEST_F(MemoryPipeTest, Capabilities) {
+  EXPECT_TRUE(reader_->CanRead());
+  EXPECT_FALSE(reader_->CanWrite());
+  EXPECT_FALSE(writer_->CanRead());
+  EXPECT_TRUE(writer_->CanWrite());
+  EXPECT_FALSE(reader_->CanSeek());
+  EXPECT_FALSE(writer_->CanGetSize());
+  ErrorPtr error;
+  EXPECT_FALSE(writer_->Seek(0, Stream::Whence::FROM_BEGIN, nullptr, &error));
+  EXPECT_EQ(errors::stream::kOperationNotSupported, error->GetCode());
+}
+
+TEST_F(MemoryPipeTest, ReadWrite) {
+  size_t size = 0;
+  EXPECT_TRUE(writer_->WriteNonBlocking("hello", 5, &size, nullptr));
+  EXPECT_EQ(5u, size);
+
+  char buffer[16];
+  bool eos = true;
+  EXPECT_TRUE(reader_->ReadNonBlocking(buffer, sizeof(buffer), &size, &eos,
+                                       nullptr));
+  EXPECT_EQ("hello", std::string(buffer, size));
+  EXPECT_FALSE(eos);
+
+  // Nothing left in the pipe, but the writer is still open.
+  EXPECT_TRUE(reader_->ReadNonBlocking(buffer, sizeof(buffer), &size, &eos,
+                                       nullptr));
+  EXPECT_EQ(0u, size);
+  EXPECT_FALSE(eos);
+}
+
+TEST_F(MemoryPipeTest, WriteWhenFull) {
+  std::string data(20, 'x');
+  size_t size = 0;
+  EXPECT_TRUE(writer_->WriteNonBlocking(data.data(), data.size(), &size,
+                                        nullptr));
+  EXPECT_EQ(16u, size);
+  EXPECT_TRUE(writer_->WriteNonBlocking(data.data(), data.size(), &size,
+                                        nullptr));
+  EXPECT_EQ(0u, size);
+}
+
+TEST_F(MemoryPipeTest, WrapAround) {
+  char buffer[16];
+  size_t size = 0;
+  std::string result;
+  for (int i = 0; i < 10; i++) {
+    std::string data = "chunk#" + std::to_string(i);
+    EXPECT_TRUE(writer_->WriteAllBlocking(data.data(), data.size(), nullptr));
+    EXPECT_TRUE(reader_->ReadAllBlocking(buffer, data.size(), nullptr));
+    result.append(buffer, data.size());
+  }
+  EXPECT_EQ("chunk#0chunk#1chunk#2chunk#3chunk#4chunk#5chunk#6chunk#7chunk#8"
+            "chunk#9", result);
+  bool eos = false;
+  EXPECT_TRUE(reader_->ReadNonBlocking(buffer, sizeof(buffer), &size, &eos,
+                                       nullptr));
+  EXPECT_EQ(0u, size);
+}
+
+TEST_F(MemoryPipeTest, EndOfStream) {
+  EXPECT_TRUE(writer_->WriteAllBlocking("abc", 3, nullptr));
+  EXPECT_TRUE(writer_->CloseBlocking(nullptr));
+
+  char buffer[16];
+  size_t size = 0;
+  bool eos = true;
+  EXPECT_TRUE(reader_->ReadNonBlocking(buffer, sizeof(buffer), &size, &eos,
+                                       nullptr));
+  EXPECT_EQ("abc", std::string(buffer, size));
+  EXPECT_FALSE(eos);
+  EXPECT_TRUE(reader_->ReadNonBlocking(buffer, sizeof(buffer), &size, &eos,
+                                       nullptr));
+  EXPECT_EQ(0u, size);
+  EXPECT_TRUE(eos);
+}
+
+TEST_F(MemoryPipeTest, BrokenPipe) {
+  EXPECT_TRUE(reader_->CloseBlocking(nullptr));
+  ErrorPtr error;
+  EXPECT_FALSE(writer_->WriteAllBlocking("abc", 3, &error));
+  EXPECT_EQ(errors::system::kDomain, error->GetDomain());
+  EXPECT_EQ("EPIPE", error->GetCode());
+}
+
+TEST_F(MemoryPipeTest, WaitForDataBlocking_Timeout) {
+  ErrorPtr error;
+  EXPECT_FALSE(reader_->WaitForDataBlocking(
+      Stream::AccessMode::READ, base::TimeDelta::FromMilliseconds(10), nullptr,
+      &error));
+  EXPECT_EQ(errors::stream::kTimeout, error->GetCode());
+}
+
+TEST_F(MemoryPipeTest, ReadAsync) {
+  base::MessageLoopForIO base_loop;
+  BaseMessageLoop brillo_loop{&base_loop};
+  brillo_loop.SetAsCurrent();
+
+  bool succeeded = false;
+  bool failed = false;
+  char buffer[16];
+
+  auto success_callback = [](bool* succeeded, char* buffer, size_t size) {
+    EXPECT_EQ("abracadabra", std::string(buffer, size));
+    *succeeded = true;
+  };
+  auto error_callback = [](bool* failed, const Error* /* error */) {
+    *failed = true;
+  };
+  auto write_data_callback = [](Stream* writer) {
+    EXPECT_TRUE(writer->WriteAllBlocking("abracadabra", 11, nullptr));
+  };
+
+  // Write to the pipe with a bit of delay.
+  brillo_loop.PostDelayedTask(
+      FROM_HERE,
+      base::Bind(write_data_callback, base::Unretained(writer_.get())),
+      base::TimeDelta::FromMilliseconds(10));
+
+  EXPECT_TRUE(
+      reader_->ReadAsync(buffer,
+                         sizeof(buffer),
+                         base::Bind(success_callback,
+                                    base::Unretained(&succeeded),
+                                    base::Unretained(buffer)),
+                         base::Bind(error_callback, base::Unretained(&failed)),
+                         nullptr));
+
+  auto end_condition = [](bool* failed, bool* succeeded) {
+    return *failed || *succeeded;
+  };
+  MessageLoopRunUntil(&brillo_loop,
+                      base::TimeDelta::FromSeconds(1),
+                      base::Bind(end_condition,
+                                 base::Unretained(&failed),
+                                 base::Unretained(&succeeded)));
+
+  EXPECT_TRUE(succeeded);
+  EXPECT_FALSE(failed);
+}
+
+TEST_F(MemoryPipeTest, CrossThread) {
+  // Push much more data than the pipe can hold through it from another
+  // thread to exercise the wake-ups in both directions.
+  std::vector<uint8_t> data(64 * 1024);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<uint8_t>(i * 7);
+
+  std::thread producer{[this, &data]() {
+    EXPECT_TRUE(writer_->WriteAllBlocking(data.data(), data.size(), nullptr));
+    EXPECT_TRUE(writer_->CloseBlocking(nullptr));
+  }};
+
+  std::vector<uint8_t> received;
+  uint8_t buffer[10];
+  size_t size = 0;
+  while (reader_->ReadBlocking(buffer, sizeof(buffer), &size, nullptr) &&
+         size > 0) {
+    received.insert(received.end(), buffer, buffer + size);
+  }
+  producer.join();
+  EXPECT_EQ(data, received);
+}
+
+// Compares the throughput of MemoryPipe with the one of pipe(2) wrapped in
+// FileStream. Run with --gtest_also_run_disabled_tests.
+TEST(MemoryPipe, DISABLED_Benchmark) {
+  const size_t kTotalSize = 1024 * 1024 * 1024;
+  const size_t kChunkSize = 64 * 1024;
+
+  StreamPtr reader;
+  StreamPtr writer;
+  ASSERT_TRUE(MemoryPipe::Create(1024 * 1024, &reader, &writer, nullptr));
+  base::TimeDelta memory_pipe_time =
+      MeasureThroughput(reader.get(), writer.get(), kTotalSize, kChunkSize);
+
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  reader = FileStream::FromFileDescriptor(fds[0], true, nullptr);
+  writer = FileStream::FromFileDescriptor(fds[1], true, nullptr);
+  ASSERT_NE(nullptr, reader);
+  ASSERT_NE(nullptr, writer);
+  base::TimeDelta os_pipe_time =
+      MeasureThroughput(reader.get(), writer.get(), kTotalSize, kChunkSize);
+
+  LOG(INFO) << "1 GiB in 64 KiB chunks: MemoryPipe "
+            << memory_pipe_time.InMilliseconds() << " ms, pipe(2) "
+            << os_pipe_time.InMilliseconds() << " ms";
+}
+
+}  // namespace brillo
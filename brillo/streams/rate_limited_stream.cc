@@ -0,0 +1,350 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/rate_limited_stream.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <base/bind.h>
+#include <base/threading/platform_thread.h>
+#include <base/time/default_clock.h>
+#include <brillo/streams/stream_errors.h>
+#include <brillo/streams/stream_utils.h>
+
+namespace brillo {
+
+namespace {
+
+// Minimum interval between throttled transfers. Waking up for every byte of
+// a slow stream is wasteful, so wait until at least this much worth of tokens
+// is accumulated (but never more than the burst size of the bucket).
+const int64_t kMinRefillIntervalMs = 10;
+
+}  // anonymous namespace
+
+TokenBucket::TokenBucket(uint64_t bytes_per_second,
+                         uint64_t burst_size,
+                         base::Clock* clock)
+    : clock_{clock} {
+  if (!clock_) {
+    default_clock_.reset(new base::DefaultClock);
+    clock_ = default_clock_.get();
+  }
+  last_refill_ = clock_->Now();
+  SetRate(bytes_per_second, burst_size);
+  // Start with a full bucket.
+  tokens_ = static_cast<double>(burst_size_);
+}
+
+TokenBucket::~TokenBucket() = default;
+
+void TokenBucket::SetRate(uint64_t bytes_per_second, uint64_t burst_size) {
+  // Account for the tokens accumulated at the old rate first.
+  Refill();
+  bytes_per_second_ = bytes_per_second;
+  burst_size_ = burst_size ? burst_size : bytes_per_second;
+  tokens_ = std::min(tokens_, static_cast<double>(burst_size_));
+}
+
+size_t TokenBucket::GetAvailable(size_t size) {
+  if (IsUnlimited())
+    return size;
+  Refill();
+  if (tokens_ < 1.0)
+    return 0;
+  return static_cast<size_t>(
+      std::min(static_cast<double>(size), std::floor(tokens_)));
+}
+
+void TokenBucket::Consume(size_t size) {
+  if (IsUnlimited())
+    return;
+  Refill();
+  // The transfers are capped by GetAvailable(), so the bucket never goes into
+  // debt. Once it is empty, GetAvailable() returns 0 and the next transfer is
+  // deferred until GetDelayUntilAvailable() has passed.
+  tokens_ = std::max(tokens_ - static_cast<double>(size), 0.0);
+}
+
+base::TimeDelta TokenBucket::GetDelayUntilAvailable() {
+  if (IsUnlimited())
+    return base::TimeDelta();
+  Refill();
+  if (tokens_ >= 1.0)
+    return base::TimeDelta();
+  double min_chunk = static_cast<double>(bytes_per_second_) *
+                     kMinRefillIntervalMs / 1000.0;
+  double target = std::max(1.0, std::min(min_chunk,
+                                         static_cast<double>(burst_size_)));
+  double seconds = (target - tokens_) / bytes_per_second_;
+  return base::TimeDelta::FromMicroseconds(static_cast<int64_t>(
+      std::ceil(seconds * base::Time::kMicrosecondsPerSecond)));
+}
+
+void TokenBucket::Refill() {
+  base::Time now = clock_->Now();
+  if (!IsUnlimited() && now > last_refill_) {
+    double elapsed = (now - last_refill_).InSecondsF();
+    tokens_ = std::min(tokens_ + elapsed * bytes_per_second_,
+                       static_cast<double>(burst_size_));
+  }
+  last_refill_ = now;
+}
+
+RateLimitedStream::RateLimitedStream(StreamPtr stream,
+                                     std::shared_ptr<TokenBucket> read_bucket,
+                                     std::shared_ptr<TokenBucket> write_bucket)
+    : stream_{std::move(stream)},
+      read_bucket_{std::move(read_bucket)},
+      write_bucket_{std::move(write_bucket)} {}
+
+StreamPtr RateLimitedStream::Create(StreamPtr stream,
+                                    std::shared_ptr<TokenBucket> read_bucket,
+                                    std::shared_ptr<TokenBucket> write_bucket,
+                                    ErrorPtr* error) {
+  StreamPtr result;
+  if (!stream || !stream->IsOpen()) {
+    stream_utils::ErrorStreamClosed(FROM_HERE, error);
+    return result;
+  }
+  result.reset(new RateLimitedStream{std::move(stream), std::move(read_bucket),
+                                     std::move(write_bucket)});
+  return result;
+}
+
+bool RateLimitedStream::IsOpen() const {
+  return stream_ && stream_->IsOpen();
+}
+
+bool RateLimitedStream::CanRead() const {
+  return stream_ && stream_->CanRead();
+}
+
+bool RateLimitedStream::CanWrite() const {
+  return stream_ && stream_->CanWrite();
+}
+
+bool RateLimitedStream::CanSeek() const {
+  return stream_ && stream_->CanSeek();
+}
+
+bool RateLimitedStream::CanGetSize() const {
+  return stream_ && stream_->CanGetSize();
+}
+
+uint64_t RateLimitedStream::GetSize() const {
+  return stream_ ? stream_->GetSize() : 0;
+}
+
+bool RateLimitedStream::SetSizeBlocking(uint64_t size, ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  return stream_->SetSizeBlocking(size, error);
+}
+
+uint64_t RateLimitedStream::GetRemainingSize() const {
+  return stream_ ? stream_->GetRemainingSize() : 0;
+}
+
+uint64_t RateLimitedStream::GetPosition() const {
+  return stream_ ? stream_->GetPosition() : 0;
+}
+
+bool RateLimitedStream::Seek(int64_t offset,
+                             Whence whence,
+                             uint64_t* new_position,
+                             ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  return stream_->Seek(offset, whence, new_position, error);
+}
+
+bool RateLimitedStream::ReadNonBlocking(void* buffer,
+                                        size_t size_to_read,
+                                        size_t* size_read,
+                                        bool* end_of_stream,
+                                        ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (read_bucket_ && size_to_read > 0) {
+    size_to_read = read_bucket_->GetAvailable(size_to_read);
+    if (size_to_read == 0) {
+      // Out of tokens, pretend the read would block.
+      *size_read = 0;
+      if (end_of_stream)
+        *end_of_stream = false;
+      return true;
+    }
+  }
+
+  if (!stream_->ReadNonBlocking(buffer, size_to_read, size_read, end_of_stream,
+                                error)) {
+    return false;
+  }
+  if (read_bucket_)
+    read_bucket_->Consume(*size_read);
+  return true;
+}
+
+bool RateLimitedStream::WriteNonBlocking(const void* buffer,
+                                         size_t size_to_write,
+                                         size_t* size_written,
+                                         ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (write_bucket_ && size_to_write > 0) {
+    size_to_write = write_bucket_->GetAvailable(size_to_write);
+    if (size_to_write == 0) {
+      // Out of tokens, pretend the write would block.
+      *size_written = 0;
+      return true;
+    }
+  }
+
+  if (!stream_->WriteNonBlocking(buffer, size_to_write, size_written, error))
+    return false;
+  if (write_bucket_)
+    write_bucket_->Consume(*size_written);
+  return true;
+}
+
+bool RateLimitedStream::FlushBlocking(ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  return stream_->FlushBlocking(error);
+}
+
+bool RateLimitedStream::CloseBlocking(ErrorPtr* error) {
+  CancelPendingAsyncOperations();
+  if (stream_ && !stream_->CloseBlocking(error))
+    return false;
+  stream_.reset();
+  return true;
+}
+
+bool RateLimitedStream::WaitForData(
+    AccessMode mode,
+    const base::Callback<void(AccessMode)>& callback,
+    ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  bool read_throttled = false;
+  bool write_throttled = false;
+  base::TimeDelta delay = GetThrottleDelay(mode, &read_throttled,
+                                           &write_throttled);
+  bool wait_read = stream_utils::IsReadAccessMode(mode) && !read_throttled;
+  bool wait_write = stream_utils::IsWriteAccessMode(mode) && !write_throttled;
+  if (wait_read || wait_write) {
+    return stream_->WaitForData(
+        stream_utils::MakeAccessMode(wait_read, wait_write), callback, error);
+  }
+
+  // All the requested operations are throttled. Come back when the bucket has
+  // been refilled. The caller will then retry the operation which in turn
+  // waits on the underlying stream if there is no data available yet.
+  // Reads and writes are waited for independently, the same way FileStream
+  // does, so a throttled write doesn't cancel a pending throttled read.
+  bool is_read = stream_utils::IsReadAccessMode(mode);
+  bool is_write = stream_utils::IsWriteAccessMode(mode);
+  if (is_read)
+    CancelThrottleTask(&read_throttle_task_);
+  if (is_write)
+    CancelThrottleTask(&write_throttle_task_);
+  MessageLoop::TaskId task_id = MessageLoop::current()->PostDelayedTask(
+      FROM_HERE,
+      base::Bind(&RateLimitedStream::OnThrottleDelayExpired,
+                 weak_ptr_factory_.GetWeakPtr(), mode, callback),
+      delay);
+  if (is_read)
+    read_throttle_task_ = task_id;
+  if (is_write)
+    write_throttle_task_ = task_id;
+  return true;
+}
+
+bool RateLimitedStream::WaitForDataBlocking(AccessMode in_mode,
+                                            base::TimeDelta timeout,
+                                            AccessMode* out_mode,
+                                            ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  bool read_throttled = false;
+  bool write_throttled = false;
+  base::TimeDelta delay = GetThrottleDelay(in_mode, &read_throttled,
+                                           &write_throttled);
+  bool wait_read = stream_utils::IsReadAccessMode(in_mode) && !read_throttled;
+  bool wait_write =
+      stream_utils::IsWriteAccessMode(in_mode) && !write_throttled;
+  if (wait_read || wait_write) {
+    return stream_->WaitForDataBlocking(
+        stream_utils::MakeAccessMode(wait_read, wait_write), timeout, out_mode,
+        error);
+  }
+
+  if (delay > timeout) {
+    base::PlatformThread::Sleep(timeout);
+    return stream_utils::ErrorOperationTimeout(FROM_HERE, error);
+  }
+  base::PlatformThread::Sleep(delay);
+  if (timeout != base::TimeDelta::Max())
+    timeout -= delay;
+  return stream_->WaitForDataBlocking(in_mode, timeout, out_mode, error);
+}
+
+void RateLimitedStream::CancelPendingAsyncOperations() {
+  CancelThrottleTask(&read_throttle_task_);
+  CancelThrottleTask(&write_throttle_task_);
+  weak_ptr_factory_.InvalidateWeakPtrs();
+  if (stream_)
+    stream_->CancelPendingAsyncOperations();
+  Stream::CancelPendingAsyncOperations();
+}
+
+base::TimeDelta RateLimitedStream::GetThrottleDelay(AccessMode mode,
+                                                    bool* read_throttled,
+                                                    bool* write_throttled) {
+  base::TimeDelta delay = base::TimeDelta::Max();
+  *read_throttled = false;
+  *write_throttled = false;
+  if (stream_utils::IsReadAccessMode(mode) && read_bucket_) {
+    base::TimeDelta read_delay = read_bucket_->GetDelayUntilAvailable();
+    *read_throttled = read_delay > base::TimeDelta();
+    delay = std::min(delay, read_delay);
+  }
+  if (stream_utils::IsWriteAccessMode(mode) && write_bucket_) {
+    base::TimeDelta write_delay = write_bucket_->GetDelayUntilAvailable();
+    *write_throttled = write_delay > base::TimeDelta();
+    delay = std::min(delay, write_delay);
+  }
+  return delay;
+}
+
+void RateLimitedStream::OnThrottleDelayExpired(
+    AccessMode mode,
+    const base::Callback<void(AccessMode)>& callback) {
+  if (stream_utils::IsReadAccessMode(mode))
+    read_throttle_task_ = MessageLoop::kTaskIdNull;
+  if (stream_utils::IsWriteAccessMode(mode))
+    write_throttle_task_ = MessageLoop::kTaskIdNull;
+  callback.Run(mode);
+}
+
+void RateLimitedStream::CancelThrottleTask(MessageLoop::TaskId* task_id) {
+  MessageLoop::TaskId id = *task_id;
+  if (id == MessageLoop::kTaskIdNull)
+    return;
+  MessageLoop::current()->CancelTask(id);
+  // A READ_WRITE wait is tracked by both directions.
+  if (read_throttle_task_ == id)
+    read_throttle_task_ = MessageLoop::kTaskIdNull;
+  if (write_throttle_task_ == id)
+    write_throttle_task_ = MessageLoop::kTaskIdNull;
+}
+
+}  // namespace brillo
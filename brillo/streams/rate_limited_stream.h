@@ -0,0 +1,173 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_STREAMS_RATE_LIMITED_STREAM_H_
+#define LIBBRILLO_BRILLO_STREAMS_RATE_LIMITED_STREAM_H_
+
+#include <memory>
+
+#include <base/macros.h>
+#include <base/memory/weak_ptr.h>
+#include <base/time/clock.h>
+#include <base/time/time.h>
+#include <brillo/brillo_export.h>
+#include <brillo/message_loops/message_loop.h>
+#include <brillo/streams/stream.h>
+
+namespace brillo {
+
+// TokenBucket implements the token bucket algorithm used to limit the
+// throughput of one or more RateLimitedStream instances. The bucket holds up
+// to |burst_size| bytes worth of tokens and is refilled at the rate of
+// |bytes_per_second|. A single bucket can be shared between many streams to
+// enforce a common (global) bandwidth budget.
+// The rate can be changed at any time by calling SetRate(), for example to
+// back off when the foreground activity is high.
+class BRILLO_EXPORT TokenBucket {
+ public:
+  // Creates a token bucket. Setting |bytes_per_second| to 0 disables the limit.
+  // If |burst_size| is 0, one second worth of tokens is used as the burst
+  // size. |clock| is used to obtain the current time and must outlive the
+  // bucket. If |clock| is nullptr, the system clock is used.
+  TokenBucket(uint64_t bytes_per_second,
+              uint64_t burst_size,
+              base::Clock* clock);
+  ~TokenBucket();
+
+  // Changes the refill rate and the burst size of the bucket. The tokens
+  // accumulated so far are kept (but capped at the new |burst_size|).
+  void SetRate(uint64_t bytes_per_second, uint64_t burst_size);
+  uint64_t GetRate() const { return bytes_per_second_; }
+  uint64_t GetBurstSize() const { return burst_size_; }
+  bool IsUnlimited() const { return bytes_per_second_ == 0; }
+
+  // Returns the number of bytes (up to |size|) that can be transferred right
+  // now without exceeding the rate limit.
+  size_t GetAvailable(size_t size);
+
+  // Removes |size| bytes worth of tokens from the bucket.
+  void Consume(size_t size);
+
+  // Returns the amount of time to wait until enough tokens accumulate in the
+  // bucket for the next transfer. Returns zero delay if tokens are available
+  // right away.
+  base::TimeDelta GetDelayUntilAvailable();
+
+ private:
+  // Adds tokens accumulated since the last refill.
+  void Refill();
+
+  uint64_t bytes_per_second_{0};
+  uint64_t burst_size_{0};
+  double tokens_{0.0};
+  base::Time last_refill_;
+  base::Clock* clock_{nullptr};
+  std::unique_ptr<base::Clock> default_clock_;
+
+  DISALLOW_COPY_AND_ASSIGN(TokenBucket);
+};
+
+// RateLimitedStream is a stream decorator that passes all the operations
+// through to an underlying stream while limiting the read and/or write
+// throughput using token buckets. When the bucket is exhausted, non-blocking
+// I/O operations return zero bytes as if the underlying stream would block,
+// and WaitForData() delays the notification on the current MessageLoop until
+// more tokens are available, so asynchronous operations such as ReadAsync()
+// are delayed instead of busy-waiting.
+class BRILLO_EXPORT RateLimitedStream : public Stream {
+ public:
+  // Creates a rate-limited stream on top of |stream|. Reads are limited by
+  // |read_bucket| and writes by |write_bucket|. Either bucket could be nullptr
+  // in which case the corresponding direction is not limited. The same bucket
+  // may be used for both directions and/or shared with other streams.
+  static StreamPtr Create(StreamPtr stream,
+                          std::shared_ptr<TokenBucket> read_bucket,
+                          std::shared_ptr<TokenBucket> write_bucket,
+                          ErrorPtr* error);
+
+  // == Stream capabilities ===================================================
+  bool IsOpen() const override;
+  bool CanRead() const override;
+  bool CanWrite() const override;
+  bool CanSeek() const override;
+  bool CanGetSize() const override;
+
+  // == Stream size operations ================================================
+  uint64_t GetSize() const override;
+  bool SetSizeBlocking(uint64_t size, ErrorPtr* error) override;
+  uint64_t GetRemainingSize() const override;
+
+  // == Seek operations =======================================================
+  uint64_t GetPosition() const override;
+  bool Seek(int64_t offset,
+            Whence whence,
+            uint64_t* new_position,
+            ErrorPtr* error) override;
+
+  // == Read operations =======================================================
+  bool ReadNonBlocking(void* buffer,
+                       size_t size_to_read,
+                       size_t* size_read,
+                       bool* end_of_stream,
+                       ErrorPtr* error) override;
+
+  // == Write operations ======================================================
+  bool WriteNonBlocking(const void* buffer,
+                        size_t size_to_write,
+                        size_t* size_written,
+                        ErrorPtr* error) override;
+
+  // == Finalizing/closing streams  ===========================================
+  bool FlushBlocking(ErrorPtr* error) override;
+  bool CloseBlocking(ErrorPtr* error) override;
+
+  // == Data availability monitoring ==========================================
+  bool WaitForData(AccessMode mode,
+                   const base::Callback<void(AccessMode)>& callback,
+                   ErrorPtr* error) override;
+
+  bool WaitForDataBlocking(AccessMode in_mode,
+                           base::TimeDelta timeout,
+                           AccessMode* out_mode,
+                           ErrorPtr* error) override;
+
+  void CancelPendingAsyncOperations() override;
+
+ private:
+  // Internal constructor used by the Create() factory method.
+  RateLimitedStream(StreamPtr stream,
+                    std::shared_ptr<TokenBucket> read_bucket,
+                    std::shared_ptr<TokenBucket> write_bucket);
+
+  // Checks which of the directions requested in |mode| are currently out of
+  // tokens, setting |read_throttled| and |write_throttled| accordingly, and
+  // returns the time until the earliest of them is allowed again.
+  base::TimeDelta GetThrottleDelay(AccessMode mode,
+                                   bool* read_throttled,
+                                   bool* write_throttled);
+
+  // Called when the rate limit delay for WaitForData() expires.
+  void OnThrottleDelayExpired(AccessMode mode,
+                              const base::Callback<void(AccessMode)>& callback);
+
+  // Cancels the throttle task |task_id| (one of |read_throttle_task_| and
+  // |write_throttle_task_|) if it is pending.
+  void CancelThrottleTask(MessageLoop::TaskId* task_id);
+
+  StreamPtr stream_;
+  std::shared_ptr<TokenBucket> read_bucket_;
+  std::shared_ptr<TokenBucket> write_bucket_;
+
+  // The delayed tasks used to resume WaitForData() after throttling, one per
+  // direction.
+  MessageLoop::TaskId read_throttle_task_{MessageLoop::kTaskIdNull};
+  MessageLoop::TaskId write_throttle_task_{MessageLoop::kTaskIdNull};
+
+  base::WeakPtrFactory<RateLimitedStream> weak_ptr_factory_{this};
+  DISALLOW_COPY_AND_ASSIGN(RateLimitedStream);
+};
+
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_STREAMS_RATE_LIMITED_STREAM_H_
@@ -0,0 +1,207 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/rate_limited_stream.h>
+
+#include <string>
+#include <vector>
+
+#include <base/bind.h>
+#include <base/test/simple_test_clock.h>
+#include <gtest/gtest.h>
+
+#include <brillo/bind_lambda.h>
+#include <brillo/message_loops/fake_message_loop.h>
+#include <brillo/streams/memory_stream.h>
+
+namespace brillo {
+
+class RateLimitedStreamTest : public testing::Test {
+ public:
+  void SetUp() override {
+    loop_.SetAsCurrent();
+    data_.resize(1000);
+    for (size_t i = 0; i < data_.size(); i++)
+      data_[i] = static_cast<char>(i % 251);
+  }
+
+  void TearDown() override {
+    EXPECT_FALSE(loop_.PendingTasks());
+  }
+
+  std::shared_ptr<TokenBucket> CreateBucket(uint64_t rate, uint64_t burst) {
+    return std::make_shared<TokenBucket>(rate, burst, &clock_);
+  }
+
+  base::SimpleTestClock clock_;
+  FakeMessageLoop loop_{&clock_};
+  std::string data_;
+};
+
+TEST_F(RateLimitedStreamTest, TokenBucket) {
+  TokenBucket bucket{100, 100, &clock_};
+  EXPECT_EQ(100, bucket.GetAvailable(150));
+  EXPECT_EQ(50, bucket.GetAvailable(50));
+  EXPECT_EQ(base::TimeDelta(), bucket.GetDelayUntilAvailable());
+  bucket.Consume(100);
+  EXPECT_EQ(0, bucket.GetAvailable(150));
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(10),
+            bucket.GetDelayUntilAvailable());
+  clock_.Advance(base::TimeDelta::FromMilliseconds(500));
+  EXPECT_EQ(50, bucket.GetAvailable(150));
+  // The bucket doesn't fill up past its burst size.
+  clock_.Advance(base::TimeDelta::FromSeconds(10));
+  EXPECT_EQ(100, bucket.GetAvailable(1000));
+}
+
+TEST_F(RateLimitedStreamTest, TokenBucketSetRate) {
+  TokenBucket bucket{100, 0, &clock_};
+  EXPECT_EQ(100, bucket.GetBurstSize());
+  bucket.Consume(100);
+  bucket.SetRate(1000, 500);
+  EXPECT_EQ(1000, bucket.GetRate());
+  clock_.Advance(base::TimeDelta::FromMilliseconds(100));
+  EXPECT_EQ(100, bucket.GetAvailable(1000));
+  bucket.SetRate(0, 0);
+  EXPECT_TRUE(bucket.IsUnlimited());
+  EXPECT_EQ(12345, bucket.GetAvailable(12345));
+  EXPECT_EQ(base::TimeDelta(), bucket.GetDelayUntilAvailable());
+}
+
+TEST_F(RateLimitedStreamTest, ReadNonBlocking) {
+  auto stream = RateLimitedStream::Create(
+      MemoryStream::OpenCopyOf(data_, nullptr), CreateBucket(100, 100),
+      nullptr, nullptr);
+  ASSERT_NE(nullptr, stream);
+
+  std::vector<char> buffer(1000);
+  size_t size_read = 0;
+  bool eos = true;
+  EXPECT_TRUE(stream->ReadNonBlocking(buffer.data(), buffer.size(), &size_read,
+                                      &eos, nullptr));
+  EXPECT_EQ(100, size_read);
+  EXPECT_FALSE(eos);
+
+  EXPECT_TRUE(stream->ReadNonBlocking(buffer.data(), buffer.size(), &size_read,
+                                      &eos, nullptr));
+  EXPECT_EQ(0, size_read);
+  EXPECT_FALSE(eos);
+
+  clock_.Advance(base::TimeDelta::FromMilliseconds(250));
+  EXPECT_TRUE(stream->ReadNonBlocking(buffer.data(), buffer.size(), &size_read,
+                                      &eos, nullptr));
+  EXPECT_EQ(25, size_read);
+  EXPECT_EQ(125, stream->GetPosition());
+}
+
+TEST_F(RateLimitedStreamTest, WriteNonBlocking) {
+  std::string output;
+  auto stream = RateLimitedStream::Create(
+      MemoryStream::CreateRef(&output, nullptr), nullptr,
+      CreateBucket(200, 50), nullptr);
+  ASSERT_NE(nullptr, stream);
+
+  size_t size_written = 0;
+  EXPECT_TRUE(stream->WriteNonBlocking(data_.data(), data_.size(),
+                                       &size_written, nullptr));
+  EXPECT_EQ(50, size_written);
+  EXPECT_TRUE(stream->WriteNonBlocking(data_.data(), data_.size(),
+                                       &size_written, nullptr));
+  EXPECT_EQ(0, size_written);
+  EXPECT_EQ(data_.substr(0, 50), output);
+}
+
+TEST_F(RateLimitedStreamTest, ReadAllAsyncIsDelayed) {
+  auto stream = RateLimitedStream::Create(
+      MemoryStream::OpenCopyOf(data_, nullptr), CreateBucket(100, 100),
+      nullptr, nullptr);
+  ASSERT_NE(nullptr, stream);
+
+  base::Time start = clock_.Now();
+  std::vector<char> buffer(300);
+  bool done = false;
+  auto success_callback = [](bool* done) { *done = true; };
+  auto error_callback = [](const Error* /* error */) { FAIL(); };
+  EXPECT_TRUE(stream->ReadAllAsync(
+      buffer.data(), buffer.size(),
+      base::Bind(success_callback, base::Unretained(&done)),
+      base::Bind(error_callback), nullptr));
+  loop_.Run();
+  EXPECT_TRUE(done);
+  EXPECT_EQ(data_.substr(0, 300), std::string(buffer.begin(), buffer.end()));
+  // The first 100 bytes are available right away, the remaining 200 bytes
+  // take two seconds to accumulate.
+  EXPECT_LE(base::TimeDelta::FromSeconds(2), clock_.Now() - start);
+  EXPECT_GT(base::TimeDelta::FromSeconds(3), clock_.Now() - start);
+}
+
+TEST_F(RateLimitedStreamTest, ConcurrentThrottledReadAndWrite) {
+  std::string output;
+  auto read_bucket = CreateBucket(100, 100);
+  auto write_bucket = CreateBucket(100, 100);
+  auto stream = RateLimitedStream::Create(
+      MemoryStream::CreateRef(&output, nullptr), read_bucket, write_bucket,
+      nullptr);
+  ASSERT_NE(nullptr, stream);
+  read_bucket->Consume(100);
+  write_bucket->Consume(100);
+
+  std::vector<Stream::AccessMode> modes;
+  auto callback = [&modes](Stream::AccessMode mode) { modes.push_back(mode); };
+  EXPECT_TRUE(stream->WaitForData(Stream::AccessMode::READ,
+                                  base::Bind(callback), nullptr));
+  EXPECT_TRUE(stream->WaitForData(Stream::AccessMode::WRITE,
+                                  base::Bind(callback), nullptr));
+  loop_.Run();
+  // Waiting for the write must not have dropped the pending read.
+  EXPECT_EQ((std::vector<Stream::AccessMode>{Stream::AccessMode::READ,
+                                             Stream::AccessMode::WRITE}),
+            modes);
+}
+
+TEST_F(RateLimitedStreamTest, SharedBucket) {
+  auto bucket = CreateBucket(100, 100);
+  auto stream1 = RateLimitedStream::Create(
+      MemoryStream::OpenCopyOf(data_, nullptr), bucket, nullptr, nullptr);
+  auto stream2 = RateLimitedStream::Create(
+      MemoryStream::OpenCopyOf(data_, nullptr), bucket, nullptr, nullptr);
+
+  std::vector<char> buffer(60);
+  size_t size_read = 0;
+  EXPECT_TRUE(stream1->ReadNonBlocking(buffer.data(), buffer.size(),
+                                       &size_read, nullptr, nullptr));
+  EXPECT_EQ(60, size_read);
+  EXPECT_TRUE(stream2->ReadNonBlocking(buffer.data(), buffer.size(),
+                                       &size_read, nullptr, nullptr));
+  EXPECT_EQ(40, size_read);
+  EXPECT_TRUE(stream1->ReadNonBlocking(buffer.data(), buffer.size(),
+                                       &size_read, nullptr, nullptr));
+  EXPECT_EQ(0, size_read);
+
+  // Lifting the limit at runtime affects all the streams sharing the bucket.
+  bucket->SetRate(0, 0);
+  EXPECT_TRUE(stream1->ReadNonBlocking(buffer.data(), buffer.size(),
+                                       &size_read, nullptr, nullptr));
+  EXPECT_EQ(60, size_read);
+  EXPECT_TRUE(stream2->ReadNonBlocking(buffer.data(), buffer.size(),
+                                       &size_read, nullptr, nullptr));
+  EXPECT_EQ(60, size_read);
+}
+
+TEST_F(RateLimitedStreamTest, CloseBlocking) {
+  auto stream = RateLimitedStream::Create(
+      MemoryStream::OpenCopyOf(data_, nullptr), CreateBucket(100, 100),
+      nullptr, nullptr);
+  EXPECT_TRUE(stream->IsOpen());
+  EXPECT_TRUE(stream->CloseBlocking(nullptr));
+  EXPECT_FALSE(stream->IsOpen());
+  char buffer[10];
+  size_t size_read = 0;
+  ErrorPtr error;
+  EXPECT_FALSE(stream->ReadNonBlocking(buffer, sizeof(buffer), &size_read,
+                                       nullptr, &error));
+  EXPECT_NE(nullptr, error);
+}
+
+}  // namespace brillo
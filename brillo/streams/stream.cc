@@ -14,6 +14,11 @@
 
 namespace brillo {
 
+Stream::~Stream() {
+  if (stats_)
+    StreamRegistry::GetInstance()->Unregister(this);
+}
+
 bool Stream::TruncateBlocking(ErrorPtr* error) {
   return SetSizeBlocking(GetPosition(), error);
 }
@@ -36,11 +41,17 @@ bool Stream::ReadAsync(void* buffer,
     return false;
   }
 
-  auto callback = base::Bind(&Stream::IgnoreEOSCallback, success_callback);
+  base::Callback<void(size_t)> callback = success_callback;
+  if (stats_) {
+    callback = base::Bind(&Stream::OnAsyncOperationDone,
+                          weak_ptr_factory_.GetWeakPtr(), AccessMode::READ,
+                          base::TimeTicks::Now(), success_callback);
+  }
+  auto eos_callback = base::Bind(&Stream::IgnoreEOSCallback, callback);
   // If we can read some data right away non-blocking we should still run the
   // callback from the main loop, so we pass true here for force_async_callback.
-  return ReadAsyncImpl(buffer, size_to_read, callback, error_callback, error,
-                       true);
+  return ReadAsyncImpl(buffer, size_to_read, eos_callback, error_callback,
+                       error, true);
 }
 
 bool Stream::ReadAllAsync(void* buffer,
@@ -55,9 +66,15 @@ bool Stream::ReadAllAsync(void* buffer,
     return false;
   }
 
+  base::Closure done_callback = success_callback;
+  if (stats_) {
+    done_callback = base::Bind(&Stream::OnAsyncAllOperationDone,
+                               weak_ptr_factory_.GetWeakPtr(), AccessMode::READ,
+                               base::TimeTicks::Now(), success_callback);
+  }
   auto callback = base::Bind(&Stream::ReadAllAsyncCallback,
                              weak_ptr_factory_.GetWeakPtr(), buffer,
-                             size_to_read, success_callback, error_callback);
+                             size_to_read, done_callback, error_callback);
   return ReadAsyncImpl(buffer, size_to_read, callback, error_callback, error,
                        true);
 }
@@ -71,13 +88,18 @@ bool Stream::ReadBlocking(void* buffer,
     if (!ReadNonBlocking(buffer, size_to_read, size_read, &eos, error))
       return false;
 
+    RecordTransfer(AccessMode::READ, *size_read, *size_read == 0 && !eos);
     if (*size_read > 0 || eos)
       break;
 
+    base::TimeTicks wait_start;
+    if (stats_)
+      wait_start = base::TimeTicks::Now();
     if (!WaitForDataBlocking(AccessMode::READ, base::TimeDelta::Max(), nullptr,
                              error)) {
       return false;
     }
+    RecordWaitTime(AccessMode::READ, wait_start);
   }
   return true;
 }
@@ -110,10 +132,16 @@ bool Stream::WriteAsync(const void* buffer,
                  "Another asynchronous operation is still pending");
     return false;
   }
+  base::Callback<void(size_t)> callback = success_callback;
+  if (stats_) {
+    callback = base::Bind(&Stream::OnAsyncOperationDone,
+                          weak_ptr_factory_.GetWeakPtr(), AccessMode::WRITE,
+                          base::TimeTicks::Now(), success_callback);
+  }
   // If we can read some data right away non-blocking we should still run the
   // callback from the main loop, so we pass true here for force_async_callback.
-  return WriteAsyncImpl(buffer, size_to_write, success_callback, error_callback,
-                        error, true);
+  return WriteAsyncImpl(buffer, size_to_write, callback, error_callback, error,
+                        true);
 }
 
 bool Stream::WriteAllAsync(const void* buffer,
@@ -128,9 +156,16 @@ bool Stream::WriteAllAsync(const void* buffer,
     return false;
   }
 
+  base::Closure done_callback = success_callback;
+  if (stats_) {
+    done_callback = base::Bind(&Stream::OnAsyncAllOperationDone,
+                               weak_ptr_factory_.GetWeakPtr(),
+                               AccessMode::WRITE, base::TimeTicks::Now(),
+                               success_callback);
+  }
   auto callback = base::Bind(&Stream::WriteAllAsyncCallback,
                              weak_ptr_factory_.GetWeakPtr(), buffer,
-                             size_to_write, success_callback, error_callback);
+                             size_to_write, done_callback, error_callback);
   return WriteAsyncImpl(buffer, size_to_write, callback, error_callback, error,
                         true);
 }
@@ -143,13 +178,19 @@ bool Stream::WriteBlocking(const void* buffer,
     if (!WriteNonBlocking(buffer, size_to_write, size_written, error))
       return false;
 
+    RecordTransfer(AccessMode::WRITE, *size_written,
+                   *size_written == 0 && size_to_write > 0);
     if (*size_written > 0 || size_to_write == 0)
       break;
 
+    base::TimeTicks wait_start;
+    if (stats_)
+      wait_start = base::TimeTicks::Now();
     if (!WaitForDataBlocking(AccessMode::WRITE, base::TimeDelta::Max(), nullptr,
                              error)) {
       return false;
     }
+    RecordWaitTime(AccessMode::WRITE, wait_start);
   }
   return true;
 }
@@ -209,6 +250,7 @@ bool Stream::ReadAsyncImpl(
   if (!ReadNonBlocking(buffer, size_to_read, &read, &eos, error))
     return false;
 
+  RecordTransfer(AccessMode::READ, read, read == 0 && !eos);
   if (read > 0 || eos) {
     if (force_async_callback) {
       MessageLoop::current()->PostTask(
@@ -222,6 +264,8 @@ bool Stream::ReadAsyncImpl(
     return true;
   }
 
+  if (stats_)
+    read_wait_start_ = base::TimeTicks::Now();
   is_async_read_pending_ = WaitForData(
       AccessMode::READ,
       base::Bind(&Stream::OnReadAvailable, weak_ptr_factory_.GetWeakPtr(),
@@ -247,6 +291,7 @@ void Stream::OnReadAvailable(
   CHECK(stream_utils::IsReadAccessMode(mode));
   CHECK(is_async_read_pending_);
   is_async_read_pending_ = false;
+  RecordWaitTime(AccessMode::READ, read_wait_start_);
   ErrorPtr error;
   // Just reschedule the read operation but don't need to run the callback from
   // the main loop since we are already running on a callback.
@@ -273,6 +318,7 @@ bool Stream::WriteAsyncImpl(
   if (!WriteNonBlocking(buffer, size_to_write, &written, error))
     return false;
 
+  RecordTransfer(AccessMode::WRITE, written, written == 0);
   if (written > 0) {
     if (force_async_callback) {
       MessageLoop::current()->PostTask(
@@ -285,6 +331,8 @@ bool Stream::WriteAsyncImpl(
     }
     return true;
   }
+  if (stats_)
+    write_wait_start_ = base::TimeTicks::Now();
   is_async_write_pending_ = WaitForData(
       AccessMode::WRITE,
       base::Bind(&Stream::OnWriteAvailable, weak_ptr_factory_.GetWeakPtr(),
@@ -309,6 +357,7 @@ void Stream::OnWriteAvailable(
   CHECK(stream_utils::IsWriteAccessMode(mode));
   CHECK(is_async_write_pending_);
   is_async_write_pending_ = false;
+  RecordWaitTime(AccessMode::WRITE, write_wait_start_);
   ErrorPtr error;
   // Just reschedule the read operation but don't need to run the callback from
   // the main loop since we are already running on a callback.
@@ -389,4 +438,79 @@ void Stream::CancelPendingAsyncOperations() {
   is_async_write_pending_ = false;
 }
 
+void Stream::EnableStats(const std::string& name) {
+  if (!stats_) {
+    stats_.reset(new StreamStats);
+    StreamRegistry::GetInstance()->Register(this);
+  }
+  stats_->name = name;
+}
+
+const StreamStats* Stream::GetStats() const {
+  return stats_.get();
+}
+
+void Stream::ResetStats() {
+  if (!stats_)
+    return;
+  std::string name = std::move(stats_->name);
+  *stats_ = StreamStats{};
+  stats_->name = std::move(name);
+}
+
+void Stream::RecordTransfer(AccessMode mode, size_t size, bool would_block) {
+  if (!stats_)
+    return;
+  if (mode == AccessMode::READ) {
+    stats_->read_calls++;
+    stats_->bytes_read += size;
+    if (would_block)
+      stats_->read_would_block++;
+  } else {
+    stats_->write_calls++;
+    stats_->bytes_written += size;
+    if (would_block)
+      stats_->write_would_block++;
+  }
+}
+
+void Stream::RecordWaitTime(AccessMode mode, base::TimeTicks start) {
+  if (!stats_ || start.is_null())
+    return;
+  base::TimeDelta wait_time = base::TimeTicks::Now() - start;
+  if (mode == AccessMode::READ)
+    stats_->read_wait_time += wait_time;
+  else
+    stats_->write_wait_time += wait_time;
+}
+
+void Stream::RecordAsyncLatency(AccessMode mode, base::TimeTicks start) {
+  if (!stats_)
+    return;
+  base::TimeDelta latency = base::TimeTicks::Now() - start;
+  if (mode == AccessMode::READ) {
+    stats_->async_reads++;
+    stats_->async_read_latency += latency;
+  } else {
+    stats_->async_writes++;
+    stats_->async_write_latency += latency;
+  }
+}
+
+void Stream::OnAsyncOperationDone(
+    AccessMode mode,
+    base::TimeTicks start,
+    const base::Callback<void(size_t)>& success_callback,
+    size_t size) {
+  RecordAsyncLatency(mode, start);
+  success_callback.Run(size);
+}
+
+void Stream::OnAsyncAllOperationDone(AccessMode mode,
+                                     base::TimeTicks start,
+                                     const base::Closure& success_callback) {
+  RecordAsyncLatency(mode, start);
+  success_callback.Run();
+}
+
 }  // namespace brillo
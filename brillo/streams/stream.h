@@ -7,6 +7,7 @@
 
 #include <cstdint>
 #include <memory>
+#include <string>
 
 #include <base/callback.h>
 #include <base/macros.h>
@@ -14,6 +15,7 @@
 #include <base/time/time.h>
 #include <brillo/brillo_export.h>
 #include <brillo/errors/error.h>
+#include <brillo/streams/stream_stats.h>
 
 namespace brillo {
 
@@ -91,7 +93,7 @@ class BRILLO_EXPORT Stream {
   // Standard error callback for asynchronous operations.
   using ErrorCallback = base::Callback<void(const Error*)>;
 
-  virtual ~Stream() = default;
+  virtual ~Stream();
 
   // == Stream capabilities ===================================================
 
@@ -390,6 +392,20 @@ class BRILLO_EXPORT Stream {
   // Cancels pending asynchronous read/write operations.
   virtual void CancelPendingAsyncOperations();
 
+  // == Statistics ============================================================
+
+  // Enables collection of I/O statistics for this stream and registers it in
+  // StreamRegistry under |name|. Statistics are off by default, so streams
+  // that don't opt in only pay for a null pointer check per operation.
+  void EnableStats(const std::string& name);
+
+  // Returns the statistics collected so far or nullptr if they have not been
+  // enabled with EnableStats().
+  const StreamStats* GetStats() const;
+
+  // Resets all the statistics counters (but not the stream name) to zero.
+  void ResetStats();
+
  protected:
   Stream() = default;
 
@@ -488,12 +504,38 @@ class BRILLO_EXPORT Stream {
       const base::Closure& success_callback,
       const ErrorCallback& error_callback);
 
+  // Helpers to update |stats_|. They do nothing if statistics are disabled.
+  BRILLO_PRIVATE void RecordTransfer(AccessMode mode,
+                                     size_t size,
+                                     bool would_block);
+  BRILLO_PRIVATE void RecordWaitTime(AccessMode mode, base::TimeTicks start);
+  BRILLO_PRIVATE void RecordAsyncLatency(AccessMode mode,
+                                         base::TimeTicks start);
+
+  // Called when an asynchronous operation started at |start| completes, to
+  // account for its latency before running the caller's |success_callback|.
+  BRILLO_PRIVATE void OnAsyncOperationDone(
+      AccessMode mode,
+      base::TimeTicks start,
+      const base::Callback<void(size_t)>& success_callback,
+      size_t size);
+  BRILLO_PRIVATE void OnAsyncAllOperationDone(
+      AccessMode mode,
+      base::TimeTicks start,
+      const base::Closure& success_callback);
+
   // Data members for asynchronous read operations.
   bool is_async_read_pending_{false};
 
   // Data members for asynchronous write operations.
   bool is_async_write_pending_{false};
 
+  // I/O statistics, only allocated when enabled with EnableStats().
+  std::unique_ptr<StreamStats> stats_;
+  // The times asynchronous operations started waiting in WaitForData().
+  base::TimeTicks read_wait_start_;
+  base::TimeTicks write_wait_start_;
+
   base::WeakPtrFactory<Stream> weak_ptr_factory_{this};
   DISALLOW_COPY_AND_ASSIGN(Stream);
 };
@@ -0,0 +1,185 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/stream_line_reader.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <base/bind.h>
+#include <brillo/message_loops/message_loop.h>
+#include <brillo/streams/stream_errors.h>
+
+namespace brillo {
+
+StreamLineReader::StreamLineReader(Stream* stream,
+                                   char delimiter,
+                                   size_t buffer_size,
+                                   size_t max_record_size)
+    : stream_{stream},
+      delimiter_{delimiter},
+      max_record_size_{std::max(buffer_size, max_record_size)},
+      buffer_(std::max<size_t>(buffer_size, 1)) {}
+
+StreamLineReader::~StreamLineReader() = default;
+
+bool StreamLineReader::ReadLineBlocking(base::StringPiece* record,
+                                        bool* end_of_stream,
+                                        ErrorPtr* error) {
+  for (;;) {
+    if (ExtractRecord(record)) {
+      *end_of_stream = false;
+      return true;
+    }
+    if (end_of_stream_) {
+      *end_of_stream = !ExtractLastRecord(record);
+      return true;
+    }
+    if (!PrepareForRead(error))
+      return false;
+
+    size_t size_read = 0;
+    if (!stream_->ReadBlocking(buffer_.data() + end_, buffer_.size() - end_,
+                               &size_read, error)) {
+      return false;
+    }
+    if (size_read == 0)
+      end_of_stream_ = true;
+    end_ += size_read;
+  }
+}
+
+bool StreamLineReader::ReadLineAsync(
+    const LineCallback& success_callback,
+    const Stream::ErrorCallback& error_callback,
+    ErrorPtr* error) {
+  if (async_read_pending_) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kOperationNotSupported,
+                 "Another asynchronous operation is still pending");
+    return false;
+  }
+
+  // If we have the record already, still call the callback from the main loop
+  // to keep the asynchronous semantics consistent with Stream::ReadAsync().
+  base::StringPiece record;
+  bool have_record = ExtractRecord(&record);
+  if (have_record || end_of_stream_) {
+    bool eos = !have_record && !ExtractLastRecord(&record);
+    async_read_pending_ = true;
+    MessageLoop::current()->PostTask(
+        FROM_HERE,
+        base::Bind(&StreamLineReader::OnAsyncRecord,
+                   weak_ptr_factory_.GetWeakPtr(), success_callback, record,
+                   eos));
+    return true;
+  }
+
+  if (!PrepareForRead(error))
+    return false;
+  async_read_pending_ = stream_->ReadAsync(
+      buffer_.data() + end_, buffer_.size() - end_,
+      base::Bind(&StreamLineReader::OnReadDone, weak_ptr_factory_.GetWeakPtr(),
+                 success_callback, error_callback),
+      base::Bind(&StreamLineReader::OnReadError,
+                 weak_ptr_factory_.GetWeakPtr(), error_callback),
+      error);
+  return async_read_pending_;
+}
+
+bool StreamLineReader::ExtractRecord(base::StringPiece* record) {
+  const char* data = buffer_.data();
+  const void* pos = std::memchr(data + scan_pos_, delimiter_, end_ - scan_pos_);
+  if (!pos) {
+    scan_pos_ = end_;
+    return false;
+  }
+  size_t delimiter_pos = static_cast<const char*>(pos) - data;
+  *record = MakeRecord(begin_, delimiter_pos - begin_);
+  begin_ = delimiter_pos + 1;
+  scan_pos_ = begin_;
+  return true;
+}
+
+bool StreamLineReader::ExtractLastRecord(base::StringPiece* record) {
+  if (begin_ == end_) {
+    *record = base::StringPiece{};
+    return false;
+  }
+  *record = MakeRecord(begin_, end_ - begin_);
+  begin_ = end_;
+  scan_pos_ = end_;
+  return true;
+}
+
+bool StreamLineReader::PrepareForRead(ErrorPtr* error) {
+  // Move the partial record to the front of the window.
+  if (begin_ > 0) {
+    size_t size = end_ - begin_;
+    if (size > 0)
+      std::memmove(buffer_.data(), buffer_.data() + begin_, size);
+    end_ = size;
+    scan_pos_ -= begin_;
+    begin_ = 0;
+  }
+
+  if (end_ < buffer_.size())
+    return true;
+
+  if (buffer_.size() >= max_record_size_) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kInvalidParameter,
+                 "Record exceeds the maximum allowed size");
+    return false;
+  }
+  buffer_.resize(std::min(buffer_.size() * 2, max_record_size_));
+  return true;
+}
+
+base::StringPiece StreamLineReader::MakeRecord(size_t offset,
+                                               size_t size) const {
+  if (delimiter_ == '\n' && size > 0 && buffer_[offset + size - 1] == '\r')
+    size--;
+  return base::StringPiece{buffer_.data() + offset, size};
+}
+
+void StreamLineReader::OnReadDone(const LineCallback& success_callback,
+                                  const Stream::ErrorCallback& error_callback,
+                                  size_t size_read) {
+  async_read_pending_ = false;
+  if (size_read == 0)
+    end_of_stream_ = true;
+  end_ += size_read;
+
+  base::StringPiece record;
+  if (ExtractRecord(&record)) {
+    success_callback.Run(record, false);
+    return;
+  }
+  if (end_of_stream_) {
+    bool eos = !ExtractLastRecord(&record);
+    success_callback.Run(record, eos);
+    return;
+  }
+
+  // Still no complete record in the window, keep reading.
+  ErrorPtr error;
+  if (!ReadLineAsync(success_callback, error_callback, &error))
+    error_callback.Run(error.get());
+}
+
+void StreamLineReader::OnReadError(const Stream::ErrorCallback& error_callback,
+                                   const Error* error) {
+  async_read_pending_ = false;
+  error_callback.Run(error);
+}
+
+void StreamLineReader::OnAsyncRecord(const LineCallback& success_callback,
+                                     base::StringPiece record,
+                                     bool eos) {
+  async_read_pending_ = false;
+  success_callback.Run(record, eos);
+}
+
+}  // namespace brillo
@@ -0,0 +1,118 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_STREAMS_STREAM_LINE_READER_H_
+#define LIBBRILLO_BRILLO_STREAMS_STREAM_LINE_READER_H_
+
+#include <vector>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/memory/weak_ptr.h>
+#include <base/strings/string_piece.h>
+#include <brillo/brillo_export.h>
+#include <brillo/errors/error.h>
+#include <brillo/streams/stream.h>
+
+namespace brillo {
+
+// StreamLineReader splits the data read from a stream into lines (or, more
+// generally, records terminated by a delimiter character) without copying
+// each record into a separate string. The reader owns a refillable window over
+// the stream data and returns base::StringPiece views into that window:
+//
+//    StreamLineReader reader{stream.get()};
+//    base::StringPiece line;
+//    bool eos = false;
+//    while (reader.ReadLineBlocking(&line, &eos, nullptr) && !eos) {
+//      ...
+//    }
+//
+// Records straddling the end of the window are moved to the beginning of the
+// buffer before it is refilled, and the buffer grows (up to the specified
+// maximum record size) if a single record doesn't fit.
+//
+// NOTE: The returned views are valid only until the next read call on the
+// reader, since refilling the window might move or overwrite the data.
+class BRILLO_EXPORT StreamLineReader {
+ public:
+  // Callback for ReadLineAsync(). Receives the record read and |eos| set to
+  // true if the end of the stream has been reached (in which case the record
+  // is always empty).
+  using LineCallback = base::Callback<void(base::StringPiece, bool)>;
+
+  // Creates a line reader over |stream| which must outlive the reader. The
+  // records are separated by |delimiter|. When the delimiter is '\n', a
+  // trailing '\r' is also stripped from each line. The window starts at
+  // |buffer_size| bytes and can grow up to |max_record_size|. Records longer
+  // than that result in an error.
+  explicit StreamLineReader(Stream* stream,
+                            char delimiter = '\n',
+                            size_t buffer_size = 4096,
+                            size_t max_record_size = 1024 * 1024);
+  ~StreamLineReader();
+
+  // Reads the next record from the stream, blocking if needed. At the end of
+  // the stream, |end_of_stream| is set to true and |record| is empty. The last
+  // record of the stream doesn't need to be terminated by the delimiter.
+  bool ReadLineBlocking(base::StringPiece* record,
+                        bool* end_of_stream,
+                        ErrorPtr* error);
+
+  // Asynchronous version of ReadLineBlocking(). Reads the next record from
+  // the stream and calls |success_callback| with it from the current
+  // MessageLoop. If an error occurs, |error_callback| is called instead.
+  // Returns false and sets |error| if the operation can't be started.
+  // Only one asynchronous operation at a time is allowed.
+  bool ReadLineAsync(const LineCallback& success_callback,
+                     const Stream::ErrorCallback& error_callback,
+                     ErrorPtr* error);
+
+ private:
+  // Tries to find the next complete record in the window. Returns true and
+  // the record in |record| if found.
+  bool ExtractRecord(base::StringPiece* record);
+
+  // Called at the end of the stream to return the last unterminated record,
+  // if any. Returns false if there is no more data left in the window.
+  bool ExtractLastRecord(base::StringPiece* record);
+
+  // Makes room for more data at the end of the window by moving the partial
+  // record to the beginning of the buffer and growing the buffer if needed.
+  bool PrepareForRead(ErrorPtr* error);
+
+  // Returns |size| bytes starting at |offset| in the buffer as a record,
+  // stripping the carriage return character if needed.
+  base::StringPiece MakeRecord(size_t offset, size_t size) const;
+
+  // Helper callbacks for ReadLineAsync().
+  void OnReadDone(const LineCallback& success_callback,
+                  const Stream::ErrorCallback& error_callback,
+                  size_t size_read);
+  void OnReadError(const Stream::ErrorCallback& error_callback,
+                   const Error* error);
+  void OnAsyncRecord(const LineCallback& success_callback,
+                     base::StringPiece record,
+                     bool eos);
+
+  Stream* stream_;
+  char delimiter_;
+  size_t max_record_size_;
+
+  // The data window. The unconsumed data spans [begin_, end_), and everything
+  // up to |scan_pos_| has already been searched for the delimiter.
+  std::vector<char> buffer_;
+  size_t begin_{0};
+  size_t end_{0};
+  size_t scan_pos_{0};
+  bool end_of_stream_{false};
+  bool async_read_pending_{false};
+
+  base::WeakPtrFactory<StreamLineReader> weak_ptr_factory_{this};
+  DISALLOW_COPY_AND_ASSIGN(StreamLineReader);
+};
+
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_STREAMS_STREAM_LINE_READER_H_
@@ -0,0 +1,177 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/stream_line_reader.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <base/bind.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/logging.h>
+#include <base/strings/stringprintf.h>
+#include <base/test/simple_test_clock.h>
+#include <base/time/time.h>
+#include <gtest/gtest.h>
+
+#include <brillo/bind_lambda.h>
+#include <brillo/message_loops/fake_message_loop.h>
+#include <brillo/streams/fake_stream.h>
+#include <brillo/streams/file_stream.h>
+#include <brillo/streams/memory_stream.h>
+#include <brillo/strings/string_utils.h>
+
+namespace brillo {
+
+namespace {
+
+// Reads all the records from |reader| using blocking calls.
+std::vector<std::string> ReadAllLines(StreamLineReader* reader) {
+  std::vector<std::string> lines;
+  base::StringPiece line;
+  bool eos = false;
+  while (reader->ReadLineBlocking(&line, &eos, nullptr) && !eos)
+    lines.push_back(line.as_string());
+  return lines;
+}
+
+}  // anonymous namespace
+
+TEST(StreamLineReader, ReadLineBlocking) {
+  auto stream = MemoryStream::OpenCopyOf("line 1\nline 2\r\n\nlast", nullptr);
+  StreamLineReader reader{stream.get()};
+  std::vector<std::string> expected{"line 1", "line 2", "", "last"};
+  EXPECT_EQ(expected, ReadAllLines(&reader));
+}
+
+TEST(StreamLineReader, TrailingDelimiter) {
+  auto stream = MemoryStream::OpenCopyOf("a\nb\n", nullptr);
+  StreamLineReader reader{stream.get()};
+  std::vector<std::string> expected{"a", "b"};
+  EXPECT_EQ(expected, ReadAllLines(&reader));
+}
+
+TEST(StreamLineReader, EmptyStream) {
+  auto stream = MemoryStream::OpenCopyOf("", nullptr);
+  StreamLineReader reader{stream.get()};
+  base::StringPiece line;
+  bool eos = false;
+  EXPECT_TRUE(reader.ReadLineBlocking(&line, &eos, nullptr));
+  EXPECT_TRUE(eos);
+  EXPECT_TRUE(line.empty());
+}
+
+TEST(StreamLineReader, CustomDelimiter) {
+  auto stream = MemoryStream::OpenCopyOf("k1=v1;k2=v2\r;k3", nullptr);
+  StreamLineReader reader{stream.get(), ';'};
+  // Carriage return is only stripped from new-line terminated records.
+  std::vector<std::string> expected{"k1=v1", "k2=v2\r", "k3"};
+  EXPECT_EQ(expected, ReadAllLines(&reader));
+}
+
+TEST(StreamLineReader, RecordsStraddleRefills) {
+  std::string data;
+  std::vector<std::string> expected;
+  for (int i = 0; i < 100; i++) {
+    expected.push_back(std::string(i % 13, 'a' + i % 26) + std::to_string(i));
+    data += expected.back() + "\n";
+  }
+  auto stream = MemoryStream::OpenCopyOf(data, nullptr);
+  // Use a tiny window to force lots of refills and data moves.
+  StreamLineReader reader{stream.get(), '\n', 8};
+  EXPECT_EQ(expected, ReadAllLines(&reader));
+}
+
+TEST(StreamLineReader, RecordTooLong) {
+  auto stream = MemoryStream::OpenCopyOf("short\nvery very long line\n",
+                                         nullptr);
+  StreamLineReader reader{stream.get(), '\n', 4, 16};
+  base::StringPiece line;
+  bool eos = false;
+  EXPECT_TRUE(reader.ReadLineBlocking(&line, &eos, nullptr));
+  EXPECT_EQ("short", line);
+  ErrorPtr error;
+  EXPECT_FALSE(reader.ReadLineBlocking(&line, &eos, &error));
+  ASSERT_NE(nullptr, error);
+  EXPECT_EQ(errors::stream::kInvalidParameter, error->GetCode());
+}
+
+TEST(StreamLineReader, ReadLineAsync) {
+  base::SimpleTestClock clock;
+  FakeMessageLoop loop{&clock};
+  loop.SetAsCurrent();
+
+  FakeStream stream{Stream::AccessMode::READ, &clock};
+  stream.AddReadPacketString({}, "first li");
+  stream.AddReadPacketString(base::TimeDelta::FromSeconds(1), "ne\nsecond");
+  stream.AddReadPacketString(base::TimeDelta::FromSeconds(1), " line\nend");
+
+  StreamLineReader reader{&stream};
+  std::vector<std::string> lines;
+  bool eos = false;
+  auto error_callback = [](const Error* /* error */) { FAIL(); };
+  base::Callback<void(base::StringPiece, bool)> success_callback;
+  auto on_line = [&](base::StringPiece line, bool end_of_stream) {
+    if (end_of_stream) {
+      eos = true;
+      return;
+    }
+    lines.push_back(line.as_string());
+    EXPECT_TRUE(reader.ReadLineAsync(success_callback,
+                                     base::Bind(error_callback), nullptr));
+  };
+  success_callback = base::Bind(on_line);
+  EXPECT_TRUE(reader.ReadLineAsync(success_callback,
+                                   base::Bind(error_callback), nullptr));
+  loop.Run();
+  EXPECT_TRUE(eos);
+  std::vector<std::string> expected{"first line", "second line", "end"};
+  EXPECT_EQ(expected, lines);
+}
+
+// Compares parsing a 100 MB file line by line with StreamLineReader against
+// reading it into a string and splitting it with string_utils::Split(). Run
+// with --gtest_also_run_disabled_tests.
+TEST(StreamLineReader, DISABLED_Benchmark) {
+  const size_t kFileSize = 100 * 1024 * 1024;
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path = temp_dir.GetPath().Append("lines.txt");
+  std::string data;
+  data.reserve(kFileSize + 64);
+  for (size_t i = 0; data.size() < kFileSize; i++)
+    data += base::StringPrintf("key_%zu=some value for line %zu\n", i, i);
+  int size = data.size();
+  ASSERT_EQ(size, base::WriteFile(path, data.data(), size));
+  size_t expected_lines = std::count(data.begin(), data.end(), '\n');
+  data.clear();
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  StreamPtr stream = FileStream::Open(path, Stream::AccessMode::READ,
+                                      FileStream::Disposition::OPEN_EXISTING,
+                                      nullptr);
+  ASSERT_NE(nullptr, stream);
+  StreamLineReader reader{stream.get(), '\n', 64 * 1024};
+  base::StringPiece line;
+  bool eos = false;
+  size_t lines = 0;
+  while (reader.ReadLineBlocking(&line, &eos, nullptr) && !eos)
+    lines++;
+  base::TimeDelta reader_time = base::TimeTicks::Now() - start;
+  EXPECT_EQ(expected_lines, lines);
+
+  start = base::TimeTicks::Now();
+  ASSERT_TRUE(base::ReadFileToString(path, &data));
+  lines = string_utils::Split(data, "\n", false, true).size();
+  base::TimeDelta split_time = base::TimeTicks::Now() - start;
+  EXPECT_EQ(expected_lines, lines);
+
+  LOG(INFO) << expected_lines << " lines: StreamLineReader "
+            << reader_time.InMilliseconds() << " ms, ReadFileToString+Split "
+            << split_time.InMilliseconds() << " ms";
+}
+
+}  // namespace brillo
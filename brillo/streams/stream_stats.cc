@@ -0,0 +1,73 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/stream_stats.h>
+
+#include <inttypes.h>
+
+#include <base/strings/stringprintf.h>
+#include <brillo/streams/stream.h>
+
+namespace brillo {
+
+namespace {
+
+base::LazyInstance<StreamRegistry>::Leaky g_stream_registry =
+    LAZY_INSTANCE_INITIALIZER;
+
+}  // anonymous namespace
+
+std::string StreamStats::ToString() const {
+  return base::StringPrintf(
+      "%s: read %" PRIu64 " bytes in %" PRIu64 " calls (%" PRIu64
+      " would block, waited %" PRId64 " ms, %" PRIu64 " async, %" PRId64
+      " ms latency), wrote %" PRIu64 " bytes in %" PRIu64 " calls (%" PRIu64
+      " would block, waited %" PRId64 " ms, %" PRIu64 " async, %" PRId64
+      " ms latency)",
+      name.c_str(), bytes_read, read_calls, read_would_block,
+      read_wait_time.InMilliseconds(), async_reads,
+      async_read_latency.InMilliseconds(), bytes_written, write_calls,
+      write_would_block, write_wait_time.InMilliseconds(), async_writes,
+      async_write_latency.InMilliseconds());
+}
+
+StreamRegistry::StreamRegistry() = default;
+StreamRegistry::~StreamRegistry() = default;
+
+StreamRegistry* StreamRegistry::GetInstance() {
+  return g_stream_registry.Pointer();
+}
+
+std::vector<StreamStats> StreamRegistry::GetSnapshot() const {
+  std::vector<StreamStats> snapshot;
+  base::AutoLock auto_lock(lock_);
+  snapshot.reserve(streams_.size());
+  for (const Stream* stream : streams_) {
+    const StreamStats* stats = stream->GetStats();
+    if (stats)
+      snapshot.push_back(*stats);
+  }
+  return snapshot;
+}
+
+std::string StreamRegistry::Dump() const {
+  std::string result;
+  for (const StreamStats& stats : GetSnapshot()) {
+    result += stats.ToString();
+    result += '\n';
+  }
+  return result;
+}
+
+void StreamRegistry::Register(const Stream* stream) {
+  base::AutoLock auto_lock(lock_);
+  streams_.insert(stream);
+}
+
+void StreamRegistry::Unregister(const Stream* stream) {
+  base::AutoLock auto_lock(lock_);
+  streams_.erase(stream);
+}
+
+}  // namespace brillo
@@ -0,0 +1,101 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_STREAMS_STREAM_STATS_H_
+#define LIBBRILLO_BRILLO_STREAMS_STREAM_STATS_H_
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <base/lazy_instance.h>
+#include <base/macros.h>
+#include <base/synchronization/lock.h>
+#include <base/time/time.h>
+#include <brillo/brillo_export.h>
+
+namespace brillo {
+
+class Stream;
+
+// I/O statistics collected by Stream when enabled with Stream::EnableStats().
+// The counters are updated by the generic helpers implemented in the Stream
+// base class (ReadAsync(), ReadBlocking(), WriteAllAsync(), etc), so they
+// work the same way for every stream type. Direct calls to ReadNonBlocking()
+// and WriteNonBlocking() on the stream bypass the base class and are not
+// accounted for.
+struct BRILLO_EXPORT StreamStats {
+  // The name given to the stream in Stream::EnableStats().
+  std::string name;
+
+  // Amount of data transferred and the number of non-blocking read/write
+  // calls made to the underlying stream implementation.
+  uint64_t bytes_read{0};
+  uint64_t bytes_written{0};
+  uint64_t read_calls{0};
+  uint64_t write_calls{0};
+
+  // Number of times a read or write operation could not make progress and
+  // had to wait for the stream to become ready.
+  uint64_t read_would_block{0};
+  uint64_t write_would_block{0};
+
+  // Total time spent waiting for the stream to become readable/writable,
+  // either blocked in WaitForDataBlocking() or with an asynchronous operation
+  // pending in WaitForData().
+  base::TimeDelta read_wait_time;
+  base::TimeDelta write_wait_time;
+
+  // Number of completed asynchronous operations and their total latency, from
+  // the call to ReadAsync()/WriteAsync() (or their *All* variants) until the
+  // success callback is invoked.
+  uint64_t async_reads{0};
+  uint64_t async_writes{0};
+  base::TimeDelta async_read_latency;
+  base::TimeDelta async_write_latency;
+
+  // Returns a one-line human-readable summary of the statistics.
+  std::string ToString() const;
+};
+
+// StreamRegistry keeps track of all the live streams that have statistics
+// collection enabled, so their state can be dumped for diagnostics (e.g.
+// from a debug D-Bus method or a signal handler).
+//
+// NOTE: Stream statistics are updated without any synchronization on the
+// thread using the stream. GetSnapshot() and Dump() should be called from that
+// same thread to get consistent values.
+class BRILLO_EXPORT StreamRegistry {
+ public:
+  // Returns the process-wide registry instance.
+  static StreamRegistry* GetInstance();
+
+  // Returns a copy of the statistics of all the registered streams.
+  std::vector<StreamStats> GetSnapshot() const;
+
+  // Returns the statistics of all the registered streams, one per line.
+  std::string Dump() const;
+
+ private:
+  friend class Stream;
+  friend struct base::DefaultLazyInstanceTraits<StreamRegistry>;
+
+  StreamRegistry();
+  ~StreamRegistry();
+
+  // Called by Stream when statistics are enabled and when the stream is
+  // destroyed.
+  void Register(const Stream* stream);
+  void Unregister(const Stream* stream);
+
+  mutable base::Lock lock_;
+  std::set<const Stream*> streams_;
+
+  DISALLOW_COPY_AND_ASSIGN(StreamRegistry);
+};
+
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_STREAMS_STREAM_STATS_H_
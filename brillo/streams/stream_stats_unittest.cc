@@ -0,0 +1,102 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/stream_stats.h>
+
+#include <string>
+
+#include <base/bind.h>
+#include <base/test/simple_test_clock.h>
+#include <gtest/gtest.h>
+
+#include <brillo/bind_lambda.h>
+#include <brillo/message_loops/fake_message_loop.h>
+#include <brillo/streams/fake_stream.h>
+#include <brillo/streams/memory_stream.h>
+
+namespace brillo {
+
+namespace {
+
+bool IsRegistered(const std::string& name) {
+  auto snapshot = StreamRegistry::GetInstance()->GetSnapshot();
+  for (const StreamStats& stats : snapshot) {
+    if (stats.name == name)
+      return true;
+  }
+  return false;
+}
+
+}  // anonymous namespace
+
+TEST(StreamStats, DisabledByDefault) {
+  auto stream = MemoryStream::OpenCopyOf("data", nullptr);
+  EXPECT_EQ(nullptr, stream->GetStats());
+}
+
+TEST(StreamStats, Blocking) {
+  auto stream = MemoryStream::Create(nullptr);
+  stream->EnableStats("memory");
+  EXPECT_TRUE(stream->WriteAllBlocking("0123456789", 10, nullptr));
+  EXPECT_TRUE(stream->SetPosition(0, nullptr));
+  char buffer[4];
+  EXPECT_TRUE(stream->ReadAllBlocking(buffer, sizeof(buffer), nullptr));
+
+  const StreamStats* stats = stream->GetStats();
+  ASSERT_NE(nullptr, stats);
+  EXPECT_EQ("memory", stats->name);
+  EXPECT_EQ(10u, stats->bytes_written);
+  EXPECT_EQ(1u, stats->write_calls);
+  EXPECT_EQ(4u, stats->bytes_read);
+  EXPECT_EQ(1u, stats->read_calls);
+  EXPECT_EQ(0u, stats->read_would_block);
+
+  stream->ResetStats();
+  EXPECT_EQ("memory", stats->name);
+  EXPECT_EQ(0u, stats->bytes_written);
+  EXPECT_EQ(0u, stats->bytes_read);
+}
+
+TEST(StreamStats, Async) {
+  base::SimpleTestClock clock;
+  FakeMessageLoop loop{&clock};
+  loop.SetAsCurrent();
+
+  FakeStream stream{Stream::AccessMode::READ, &clock};
+  stream.EnableStats("fake");
+  stream.AddReadPacketString(base::TimeDelta::FromSeconds(1), "abc");
+  stream.AddReadPacketString(base::TimeDelta::FromSeconds(1), "def");
+
+  char buffer[6];
+  bool done = false;
+  auto on_success = [](bool* done) { *done = true; };
+  auto on_error = [](const Error* /* error */) { FAIL(); };
+  EXPECT_TRUE(stream.ReadAllAsync(buffer, sizeof(buffer),
+                                  base::Bind(on_success,
+                                             base::Unretained(&done)),
+                                  base::Bind(on_error), nullptr));
+  loop.Run();
+  EXPECT_TRUE(done);
+
+  const StreamStats* stats = stream.GetStats();
+  ASSERT_NE(nullptr, stats);
+  EXPECT_EQ(6u, stats->bytes_read);
+  EXPECT_EQ(2u, stats->read_would_block);
+  EXPECT_EQ(4u, stats->read_calls);
+  EXPECT_EQ(1u, stats->async_reads);
+  EXPECT_EQ(0u, stats->async_writes);
+}
+
+TEST(StreamStats, Registry) {
+  {
+    auto stream = MemoryStream::OpenCopyOf("data", nullptr);
+    stream->EnableStats("registered_stream");
+    EXPECT_TRUE(IsRegistered("registered_stream"));
+    EXPECT_NE(std::string::npos,
+              StreamRegistry::GetInstance()->Dump().find("registered_stream"));
+  }
+  EXPECT_FALSE(IsRegistered("registered_stream"));
+}
+
+}  // namespace brillo
@@ -78,6 +78,81 @@ void PerformRead(const std::shared_ptr<CopyDataState>& state) {
     OnCopyDataError(state, error.get());
 }
 
+// A write-only stream that passes the data written to it to a callback.
+class WriteCallbackStream : public Stream {
+ public:
+  explicit WriteCallbackStream(const WriteCallback& write_callback)
+      : write_callback_{write_callback} {}
+
+  bool IsOpen() const override { return !write_callback_.is_null(); }
+  bool CanRead() const override { return false; }
+  bool CanWrite() const override { return IsOpen(); }
+  bool CanSeek() const override { return false; }
+  bool CanGetSize() const override { return false; }
+  uint64_t GetSize() const override { return 0; }
+  bool SetSizeBlocking(uint64_t /* size */, ErrorPtr* error) override {
+    return ErrorOperationNotSupported(FROM_HERE, error);
+  }
+  uint64_t GetRemainingSize() const override { return 0; }
+  uint64_t GetPosition() const override { return 0; }
+  bool Seek(int64_t /* offset */,
+            Whence /* whence */,
+            uint64_t* /* new_position */,
+            ErrorPtr* error) override {
+    return ErrorOperationNotSupported(FROM_HERE, error);
+  }
+
+  bool ReadNonBlocking(void* /* buffer */,
+                       size_t /* size_to_read */,
+                       size_t* /* size_read */,
+                       bool* /* end_of_stream */,
+                       ErrorPtr* error) override {
+    return ErrorOperationNotSupported(FROM_HERE, error);
+  }
+
+  bool WriteNonBlocking(const void* buffer,
+                        size_t size_to_write,
+                        size_t* size_written,
+                        ErrorPtr* error) override {
+    if (!IsOpen())
+      return ErrorStreamClosed(FROM_HERE, error);
+    if (!write_callback_.Run(buffer, size_to_write, error))
+      return false;
+    *size_written = size_to_write;
+    return true;
+  }
+
+  bool FlushBlocking(ErrorPtr* error) override {
+    return IsOpen() || ErrorStreamClosed(FROM_HERE, error);
+  }
+
+  bool CloseBlocking(ErrorPtr* /* error */) override {
+    write_callback_.Reset();
+    return true;
+  }
+
+  bool WaitForData(AccessMode mode,
+                   const base::Callback<void(AccessMode)>& callback,
+                   ErrorPtr* /* error */) override {
+    MessageLoop::current()->PostTask(FROM_HERE, base::Bind(callback, mode));
+    return true;
+  }
+
+  bool WaitForDataBlocking(AccessMode in_mode,
+                           base::TimeDelta /* timeout */,
+                           AccessMode* out_mode,
+                           ErrorPtr* /* error */) override {
+    if (out_mode)
+      *out_mode = in_mode;
+    return true;
+  }
+
+ private:
+  WriteCallback write_callback_;
+
+  DISALLOW_COPY_AND_ASSIGN(WriteCallbackStream);
+};
+
 }  // anonymous namespace
 
 bool ErrorStreamClosed(const tracked_objects::Location& location,
@@ -212,5 +287,9 @@ void CopyData(StreamPtr in_stream,
                                              base::Bind(&PerformRead, state));
 }
 
+StreamPtr CreateWriteCallbackStream(const WriteCallback& write_callback) {
+  return StreamPtr{new WriteCallbackStream{write_callback}};
+}
+
 }  // namespace stream_utils
 }  // namespace brillo
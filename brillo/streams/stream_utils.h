@@ -5,6 +5,7 @@
 #ifndef LIBBRILLO_BRILLO_STREAMS_STREAM_UTILS_H_
 #define LIBBRILLO_BRILLO_STREAMS_STREAM_UTILS_H_
 
+#include <base/callback.h>
 #include <base/location.h>
 #include <brillo/brillo_export.h>
 #include <brillo/streams/stream.h>
@@ -108,6 +109,19 @@ BRILLO_EXPORT void CopyData(StreamPtr in_stream,
                             const CopyDataSuccessCallback& success_callback,
                             const CopyDataErrorCallback& error_callback);
 
+// Called with each chunk of data written to a stream created by
+// CreateWriteCallbackStream(). Returns false (and fills |error|) to fail the
+// write operation.
+using WriteCallback =
+    base::Callback<bool(const void*, size_t, brillo::ErrorPtr*)>;
+
+// Creates a write-only, non-seekable stream that hands all the data written to
+// it to |write_callback|. Useful as a response data stream of an HTTP request
+// to process the data as it is received. The callback is released when the
+// stream is closed.
+BRILLO_EXPORT StreamPtr
+CreateWriteCallbackStream(const WriteCallback& write_callback);
+
 }  // namespace stream_utils
 }  // namespace brillo
 
@@ -5,8 +5,10 @@
 #include <brillo/streams/stream_utils.h>
 
 #include <limits>
+#include <string>
 
 #include <base/bind.h>
+#include <brillo/bind_lambda.h>
 #include <brillo/message_loops/fake_message_loop.h>
 #include <brillo/message_loops/message_loop.h>
 #include <brillo/streams/mock_stream.h>
@@ -151,6 +153,44 @@ TEST(StreamUtils, CalculateStreamPosition) {
       FROM_HERE, 1, Whence::FROM_CURRENT, max_int64, end_pos, &pos, nullptr));
 }
 
+TEST(StreamUtils, CreateWriteCallbackStream) {
+  std::string data;
+  auto write_callback = [&data](const void* buffer, size_t size,
+                                ErrorPtr* /* error */) {
+    data.append(static_cast<const char*>(buffer), size);
+    return true;
+  };
+  StreamPtr stream =
+      stream_utils::CreateWriteCallbackStream(base::Bind(write_callback));
+  EXPECT_TRUE(stream->IsOpen());
+  EXPECT_TRUE(stream->CanWrite());
+  EXPECT_FALSE(stream->CanRead());
+  EXPECT_FALSE(stream->CanSeek());
+  EXPECT_TRUE(stream->WriteAllBlocking("foo", 3, nullptr));
+  EXPECT_TRUE(stream->WriteAllBlocking("bar", 3, nullptr));
+  EXPECT_EQ("foobar", data);
+
+  EXPECT_TRUE(stream->CloseBlocking(nullptr));
+  EXPECT_FALSE(stream->IsOpen());
+  ErrorPtr error;
+  EXPECT_FALSE(stream->WriteAllBlocking("baz", 3, &error));
+  EXPECT_EQ(errors::stream::kStreamClosed, error->GetCode());
+  EXPECT_EQ("foobar", data);
+}
+
+TEST(StreamUtils, CreateWriteCallbackStreamError) {
+  auto write_callback = [](const void* /* buffer */, size_t /* size */,
+                           ErrorPtr* error) {
+    Error::AddTo(error, FROM_HERE, "test", "write_failed", "Write failed");
+    return false;
+  };
+  StreamPtr stream =
+      stream_utils::CreateWriteCallbackStream(base::Bind(write_callback));
+  ErrorPtr error;
+  EXPECT_FALSE(stream->WriteAllBlocking("foo", 3, &error));
+  EXPECT_EQ("write_failed", error->GetCode());
+}
+
 class CopyStreamDataTest : public testing::Test {
  public:
   void SetUp() override {
@@ -5,15 +5,34 @@
 #include <brillo/streams/tls_stream.h>
 
 #include <algorithm>
+#include <cstring>
 #include <limits>
 #include <string>
 #include <vector>
 
+#if defined(__linux__)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+// Older kernel headers and host sysroots don't have the kernel TLS header.
+// Everything using it is conditional on TLS_RX being defined.
+#if defined(__has_include)
+#if __has_include(<linux/tls.h>)
+#include <linux/tls.h>
+#endif
+#endif  // __has_include
+#endif  // __linux__
+
 #include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
 #include <openssl/ssl.h>
 
 #include <base/bind.h>
 #include <base/memory/weak_ptr.h>
+#include <base/posix/eintr_wrapper.h>
+#include <brillo/errors/error_codes.h>
 #include <brillo/message_loops/message_loop.h>
 #include <brillo/secure_blob.h>
 #include <brillo/streams/openssl_stream_bio.h>
@@ -63,6 +82,89 @@ const char kCACertificatePath[] =
     "/usr/share/chromeos-ca-certificates";
 #endif
 
+#if defined(__linux__) && defined(TLS_RX)
+
+// Kernel TLS constants that might be missing from older system headers.
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+// TLS record content types and alert values (RFC 5246, sections 6.2.1 and
+// 7.2).
+const uint8_t kTlsRecordTypeAlert = 21;
+const uint8_t kTlsRecordTypeApplicationData = 23;
+const uint8_t kTlsAlertLevelWarning = 1;
+const uint8_t kTlsAlertCloseNotify = 0;
+
+// Size of the implicit part of the AES-GCM nonce (the "salt") derived from
+// the TLS key block (RFC 5288, section 3).
+const size_t kGcmSaltSize = 4;
+
+// Sequence number of the first application data record in each direction.
+// The Finished messages are the first records protected by the negotiated
+// keys and use up sequence number 0.
+const uint64_t kFirstApplicationDataSequence = 1;
+
+// Retrieves the master secret of the current session of |ssl| and the seed
+// of the key expansion (server_random + client_random).
+void GetKeyExpansionInputs(SSL* ssl,
+                           brillo::SecureBlob* master_key,
+                           brillo::Blob* seed) {
+  SSL_SESSION* session = SSL_get_session(ssl);
+  if (!session)
+    return;
+  seed->resize(2 * SSL3_RANDOM_SIZE);
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L || defined(OPENSSL_IS_BORINGSSL)
+  master_key->resize(SSL_MAX_MASTER_KEY_LENGTH);
+  master_key->resize(SSL_SESSION_get_master_key(session, master_key->data(),
+                                                master_key->size()));
+  SSL_get_server_random(ssl, seed->data(), SSL3_RANDOM_SIZE);
+  SSL_get_client_random(ssl, seed->data() + SSL3_RANDOM_SIZE,
+                        SSL3_RANDOM_SIZE);
+#else
+  // OpenSSL 1.0.x has no accessors for these, but its structures are public.
+  master_key->assign(session->master_key,
+                     session->master_key + session->master_key_length);
+  std::memcpy(seed->data(), ssl->s3->server_random, SSL3_RANDOM_SIZE);
+  std::memcpy(seed->data() + SSL3_RANDOM_SIZE, ssl->s3->client_random,
+              SSL3_RANDOM_SIZE);
+#endif
+}
+
+// Installs the record protection parameters for one direction (|direction| is
+// either TLS_TX or TLS_RX) of the kernel TLS socket |fd|.
+template <typename CryptoInfo>
+bool SetKernelTlsCryptoInfo(int fd,
+                            int direction,
+                            uint16_t cipher_type,
+                            const uint8_t* key,
+                            const uint8_t* salt) {
+  CryptoInfo crypto_info;
+  std::memset(&crypto_info, 0, sizeof(crypto_info));
+  crypto_info.info.version = TLS_1_2_VERSION;
+  crypto_info.info.cipher_type = cipher_type;
+  std::memcpy(crypto_info.key, key, sizeof(crypto_info.key));
+  std::memcpy(crypto_info.salt, salt, sizeof(crypto_info.salt));
+  // Sequence numbers are stored in network byte order.
+  uint64_t seq = kFirstApplicationDataSequence;
+  for (size_t i = sizeof(crypto_info.rec_seq); i > 0; i--) {
+    crypto_info.rec_seq[i - 1] = static_cast<uint8_t>(seq & 0xFF);
+    seq >>= 8;
+  }
+  // Use the record sequence number as the explicit part of the nonce, the
+  // same way OpenSSL does it.
+  std::memcpy(crypto_info.iv, crypto_info.rec_seq, sizeof(crypto_info.iv));
+  bool success = setsockopt(fd, SOL_TLS, direction, &crypto_info,
+                            sizeof(crypto_info)) == 0;
+  brillo::SecureMemset(&crypto_info, 0, sizeof(crypto_info));
+  return success;
+}
+
+#endif  // __linux__ && TLS_RX
+
 }  // anonymous namespace
 
 namespace brillo {
@@ -75,7 +177,9 @@ class TlsStream::TlsStreamImpl {
   ~TlsStreamImpl();
 
   bool Init(StreamPtr socket,
+            int socket_fd,
             const std::string& host,
+            const std::string& ca_cert_path,
             const base::Closure& success_callback,
             const Stream::ErrorCallback& error_callback,
             ErrorPtr* error);
@@ -102,6 +206,9 @@ class TlsStream::TlsStreamImpl {
                            ErrorPtr* error);
   void CancelPendingAsyncOperations();
 
+  bool IsKernelOffloadEnabled() const { return ktls_tx_; }
+  bool SendFile(int file_fd, uint64_t offset, uint64_t size, ErrorPtr* error);
+
  private:
   bool ReportError(ErrorPtr* error,
                    const tracked_objects::Location& location,
@@ -115,7 +222,24 @@ class TlsStream::TlsStreamImpl {
   int OnCertVerifyResults(int ok, X509_STORE_CTX* ctx);
   static int OnCertVerifyResultsStatic(int ok, X509_STORE_CTX* ctx);
 
+  // Called after a successful handshake to move record encryption and/or
+  // decryption for |socket_fd_| into the kernel.
+  void EnableKernelOffload();
+  bool ReadFromKernel(void* buffer,
+                      size_t size_to_read,
+                      size_t* size_read,
+                      bool* end_of_stream,
+                      ErrorPtr* error);
+  void SendCloseNotifyFromKernel();
+
   StreamPtr socket_;
+  // File descriptor of the socket wrapped by |socket_| if kernel TLS offload
+  // was requested, -1 otherwise.
+  int socket_fd_{-1};
+  // Set to true when the kernel takes over encryption (|ktls_tx_|) or
+  // decryption (|ktls_rx_|) of TLS records on |socket_fd_|.
+  bool ktls_tx_{false};
+  bool ktls_rx_{false};
   std::unique_ptr<SSL_CTX, decltype(&SSL_CTX_free)> ctx_{nullptr, SSL_CTX_free};
   std::unique_ptr<SSL, decltype(&SSL_free)> ssl_{nullptr, SSL_free};
   BIO* stream_bio_{nullptr};
@@ -145,6 +269,11 @@ bool TlsStream::TlsStreamImpl::ReadNonBlocking(void* buffer,
                                                size_t* size_read,
                                                bool* end_of_stream,
                                                ErrorPtr* error) {
+  if (ktls_rx_) {
+    return ReadFromKernel(buffer, size_to_read, size_read, end_of_stream,
+                          error);
+  }
+
   const size_t max_int = std::numeric_limits<int>::max();
   int size_int = static_cast<int>(std::min(size_to_read, max_int));
   int ret = SSL_read(ssl_.get(), buffer, size_int);
@@ -182,6 +311,13 @@ bool TlsStream::TlsStreamImpl::WriteNonBlocking(const void* buffer,
                                                 size_t size_to_write,
                                                 size_t* size_written,
                                                 ErrorPtr* error) {
+  // With kernel TLS, plain text written to the socket is encrypted and framed
+  // into TLS records by the kernel.
+  if (ktls_tx_) {
+    return socket_->WriteNonBlocking(buffer, size_to_write, size_written,
+                                     error);
+  }
+
   const size_t max_int = std::numeric_limits<int>::max();
   int size_int = static_cast<int>(std::min(size_to_write, max_int));
   int ret = SSL_write(ssl_.get(), buffer, size_int);
@@ -209,6 +345,13 @@ bool TlsStream::TlsStreamImpl::Flush(ErrorPtr* error) {
 }
 
 bool TlsStream::TlsStreamImpl::Close(ErrorPtr* error) {
+  // OpenSSL's record state is stale once the kernel encrypts outgoing records,
+  // so the "close notify" alert must be sent through the kernel as well.
+  if (ktls_tx_) {
+    SendCloseNotifyFromKernel();
+    return socket_->CloseBlocking(error);
+  }
+
   // 2 seconds should be plenty here.
   const base::TimeDelta kTimeout = base::TimeDelta::FromSeconds(2);
   // The retry count of 4 below is just arbitrary, to ensure we don't get stuck
@@ -281,6 +424,213 @@ void TlsStream::TlsStreamImpl::CancelPendingAsyncOperations() {
   weak_ptr_factory_.InvalidateWeakPtrs();
 }
 
+bool TlsStream::TlsStreamImpl::SendFile(int file_fd,
+                                        uint64_t offset,
+                                        uint64_t size,
+                                        ErrorPtr* error) {
+#if defined(__linux__)
+  if (!ktls_tx_)
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+  if (!stream_utils::CheckInt64Overflow(FROM_HERE, offset, 0, error))
+    return false;
+
+  off64_t file_offset = static_cast<off64_t>(offset);
+  // sendfile() transfers at most 0x7ffff000 bytes at a time anyway.
+  const uint64_t max_chunk = std::numeric_limits<int32_t>::max();
+  while (size > 0) {
+    size_t chunk = static_cast<size_t>(std::min(size, max_chunk));
+    ssize_t sent =
+        HANDLE_EINTR(sendfile64(socket_fd_, file_fd, &file_offset, chunk));
+    if (sent < 0) {
+      if (errno != EWOULDBLOCK && errno != EAGAIN) {
+        errors::system::AddSystemError(error, FROM_HERE, errno);
+        return false;
+      }
+      if (!socket_->WaitForDataBlocking(AccessMode::WRITE,
+                                        base::TimeDelta::Max(), nullptr,
+                                        error)) {
+        return false;
+      }
+      continue;
+    }
+    // The file is shorter than the amount of data requested.
+    if (sent == 0)
+      return stream_utils::ErrorReadPastEndOfStream(FROM_HERE, error);
+    size -= static_cast<uint64_t>(sent);
+  }
+  return true;
+#else
+  return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+#endif  // __linux__
+}
+
+void TlsStream::TlsStreamImpl::EnableKernelOffload() {
+#if defined(__linux__) && defined(TLS_RX)
+  if (SSL_version(ssl_.get()) != TLS1_2_VERSION) {
+    VLOG(1) << "Kernel TLS offload is only supported for TLS 1.2";
+    return;
+  }
+
+  const EVP_MD* md = nullptr;
+  size_t key_size = 0;
+  uint16_t cipher_type = 0;
+  const char* cipher_name =
+      SSL_CIPHER_get_name(SSL_get_current_cipher(ssl_.get()));
+  if (strcmp(cipher_name, "ECDHE-ECDSA-AES128-GCM-SHA256") == 0 ||
+      strcmp(cipher_name, "ECDHE-RSA-AES128-GCM-SHA256") == 0) {
+    md = EVP_sha256();
+    key_size = TLS_CIPHER_AES_GCM_128_KEY_SIZE;
+    cipher_type = TLS_CIPHER_AES_GCM_128;
+#ifdef TLS_CIPHER_AES_GCM_256
+  } else if (strcmp(cipher_name, "ECDHE-ECDSA-AES256-GCM-SHA384") == 0 ||
+             strcmp(cipher_name, "ECDHE-RSA-AES256-GCM-SHA384") == 0) {
+    md = EVP_sha384();
+    key_size = TLS_CIPHER_AES_GCM_256_KEY_SIZE;
+    cipher_type = TLS_CIPHER_AES_GCM_256;
+#endif  // TLS_CIPHER_AES_GCM_256
+  } else {
+    VLOG(1) << "Kernel TLS offload is not supported for cipher "
+            << cipher_name;
+    return;
+  }
+
+  // The kernel can only take over if OpenSSL hasn't read ahead any records
+  // past the end of the handshake.
+  if (SSL_pending(ssl_.get()) > 0) {
+    VLOG(1) << "Unprocessed TLS data pending, not using kernel TLS offload";
+    return;
+  }
+
+  // Derive the key block from the master secret (RFC 5246, section 6.3). For
+  // AEAD ciphers it consists of client_write_key, server_write_key,
+  // client_write_IV and server_write_IV (the latter two are the GCM salts).
+  SecureBlob master_key;
+  Blob seed;
+  GetKeyExpansionInputs(ssl_.get(), &master_key, &seed);
+  SecureBlob key_block(2 * key_size + 2 * kGcmSaltSize);
+  if (master_key.empty() ||
+      !TlsPrf(md, master_key, "key expansion", seed, &key_block)) {
+    LOG(WARNING) << "Failed to derive TLS keys for kernel offload";
+    return;
+  }
+  const uint8_t* client_key = key_block.data();
+  const uint8_t* server_key = client_key + key_size;
+  const uint8_t* client_salt = server_key + key_size;
+  const uint8_t* server_salt = client_salt + kGcmSaltSize;
+
+  if (setsockopt(socket_fd_, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0) {
+    PLOG(INFO) << "Kernel TLS is not available";
+    return;
+  }
+
+  // Install the receive side first. If that isn't supported, nothing has
+  // changed yet and OpenSSL remains in charge of both directions. Once the
+  // kernel owns decryption, OpenSSL never processes incoming records again, so
+  // it's safe for it to keep encrypting if the transmit side fails.
+  auto set_crypto_info = [this, key_size, cipher_type](int direction,
+                                                       const uint8_t* key,
+                                                       const uint8_t* salt) {
+    if (key_size == TLS_CIPHER_AES_GCM_128_KEY_SIZE) {
+      return SetKernelTlsCryptoInfo<tls12_crypto_info_aes_gcm_128>(
+          socket_fd_, direction, cipher_type, key, salt);
+    }
+#ifdef TLS_CIPHER_AES_GCM_256
+    return SetKernelTlsCryptoInfo<tls12_crypto_info_aes_gcm_256>(
+        socket_fd_, direction, cipher_type, key, salt);
+#else
+    return false;
+#endif  // TLS_CIPHER_AES_GCM_256
+  };
+  if (!set_crypto_info(TLS_RX, server_key, server_salt)) {
+    PLOG(INFO) << "Kernel TLS receive offload is not available";
+    return;
+  }
+  ktls_rx_ = true;
+  ktls_tx_ = set_crypto_info(TLS_TX, client_key, client_salt);
+  if (!ktls_tx_)
+    PLOG(INFO) << "Kernel TLS transmit offload is not available";
+  VLOG(1) << "Kernel TLS offload enabled for " << cipher_name
+          << (ktls_tx_ ? " (transmit and receive)" : " (receive only)");
+#endif  // __linux__ && TLS_RX
+}
+
+bool TlsStream::TlsStreamImpl::ReadFromKernel(void* buffer,
+                                              size_t size_to_read,
+                                              size_t* size_read,
+                                              bool* end_of_stream,
+                                              ErrorPtr* error) {
+  *size_read = 0;
+  if (end_of_stream)
+    *end_of_stream = false;
+#if defined(__linux__) && defined(TLS_RX)
+  // Non-data records (alerts, handshake messages) are reported via a control
+  // message carrying the record type.
+  char control[CMSG_SPACE(sizeof(uint8_t))];
+  iovec iov{buffer, size_to_read};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t ret = HANDLE_EINTR(recvmsg(socket_fd_, &msg, 0));
+  if (ret < 0) {
+    if (errno == EWOULDBLOCK || errno == EAGAIN)
+      return true;
+    errors::system::AddSystemError(error, FROM_HERE, errno);
+    return false;
+  }
+
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg && cmsg->cmsg_level == SOL_TLS &&
+      cmsg->cmsg_type == TLS_GET_RECORD_TYPE) {
+    uint8_t record_type = *CMSG_DATA(cmsg);
+    if (record_type != kTlsRecordTypeApplicationData) {
+      const uint8_t* data = static_cast<const uint8_t*>(buffer);
+      if (record_type == kTlsRecordTypeAlert && ret >= 2 &&
+          data[1] == kTlsAlertCloseNotify) {
+        if (end_of_stream)
+          *end_of_stream = true;
+        return true;
+      }
+      Error::AddTo(error, FROM_HERE, "tls_stream", "failed",
+                   "Unexpected TLS record of type " +
+                       std::to_string(record_type));
+      return false;
+    }
+  }
+
+  if (end_of_stream)
+    *end_of_stream = (ret == 0 && size_to_read != 0);
+  *size_read = static_cast<size_t>(ret);
+  return true;
+#else
+  return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+#endif  // __linux__ && TLS_RX
+}
+
+void TlsStream::TlsStreamImpl::SendCloseNotifyFromKernel() {
+#if defined(__linux__) && defined(TLS_RX)
+  uint8_t alert[] = {kTlsAlertLevelWarning, kTlsAlertCloseNotify};
+  char control[CMSG_SPACE(sizeof(uint8_t))] = {};
+  iovec iov{alert, sizeof(alert)};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_TLS;
+  cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(uint8_t));
+  *CMSG_DATA(cmsg) = kTlsRecordTypeAlert;
+  msg.msg_controllen = cmsg->cmsg_len;
+  // Like with SSL_shutdown(), we don't care if the alert doesn't make it.
+  if (HANDLE_EINTR(sendmsg(socket_fd_, &msg, 0)) < 0)
+    PLOG(WARNING) << "Failed to send TLS close notify alert";
+#endif  // __linux__ && TLS_RX
+}
+
 bool TlsStream::TlsStreamImpl::ReportError(
     ErrorPtr* error,
     const tracked_objects::Location& location,
@@ -337,7 +687,9 @@ int TlsStream::TlsStreamImpl::OnCertVerifyResultsStatic(int ok,
 }
 
 bool TlsStream::TlsStreamImpl::Init(StreamPtr socket,
+                                    int socket_fd,
                                     const std::string& host,
+                                    const std::string& ca_cert_path,
                                     const base::Closure& success_callback,
                                     const Stream::ErrorCallback& error_callback,
                                     ErrorPtr* error) {
@@ -355,7 +707,8 @@ bool TlsStream::TlsStreamImpl::Init(StreamPtr socket,
   if (res != 1)
     return ReportError(error, FROM_HERE, "Cannot set the cipher list");
 
-  res = SSL_CTX_load_verify_locations(ctx_.get(), nullptr, kCACertificatePath);
+  res = SSL_CTX_load_verify_locations(ctx_.get(), nullptr,
+                                      ca_cert_path.c_str());
   if (res != 1) {
     return ReportError(error, FROM_HERE,
                        "Failed to specify trusted certificate location");
@@ -373,6 +726,7 @@ bool TlsStream::TlsStreamImpl::Init(StreamPtr socket,
                      &TlsStreamImpl::OnCertVerifyResultsStatic);
 
   socket_ = std::move(socket);
+  socket_fd_ = socket_fd;
   ssl_.reset(SSL_new(ctx_.get()));
 
   // Enable TLS progress callback if VLOG level is >=3.
@@ -412,6 +766,8 @@ void TlsStream::TlsStreamImpl::DoHandshake(
   int res = SSL_do_handshake(ssl_.get());
   if (res == 1) {
     VLOG(1) << "Handshake successful";
+    if (socket_fd_ >= 0)
+      EnableKernelOffload();
     success_callback.Run();
     return;
   }
@@ -457,12 +813,34 @@ void TlsStream::Connect(StreamPtr socket,
                         const std::string& host,
                         const base::Callback<void(StreamPtr)>& success_callback,
                         const Stream::ErrorCallback& error_callback) {
+  // Invalid socket file descriptor disables kernel TLS offload.
+  ConnectWithKernelOffload(std::move(socket), -1, host, success_callback,
+                           error_callback);
+}
+
+void TlsStream::ConnectWithKernelOffload(
+    StreamPtr socket,
+    int socket_fd,
+    const std::string& host,
+    const base::Callback<void(StreamPtr)>& success_callback,
+    const Stream::ErrorCallback& error_callback) {
+  ConnectImpl(std::move(socket), socket_fd, host, kCACertificatePath,
+              success_callback, error_callback);
+}
+
+void TlsStream::ConnectImpl(
+    StreamPtr socket,
+    int socket_fd,
+    const std::string& host,
+    const std::string& ca_cert_path,
+    const base::Callback<void(StreamPtr)>& success_callback,
+    const Stream::ErrorCallback& error_callback) {
   std::unique_ptr<TlsStreamImpl> impl{new TlsStreamImpl};
   std::unique_ptr<TlsStream> stream{new TlsStream{std::move(impl)}};
 
   TlsStreamImpl* pimpl = stream->impl_.get();
   ErrorPtr error;
-  bool success = pimpl->Init(std::move(socket), host,
+  bool success = pimpl->Init(std::move(socket), socket_fd, host, ca_cert_path,
                              base::Bind(success_callback,
                                         base::Passed(std::move(stream))),
                              error_callback, &error);
@@ -475,6 +853,53 @@ bool TlsStream::IsOpen() const {
   return impl_ ? true : false;
 }
 
+bool TlsStream::IsKernelOffloadEnabled() const {
+  return impl_ && impl_->IsKernelOffloadEnabled();
+}
+
+bool TlsStream::TlsPrf(const EVP_MD* md,
+                       const SecureBlob& secret,
+                       const std::string& label,
+                       const Blob& seed,
+                       SecureBlob* output) {
+  Blob label_seed{label.begin(), label.end()};
+  label_seed.insert(label_seed.end(), seed.begin(), seed.end());
+
+  // A(0) = seed, A(i) = HMAC_hash(secret, A(i-1)).
+  SecureBlob a{label_seed.begin(), label_seed.end()};
+  uint8_t digest[EVP_MAX_MD_SIZE];
+  unsigned int digest_size = 0;
+  size_t offset = 0;
+  while (offset < output->size()) {
+    if (!HMAC(md, secret.data(), secret.size(), a.data(), a.size(), digest,
+              &digest_size)) {
+      return false;
+    }
+    a.assign(digest, digest + digest_size);
+
+    SecureBlob input = a;
+    input.insert(input.end(), label_seed.begin(), label_seed.end());
+    if (!HMAC(md, secret.data(), secret.size(), input.data(), input.size(),
+              digest, &digest_size)) {
+      return false;
+    }
+    size_t size = std::min<size_t>(digest_size, output->size() - offset);
+    std::memcpy(output->data() + offset, digest, size);
+    offset += size;
+  }
+  SecureMemset(digest, 0, sizeof(digest));
+  return true;
+}
+
+bool TlsStream::SendFileBlocking(int file_fd,
+                                 uint64_t offset,
+                                 uint64_t size,
+                                 ErrorPtr* error) {
+  if (!impl_)
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  return impl_->SendFile(file_fd, offset, size, error);
+}
+
 bool TlsStream::SetSizeBlocking(uint64_t /* size */, ErrorPtr* error) {
   return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
 }
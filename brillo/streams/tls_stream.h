@@ -11,7 +11,17 @@
 #include <base/macros.h>
 #include <brillo/brillo_export.h>
 #include <brillo/errors/error.h>
+#include <brillo/secure_blob.h>
 #include <brillo/streams/stream.h>
+#include <gtest/gtest_prod.h>
+#include <openssl/opensslv.h>
+
+// The OpenSSL hash function type, whose struct tag depends on the library.
+#if OPENSSL_VERSION_NUMBER < 0x10100000L || defined(OPENSSL_IS_BORINGSSL)
+typedef struct env_md_st EVP_MD;
+#else
+typedef struct evp_md_st EVP_MD;
+#endif
 
 namespace brillo {
 
@@ -35,6 +45,34 @@ class BRILLO_EXPORT TlsStream : public Stream {
       const base::Callback<void(StreamPtr)>& success_callback,
       const Stream::ErrorCallback& error_callback);
 
+  // Same as Connect() above, but once the handshake is complete, tries to
+  // install the negotiated record keys into the kernel (Linux kernel TLS) for
+  // the socket |socket_fd|, which must be the file descriptor wrapped by
+  // |socket|. When successful, record encryption and decryption are performed
+  // by the kernel and the data is written to/read from the socket directly,
+  // bypassing OpenSSL. If the negotiated cipher or the kernel does not support
+  // TLS offload, the stream silently falls back to the regular user-space TLS
+  // implementation.
+  static void ConnectWithKernelOffload(
+      StreamPtr socket,
+      int socket_fd,
+      const std::string& host,
+      const base::Callback<void(StreamPtr)>& success_callback,
+      const Stream::ErrorCallback& error_callback);
+
+  // Returns true if outgoing records are encrypted by the kernel (see
+  // ConnectWithKernelOffload() above).
+  bool IsKernelOffloadEnabled() const;
+
+  // Sends |size| bytes of the file |file_fd| starting at |offset| over the
+  // TLS connection using sendfile(2), so the data never enters user space.
+  // Only available when IsKernelOffloadEnabled() returns true, fails with
+  // "operation_not_supported" error otherwise.
+  bool SendFileBlocking(int file_fd,
+                        uint64_t offset,
+                        uint64_t size,
+                        ErrorPtr* error);
+
   // Overrides from Stream:
   bool IsOpen() const override;
   bool CanRead() const override { return true; }
@@ -71,6 +109,28 @@ class BRILLO_EXPORT TlsStream : public Stream {
 
  private:
   class TlsStreamImpl;
+  friend class TlsStreamTest;
+  FRIEND_TEST(TlsStreamTest, TlsPrfSha256);
+  FRIEND_TEST(TlsStreamTest, TlsPrfSha384);
+
+  // Implementation of Connect() and ConnectWithKernelOffload(), which verifies
+  // the server certificate against the trusted CA certificates in the
+  // directory |ca_cert_path|.
+  static void ConnectImpl(
+      StreamPtr socket,
+      int socket_fd,
+      const std::string& host,
+      const std::string& ca_cert_path,
+      const base::Callback<void(StreamPtr)>& success_callback,
+      const Stream::ErrorCallback& error_callback);
+
+  // TLS 1.2 pseudo-random function (RFC 5246, section 5). Fills |output| with
+  // PRF(|secret|, |label|, |seed|) using HMAC with the hash function |md|.
+  static bool TlsPrf(const EVP_MD* md,
+                     const SecureBlob& secret,
+                     const std::string& label,
+                     const Blob& seed,
+                     SecureBlob* output);
 
   // Private constructor called from TlsStream::Connect() factory method.
   explicit TlsStream(std::unique_ptr<TlsStreamImpl> impl);
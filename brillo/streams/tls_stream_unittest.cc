@@ -0,0 +1,213 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/tls_stream.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <openssl/bn.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include <base/bind.h>
+#include <base/files/file_path.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/message_loop/message_loop.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/stringprintf.h>
+#include <brillo/message_loops/base_message_loop.h>
+#include <brillo/message_loops/message_loop_utils.h>
+#include <brillo/streams/file_stream.h>
+#include <brillo/streams/stream_errors.h>
+#include <gtest/gtest.h>
+
+namespace brillo {
+
+namespace {
+
+const char kHostName[] = "localhost";
+const char kServerMessage[] = "Hello from the server";
+
+Blob FromHex(const std::string& hex) {
+  Blob blob;
+  CHECK(base::HexStringToBytes(hex, &blob));
+  return blob;
+}
+
+SecureBlob SecureFromHex(const std::string& hex) {
+  Blob blob = FromHex(hex);
+  return SecureBlob(blob.begin(), blob.end());
+}
+
+}  // anonymous namespace
+
+class TlsStreamTest : public testing::Test {
+ public:
+  void SetUp() override { brillo_loop_.SetAsCurrent(); }
+
+  void TearDown() override {
+    X509_free(certificate_);
+    EVP_PKEY_free(key_);
+  }
+
+  // Creates a self-signed certificate for |kHostName| and stores it in
+  // |temp_dir_| under the hashed name OpenSSL looks it up by. Only the
+  // handshake tests need it, as generating the RSA key is slow.
+  void GenerateServerCertificate() {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    key_ = EVP_PKEY_new();
+    RSA* rsa = RSA_new();
+    BIGNUM* exponent = BN_new();
+    BN_set_word(exponent, RSA_F4);
+    ASSERT_EQ(1, RSA_generate_key_ex(rsa, 2048, exponent, nullptr));
+    BN_free(exponent);
+    EVP_PKEY_assign_RSA(key_, rsa);
+
+    certificate_ = X509_new();
+    X509_set_version(certificate_, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(certificate_), 1);
+    X509_gmtime_adj(X509_get_notBefore(certificate_), -3600);
+    X509_gmtime_adj(X509_get_notAfter(certificate_), 3600);
+    X509_set_pubkey(certificate_, key_);
+    X509_NAME* name = X509_get_subject_name(certificate_);
+    X509_NAME_add_entry_by_txt(
+        name, "CN", MBSTRING_ASC,
+        reinterpret_cast<const unsigned char*>(kHostName), -1, -1, 0);
+    X509_set_issuer_name(certificate_, name);
+    ASSERT_NE(0, X509_sign(certificate_, key_, EVP_sha256()));
+
+    std::string file_name =
+        base::StringPrintf("%08lx.0", X509_NAME_hash(name));
+    FILE* file =
+        fopen(temp_dir_.GetPath().Append(file_name).value().c_str(), "w");
+    ASSERT_NE(nullptr, file);
+    EXPECT_EQ(1, PEM_write_X509(file, certificate_));
+    fclose(file);
+  }
+
+  // Runs a TLS server on the blocking socket |fd|: completes the handshake,
+  // sends |kServerMessage| and closes the connection.
+  void RunServer(int fd) {
+    SSL_CTX* ctx = SSL_CTX_new(TLSv1_2_server_method());
+    SSL_CTX_use_certificate(ctx, certificate_);
+    SSL_CTX_use_PrivateKey(ctx, key_);
+    SSL_CTX_set_cipher_list(ctx, "ECDHE-RSA-AES128-GCM-SHA256");
+#if OPENSSL_VERSION_NUMBER < 0x10100000L && !defined(OPENSSL_IS_BORINGSSL)
+    SSL_CTX_set_ecdh_auto(ctx, 1);
+#endif
+    SSL* ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    if (SSL_accept(ssl) == 1) {
+      SSL_write(ssl, kServerMessage, sizeof(kServerMessage) - 1);
+      SSL_shutdown(ssl);
+    }
+    SSL_free(ssl);
+    SSL_CTX_free(ctx);
+    close(fd);
+  }
+
+  // Starts the TLS handshake over |socket|, trusting only the certificate
+  // created by GenerateServerCertificate().
+  void Connect(StreamPtr socket, int socket_fd) {
+    TlsStream::ConnectImpl(
+        std::move(socket), socket_fd, kHostName, temp_dir_.GetPath().value(),
+        base::Bind(&TlsStreamTest::OnConnected, base::Unretained(this)),
+        base::Bind(&TlsStreamTest::OnError, base::Unretained(this)));
+  }
+
+  void OnConnected(StreamPtr stream) { tls_stream_ = std::move(stream); }
+
+  void OnError(const Error* error) {
+    ADD_FAILURE() << "TLS handshake failed: " << error->GetMessage();
+    handshake_failed_ = true;
+  }
+
+  bool IsHandshakeDone() const {
+    return tls_stream_ != nullptr || handshake_failed_;
+  }
+
+ protected:
+  base::MessageLoopForIO base_loop_;
+  BaseMessageLoop brillo_loop_{&base_loop_};
+  base::ScopedTempDir temp_dir_;
+  EVP_PKEY* key_{nullptr};
+  X509* certificate_{nullptr};
+  StreamPtr tls_stream_;
+  bool handshake_failed_{false};
+};
+
+// Test vectors from the IETF TLS working group mailing list for the TLS 1.2
+// PRF defined in RFC 5246, section 5.
+TEST_F(TlsStreamTest, TlsPrfSha256) {
+  SecureBlob secret = SecureFromHex("9bbe436ba940f017b17652849a71db35");
+  Blob seed = FromHex("a0ba9f936cda311827a6f796ffd5198c");
+  SecureBlob output(100);
+  EXPECT_TRUE(
+      TlsStream::TlsPrf(EVP_sha256(), secret, "test label", seed, &output));
+  Blob expected = FromHex(
+      "e3f229ba727be17b8d122620557cd453c2aab21d07c3d495329b52d4e61edb5a"
+      "6b301791e90d35c9c9a46b4e14baf9af0fa022f7077def17abfd3797c0564bab"
+      "4fbc91666e9def9b97fce34f796789baa48082d122ee42c5a72e5a5110fff701"
+      "87347b66");
+  EXPECT_EQ(expected, Blob(output.begin(), output.end()));
+}
+
+TEST_F(TlsStreamTest, TlsPrfSha384) {
+  SecureBlob secret = SecureFromHex("b80b733d6ceefcdc71566ea48e5567df");
+  Blob seed = FromHex("cd665cf6a8447dd6ff8b27555edb7465");
+  SecureBlob output(148);
+  EXPECT_TRUE(
+      TlsStream::TlsPrf(EVP_sha384(), secret, "test label", seed, &output));
+  Blob expected = FromHex(
+      "7b0c18e9ced410ed1804f2cfa34a336a1c14dffb4900bb5fd7942107e81c83cd"
+      "e9ca0faa60be9fe34f82b1233c9146a0e534cb400fed2700884f9dc236f80edd"
+      "8bfa961144c9e8d792eca722a7b32fc3d416d473ebc2c5fd4abfdad05d918425"
+      "9b5bf8cd4d90fa0d31e2dec479e4f1a26066f2eea9a69236a3e52655c9e9aee6"
+      "91c8f3a26854308d5eaa3be85e0990703d73e56f");
+  EXPECT_EQ(expected, Blob(output.begin(), output.end()));
+}
+
+// Kernel TLS can't be enabled on a Unix domain socket (TCP_ULP is rejected),
+// so the stream must keep working through OpenSSL.
+TEST_F(TlsStreamTest, KernelOffloadFallback) {
+  ASSERT_NO_FATAL_FAILURE(GenerateServerCertificate());
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  std::thread server{&TlsStreamTest::RunServer, this, fds[1]};
+
+  StreamPtr socket = FileStream::FromFileDescriptor(fds[0], true, nullptr);
+  ASSERT_NE(nullptr, socket);
+  Connect(std::move(socket), fds[0]);
+  MessageLoopRunUntil(&brillo_loop_, base::TimeDelta::FromSeconds(10),
+                      base::Bind(&TlsStreamTest::IsHandshakeDone,
+                                 base::Unretained(this)));
+
+  TlsStream* stream = static_cast<TlsStream*>(tls_stream_.get());
+  bool connected = (stream != nullptr);
+  std::string message(sizeof(kServerMessage) - 1, '\0');
+  if (connected) {
+    EXPECT_FALSE(stream->IsKernelOffloadEnabled());
+    ErrorPtr error;
+    EXPECT_FALSE(stream->SendFileBlocking(0, 0, 1, &error));
+    EXPECT_TRUE(error && error->GetCode() ==
+                             errors::stream::kOperationNotSupported);
+
+    EXPECT_TRUE(stream->ReadAllBlocking(&message[0], message.size(), nullptr));
+  }
+  tls_stream_.reset();
+  server.join();
+  ASSERT_TRUE(connected);
+  EXPECT_EQ(kServerMessage, message);
+}
+
+}  // namespace brillo
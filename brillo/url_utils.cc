@@ -6,6 +6,8 @@
 
 #include <algorithm>
 
+#include <base/strings/string_util.h>
+
 namespace {
 // Given a URL string, determine where the query string starts and ends.
 // URLs have schema, domain and path (along with possible user name, password
@@ -163,4 +165,16 @@ bool url::HasQueryString(const std::string& url) {
   return (query_len > 0);
 }
 
+std::string url::GetHostAndPort(const std::string& url) {
+  size_t begin = url.find("://");
+  begin = (begin == std::string::npos) ? 0 : begin + 3;
+  size_t end = url.find_first_of("/?#", begin);
+  std::string host = url.substr(
+      begin, end == std::string::npos ? std::string::npos : end - begin);
+  size_t at = host.rfind('@');
+  if (at != std::string::npos)
+    host.erase(0, at + 1);
+  return base::ToLowerASCII(host);
+}
+
 }  // namespace brillo
@@ -79,6 +79,11 @@ BRILLO_EXPORT std::string AppendQueryParams(
 // Checks if the URL has query parameters.
 BRILLO_EXPORT bool HasQueryString(const std::string& url);
 
+// Returns the lowercase "host[:port]" part of the URL, without the user
+// information. For example:
+//    http://user@Server.com:8080/path?k=v -> server.com:8080
+BRILLO_EXPORT std::string GetHostAndPort(const std::string& url);
+
 }  // namespace url
 }  // namespace brillo
 
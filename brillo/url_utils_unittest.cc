@@ -143,4 +143,12 @@ TEST(UrlUtils, HasQueryString) {
   EXPECT_TRUE(url::HasQueryString("?ss"));
 }
 
+TEST(UrlUtils, GetHostAndPort) {
+  EXPECT_EQ("server.com", url::GetHostAndPort("http://Server.COM/path?q#f"));
+  EXPECT_EQ("server.com:8080",
+            url::GetHostAndPort("https://user:pw@server.com:8080?k=v"));
+  EXPECT_EQ("server.com", url::GetHostAndPort("server.com#fragment"));
+  EXPECT_EQ("", url::GetHostAndPort(""));
+}
+
 }  // namespace brillo